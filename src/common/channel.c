@@ -0,0 +1,155 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "channel.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "common/logging.h"
+
+Channel *Channel_Create(size_t capacity) {
+    size_t rounded = 2;
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+    Channel *ch = malloc(sizeof(Channel));
+    if (!ch) {
+        logFatal("Cannot allocate memory for Channel.");
+    }
+    ch->slots = malloc(rounded * sizeof(ChannelSlot));
+    if (!ch->slots) {
+        logFatal("Cannot allocate memory for Channel.");
+    }
+    for (size_t i = 0; i < rounded; i++) {
+        atomic_init(&ch->slots[i].sequence, i);
+        ch->slots[i].item = NULL;
+    }
+    ch->capacity = rounded;
+    atomic_init(&ch->tail, 0);
+    atomic_init(&ch->head, 0);
+    atomic_init(&ch->wake_pending, false);
+    atomic_init(&ch->stats.sent, 0);
+    atomic_init(&ch->stats.received, 0);
+    atomic_init(&ch->stats.full, 0);
+    atomic_init(&ch->stats.contended, 0);
+    atomic_init(&ch->stats.max_depth, 0);
+
+    ch->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ch->wake_fd < 0) {
+        logWarn("eventfd is not available (%s), results are picked up with the next input timeout.", strerror(errno));
+    }
+    return ch;
+}
+
+void Channel_Destroy(Channel *ch) {
+    if (!ch) {
+        return;
+    }
+    if (ch->wake_fd >= 0) {
+        close(ch->wake_fd);
+    }
+    free(ch->slots);
+    free(ch);
+}
+
+static void update_max_depth(Channel *ch, size_t depth) {
+    size_t max = atomic_load_explicit(&ch->stats.max_depth, memory_order_relaxed);
+    while (depth > max
+           && !atomic_compare_exchange_weak_explicit(&ch->stats.max_depth, &max, depth,
+                                                     memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+bool Channel_Send(Channel *ch, void *item) {
+    size_t position = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+    ChannelSlot *slot;
+    while (true) {
+        slot = &ch->slots[position & (ch->capacity - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+        if (diff == 0) {
+            // the slot is free, claim it (position is updated if another sender was faster)
+            if (atomic_compare_exchange_weak_explicit(&ch->tail, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+            atomic_fetch_add_explicit(&ch->stats.contended, 1, memory_order_relaxed);
+        }
+        else if (diff < 0) {
+            // the receiver did not take the item of the last round yet
+            atomic_fetch_add_explicit(&ch->stats.full, 1, memory_order_relaxed);
+            return false;
+        }
+        else {
+            position = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+            atomic_fetch_add_explicit(&ch->stats.contended, 1, memory_order_relaxed);
+        }
+    }
+    slot->item = item;
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    atomic_fetch_add_explicit(&ch->stats.sent, 1, memory_order_relaxed);
+    update_max_depth(ch, position + 1 - atomic_load_explicit(&ch->head, memory_order_relaxed));
+
+    // only the first item since the last receive signals
+    if (!atomic_exchange(&ch->wake_pending, true) && ch->wake_fd >= 0) {
+        uint64_t one = 1;
+        ssize_t written = write(ch->wake_fd, &one, sizeof(one));
+        (void)written;  // can only fail if the counter overflows, it's readable then anyway
+    }
+    return true;
+}
+
+static bool take(Channel *ch, void **item) {
+    size_t position = atomic_load_explicit(&ch->head, memory_order_relaxed);
+    ChannelSlot *slot = &ch->slots[position & (ch->capacity - 1)];
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != position + 1) {
+        return false;
+    }
+    *item = slot->item;
+    atomic_store_explicit(&slot->sequence, position + ch->capacity, memory_order_release);
+    atomic_store_explicit(&ch->head, position + 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&ch->stats.received, 1, memory_order_relaxed);
+    return true;
+}
+
+bool Channel_Receive(Channel *ch, void **item) {
+    if (take(ch, item)) {
+        return true;
+    }
+    // empty, reset the wakeup so the next item signals again
+    atomic_exchange(&ch->wake_pending, false);
+    if (ch->wake_fd >= 0) {
+        // even if the flag was not set: a sender might have written after the last reset
+        uint64_t count;
+        ssize_t bytes_read = read(ch->wake_fd, &count, sizeof(count));
+        (void)bytes_read;
+    }
+    // an item sent before the reset did not signal
+    return take(ch, item);
+}
+
+size_t Channel_Depth(Channel *ch) {
+    size_t head = atomic_load_explicit(&ch->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+int Channel_Fd(const Channel *ch) {
+    return ch ? ch->wake_fd : -1;
+}
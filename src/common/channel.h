@@ -0,0 +1,103 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file channel.h
+ * @brief Bounded lock-free queue from any number of threads to the main thread.
+ *
+ * Background threads hand their results (a pointer each) to the main thread
+ * with Channel_Send(), which never blocks: if the queue is full it returns
+ * false and the sender decides what to do with the item. Only the main thread
+ * calls Channel_Receive().
+ *
+ * The first item sent after the main thread looked at the channel makes
+ * Channel_Fd() readable (an eventfd), so the main loop can wait for input and
+ * results at the same time (see Input_SetWakeFd()) and drain the channel once
+ * per frame.
+ *
+ * The slots carry sequence numbers (Vyukov's bounded queue): a sender claims a
+ * position with a compare and swap on `tail` and publishes the item by
+ * advancing the sequence of its slot, so a slow sender never exposes a half
+ * written slot.
+ */
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+typedef struct _ChannelSlot {
+    atomic_size_t sequence;     //< position + 1 if filled, position + capacity if free again
+    void *item;
+} ChannelSlot;
+
+typedef struct _ChannelStats {
+    atomic_size_t sent;
+    atomic_size_t received;
+    atomic_size_t full;         //< Channel_Send() calls that failed
+    atomic_size_t contended;    //< retries because another sender was faster
+    atomic_size_t max_depth;    //< most items waiting at the same time
+} ChannelStats;
+
+typedef struct _Channel {
+    ChannelSlot *slots;
+    size_t capacity;            //< power of 2
+    atomic_size_t tail;         //< next position for a sender
+    atomic_size_t head;         //< next position to receive (only written by the receiver)
+    int wake_fd;                //< eventfd, -1 if not available
+    atomic_bool wake_pending;   //< the eventfd was signaled and not read yet
+    ChannelStats stats;
+} Channel;
+
+/**
+ * @brief Create a channel for at least `capacity` items.
+ */
+Channel *Channel_Create(size_t capacity);
+
+/**
+ * @brief Free the channel, items that were not received are lost.
+ */
+void Channel_Destroy(Channel *ch);
+
+/**
+ * @brief Queue `item` without blocking (any thread).
+ *
+ * @returns false if the channel is full.
+ */
+bool Channel_Send(Channel *ch, void *item);
+
+/**
+ * @brief Take the oldest item (main thread only).
+ *
+ * The wakeup is reset when the channel is found empty, so receive until it
+ * returns false.
+ *
+ * @returns false if the channel is empty.
+ */
+bool Channel_Receive(Channel *ch, void **item);
+
+/**
+ * @brief Number of items waiting (a snapshot).
+ */
+size_t Channel_Depth(Channel *ch);
+
+/**
+ * @brief File descriptor that becomes readable when items were sent (-1 if not available).
+ */
+int Channel_Fd(const Channel *ch);
+
+#endif
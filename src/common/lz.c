@@ -0,0 +1,171 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "lz.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+#define LZ_LAST_LITERALS 5  // the end of the input is always stored as literals
+
+static uint32_t read32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// write the rest of a length that didn't fit in the token nibble
+static char *write_length(char *out, const char *end, size_t length) {
+    while (length >= 255) {
+        if (out >= end) {
+            return NULL;
+        }
+        *out++ = (char)255;
+        length -= 255;
+    }
+    if (out >= end) {
+        return NULL;
+    }
+    *out++ = (char)length;
+    return out;
+}
+
+static char *write_sequence(char *out, const char *end, const char *literals, size_t literal_count, size_t offset, size_t match_length) {
+    if (out >= end) {
+        return NULL;
+    }
+    char *token = out++;
+    size_t match_rest = match_length ? match_length - LZ_MIN_MATCH : 0;
+    *token = (char)(((literal_count < 15 ? literal_count : 15) << 4) | (match_rest < 15 ? match_rest : 15));
+    if (literal_count >= 15 && !(out = write_length(out, end, literal_count - 15))) {
+        return NULL;
+    }
+    if ((size_t)(end - out) < literal_count) {
+        return NULL;
+    }
+    memcpy(out, literals, literal_count);
+    out += literal_count;
+    if (match_length == 0) {
+        return out;
+    }
+    if (end - out < 2) {
+        return NULL;
+    }
+    *out++ = (char)(offset & 0xff);
+    *out++ = (char)(offset >> 8);
+    if (match_rest >= 15 && !(out = write_length(out, end, match_rest - 15))) {
+        return NULL;
+    }
+    return out;
+}
+
+size_t LZ_CompressBound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+size_t LZ_Compress(const char *src, size_t size, char *dst, size_t capacity) {
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0xff, sizeof(table));
+
+    char *out = dst;
+    const char *end = dst + capacity;
+    size_t anchor = 0;  // start of the pending literals
+    size_t pos = 0;
+    size_t match_limit = size > LZ_LAST_LITERALS ? size - LZ_LAST_LITERALS : 0;
+    while (pos + LZ_MIN_MATCH <= match_limit) {
+        uint32_t sequence = read32(src + pos);
+        uint32_t h = hash(sequence);
+        uint32_t candidate = table[h];
+        table[h] = (uint32_t)pos;
+        if (candidate == UINT32_MAX || pos - candidate > LZ_MAX_OFFSET || read32(src + candidate) != sequence) {
+            pos++;
+            continue;
+        }
+        size_t length = LZ_MIN_MATCH;
+        while (pos + length < match_limit && src[candidate + length] == src[pos + length]) {
+            length++;
+        }
+        out = write_sequence(out, end, src + anchor, pos - anchor, pos - candidate, length);
+        if (!out) {
+            return 0;
+        }
+        pos += length;
+        anchor = pos;
+    }
+    out = write_sequence(out, end, src + anchor, size - anchor, 0, 0);
+    return out ? (size_t)(out - dst) : 0;
+}
+
+static bool read_length(const unsigned char **in, const unsigned char *end, size_t *length) {
+    unsigned char b;
+    do {
+        if (*in >= end) {
+            return false;
+        }
+        b = *(*in)++;
+        *length += b;
+    } while (b == 255);
+    return true;
+}
+
+bool LZ_Decompress(const char *src, size_t compressed_size, char *dst, size_t size) {
+    const unsigned char *in = (const unsigned char*)src;
+    const unsigned char *in_end = in + compressed_size;
+    size_t produced = 0;
+    while (in < in_end) {
+        unsigned char token = *in++;
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !read_length(&in, in_end, &literal_count)) {
+            return false;
+        }
+        if ((size_t)(in_end - in) < literal_count || size - produced < literal_count) {
+            return false;
+        }
+        memcpy(dst + produced, in, literal_count);
+        in += literal_count;
+        produced += literal_count;
+        if (in == in_end) {
+            break;  // the last sequence has no match
+        }
+
+        if (in_end - in < 2) {
+            return false;
+        }
+        size_t offset = (size_t)in[0] | ((size_t)in[1] << 8);
+        in += 2;
+        size_t length = token & 0x0f;
+        if (length == 15 && !read_length(&in, in_end, &length)) {
+            return false;
+        }
+        length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > produced || size - produced < length) {
+            return false;
+        }
+        // byte by byte, the match may overlap with the bytes it produces
+        const char *from = dst + produced - offset;
+        for (size_t i = 0; i < length; i++) {
+            dst[produced + i] = from[i];
+        }
+        produced += length;
+    }
+    return produced == size;
+}
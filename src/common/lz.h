@@ -0,0 +1,58 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file lz.h
+ * @brief Small and fast LZ77 compression of memory blocks.
+ *
+ * The format follows the LZ4 block format: a sequence starts with a token
+ * (high nibble: number of literals, low nibble: match length - 4), followed by
+ * more length bytes if a nibble is 15, the literals, a 2 byte little endian
+ * offset and more match length bytes. The last sequence has only literals.
+ *
+ * Matches are found with a single hash table of the last position of every
+ * 4 byte sequence, so compression is one pass without any search. That's
+ * enough for repetitive text such as logs and CSV data.
+ */
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Max compressed size of n bytes (incompressible data grows a little).
+ */
+size_t LZ_CompressBound(size_t n);
+
+/**
+ * @brief Compress size bytes from src into dst.
+ *
+ * @param capacity Size of dst, LZ_CompressBound(size) is always enough.
+ * @returns The compressed size or 0 if dst is too small.
+ */
+size_t LZ_Compress(const char *src, size_t size, char *dst, size_t capacity);
+
+/**
+ * @brief Decompress exactly size bytes from src into dst.
+ *
+ * Damaged input is detected, nothing is written outside dst.
+ *
+ * @returns false if src is no valid compressed block of size bytes.
+ */
+bool LZ_Decompress(const char *src, size_t compressed_size, char *dst, size_t size);
+
+#endif
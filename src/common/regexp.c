@@ -0,0 +1,1663 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "regexp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "logging.h"
+
+#define MAX_CODEPOINT 0x10FFFF
+#define NO_HOLE UINT32_MAX
+
+// position context of a DFA state
+#define STATE_BEGIN 1   //< the position is the begin of the text
+#define STATE_WORD 2    //< the byte before the position is a word character
+
+typedef enum {
+    ASSERT_BEGIN,
+    ASSERT_END,
+    ASSERT_WORD_BOUNDARY,
+    ASSERT_NOT_WORD_BOUNDARY,
+    ASSERT_WORD_START,
+    ASSERT_WORD_END
+} Assertion;
+
+// returned by transitions that can never lead to a match
+static RegexpState dead_state;
+
+static bool is_word_byte(uint8_t b) {
+    return (b >= '0' && b <= '9') || (b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || b == '_' || b >= 0x80;
+}
+
+/*****************************************************************************/
+/* Parser                                                                    */
+
+typedef struct _CodeRange {
+    uint32_t lo;
+    uint32_t hi;
+} CodeRange;
+
+typedef enum {
+    NODE_EMPTY,
+    NODE_BYTES,         //< a single byte in [lo, hi] (ASCII or invalid UTF-8 in the pattern)
+    NODE_CLASS,         //< a character in one of the ranges
+    NODE_ASSERT,
+    NODE_CONCAT,
+    NODE_ALTERNATE,
+    NODE_REPEAT
+} NodeType;
+
+typedef struct _Node {
+    NodeType type;
+    struct _Node *left;
+    struct _Node *right;
+    CodeRange *ranges;      //< NODE_CLASS, sorted and not overlapping
+    size_t range_count;
+    bool raw;               //< NODE_CLASS, also match bytes that are never part of valid UTF-8
+    uint8_t lo, hi;         //< NODE_BYTES, NODE_ASSERT (lo)
+    int min, max;           //< NODE_REPEAT, max is -1 for no limit
+} Node;
+
+typedef struct _Parser {
+    const unsigned char *p;
+    char *error;
+    size_t error_size;
+    bool failed;
+    int depth;              //< number of open groups
+    Node **nodes;           //< all nodes, for freeing them
+    size_t node_count;
+    size_t node_capacity;
+} Parser;
+
+typedef struct _ClassBuilder {
+    CodeRange *ranges;
+    size_t count;
+    size_t capacity;
+} ClassBuilder;
+
+static void fail(Parser *parser, const char *message) {
+    if (parser->failed) {
+        return;
+    }
+    parser->failed = true;
+    if (parser->error && parser->error_size > 0) {
+        snprintf(parser->error, parser->error_size, "%s", message);
+    }
+}
+
+static Node *new_node(Parser *parser, NodeType type) {
+    if (parser->node_count == parser->node_capacity) {
+        parser->node_capacity = parser->node_capacity ? parser->node_capacity * 2 : 32;
+        parser->nodes = realloc(parser->nodes, sizeof(Node*) * parser->node_capacity);
+        if (!parser->nodes) {
+            logFatal("Cannot allocate memory for regular expression.");
+        }
+    }
+    Node *node = calloc(1, sizeof(Node));
+    if (!node) {
+        logFatal("Cannot allocate memory for regular expression.");
+    }
+    node->type = type;
+    parser->nodes[parser->node_count++] = node;
+    return node;
+}
+
+static Node *new_pair(Parser *parser, NodeType type, Node *left, Node *right) {
+    Node *node = new_node(parser, type);
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+static Node *new_byte(Parser *parser, uint8_t b) {
+    Node *node = new_node(parser, NODE_BYTES);
+    node->lo = b;
+    node->hi = b;
+    return node;
+}
+
+static Node *new_assert(Parser *parser, Assertion assertion) {
+    Node *node = new_node(parser, NODE_ASSERT);
+    node->lo = (uint8_t)assertion;
+    return node;
+}
+
+static void free_nodes(Parser *parser) {
+    for (size_t i = 0; i < parser->node_count; i++) {
+        free(parser->nodes[i]->ranges);
+        free(parser->nodes[i]);
+    }
+    free(parser->nodes);
+    parser->nodes = NULL;
+    parser->node_count = 0;
+}
+
+static void class_add(ClassBuilder *cb, uint32_t lo, uint32_t hi) {
+    if (cb->count == cb->capacity) {
+        cb->capacity = cb->capacity ? cb->capacity * 2 : 8;
+        cb->ranges = realloc(cb->ranges, sizeof(CodeRange) * cb->capacity);
+        if (!cb->ranges) {
+            logFatal("Cannot allocate memory for regular expression.");
+        }
+    }
+    cb->ranges[cb->count++] = (CodeRange){ .lo = lo, .hi = hi };
+}
+
+static int compare_ranges(const void *a, const void *b) {
+    const CodeRange *ra = a;
+    const CodeRange *rb = b;
+    return ra->lo < rb->lo ? -1 : ra->lo > rb->lo;
+}
+
+// sort and merge overlapping and adjacent ranges
+static void class_normalize(ClassBuilder *cb) {
+    if (cb->count == 0) {
+        return;
+    }
+    qsort(cb->ranges, cb->count, sizeof(CodeRange), compare_ranges);
+    size_t n = 0;
+    for (size_t i = 1; i < cb->count; i++) {
+        if (cb->ranges[i].lo <= cb->ranges[n].hi + 1) {
+            if (cb->ranges[i].hi > cb->ranges[n].hi) {
+                cb->ranges[n].hi = cb->ranges[i].hi;
+            }
+        }
+        else {
+            cb->ranges[++n] = cb->ranges[i];
+        }
+    }
+    cb->count = n + 1;
+}
+
+static void class_negate(ClassBuilder *cb) {
+    ClassBuilder negated = {0};
+    uint32_t next = 0;
+    for (size_t i = 0; i < cb->count; i++) {
+        if (cb->ranges[i].lo > next) {
+            class_add(&negated, next, cb->ranges[i].lo - 1);
+        }
+        next = cb->ranges[i].hi + 1;
+    }
+    if (next <= MAX_CODEPOINT) {
+        class_add(&negated, next, MAX_CODEPOINT);
+    }
+    free(cb->ranges);
+    *cb = negated;
+}
+
+static Node *new_class(Parser *parser, ClassBuilder *cb, bool negate) {
+    class_normalize(cb);
+    if (negate) {
+        class_negate(cb);
+    }
+    Node *node = new_node(parser, NODE_CLASS);
+    node->ranges = cb->ranges;
+    node->range_count = cb->count;
+    node->raw = negate;
+    *cb = (ClassBuilder){0};
+    return node;
+}
+
+// decode one UTF-8 character, returns its length or 0 if it's not valid
+static size_t decode_utf8(const unsigned char *s, uint32_t *cp) {
+    if (s[0] < 0x80) {
+        *cp = s[0];
+        return 1;
+    }
+    size_t length;
+    uint32_t min;
+    if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+        length = 2;
+        min = 0x80;
+        *cp = s[0] & 0x1F;
+    }
+    else if (s[0] >= 0xE0 && s[0] <= 0xEF) {
+        length = 3;
+        min = 0x800;
+        *cp = s[0] & 0x0F;
+    }
+    else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+        length = 4;
+        min = 0x10000;
+        *cp = s[0] & 0x07;
+    }
+    else {
+        return 0;
+    }
+    for (size_t i = 1; i < length; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+        *cp = (*cp << 6) | (s[i] & 0x3F);
+    }
+    return *cp >= min && *cp <= MAX_CODEPOINT ? length : 0;
+}
+
+static bool in_named_class(const char *name, size_t length, int c) {
+    #define IS(class_name) (length == strlen(class_name) && strncmp(name, class_name, length) == 0)
+    if (IS("alnum")) return isalnum(c);
+    if (IS("alpha")) return isalpha(c);
+    if (IS("blank")) return c == ' ' || c == '\t';
+    if (IS("cntrl")) return iscntrl(c);
+    if (IS("digit")) return c >= '0' && c <= '9';
+    if (IS("graph")) return isgraph(c);
+    if (IS("lower")) return islower(c);
+    if (IS("print")) return isprint(c);
+    if (IS("punct")) return ispunct(c);
+    if (IS("space")) return isspace(c);
+    if (IS("upper")) return isupper(c);
+    if (IS("xdigit")) return isxdigit(c);
+    #undef IS
+    return false;
+}
+
+static bool is_named_class(const char *name, size_t length) {
+    static const char *names[] = {
+        "alnum", "alpha", "blank", "cntrl", "digit", "graph",
+        "lower", "print", "punct", "space", "upper", "xdigit"
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (length == strlen(names[i]) && strncmp(name, names[i], length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the ASCII characters of a [:name:] class, every other character is taken as a letter
+static void add_named_class(ClassBuilder *cb, const char *name, size_t length) {
+    for (int c = 0; c < 0x80; c++) {
+        if (in_named_class(name, length, c)) {
+            class_add(cb, (uint32_t)c, (uint32_t)c);
+        }
+    }
+    if (in_named_class(name, length, 'a') && in_named_class(name, length, 'A')) {
+        class_add(cb, 0x80, MAX_CODEPOINT);
+    }
+}
+
+// a single character in a bracket expression, [.x.] and [=x=] are accepted as well
+static bool parse_bracket_char(Parser *parser, uint32_t *cp) {
+    const unsigned char *p = parser->p;
+    char delimiter = 0;
+    if (p[0] == '[' && (p[1] == '.' || p[1] == '=')) {
+        delimiter = (char)p[1];
+        p += 2;
+    }
+    size_t length = decode_utf8(p, cp);
+    if (length == 0) {
+        fail(parser, "Invalid UTF-8 in bracket expression");
+        return false;
+    }
+    p += length;
+    if (delimiter) {
+        if (p[0] != delimiter || p[1] != ']') {
+            fail(parser, "Invalid collating element");
+            return false;
+        }
+        p += 2;
+    }
+    parser->p = p;
+    return true;
+}
+
+static Node *parse_bracket(Parser *parser) {
+    parser->p++;  // [
+    bool negate = false;
+    if (*parser->p == '^') {
+        negate = true;
+        parser->p++;
+    }
+    ClassBuilder cb = {0};
+    bool first = true;
+    for (;;) {
+        const unsigned char *p = parser->p;
+        if (*p == '\0') {
+            fail(parser, "Unmatched [ or [^");
+            free(cb.ranges);
+            return NULL;
+        }
+        if (*p == ']' && !first) {
+            parser->p++;
+            break;
+        }
+        first = false;
+
+        if (p[0] == '[' && p[1] == ':') {
+            const char *name = (const char*)p + 2;
+            const char *close = strstr(name, ":]");
+            if (!close || !is_named_class(name, close - name)) {
+                fail(parser, "Invalid character class name");
+                free(cb.ranges);
+                return NULL;
+            }
+            add_named_class(&cb, name, close - name);
+            parser->p = (const unsigned char*)close + 2;
+            continue;
+        }
+
+        uint32_t lo, hi;
+        if (!parse_bracket_char(parser, &lo)) {
+            free(cb.ranges);
+            return NULL;
+        }
+        hi = lo;
+        if (parser->p[0] == '-' && parser->p[1] != '\0' && parser->p[1] != ']') {
+            parser->p++;
+            if (!parse_bracket_char(parser, &hi)) {
+                free(cb.ranges);
+                return NULL;
+            }
+            if (hi < lo) {
+                fail(parser, "Invalid range end");
+                free(cb.ranges);
+                return NULL;
+            }
+        }
+        class_add(&cb, lo, hi);
+    }
+    return new_class(parser, &cb, negate);
+}
+
+// \w, \W, \s, \S
+static Node *parse_class_escape(Parser *parser, char c) {
+    ClassBuilder cb = {0};
+    if (c == 'w' || c == 'W') {
+        class_add(&cb, '0', '9');
+        class_add(&cb, 'A', 'Z');
+        class_add(&cb, '_', '_');
+        class_add(&cb, 'a', 'z');
+        class_add(&cb, 0x80, MAX_CODEPOINT);
+    }
+    else {
+        add_named_class(&cb, "space", 5);
+    }
+    Node *node = new_class(parser, &cb, c == 'W' || c == 'S');
+    node->raw = c == 'S';  // invalid bytes count as word characters
+    return node;
+}
+
+static Node *parse_literal(Parser *parser) {
+    uint32_t cp;
+    size_t length = decode_utf8(parser->p, &cp);
+    if (length <= 1) {
+        // ASCII or a byte that is not valid UTF-8
+        return new_byte(parser, *parser->p++);
+    }
+    parser->p += length;
+    ClassBuilder cb = {0};
+    class_add(&cb, cp, cp);
+    return new_class(parser, &cb, false);
+}
+
+static Node *parse_escape(Parser *parser) {
+    parser->p++;  // backslash
+    char c = (char)*parser->p;
+    switch (c) {
+        case '\0':
+            fail(parser, "Trailing backslash");
+            return NULL;
+        case 'w': case 'W': case 's': case 'S':
+            parser->p++;
+            return parse_class_escape(parser, c);
+        case 'b':
+            parser->p++;
+            return new_assert(parser, ASSERT_WORD_BOUNDARY);
+        case 'B':
+            parser->p++;
+            return new_assert(parser, ASSERT_NOT_WORD_BOUNDARY);
+        case '<':
+            parser->p++;
+            return new_assert(parser, ASSERT_WORD_START);
+        case '>':
+            parser->p++;
+            return new_assert(parser, ASSERT_WORD_END);
+        case '`':
+            parser->p++;
+            return new_assert(parser, ASSERT_BEGIN);
+        case '\'':
+            parser->p++;
+            return new_assert(parser, ASSERT_END);
+        default:
+            if (c >= '1' && c <= '9') {
+                fail(parser, "Back references are not supported");
+                return NULL;
+            }
+            return parse_literal(parser);
+    }
+}
+
+// parse {m}, {m,}, {m,n} or {,n}, returns false (and keeps the position) if it's no interval
+static bool parse_interval(Parser *parser, int *min, int *max) {
+    const unsigned char *p = parser->p + 1;
+    bool have_min = false;
+    bool have_max = false;
+    bool too_large = false;
+    int value = 0;
+    while (*p >= '0' && *p <= '9') {
+        value = value * 10 + (*p++ - '0');
+        too_large = too_large || value > REGEXP_MAX_REPEAT;
+        value = too_large ? 0 : value;
+        have_min = true;
+    }
+    *min = value;
+    if (*p == ',') {
+        p++;
+        value = 0;
+        while (*p >= '0' && *p <= '9') {
+            value = value * 10 + (*p++ - '0');
+            too_large = too_large || value > REGEXP_MAX_REPEAT;
+            value = too_large ? 0 : value;
+            have_max = true;
+        }
+        *max = have_max ? value : -1;
+        if (!have_min && !have_max) {
+            return false;
+        }
+    }
+    else {
+        if (!have_min) {
+            return false;
+        }
+        *max = *min;
+    }
+    if (*p != '}') {
+        return false;
+    }
+    parser->p = p + 1;
+    if (too_large) {
+        fail(parser, "Interval count too large");
+    }
+    else if (*max != -1 && *max < *min) {
+        fail(parser, "Invalid content of \\{\\}");
+    }
+    return true;
+}
+
+static Node *parse_alternation(Parser *parser);
+
+static Node *parse_atom(Parser *parser) {
+    int min, max;
+    switch (*parser->p) {
+        case '(': {
+            parser->p++;
+            parser->depth++;
+            Node *node = parse_alternation(parser);
+            if (parser->failed) {
+                return NULL;
+            }
+            if (*parser->p != ')') {
+                fail(parser, "Unmatched ( or \\(");
+                return NULL;
+            }
+            parser->p++;
+            parser->depth--;
+            return node;
+        }
+        case '*': case '+': case '?':
+            fail(parser, "Invalid preceding regular expression");
+            return NULL;
+        case '{':
+            if (parse_interval(parser, &min, &max)) {
+                fail(parser, "Invalid preceding regular expression");
+                return NULL;
+            }
+            return new_byte(parser, *parser->p++);
+        case '^':
+            parser->p++;
+            return new_assert(parser, ASSERT_BEGIN);
+        case '$':
+            parser->p++;
+            return new_assert(parser, ASSERT_END);
+        case '.': {
+            parser->p++;
+            ClassBuilder cb = {0};
+            return new_class(parser, &cb, true);
+        }
+        case '[':
+            return parse_bracket(parser);
+        case '\\':
+            return parse_escape(parser);
+        default:
+            return parse_literal(parser);
+    }
+}
+
+static Node *parse_repeat(Parser *parser) {
+    Node *node = parse_atom(parser);
+    while (!parser->failed) {
+        int min, max;
+        char c = (char)*parser->p;
+        if (c == '*') {
+            min = 0;
+            max = -1;
+            parser->p++;
+        }
+        else if (c == '+') {
+            min = 1;
+            max = -1;
+            parser->p++;
+        }
+        else if (c == '?') {
+            min = 0;
+            max = 1;
+            parser->p++;
+        }
+        else if (c != '{' || !parse_interval(parser, &min, &max)) {
+            break;
+        }
+        Node *repeat = new_node(parser, NODE_REPEAT);
+        repeat->left = node;
+        repeat->min = min;
+        repeat->max = max;
+        node = repeat;
+    }
+    return node;
+}
+
+static Node *parse_concat(Parser *parser) {
+    Node *node = NULL;
+    // like glibc a ) without a group is an ordinary character
+    while (!parser->failed && *parser->p && *parser->p != '|' && (*parser->p != ')' || parser->depth == 0)) {
+        Node *atom = parse_repeat(parser);
+        node = node ? new_pair(parser, NODE_CONCAT, node, atom) : atom;
+    }
+    return node ? node : new_node(parser, NODE_EMPTY);
+}
+
+static Node *parse_alternation(Parser *parser) {
+    Node *node = parse_concat(parser);
+    while (!parser->failed && *parser->p == '|') {
+        parser->p++;
+        Node *right = parse_concat(parser);
+        node = new_pair(parser, NODE_ALTERNATE, node, right);
+    }
+    return node;
+}
+
+/*****************************************************************************/
+/* Compiler (Thompson construction)                                          */
+
+typedef struct _Program {
+    RegexpInst *insts;
+    uint32_t count;
+    uint32_t capacity;
+    bool too_big;
+} Program;
+
+// a partly built NFA, the holes are the unset outs, linked through the outs themselves
+typedef struct _Fragment {
+    uint32_t start;
+    uint32_t holes;     //< (index << 1 | out1) of the first hole, NO_HOLE if there is none
+} Fragment;
+
+static uint32_t emit(Program *prog, RegexpInstType type, uint8_t lo, uint8_t hi) {
+    if (prog->count == prog->capacity) {
+        prog->capacity = prog->capacity ? prog->capacity * 2 : 64;
+        prog->insts = realloc(prog->insts, sizeof(RegexpInst) * prog->capacity);
+        if (!prog->insts) {
+            logFatal("Cannot allocate memory for regular expression.");
+        }
+    }
+    if (prog->count >= REGEXP_MAX_INSTS) {
+        prog->too_big = true;
+    }
+    prog->insts[prog->count] = (RegexpInst){ .type = type, .lo = lo, .hi = hi, .out = NO_HOLE, .out1 = NO_HOLE };
+    return prog->count++;
+}
+
+static uint32_t *hole(Program *prog, uint32_t h) {
+    RegexpInst *inst = &prog->insts[h >> 1];
+    return (h & 1) ? &inst->out1 : &inst->out;
+}
+
+static void patch(Program *prog, uint32_t holes, uint32_t target) {
+    while (holes != NO_HOLE) {
+        uint32_t *out = hole(prog, holes);
+        holes = *out;
+        *out = target;
+    }
+}
+
+static uint32_t append_holes(Program *prog, uint32_t a, uint32_t b) {
+    if (a == NO_HOLE) {
+        return b;
+    }
+    uint32_t h = a;
+    while (*hole(prog, h) != NO_HOLE) {
+        h = *hole(prog, h);
+    }
+    *hole(prog, h) = b;
+    return a;
+}
+
+static Fragment single(Program *prog, RegexpInstType type, uint8_t lo, uint8_t hi) {
+    uint32_t i = emit(prog, type, lo, hi);
+    return (Fragment){ .start = i, .holes = i << 1 };
+}
+
+static Fragment concat(Program *prog, Fragment a, Fragment b) {
+    patch(prog, a.holes, b.start);
+    return (Fragment){ .start = a.start, .holes = b.holes };
+}
+
+static Fragment alternate(Program *prog, Fragment a, Fragment b) {
+    uint32_t split = emit(prog, REGEXP_INST_SPLIT, 0, 0);
+    prog->insts[split].out = a.start;
+    prog->insts[split].out1 = b.start;
+    return (Fragment){ .start = split, .holes = append_holes(prog, a.holes, b.holes) };
+}
+
+// a?, or a* if loop is true
+static Fragment optional(Program *prog, Fragment a, bool loop) {
+    uint32_t split = emit(prog, REGEXP_INST_SPLIT, 0, 0);
+    prog->insts[split].out = a.start;
+    if (loop) {
+        patch(prog, a.holes, split);
+        return (Fragment){ .start = split, .holes = split << 1 | 1 };
+    }
+    return (Fragment){ .start = split, .holes = append_holes(prog, a.holes, split << 1 | 1) };
+}
+
+static void encode_utf8(uint32_t cp, uint8_t *out, size_t *length) {
+    if (cp < 0x80) {
+        out[0] = (uint8_t)cp;
+        *length = 1;
+    }
+    else if (cp < 0x800) {
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        *length = 2;
+    }
+    else if (cp < 0x10000) {
+        out[0] = 0xE0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        *length = 3;
+    }
+    else {
+        out[0] = 0xF0 | (cp >> 18);
+        out[1] = 0x80 | ((cp >> 12) & 0x3F);
+        out[2] = 0x80 | ((cp >> 6) & 0x3F);
+        out[3] = 0x80 | (cp & 0x3F);
+        *length = 4;
+    }
+}
+
+static void add_alternative(Program *prog, Fragment *all, bool *have, Fragment f) {
+    *all = *have ? alternate(prog, *all, f) : f;
+    *have = true;
+}
+
+// split [lo, hi] until every part is a sequence of byte ranges
+static void compile_utf8_range(Program *prog, Fragment *all, bool *have, uint32_t lo, uint32_t hi) {
+    static const uint32_t max_for_length[] = { 0x7F, 0x7FF, 0xFFFF };
+    for (size_t i = 0; i < 3; i++) {
+        uint32_t max = max_for_length[i];
+        if (lo <= max && hi > max) {
+            compile_utf8_range(prog, all, have, lo, max);
+            compile_utf8_range(prog, all, have, max + 1, hi);
+            return;
+        }
+    }
+    for (int i = 1; i < 4; i++) {
+        uint32_t m = (1u << (6 * i)) - 1;
+        if ((lo & ~m) != (hi & ~m)) {
+            if ((lo & m) != 0) {
+                compile_utf8_range(prog, all, have, lo, lo | m);
+                compile_utf8_range(prog, all, have, (lo | m) + 1, hi);
+                return;
+            }
+            if ((hi & m) != m) {
+                compile_utf8_range(prog, all, have, lo, (hi & ~m) - 1);
+                compile_utf8_range(prog, all, have, hi & ~m, hi);
+                return;
+            }
+        }
+    }
+    uint8_t lo_bytes[4], hi_bytes[4];
+    size_t length;
+    encode_utf8(lo, lo_bytes, &length);
+    encode_utf8(hi, hi_bytes, &length);
+    Fragment sequence = single(prog, REGEXP_INST_BYTE, lo_bytes[0], hi_bytes[0]);
+    for (size_t i = 1; i < length; i++) {
+        sequence = concat(prog, sequence, single(prog, REGEXP_INST_BYTE, lo_bytes[i], hi_bytes[i]));
+    }
+    add_alternative(prog, all, have, sequence);
+}
+
+static Fragment compile_class(Program *prog, const Node *node) {
+    Fragment all = {0};
+    bool have = false;
+    for (size_t i = 0; i < node->range_count && !prog->too_big; i++) {
+        compile_utf8_range(prog, &all, &have, node->ranges[i].lo, node->ranges[i].hi);
+    }
+    if (node->raw) {
+        add_alternative(prog, &all, &have, single(prog, REGEXP_INST_BYTE, 0xC0, 0xC1));
+        add_alternative(prog, &all, &have, single(prog, REGEXP_INST_BYTE, 0xF5, 0xFF));
+    }
+    if (!have) {
+        // empty class, never matches
+        return single(prog, REGEXP_INST_BYTE, 1, 0);
+    }
+    return all;
+}
+
+static Fragment compile_node(Program *prog, const Node *node) {
+    if (prog->too_big) {
+        return (Fragment){ .start = 0, .holes = NO_HOLE };
+    }
+    switch (node->type) {
+        case NODE_EMPTY:
+            return single(prog, REGEXP_INST_EMPTY, 0, 0);
+        case NODE_BYTES:
+            return single(prog, REGEXP_INST_BYTE, node->lo, node->hi);
+        case NODE_CLASS:
+            return compile_class(prog, node);
+        case NODE_ASSERT:
+            return single(prog, REGEXP_INST_ASSERT, node->lo, 0);
+        case NODE_CONCAT: {
+            Fragment a = compile_node(prog, node->left);
+            Fragment b = compile_node(prog, node->right);
+            return prog->too_big ? a : concat(prog, a, b);
+        }
+        case NODE_ALTERNATE: {
+            Fragment a = compile_node(prog, node->left);
+            Fragment b = compile_node(prog, node->right);
+            return prog->too_big ? a : alternate(prog, a, b);
+        }
+        case NODE_REPEAT: {
+            // a{2,4} is compiled as a a a? a?, a{2,} as a a a*
+            Fragment all = {0};
+            bool have = false;
+            int copies = node->max == -1 ? node->min + 1 : node->max;
+            for (int i = 0; i < copies && !prog->too_big; i++) {
+                Fragment f = compile_node(prog, node->left);
+                if (prog->too_big) {
+                    break;
+                }
+                if (i >= node->min) {
+                    f = optional(prog, f, node->max == -1);
+                }
+                all = have ? concat(prog, all, f) : f;
+                have = true;
+            }
+            return have ? all : single(prog, REGEXP_INST_EMPTY, 0, 0);
+        }
+    }
+    return single(prog, REGEXP_INST_EMPTY, 0, 0);
+}
+
+/*****************************************************************************/
+/* Regexp                                                                    */
+
+static void compute_byte_classes(Regexp *re) {
+    bool boundary[257] = { false };
+    for (uint32_t i = 0; i < re->inst_count; i++) {
+        const RegexpInst *inst = &re->insts[i];
+        if (inst->type == REGEXP_INST_BYTE && inst->lo <= inst->hi) {
+            boundary[inst->lo] = true;
+            boundary[inst->hi + 1] = true;
+        }
+    }
+    if (re->word_assertions) {
+        for (int b = 1; b < 256; b++) {
+            if (is_word_byte((uint8_t)b) != is_word_byte((uint8_t)(b - 1))) {
+                boundary[b] = true;
+            }
+        }
+    }
+    uint32_t cls = 0;
+    re->class_byte[0] = 0;
+    for (int b = 0; b < 256; b++) {
+        if (b > 0 && boundary[b]) {
+            cls++;
+            re->class_byte[cls] = (uint8_t)b;
+        }
+        re->byte_class[b] = (uint8_t)cls;
+    }
+    re->class_count = cls + 1;
+}
+
+// true if every path through the pattern starts with ^
+static bool is_begin_anchored(const Regexp *re) {
+    uint32_t *stack = malloc(sizeof(uint32_t) * re->inst_count);
+    bool *seen = calloc(re->inst_count, sizeof(bool));
+    if (!stack || !seen) {
+        logFatal("Cannot allocate memory for Regexp.");
+    }
+    bool anchored = true;
+    uint32_t sp = 0;
+    stack[sp++] = re->anchored;
+    seen[re->anchored] = true;
+    while (sp > 0 && anchored) {
+        const RegexpInst *inst = &re->insts[stack[--sp]];
+        uint32_t outs[2] = { inst->out, inst->out1 };
+        int out_count = inst->type == REGEXP_INST_SPLIT ? 2 : inst->type == REGEXP_INST_EMPTY ? 1 : 0;
+        if (inst->type == REGEXP_INST_ASSERT) {
+            anchored = inst->lo == ASSERT_BEGIN;
+        }
+        else if (out_count == 0) {
+            anchored = false;
+        }
+        for (int i = 0; i < out_count; i++) {
+            if (!seen[outs[i]]) {
+                seen[outs[i]] = true;
+                stack[sp++] = outs[i];
+            }
+        }
+    }
+    free(stack);
+    free(seen);
+    return anchored;
+}
+
+// collect the bytes a match can start with, a match that starts at the begin of the text is not filtered
+static void compute_prefilter(Regexp *re) {
+    uint32_t *stack = malloc(sizeof(uint32_t) * re->inst_count);
+    bool *seen = calloc(re->inst_count, sizeof(bool));
+    if (!stack || !seen) {
+        logFatal("Cannot allocate memory for Regexp.");
+    }
+    bool empty = false;
+    uint32_t sp = 0;
+    stack[sp++] = re->anchored;
+    seen[re->anchored] = true;
+    while (sp > 0 && !empty) {
+        const RegexpInst *inst = &re->insts[stack[--sp]];
+        uint32_t outs[2] = { inst->out, inst->out1 };
+        int out_count = 0;
+        switch (inst->type) {
+            case REGEXP_INST_BYTE:
+                for (int b = inst->lo; b <= inst->hi; b++) {
+                    re->prefilter_bytes[b] = true;
+                }
+                break;
+            case REGEXP_INST_SPLIT:
+                out_count = 2;
+                break;
+            case REGEXP_INST_EMPTY:
+                out_count = 1;
+                break;
+            case REGEXP_INST_ASSERT:
+                // ^ never holds behind the begin, behind $ only the empty match at the end is possible
+                // (the search always looks at the end)
+                out_count = inst->lo == ASSERT_BEGIN || inst->lo == ASSERT_END ? 0 : 1;
+                break;
+            case REGEXP_INST_MATCH:
+                // an empty match is possible everywhere
+                empty = true;
+                break;
+        }
+        for (int i = 0; i < out_count; i++) {
+            if (!seen[outs[i]]) {
+                seen[outs[i]] = true;
+                stack[sp++] = outs[i];
+            }
+        }
+    }
+    free(stack);
+    free(seen);
+
+    re->prefilter_count = 0;
+    for (int b = 0; b < 256; b++) {
+        if (re->prefilter_bytes[b]) {
+            re->prefilter_byte = (uint8_t)b;
+            re->prefilter_count++;
+        }
+    }
+    re->prefilter = !empty && re->prefilter_count <= REGEXP_PREFILTER_MAX_BYTES;
+}
+
+// an empty state cache and the scratch space to build states
+static void init_dfa(Regexp *re) {
+    re->slots_capacity = 64;
+    re->slots = calloc(re->slots_capacity, sizeof(RegexpState*));
+    re->stack = malloc(sizeof(uint32_t) * re->inst_count);
+    re->marks = calloc(re->inst_count, sizeof(uint32_t));
+    re->set_marks = calloc(re->inst_count, sizeof(uint32_t));
+    re->set = malloc(sizeof(uint32_t) * re->inst_count);
+    re->ids = malloc(sizeof(uint32_t) * re->inst_count);
+    if (!re->slots || !re->stack || !re->marks || !re->set_marks || !re->set || !re->ids) {
+        logFatal("Cannot allocate memory for Regexp.");
+    }
+    re->mark = 0;
+}
+
+// finish prog (the pattern starts at start) to a Regexp, part_starts are taken over
+static Regexp *create_regexp(Program *prog, uint32_t start, uint32_t *part_starts, uint32_t part_count) {
+    // the unanchored search tries the pattern at every byte
+    uint32_t loop = emit(prog, REGEXP_INST_SPLIT, 0, 0);
+    uint32_t any = emit(prog, REGEXP_INST_BYTE, 0x00, 0xFF);
+    prog->insts[any].out = loop;
+    prog->insts[loop].out = start;
+    prog->insts[loop].out1 = any;
+
+    Regexp *re = calloc(1, sizeof(Regexp));
+    if (!re) {
+        logFatal("Cannot allocate memory for Regexp.");
+    }
+    re->insts = prog->insts;
+    re->inst_count = prog->count;
+    re->anchored = start;
+    re->unanchored = loop;
+    re->part_starts = part_starts;
+    re->part_count = part_count;
+    for (uint32_t i = 0; i < re->inst_count; i++) {
+        if (re->insts[i].type == REGEXP_INST_ASSERT && re->insts[i].lo >= ASSERT_WORD_BOUNDARY) {
+            re->word_assertions = true;
+        }
+    }
+    re->begin_anchored = is_begin_anchored(re);
+    compute_prefilter(re);
+    compute_byte_classes(re);
+    init_dfa(re);
+    re->cache_limit = REGEXP_CACHE_SIZE;
+    return re;
+}
+
+Regexp *Regexp_Compile(const char *pattern, char *error, size_t error_size) {
+    if (!pattern) {
+        return NULL;
+    }
+    Parser parser = {
+        .p = (const unsigned char*)pattern,
+        .error = error,
+        .error_size = error_size,
+        .failed = false
+    };
+    Node *root = parse_alternation(&parser);
+    if (parser.failed) {
+        free_nodes(&parser);
+        return NULL;
+    }
+
+    Program prog = {0};
+    Fragment f = compile_node(&prog, root);
+    free_nodes(&parser);
+    if (prog.too_big) {
+        fail(&parser, "Regular expression too big");
+        free(prog.insts);
+        return NULL;
+    }
+    uint32_t match = emit(&prog, REGEXP_INST_MATCH, 0, 0);
+    prog.insts[match].out = 0;
+    patch(&prog, f.holes, match);
+    uint32_t *part_starts = malloc(sizeof(uint32_t));
+    if (!part_starts) {
+        logFatal("Cannot allocate memory for Regexp.");
+    }
+    part_starts[0] = f.start;
+    return create_regexp(&prog, f.start, part_starts, 1);
+}
+
+Regexp *Regexp_Union(Regexp *const *parts, size_t count) {
+    Program prog = {0};
+    uint32_t start = NO_HOLE;
+    uint32_t *part_starts = malloc(sizeof(uint32_t) * (count ? count : 1));
+    if (!part_starts) {
+        logFatal("Cannot allocate memory for Regexp.");
+    }
+    for (size_t i = 0; i < count; i++) {
+        const Regexp *part = parts[i];
+        part_starts[i] = NO_HOLE;
+        if (!part) {
+            continue;
+        }
+        // copy the part behind the others, its own unanchored loop is not reached
+        uint32_t base = prog.count;
+        for (uint32_t j = 0; j < part->inst_count; j++) {
+            RegexpInst inst = part->insts[j];
+            uint32_t index = emit(&prog, inst.type, inst.lo, inst.hi);
+            if (inst.type == REGEXP_INST_MATCH) {
+                prog.insts[index].out = (uint32_t)i;
+                continue;
+            }
+            prog.insts[index].out = inst.out + base;
+            if (inst.type == REGEXP_INST_SPLIT) {
+                prog.insts[index].out1 = inst.out1 + base;
+            }
+        }
+        part_starts[i] = base + part->anchored;
+        if (start == NO_HOLE) {
+            start = base + part->anchored;
+        }
+        else {
+            uint32_t split = emit(&prog, REGEXP_INST_SPLIT, 0, 0);
+            prog.insts[split].out = start;
+            prog.insts[split].out1 = base + part->anchored;
+            start = split;
+        }
+    }
+    if (start == NO_HOLE) {
+        free(prog.insts);
+        free(part_starts);
+        return NULL;
+    }
+    return create_regexp(&prog, start, part_starts, (uint32_t)count);
+}
+
+Regexp *Regexp_Copy(const Regexp *re) {
+    if (!re) {
+        return NULL;
+    }
+    Regexp *copy = malloc(sizeof(Regexp));
+    if (!copy) {
+        logFatal("Cannot allocate memory for Regexp.");
+    }
+    *copy = *re;
+    copy->insts = malloc(sizeof(RegexpInst) * re->inst_count);
+    copy->part_starts = malloc(sizeof(uint32_t) * (re->part_count ? re->part_count : 1));
+    if (!copy->insts || !copy->part_starts) {
+        logFatal("Cannot allocate memory for Regexp.");
+    }
+    memcpy(copy->insts, re->insts, sizeof(RegexpInst) * re->inst_count);
+    memcpy(copy->part_starts, re->part_starts, sizeof(uint32_t) * re->part_count);
+    copy->reverse = NULL;  // built again by the first Regexp_FindStarts() of the copy
+    memset(copy->start, 0, sizeof(copy->start));
+    copy->stats = (RegexpStats){ 0 };
+    init_dfa(copy);
+    return copy;
+}
+
+// the assertion at the same position seen from the other direction
+static uint8_t reverse_assertion(uint8_t assertion) {
+    switch (assertion) {
+        case ASSERT_BEGIN:
+            return ASSERT_END;
+        case ASSERT_END:
+            return ASSERT_BEGIN;
+        case ASSERT_WORD_START:
+            return ASSERT_WORD_END;
+        case ASSERT_WORD_END:
+            return ASSERT_WORD_START;
+    }
+    return assertion;
+}
+
+// an instruction that never continues
+static uint32_t emit_fail(Program *prog) {
+    uint32_t fail = emit(prog, REGEXP_INST_BYTE, 1, 0);
+    prog->insts[fail].out = fail;
+    return fail;
+}
+
+/*
+ * The program of re read backwards: every instruction gets a node that leads
+ * to the instructions in front of it, a match of the reverse program starts
+ * at the end of a match of re and ends where it starts. The unanchored loop
+ * lets the matches end anywhere, MATCH tells the pattern (part) of re.
+ */
+static Regexp *create_reverse(const Regexp *re) {
+    uint32_t n = re->inst_count;
+    uint32_t *stack = malloc(sizeof(uint32_t) * n);
+    bool *reachable = calloc(n, sizeof(bool));
+    uint32_t *edge_start = calloc(n + 1, sizeof(uint32_t));
+    if (!stack || !reachable || !edge_start) {
+        logFatal("Cannot allocate memory for Regexp.");
+    }
+    // the unanchored loops (of the union and of its copied parts) are left out
+    uint32_t sp = 0;
+    stack[sp++] = re->anchored;
+    reachable[re->anchored] = true;
+    while (sp > 0) {
+        const RegexpInst *inst = &re->insts[stack[--sp]];
+        uint32_t outs[2] = { inst->out, inst->out1 };
+        int out_count = inst->type == REGEXP_INST_SPLIT ? 2 : inst->type == REGEXP_INST_MATCH ? 0 : 1;
+        for (int i = 0; i < out_count; i++) {
+            edge_start[outs[i] + 1]++;
+            if (!reachable[outs[i]]) {
+                reachable[outs[i]] = true;
+                stack[sp++] = outs[i];
+            }
+        }
+    }
+    // the sources of the edges into each instruction, grouped by the target
+    for (uint32_t i = 0; i < n; i++) {
+        edge_start[i + 1] += edge_start[i];
+    }
+    uint32_t *sources = malloc(sizeof(uint32_t) * (edge_start[n] ? edge_start[n] : 1));
+    uint32_t *filled = calloc(n, sizeof(uint32_t));
+    if (!sources || !filled) {
+        logFatal("Cannot allocate memory for Regexp.");
+    }
+    for (uint32_t u = 0; u < n; u++) {
+        if (!reachable[u]) {
+            continue;
+        }
+        const RegexpInst *inst = &re->insts[u];
+        uint32_t outs[2] = { inst->out, inst->out1 };
+        int out_count = inst->type == REGEXP_INST_SPLIT ? 2 : inst->type == REGEXP_INST_MATCH ? 0 : 1;
+        for (int i = 0; i < out_count; i++) {
+            sources[edge_start[outs[i]] + filled[outs[i]]++] = u;
+        }
+    }
+    uint32_t *part_of = malloc(sizeof(uint32_t) * n);
+    if (!part_of) {
+        logFatal("Cannot allocate memory for Regexp.");
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        part_of[i] = NO_HOLE;
+    }
+    for (uint32_t p = 0; p < re->part_count; p++) {
+        if (re->part_starts[p] != NO_HOLE) {
+            part_of[re->part_starts[p]] = p;
+        }
+    }
+
+    // node of instruction i is i, its edges follow behind
+    Program prog = {0};
+    for (uint32_t i = 0; i < n; i++) {
+        emit(&prog, REGEXP_INST_EMPTY, 0, 0);
+    }
+    uint32_t fail = emit_fail(&prog);
+    for (uint32_t v = 0; v < n; v++) {
+        uint32_t count = edge_start[v + 1] - edge_start[v] + (part_of[v] != NO_HOLE);
+        if (!reachable[v] || count == 0) {
+            prog.insts[v].out = fail;
+            continue;
+        }
+        uint32_t h = v << 1;    // the hole to fill with the next edge
+        for (uint32_t j = 0; j < count; j++) {
+            uint32_t edge;
+            if (j == edge_start[v + 1] - edge_start[v]) {
+                edge = emit(&prog, REGEXP_INST_MATCH, 0, 0);
+                prog.insts[edge].out = part_of[v];
+            }
+            else {
+                uint32_t u = sources[edge_start[v] + j];
+                const RegexpInst inst = re->insts[u];
+                if (inst.type == REGEXP_INST_BYTE) {
+                    edge = emit(&prog, REGEXP_INST_BYTE, inst.lo, inst.hi);
+                    prog.insts[edge].out = u;
+                }
+                else if (inst.type == REGEXP_INST_ASSERT) {
+                    edge = emit(&prog, REGEXP_INST_ASSERT, reverse_assertion(inst.lo), 0);
+                    prog.insts[edge].out = u;
+                }
+                else {
+                    edge = u;
+                }
+            }
+            if (j + 1 < count) {
+                uint32_t split = emit(&prog, REGEXP_INST_SPLIT, 0, 0);
+                prog.insts[split].out = edge;
+                *hole(&prog, h) = split;
+                h = split << 1 | 1;
+            }
+            else {
+                *hole(&prog, h) = edge;
+            }
+        }
+    }
+
+    // start at the end of every pattern
+    uint32_t start = NO_HOLE;
+    for (uint32_t i = 0; i < n; i++) {
+        if (!reachable[i] || re->insts[i].type != REGEXP_INST_MATCH) {
+            continue;
+        }
+        if (start == NO_HOLE) {
+            start = i;
+        }
+        else {
+            uint32_t split = emit(&prog, REGEXP_INST_SPLIT, 0, 0);
+            prog.insts[split].out = start;
+            prog.insts[split].out1 = i;
+            start = split;
+        }
+    }
+    if (start == NO_HOLE) {
+        start = fail;
+    }
+    free(stack);
+    free(reachable);
+    free(edge_start);
+    free(sources);
+    free(filled);
+    free(part_of);
+
+    uint32_t *part_starts = malloc(sizeof(uint32_t));
+    if (!part_starts) {
+        logFatal("Cannot allocate memory for Regexp.");
+    }
+    part_starts[0] = start;
+    Regexp *reverse = create_regexp(&prog, start, part_starts, 1);
+    reverse->cache_limit = re->cache_limit;
+    return reverse;
+}
+
+static void flush_states(Regexp *re) {
+    for (size_t i = 0; i < re->slots_capacity; i++) {
+        free(re->slots[i]);
+        re->slots[i] = NULL;
+    }
+    memset(re->start, 0, sizeof(re->start));
+    re->stats.states = 0;
+    re->stats.cache_bytes = 0;
+}
+
+void Regexp_Destroy(Regexp *re) {
+    if (!re) {
+        return;
+    }
+    flush_states(re);
+    free(re->slots);
+    free(re->stack);
+    free(re->marks);
+    free(re->set_marks);
+    free(re->set);
+    free(re->ids);
+    free(re->insts);
+    free(re->part_starts);
+    Regexp_Destroy(re->reverse);
+    free(re);
+}
+
+void Regexp_SetCacheLimit(Regexp *re, size_t bytes) {
+    if (re->reverse) {
+        Regexp_SetCacheLimit(re->reverse, bytes);
+    }
+    re->cache_limit = bytes;
+    if (re->stats.cache_bytes > bytes) {
+        flush_states(re);
+        re->stats.flushes++;
+    }
+}
+
+/*****************************************************************************/
+/* Lazy DFA                                                                  */
+
+static uint32_t hash_state(uint16_t flags, const uint32_t *matches, uint16_t match_count, const uint32_t *insts, uint32_t count) {
+    uint32_t h = 2166136261u;
+    h = (h ^ flags) * 16777619u;
+    for (uint16_t i = 0; i < match_count; i++) {
+        h = (h ^ matches[i]) * 16777619u;
+    }
+    h = (h ^ match_count) * 16777619u;
+    for (uint32_t i = 0; i < count; i++) {
+        h = (h ^ insts[i]) * 16777619u;
+    }
+    return h;
+}
+
+static void grow_slots(Regexp *re) {
+    size_t capacity = re->slots_capacity * 2;
+    RegexpState **slots = calloc(capacity, sizeof(RegexpState*));
+    if (!slots) {
+        logFatal("Cannot allocate memory for Regexp states.");
+    }
+    for (size_t i = 0; i < re->slots_capacity; i++) {
+        RegexpState *state = re->slots[i];
+        if (state) {
+            size_t j = state->hash & (capacity - 1);
+            while (slots[j]) {
+                j = (j + 1) & (capacity - 1);
+            }
+            slots[j] = state;
+        }
+    }
+    free(re->slots);
+    re->slots = slots;
+    re->slots_capacity = capacity;
+}
+
+static RegexpState *find_state(Regexp *re, uint16_t flags, const uint32_t *matches, uint16_t match_count,
+                               const uint32_t *insts, uint32_t count)
+{
+    uint32_t hash = hash_state(flags, matches, match_count, insts, count);
+    size_t mask = re->slots_capacity - 1;
+    size_t i = hash & mask;
+    while (re->slots[i]) {
+        RegexpState *state = re->slots[i];
+        if (state->hash == hash && state->flags == flags && state->match_count == match_count
+            && state->inst_count == count && memcmp(state->insts, insts, sizeof(uint32_t) * count) == 0
+            && memcmp(state->matches, matches, sizeof(uint32_t) * match_count) == 0)
+        {
+            return state;
+        }
+        i = (i + 1) & mask;
+    }
+
+    size_t size = sizeof(RegexpState) + sizeof(RegexpState*) * (re->class_count + 1)
+                  + sizeof(uint32_t) * (match_count + count);
+    if (re->stats.states > 0 && re->stats.cache_bytes + size > re->cache_limit) {
+        // start over, the states that are still needed are built again
+        flush_states(re);
+        re->stats.flushes++;
+        return find_state(re, flags, matches, match_count, insts, count);
+    }
+    if ((re->stats.states + 1) * 2 > re->slots_capacity) {
+        grow_slots(re);
+        mask = re->slots_capacity - 1;
+        i = hash & mask;
+        while (re->slots[i]) {
+            i = (i + 1) & mask;
+        }
+    }
+    RegexpState *state = malloc(size);
+    if (!state) {
+        logFatal("Cannot allocate memory for Regexp state.");
+    }
+    memset(state->next, 0, sizeof(RegexpState*) * (re->class_count + 1));
+    state->matches = (uint32_t*)&state->next[re->class_count + 1];
+    state->insts = state->matches + match_count;
+    state->hash = hash;
+    state->flags = flags;
+    state->match_count = match_count;
+    state->inst_count = count;
+    state->idle = re->prefilter && !(flags & STATE_BEGIN) && match_count == 0 && count == 1 && insts[0] == re->unanchored;
+    memcpy(state->matches, matches, sizeof(uint32_t) * match_count);
+    memcpy(state->insts, insts, sizeof(uint32_t) * count);
+    re->slots[i] = state;
+    re->stats.states++;
+    re->stats.cache_bytes += size;
+    return state;
+}
+
+static bool assertion_holds(uint8_t assertion, uint16_t flags, bool at_end, bool next_word) {
+    bool prev_word = flags & STATE_WORD;
+    switch (assertion) {
+        case ASSERT_BEGIN:
+            return flags & STATE_BEGIN;
+        case ASSERT_END:
+            return at_end;
+        case ASSERT_WORD_BOUNDARY:
+            return prev_word != next_word;
+        case ASSERT_NOT_WORD_BOUNDARY:
+            return prev_word == next_word;
+        case ASSERT_WORD_START:
+            return !prev_word && next_word;
+        case ASSERT_WORD_END:
+            return prev_word && !next_word;
+    }
+    return false;
+}
+
+static int compare_insts(const void *a, const void *b) {
+    uint32_t ia = *(const uint32_t*)a;
+    uint32_t ib = *(const uint32_t*)b;
+    return ia < ib ? -1 : ia > ib;
+}
+
+// follow the empty transitions of state (assertions are checked now that the next byte is known) and read a byte of cls
+static RegexpState *build_transition(Regexp *re, RegexpState *state, uint32_t cls) {
+    bool at_end = cls == re->class_count;
+    uint8_t b = at_end ? 0 : re->class_byte[cls];
+    bool next_word = !at_end && is_word_byte(b);
+
+    if (re->mark >= UINT32_MAX - 1) {
+        memset(re->marks, 0, sizeof(uint32_t) * re->inst_count);
+        memset(re->set_marks, 0, sizeof(uint32_t) * re->inst_count);
+        re->mark = 0;
+    }
+    uint32_t mark = ++re->mark;
+    uint32_t sp = 0;
+    uint32_t count = 0;
+    uint16_t match_count = 0;
+
+    #define VISIT(index) do { \
+        uint32_t _i = (index); \
+        if (re->marks[_i] != mark) { \
+            re->marks[_i] = mark; \
+            re->stack[sp++] = _i; \
+        } \
+    } while (0)
+
+    for (uint32_t i = 0; i < state->inst_count; i++) {
+        VISIT(state->insts[i]);
+    }
+    while (sp > 0) {
+        const RegexpInst *inst = &re->insts[re->stack[--sp]];
+        switch (inst->type) {
+            case REGEXP_INST_EMPTY:
+                VISIT(inst->out);
+                break;
+            case REGEXP_INST_SPLIT:
+                VISIT(inst->out);
+                VISIT(inst->out1);
+                break;
+            case REGEXP_INST_ASSERT:
+                if (assertion_holds(inst->lo, state->flags, at_end, next_word)) {
+                    VISIT(inst->out);
+                }
+                break;
+            case REGEXP_INST_MATCH:
+                // every pattern has a single MATCH instruction
+                re->ids[match_count++] = inst->out;
+                break;
+            case REGEXP_INST_BYTE:
+                if (!at_end && inst->lo <= b && b <= inst->hi && re->set_marks[inst->out] != mark) {
+                    re->set_marks[inst->out] = mark;
+                    re->set[count++] = inst->out;
+                }
+                break;
+        }
+    }
+    #undef VISIT
+
+    if (count == 0 && match_count == 0) {
+        state->next[cls] = &dead_state;
+        return &dead_state;
+    }
+    qsort(re->set, count, sizeof(uint32_t), compare_insts);
+    qsort(re->ids, match_count, sizeof(uint32_t), compare_insts);
+    uint16_t flags = re->word_assertions && next_word ? STATE_WORD : 0;
+    size_t flushes = re->stats.flushes;
+    RegexpState *next = find_state(re, flags, re->ids, match_count, re->set, count);
+    if (flushes == re->stats.flushes) {
+        // otherwise state was freed
+        state->next[cls] = next;
+    }
+    return next;
+}
+
+static inline RegexpState *step(Regexp *re, RegexpState *state, uint32_t cls) {
+    RegexpState *next = state->next[cls];
+    return next ? next : build_transition(re, state, cls);
+}
+
+static RegexpState *start_state(Regexp *re, bool anchored, const char *text, size_t pos) {
+    uint16_t flags = pos == 0 ? STATE_BEGIN : 0;
+    if (re->word_assertions && pos > 0 && is_word_byte((uint8_t)text[pos - 1])) {
+        flags |= STATE_WORD;
+    }
+    RegexpState **start = &re->start[anchored][flags];
+    if (!*start) {
+        uint32_t inst = anchored ? re->anchored : re->unanchored;
+        *start = find_state(re, flags, re->ids, 0, &inst, 1);
+    }
+    return *start;
+}
+
+// remember pos as end if state holds a match of the first pattern seen so far (or of an earlier one)
+static inline void note_match(const RegexpState *state, size_t pos, uint32_t *pattern, size_t *end) {
+    if (state->matches[0] <= *pattern) {
+        *pattern = state->matches[0];
+        *end = pos;
+        return;
+    }
+    for (uint16_t i = 1; i < state->match_count && state->matches[i] <= *pattern; i++) {
+        if (state->matches[i] == *pattern) {
+            *end = pos;
+        }
+    }
+}
+
+// the state behind the limit: the end of the text or the next byte (only read to check the assertions)
+static inline uint32_t limit_class(const Regexp *re, const char *text, size_t length, size_t limit) {
+    return limit < length ? re->byte_class[(uint8_t)text[limit]] : re->class_count;
+}
+
+// the end of the longest match from state at pos on (of the first pattern that matches there)
+static bool longest_match(Regexp *re, RegexpState *state, const char *text, size_t length, size_t limit,
+                          size_t pos, size_t *end, uint32_t *pattern)
+{
+    *pattern = UINT32_MAX;
+    for (size_t i = pos; i < limit; i++) {
+        state = step(re, state, re->byte_class[(uint8_t)text[i]]);
+        if (state == &dead_state) {
+            re->stats.scanned += i + 1 - pos;
+            return *pattern != UINT32_MAX;
+        }
+        if (state->match_count) {
+            note_match(state, i, pattern, end);
+        }
+    }
+    re->stats.scanned += limit - pos;
+    state = step(re, state, limit_class(re, text, length, limit));
+    if (state->match_count) {
+        note_match(state, limit, pattern, end);
+    }
+    return *pattern != UINT32_MAX;
+}
+
+// the first position from pos on with a byte a match can start with (limit if there is none)
+static size_t next_candidate(const Regexp *re, const char *text, size_t limit, size_t pos) {
+    if (re->prefilter_count == 1) {
+        const char *found = memchr(text + pos, re->prefilter_byte, limit - pos);
+        return found ? (size_t)(found - text) : limit;
+    }
+    while (pos < limit && !re->prefilter_bytes[(uint8_t)text[pos]]) {
+        pos++;
+    }
+    return pos;
+}
+
+bool Regexp_Search(Regexp *re, const char *text, size_t length, size_t start, RegexpMatch *match) {
+    return Regexp_SearchRange(re, text, length, start, length, match);
+}
+
+bool Regexp_SearchRange(Regexp *re, const char *text, size_t length, size_t start, size_t limit, RegexpMatch *match) {
+    if (!re || start > limit || limit > length) {
+        return false;
+    }
+    re->stats.searches++;
+
+    if (re->begin_anchored) {
+        size_t end;
+        uint32_t pattern;
+        if (start > 0 || !longest_match(re, start_state(re, true, text, 0), text, length, limit, 0, &end, &pattern)) {
+            return false;
+        }
+        match->start = 0;
+        match->end = end;
+        match->pattern = pattern;
+        return true;
+    }
+
+    // find the end of the match that ends first, the leftmost match can't start behind it
+    RegexpState *state = start_state(re, false, text, start);
+    size_t first_end = limit + 1;
+    for (size_t i = start; i < limit; i++) {
+        if (state->idle) {
+            size_t candidate = next_candidate(re, text, limit, i);
+            if (candidate > i) {
+                re->stats.skipped += candidate - i;
+                i = candidate;
+                state = start_state(re, false, text, i);
+                if (i == limit) {
+                    break;
+                }
+            }
+        }
+        state = step(re, state, re->byte_class[(uint8_t)text[i]]);
+        if (state->match_count) {
+            first_end = i;
+            break;
+        }
+    }
+    if (state == &dead_state) {
+        return false;
+    }
+    if (first_end > limit) {
+        state = step(re, state, limit_class(re, text, length, limit));
+        if (!state->match_count) {
+            return false;
+        }
+        first_end = limit;
+    }
+
+    // the first position a match starts at (mostly the DFA dies after a byte)
+    for (size_t pos = start; pos <= first_end; pos++) {
+        size_t end;
+        uint32_t pattern;
+        if (re->prefilter && pos > 0 && pos < length && !re->prefilter_bytes[(uint8_t)text[pos]]) {
+            continue;
+        }
+        if (longest_match(re, start_state(re, true, text, pos), text, length, limit, pos, &end, &pattern)) {
+            match->start = pos;
+            match->end = end;
+            match->pattern = pattern;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Regexp_FindStarts(Regexp *re, const char *text, size_t length, size_t from, uint16_t *starts) {
+    if (!re || from > length || re->part_count >= REGEXP_NO_START) {
+        return false;
+    }
+    if (!re->reverse) {
+        re->reverse = create_reverse(re);
+    }
+    Regexp *reverse = re->reverse;
+    reverse->stats.searches++;
+
+    // the end of the text is the begin for the reverse program
+    RegexpState *state = start_state(reverse, false, text, 0);
+    for (size_t i = length; i > from; i--) {
+        state = step(reverse, state, reverse->byte_class[(uint8_t)text[i - 1]]);
+        // the matches are the ones in front of the byte
+        starts[i] = state->match_count ? (uint16_t)state->matches[0] : REGEXP_NO_START;
+    }
+    state = step(reverse, state, from > 0 ? reverse->byte_class[(uint8_t)text[from - 1]] : reverse->class_count);
+    starts[from] = state->match_count ? (uint16_t)state->matches[0] : REGEXP_NO_START;
+    return true;
+}
+
+bool Regexp_SearchStarts(Regexp *re, const char *text, size_t length, size_t start, const uint16_t *starts,
+                         RegexpMatch *match)
+{
+    if (!re || start > length) {
+        return false;
+    }
+    re->stats.searches++;
+    for (size_t pos = start; pos <= length; pos++) {
+        if (starts[pos] == REGEXP_NO_START) {
+            continue;
+        }
+        // only the pattern that wins is followed
+        uint32_t part = starts[pos];
+        uint16_t flags = pos == 0 ? STATE_BEGIN : 0;
+        if (re->word_assertions && pos > 0 && is_word_byte((uint8_t)text[pos - 1])) {
+            flags |= STATE_WORD;
+        }
+        RegexpState *state = find_state(re, flags, re->ids, 0, &re->part_starts[part], 1);
+        size_t end;
+        uint32_t pattern;
+        if (longest_match(re, state, text, length, length, pos, &end, &pattern)) {
+            match->start = pos;
+            match->end = end;
+            match->pattern = pattern;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,223 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/**
+ * @file regexp.h
+ * @brief Extended regular expressions (POSIX ERE syntax) matched by a lazily built DFA.
+ *
+ * A pattern is parsed and compiled to a Thompson NFA over bytes (UTF-8 aware,
+ * `.` and bracket expressions match whole characters). Searching runs a DFA
+ * whose states are built from the NFA on demand and cached, so every byte of
+ * the text costs a table lookup once the states in use exist. The cache is
+ * limited to `cache_limit` bytes, if it's full it is thrown away and
+ * built again from the current position.
+ *
+ * The bytes a match can start with are extracted when compiling. As long as
+ * no match is in progress the search jumps to the next of these bytes with
+ * `memchr()` (or a scan over a byte set), so text without any candidate
+ * costs nearly nothing.
+ *
+ * Matches are leftmost-longest like with `regexec()`. Supported are
+ * alternation, grouping, `* + ? {m,n}`, bracket expressions with ranges and
+ * `[:class:]` names, the anchors `^ $`, word boundaries `\b \B \< \>` and the
+ * GNU classes `\w \W \s \S`. Back references are not supported. Character
+ * classes only know ASCII, every other character counts as a letter (and a
+ * word character).
+ *
+ * `Regexp_Union()` combines several expressions, so a single pass over the
+ * text finds the first match of any of them (and tells which one it is).
+ *
+ * Usage:
+ * ```
+ * char error[256];
+ * Regexp *re = Regexp_Compile("[a-z]+", error, sizeof(error));
+ * RegexpMatch match;
+ * if (Regexp_Search(re, "42 foo", 6, 0, &match)) {
+ *     // match.start == 3, match.end == 6
+ * }
+ * Regexp_Destroy(re);
+ * ```
+ */
+#ifndef REGEXP_H
+#define REGEXP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define REGEXP_CACHE_SIZE (256 * 1024)  //< default memory limit of the DFA states of one Regexp
+#define REGEXP_MAX_INSTS 65536          //< max size of the compiled NFA
+#define REGEXP_MAX_REPEAT 1000          //< max count in an interval {m,n}
+#define REGEXP_PREFILTER_MAX_BYTES 32   //< no prefilter if a match can start with more different bytes
+#define REGEXP_NO_START UINT16_MAX      //< no match starts at the position (see Regexp_FindStarts())
+
+typedef enum {
+    REGEXP_INST_BYTE,       //< consume a byte in [lo, hi]
+    REGEXP_INST_SPLIT,      //< continue at out and out1
+    REGEXP_INST_EMPTY,      //< continue at out
+    REGEXP_INST_ASSERT,     //< continue at out if the assertion holds at the position
+    REGEXP_INST_MATCH       //< the pattern with the index out matched
+} RegexpInstType;
+
+typedef struct _RegexpInst {
+    uint8_t type;
+    uint8_t lo, hi;         //< byte range (REGEXP_INST_BYTE) or assertion (lo, REGEXP_INST_ASSERT)
+    uint32_t out;
+    uint32_t out1;          //< REGEXP_INST_SPLIT only
+} RegexpInst;
+
+/**
+ * @brief A state of the DFA: the NFA instructions reached by the bytes read so far.
+ */
+typedef struct _RegexpState {
+    uint32_t hash;
+    uint16_t flags;             //< position context (begin of text, word character before)
+    uint16_t match_count;       //< number of patterns with a match that ends before the last byte
+    uint32_t inst_count;
+    bool idle;                  //< true if no match is in progress, the prefilter may skip bytes then
+    uint32_t *matches;          //< sorted indices of these patterns (stored behind next)
+    uint32_t *insts;            //< sorted instruction indices (stored behind matches)
+    struct _RegexpState *next[]; //< transitions per byte class (and end of text), NULL if not built yet
+} RegexpState;
+
+typedef struct _RegexpStats {
+    size_t searches;
+    size_t states;          //< DFA states in the cache
+    size_t cache_bytes;     //< memory used by the DFA states
+    size_t flushes;         //< number of times the cache was full and thrown away
+    size_t skipped;         //< bytes jumped over by the prefilter
+    size_t scanned;         //< bytes read by the anchored runs that find the end of a match
+} RegexpStats;
+
+typedef struct _RegexpMatch {
+    size_t start;           //< byte offset of the first byte of the match
+    size_t end;             //< byte offset behind the match
+    size_t pattern;         //< index of the matching part of a union (0 for a single pattern)
+} RegexpMatch;
+
+typedef struct _Regexp {
+    RegexpInst *insts;
+    uint32_t inst_count;
+    uint32_t anchored;          //< first instruction of the pattern
+    uint32_t unanchored;        //< the pattern behind a loop over any byte
+    uint32_t *part_starts;      //< first instruction of each part of a union (UINT32_MAX for NULL parts)
+    uint32_t part_count;
+    struct _Regexp *reverse;    //< the program read backwards, built by the first Regexp_FindStarts()
+    bool word_assertions;       //< true if the position context must know about word characters
+    bool begin_anchored;        //< true if the pattern can only match at the begin of the text
+
+    // a match behind the begin of the text starts with one of these bytes
+    bool prefilter;             //< true if the bytes are known (and not too many)
+    bool prefilter_bytes[256];
+    uint32_t prefilter_count;   //< number of bytes in prefilter_bytes
+    uint8_t prefilter_byte;     //< the byte if there is only one
+
+    uint8_t byte_class[256];    //< bytes that are never told apart share a class
+    uint32_t class_count;       //< number of byte classes, class_count is the end of text
+    uint8_t class_byte[256];    //< a byte of each class
+
+    // lazy DFA
+    RegexpState **slots;        //< hash set of all states
+    size_t slots_capacity;      //< power of 2
+    RegexpState *start[2][4];   //< [anchored][flags]
+    size_t cache_limit;
+
+    // scratch space to build a state
+    uint32_t *stack;
+    uint32_t *marks;            //< instructions visited in this build
+    uint32_t *set_marks;        //< instructions in the new state
+    uint32_t mark;              //< current value of the marks
+    uint32_t *set;
+    uint32_t *ids;              //< matched patterns
+
+    RegexpStats stats;
+} Regexp;
+
+/**
+ * @brief Compile `pattern`.
+ *
+ * @returns The compiled expression or NULL if the pattern is invalid, in this
+ *          case a description of the problem is written to `error`.
+ */
+Regexp *Regexp_Compile(const char *pattern, char *error, size_t error_size);
+
+/**
+ * @brief Combine `parts` to one expression that finds the first match of any of them.
+ *
+ * The match that starts first wins, if several parts match at the same
+ * position the one with the lowest index wins (and its longest match is
+ * taken). `RegexpMatch.pattern` tells which part matched. The parts are only
+ * copied, NULL parts never match.
+ *
+ * @returns The union or NULL if there is no part.
+ */
+Regexp *Regexp_Union(Regexp *const *parts, size_t count);
+
+/**
+ * @brief Copy `re` with an empty DFA cache.
+ *
+ * Searching changes the cache (and the stats), so a Regexp must not be used by
+ * two threads at the same time. Every thread can search with its own copy (made
+ * by the thread that searches with `re`).
+ */
+Regexp *Regexp_Copy(const Regexp *re);
+
+void Regexp_Destroy(Regexp *re);
+
+/**
+ * @brief Find the leftmost-longest match in `text` that starts at or behind `start`.
+ *
+ * `^` matches at offset 0 of `text` and `$` at `length` only, the bytes in
+ * front of `start` are seen by the word assertions.
+ *
+ * @returns true if there is a match.
+ */
+bool Regexp_Search(Regexp *re, const char *text, size_t length, size_t start, RegexpMatch *match);
+
+/**
+ * @brief Like Regexp_Search() but nothing behind `limit` is read.
+ *
+ * Only matches that end at `limit` at the latest are found (the byte at
+ * `limit` is looked at for the assertions). Anchors keep their meaning,
+ * `$` still only matches at `length`.
+ */
+bool Regexp_SearchRange(Regexp *re, const char *text, size_t length, size_t start, size_t limit, RegexpMatch *match);
+
+/**
+ * @brief Find where matches start in `text` from `from` on, with a single pass backwards.
+ *
+ * `starts[i]` (`length + 1` entries) is set to the index of the first part
+ * (see Regexp_Union()) with a match that starts at `i`, or REGEXP_NO_START.
+ * Searching a long text again and again costs the distance to the next
+ * match then, no matter how far the patterns would have to look ahead.
+ *
+ * @returns false if there are too many parts, starts is untouched then.
+ */
+bool Regexp_FindStarts(Regexp *re, const char *text, size_t length, size_t from, uint16_t *starts);
+
+/**
+ * @brief Like Regexp_Search() with the `starts` found by Regexp_FindStarts() for the same text.
+ *
+ * `start` must not be in front of the `from` passed to Regexp_FindStarts().
+ */
+bool Regexp_SearchStarts(Regexp *re, const char *text, size_t length, size_t start, const uint16_t *starts,
+                         RegexpMatch *match);
+
+/**
+ * @brief Limit the memory of the DFA states to `bytes` (REGEXP_CACHE_SIZE by default).
+ */
+void Regexp_SetCacheLimit(Regexp *re, size_t bytes);
+
+#endif
@@ -175,7 +175,12 @@ void increase_bytes_capacity(String *string) {
          resize_bytes_capacity(string, STRING_INITIAL_CAPACITY);
          return;
     }
-    resize_bytes_capacity(string, STRING_GROW(string->bytes_capacity));
+    // a tight capacity (e.g. after String_ShrinkToFit()) must still fit the longest UTF-8 character
+    size_t capacity = STRING_GROW(string->bytes_capacity);
+    if (capacity < string->bytes_capacity + 4) {
+        capacity = string->bytes_capacity + 4;
+    }
+    resize_bytes_capacity(string, capacity);
 }
 
 void resize_multibytes_capacity(String *str, size_t new_capacity) {
@@ -194,7 +199,11 @@ void increase_multibytes_capacity(String *string) {
         resize_multibytes_capacity(string, STRING_INITIAL_MULTIBYTE_OFFSETS_CAPACITY);
         return;
     }
-    resize_multibytes_capacity(string, STRING_GROW(string->multibytes_capacity));
+    size_t capacity = STRING_GROW(string->multibytes_capacity);
+    if (capacity <= string->multibytes_capacity) {
+        capacity = string->multibytes_capacity + STRING_INITIAL_MULTIBYTE_OFFSETS_CAPACITY;
+    }
+    resize_multibytes_capacity(string, capacity);
 }
 
 /**
@@ -667,3 +676,26 @@ StringView *String_Split(String *string, String *delimiter, ssize_t *count) {
 
     return out;
 }
+
+void String_ShrinkToFit(String *string) {
+    if (string->bytes && string->bytes_capacity > string->bytes_size + 1) {
+        char *bytes = realloc(string->bytes, string->bytes_size + 1);
+        if (bytes) {
+            string->bytes = bytes;
+            string->bytes_capacity = string->bytes_size + 1;
+        }
+    }
+    if (string->multibytes && string->multibytes_capacity > string->multibytes_size) {
+        if (string->multibytes_size == 0) {
+            free(string->multibytes);
+            string->multibytes = NULL;
+            string->multibytes_capacity = 0;
+            return;
+        }
+        MultibyteIndexHelper *multibytes = realloc(string->multibytes, string->multibytes_size * sizeof(MultibyteIndexHelper));
+        if (multibytes) {
+            string->multibytes = multibytes;
+            string->multibytes_capacity = string->multibytes_size;
+        }
+    }
+}
@@ -289,6 +289,11 @@ void String_Shorten(String *str, size_t n);
  */
 void String_Trim(String *string);
 
+/**
+ * @brief Release unused capacity (of the bytes and the multibyte index).
+ */
+void String_ShrinkToFit(String *string);
+
 /**
  * @brief Split a string into an array of StringViews.
  * 
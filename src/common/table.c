@@ -338,4 +338,14 @@ size_t Table_GetUsage(const Table *table) {
         return 0;
     }
     return table->used;
-}
\ No newline at end of file
+}
+
+void Table_Clear(Table *table) {
+    if (!table) {
+        return;
+    }
+    for (size_t i=0; i<table->capacity; i++) {
+        TableSlot_Deinit(&table->slots[i], table->key_free_func);
+    }
+    table->used = 0;
+}
@@ -132,4 +132,9 @@ bool Table_HasOwnership(const Table *table, const void *key);
  */
 size_t Table_GetUsage(const Table *table);
 
+/**
+ * @brief Delete all entries but keep the capacity.
+ */
+void Table_Clear(Table *table);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,345 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "threadpool.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "common/logging.h"
+
+// the worker that runs on this thread (NULL on other threads)
+static __thread Worker *current_worker = NULL;
+
+/*****************************************************************************
+ * CancelToken
+ *****************************************************************************/
+
+CancelToken *CancelToken_Create(void) {
+    CancelToken *token = malloc(sizeof(CancelToken));
+    if (!token) {
+        logFatal("Cannot allocate memory for CancelToken.");
+    }
+    atomic_init(&token->cancelled, false);
+    atomic_init(&token->refs, 1);
+    return token;
+}
+
+CancelToken *CancelToken_Retain(CancelToken *token) {
+    if (token) {
+        atomic_fetch_add(&token->refs, 1);
+    }
+    return token;
+}
+
+void CancelToken_Release(CancelToken *token) {
+    if (token && atomic_fetch_sub(&token->refs, 1) == 1) {
+        free(token);
+    }
+}
+
+void CancelToken_Cancel(CancelToken *token) {
+    if (token) {
+        atomic_store(&token->cancelled, true);
+    }
+}
+
+bool CancelToken_IsCancelled(const CancelToken *token) {
+    return token && atomic_load(&((CancelToken*)token)->cancelled);
+}
+
+/*****************************************************************************
+ * TaskDeque
+ *****************************************************************************/
+
+static void deque_init(TaskDeque *deque) {
+    pthread_mutex_init(&deque->mutex, NULL);
+    deque->tasks = NULL;
+    deque->capacity = 0;
+    deque->top = 0;
+    deque->count = 0;
+}
+
+static void deque_deinit(TaskDeque *deque) {
+    free(deque->tasks);
+    pthread_mutex_destroy(&deque->mutex);
+}
+
+static void deque_push_bottom(TaskDeque *deque, Task *task) {
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count == deque->capacity) {
+        size_t capacity = deque->capacity ? deque->capacity * 2 : THREADPOOL_INITIAL_DEQUE_CAPACITY;
+        Task **tasks = malloc(capacity * sizeof(Task*));
+        if (!tasks) {
+            logFatal("Cannot allocate memory for TaskDeque.");
+        }
+        for (size_t i = 0; i < deque->count; i++) {
+            tasks[i] = deque->tasks[(deque->top + i) % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->capacity = capacity;
+        deque->top = 0;
+    }
+    deque->tasks[(deque->top + deque->count) % deque->capacity] = task;
+    deque->count++;
+    pthread_mutex_unlock(&deque->mutex);
+}
+
+static Task *deque_pop_bottom(TaskDeque *deque) {
+    pthread_mutex_lock(&deque->mutex);
+    Task *task = NULL;
+    if (deque->count > 0) {
+        deque->count--;
+        task = deque->tasks[(deque->top + deque->count) % deque->capacity];
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return task;
+}
+
+static Task *deque_steal_top(TaskDeque *deque) {
+    pthread_mutex_lock(&deque->mutex);
+    Task *task = NULL;
+    if (deque->count > 0) {
+        task = deque->tasks[deque->top];
+        deque->top = (deque->top + 1) % deque->capacity;
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return task;
+}
+
+/*****************************************************************************
+ * Workers
+ *****************************************************************************/
+
+// own newest task first, then the oldest one of the others, higher priorities first
+static Task *take_task(Worker *worker) {
+    ThreadPool *pool = worker->pool;
+    for (int priority = 0; priority < THREADPOOL_PRIORITIES; priority++) {
+        Task *task = deque_pop_bottom(&worker->deques[priority]);
+        if (task) {
+            return task;
+        }
+        for (size_t i = 1; i < pool->worker_count; i++) {
+            Worker *victim = &pool->workers[(worker->index + i) % pool->worker_count];
+            task = deque_steal_top(&victim->deques[priority]);
+            if (task) {
+                atomic_fetch_add(&pool->stats.stolen, 1);
+                return task;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void finish_task(ThreadPool *pool, Task *task) {
+    bool sent = Channel_Send(pool->done, task);
+    pthread_mutex_lock(&pool->mutex);
+    if (!sent) {
+        // the main thread is behind, keep it in the overflow list
+        task->next = NULL;
+        if (pool->done_tail) {
+            pool->done_tail->next = task;
+        }
+        else {
+            pool->done_head = task;
+        }
+        pool->done_tail = task;
+    }
+    if (--pool->pending == 0) {
+        pthread_cond_broadcast(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void *worker_thread(void *arg) {
+    Worker *worker = arg;
+    ThreadPool *pool = worker->pool;
+    current_worker = worker;
+    while (true) {
+        Task *task = take_task(worker);
+        if (!task) {
+            pthread_mutex_lock(&pool->mutex);
+            while (pool->queued == 0 && !pool->stopping) {
+                pthread_cond_wait(&pool->wake, &pool->mutex);
+            }
+            bool stop = pool->stopping;
+            pthread_mutex_unlock(&pool->mutex);
+            if (stop) {
+                break;
+            }
+            continue;  // another worker might be faster
+        }
+        pthread_mutex_lock(&pool->mutex);
+        pool->queued--;
+        bool stop = pool->stopping;
+        pthread_mutex_unlock(&pool->mutex);
+
+        task->cancelled = stop || CancelToken_IsCancelled(task->token);
+        if (task->cancelled) {
+            atomic_fetch_add(&pool->stats.cancelled, 1);
+        }
+        else {
+            task->run(task->data, task->token);
+            atomic_fetch_add(&pool->stats.completed, 1);
+        }
+        finish_task(pool, task);
+    }
+    current_worker = NULL;
+    return NULL;
+}
+
+/*****************************************************************************
+ * ThreadPool
+ *****************************************************************************/
+
+ThreadPool *ThreadPool_Create(size_t workers) {
+    if (workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (workers > THREADPOOL_MAX_WORKERS) {
+        workers = THREADPOOL_MAX_WORKERS;
+    }
+    ThreadPool *pool = malloc(sizeof(ThreadPool));
+    if (!pool) {
+        logFatal("Cannot allocate memory for ThreadPool.");
+    }
+    atomic_init(&pool->next_worker, 0);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    pool->queued = 0;
+    pool->pending = 0;
+    pool->stopping = false;
+    pool->done = Channel_Create(THREADPOOL_DONE_CAPACITY);
+    pool->done_head = NULL;
+    pool->done_tail = NULL;
+    atomic_init(&pool->stats.submitted, 0);
+    atomic_init(&pool->stats.completed, 0);
+    atomic_init(&pool->stats.cancelled, 0);
+    atomic_init(&pool->stats.stolen, 0);
+
+    pool->worker_count = workers;
+    for (size_t i = 0; i < workers; i++) {
+        Worker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        for (int priority = 0; priority < THREADPOOL_PRIORITIES; priority++) {
+            deque_init(&worker->deques[priority]);
+        }
+    }
+    // the deques must exist before any worker steals from them
+    for (size_t i = 0; i < workers; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, worker_thread, &pool->workers[i]) != 0) {
+            logFatal("Cannot start worker thread.");
+        }
+    }
+    return pool;
+}
+
+void ThreadPool_Destroy(ThreadPool *pool) {
+    if (!pool) {
+        return;
+    }
+    // queued tasks are finished as cancelled
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+    ThreadPool_WaitIdle(pool);
+    for (size_t i = 0; i < pool->worker_count; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    ThreadPool_Poll(pool);
+
+    for (size_t i = 0; i < pool->worker_count; i++) {
+        for (int priority = 0; priority < THREADPOOL_PRIORITIES; priority++) {
+            deque_deinit(&pool->workers[i].deques[priority]);
+        }
+    }
+    Channel_Destroy(pool->done);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->idle);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+void ThreadPool_Submit(ThreadPool *pool, ThreadPoolPriority priority, TaskRun run, TaskDone done, void *data, CancelToken *token) {
+    Task *task = malloc(sizeof(Task));
+    if (!task) {
+        logFatal("Cannot allocate memory for Task.");
+    }
+    task->run = run;
+    task->done = done;
+    task->data = data;
+    task->token = CancelToken_Retain(token);
+    task->cancelled = false;
+    task->next = NULL;
+
+    Worker *worker = current_worker && current_worker->pool == pool
+                     ? current_worker
+                     : &pool->workers[atomic_fetch_add(&pool->next_worker, 1) % pool->worker_count];
+    // counted before it's visible, so a fast worker never decrements first
+    pthread_mutex_lock(&pool->mutex);
+    pool->pending++;
+    pool->queued++;
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+    deque_push_bottom(&worker->deques[priority], task);
+    atomic_fetch_add(&pool->stats.submitted, 1);
+}
+
+static void call_done(Task *task) {
+    if (task->done) {
+        task->done(task->data, task->cancelled);
+    }
+    CancelToken_Release(task->token);
+    free(task);
+}
+
+size_t ThreadPool_Poll(ThreadPool *pool) {
+    size_t count = 0;
+    void *item;
+    while (Channel_Receive(pool->done, &item)) {
+        call_done(item);
+        count++;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    Task *task = pool->done_head;
+    pool->done_head = NULL;
+    pool->done_tail = NULL;
+    pthread_mutex_unlock(&pool->mutex);
+    while (task) {
+        Task *next = task->next;
+        call_done(task);
+        task = next;
+        count++;
+    }
+    return count;
+}
+
+int ThreadPool_Fd(const ThreadPool *pool) {
+    return pool ? Channel_Fd(pool->done) : -1;
+}
+
+void ThreadPool_WaitIdle(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->idle, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
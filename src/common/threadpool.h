@@ -0,0 +1,188 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file threadpool.h
+ * @brief Fixed pool of worker threads for background work.
+ *
+ * Every worker owns one deque per priority. Tasks submitted by a worker go
+ * to its own deques, tasks from other threads are spread round robin. A
+ * worker takes its newest task first (the data is still in its cache) and
+ * steals the oldest task of another worker if it has nothing to do. All
+ * THREADPOOL_PRIORITY_HIGH tasks (e.g. the lines on the screen) are taken
+ * before any THREADPOOL_PRIORITY_LOW task (e.g. the whole document).
+ *
+ * Cancellation is cooperative: a task gets a CancelToken and should return
+ * early once it's cancelled. Tasks whose token is cancelled before they
+ * started are not run at all.
+ *
+ * The results are handed back to the main thread: finished tasks go through
+ * a lock-free Channel (see channel.h) whose file descriptor wakes the main
+ * loop, and ThreadPool_Poll() runs their `done` callbacks, so they can touch
+ * the editor state without locking.
+ *
+ * Usage:
+ * ```
+ * ThreadPool *pool = ThreadPool_Create(0);
+ * CancelToken *token = CancelToken_Create();
+ * ThreadPool_Submit(pool, THREADPOOL_PRIORITY_LOW, count_words, words_counted, job, token);
+ * // in the main loop
+ * ThreadPool_Poll(pool);
+ * // the result is not needed anymore
+ * CancelToken_Cancel(token);
+ * CancelToken_Release(token);
+ * ```
+ */
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "channel.h"
+
+#define THREADPOOL_MAX_WORKERS 16
+#define THREADPOOL_INITIAL_DEQUE_CAPACITY 64
+#define THREADPOOL_DONE_CAPACITY 1024  //< finished tasks the main thread can fall behind before the overflow list is used
+
+typedef enum {
+    THREADPOOL_PRIORITY_HIGH,   //< needed for the next frame
+    THREADPOOL_PRIORITY_LOW,    //< whole document work
+    THREADPOOL_PRIORITIES
+} ThreadPoolPriority;
+
+/**
+ * @brief Reference counted cancellation flag shared by the submitter and its tasks.
+ */
+typedef struct _CancelToken {
+    atomic_bool cancelled;
+    atomic_size_t refs;
+} CancelToken;
+
+CancelToken *CancelToken_Create(void);
+CancelToken *CancelToken_Retain(CancelToken *token);
+void CancelToken_Release(CancelToken *token);
+void CancelToken_Cancel(CancelToken *token);
+bool CancelToken_IsCancelled(const CancelToken *token);  //< false for NULL
+
+/**
+ * @brief Work done by a worker thread, it should check token regularly.
+ */
+typedef void (*TaskRun)(void *data, const CancelToken *token);
+
+/**
+ * @brief Called on the main thread by ThreadPool_Poll() when the task is finished.
+ *
+ * @param cancelled true if the task was cancelled before it was run.
+ */
+typedef void (*TaskDone)(void *data, bool cancelled);
+
+typedef struct _Task {
+    TaskRun run;
+    TaskDone done;
+    void *data;
+    CancelToken *token;
+    bool cancelled;
+    struct _Task *next;         //< overflow list of finished tasks
+} Task;
+
+/**
+ * @brief Ring buffer of tasks, the owner uses the bottom, thieves the top.
+ */
+typedef struct _TaskDeque {
+    pthread_mutex_t mutex;
+    Task **tasks;
+    size_t capacity;
+    size_t top;                 //< index of the oldest task
+    size_t count;
+} TaskDeque;
+
+typedef struct _ThreadPoolStats {
+    atomic_size_t submitted;
+    atomic_size_t completed;    //< tasks that were run
+    atomic_size_t cancelled;    //< tasks that were skipped
+    atomic_size_t stolen;       //< tasks taken from the deque of another worker
+} ThreadPoolStats;
+
+struct _ThreadPool;
+
+typedef struct _Worker {
+    struct _ThreadPool *pool;
+    size_t index;
+    pthread_t thread;
+    TaskDeque deques[THREADPOOL_PRIORITIES];
+} Worker;
+
+typedef struct _ThreadPool {
+    Worker workers[THREADPOOL_MAX_WORKERS];
+    size_t worker_count;
+    atomic_size_t next_worker;  //< round robin for tasks from other threads
+
+    pthread_mutex_t mutex;      //< protects the fields below
+    pthread_cond_t wake;        //< signaled when there is a task or the pool stops
+    pthread_cond_t idle;        //< signaled when the last pending task is finished
+    size_t queued;              //< tasks in the deques
+    size_t pending;             //< tasks submitted but not finished
+    bool stopping;
+    Task *done_head;            //< finished tasks that did not fit into `done`
+    Task *done_tail;
+
+    Channel *done;              //< finished tasks for ThreadPool_Poll()
+
+    ThreadPoolStats stats;
+} ThreadPool;
+
+/**
+ * @brief Start the workers.
+ *
+ * @param workers Number of threads, 0 for one per CPU (at most THREADPOOL_MAX_WORKERS).
+ */
+ThreadPool *ThreadPool_Create(size_t workers);
+
+/**
+ * @brief Cancel all queued tasks, wait for the running ones and free the pool.
+ *
+ * The done callbacks of all tasks are called, so their data can be freed.
+ */
+void ThreadPool_Destroy(ThreadPool *pool);
+
+/**
+ * @brief Queue a task.
+ *
+ * @param done Called from ThreadPool_Poll() on the main thread (may be NULL).
+ * @param token May be NULL, the task keeps a reference.
+ */
+void ThreadPool_Submit(ThreadPool *pool, ThreadPoolPriority priority, TaskRun run, TaskDone done, void *data, CancelToken *token);
+
+/**
+ * @brief Run the done callbacks of the finished tasks. Call this from the main loop.
+ *
+ * @returns The number of finished tasks.
+ */
+size_t ThreadPool_Poll(ThreadPool *pool);
+
+/**
+ * @brief File descriptor that becomes readable when a task is finished (-1 if not available).
+ */
+int ThreadPool_Fd(const ThreadPool *pool);
+
+/**
+ * @brief Block until every submitted task is finished (the done callbacks still need ThreadPool_Poll()).
+ */
+void ThreadPool_WaitIdle(ThreadPool *pool);
+
+#endif
@@ -152,6 +152,31 @@ void Canvas_PutChar(Canvas *canvas, uint32_t cp) {
     canvas->cursor_x += utf8_calc_width(cp); // Move cursor to the right. Wrapping is handled by the caller or by subsequent calls.
 }
 
+void Canvas_PutChars(Canvas *canvas, const uint32_t *cps, size_t count) {
+    if (canvas->cursor_y < 0 || canvas->cursor_y >= canvas->height) {
+        for (size_t i = 0; i < count; i++) {
+            canvas->cursor_x += utf8_calc_width(cps[i]);
+        }
+        return;
+    }
+    Cell *row = &canvas->buffer[canvas->cursor_y * canvas->width];
+    const Style style = canvas->current_style;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t cp = cps[i];
+        int x = canvas->cursor_x;
+        if (x >= 0 && x < canvas->width) {
+            Cell *cell = &row[x];
+            if (cell->cp != cp || !Style_Equal(&cell->style, &style)) {
+                cell->cp = cp;
+                cell->style = style;
+                cell->changed = true;
+            }
+        }
+        // printable ASCII needs no wcwidth()
+        canvas->cursor_x += cp >= 0x20 && cp < 0x7f ? 1 : utf8_calc_width(cp);
+    }
+}
+
 void Canvas_Write(Canvas *canvas, const String *s) {
     StringView limited = String_ToView(s);
 
@@ -133,6 +133,18 @@ void Canvas_MoveCursor(Canvas *canvas, int col, int row);
  */
 void Canvas_PutChar(Canvas *canvas, uint32_t cp);
 
+/**
+ * @brief Puts `count` characters with the current style at the cursor position.
+ *
+ * The same as calling `Canvas_PutChar` for each of them, but the row is only
+ * checked once, so it's meant for drawing runs of equally styled text.
+ *
+ * @param canvas A pointer to the Canvas object.
+ * @param cps The code points to put on the canvas.
+ * @param count The number of code points.
+ */
+void Canvas_PutChars(Canvas *canvas, const uint32_t *cps, size_t count);
+
 /**
  * @brief Writes a UTF8String to the canvas starting at the current cursor position.
  *
@@ -0,0 +1,133 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "backgroundsave.h"
+
+#include <stdlib.h>
+#include "textio.h"
+#include "linepager.h"
+#include "common/logging.h"
+
+static void *save_thread(void *arg) {
+    BackgroundSave *bs = arg;
+    TextSnapshot *snap = bs->snapshot;
+    const char *bytes[BACKGROUNDSAVE_BATCH];
+    size_t lengths[BACKGROUNDSAVE_BATCH];
+    const LineBlock *blocks[BACKGROUNDSAVE_BATCH];  // of paged out lines (bytes is NULL then)
+    int64_t offsets[BACKGROUNDSAVE_BATCH];
+    LinePagerScratch scratch;
+    LinePagerScratch_Init(&scratch);
+
+    Line *line = snap->first;
+    bool ok = true;
+    while (line && ok) {
+        // collect a batch of lines, the bytes stay valid after unlocking
+        int n = 0;
+        TextSnapshot_Lock(snap);
+        while (line && n < BACKGROUNDSAVE_BATCH) {
+            const String *text = TextSnapshot_Text(snap, line);
+            bytes[n] = line->paged_out ? NULL : text->bytes;
+            lengths[n] = text->bytes_size;
+            blocks[n] = line->block;
+            offsets[n] = line->block ? line->block_offset : line->disk_offset;
+            n++;
+            line = TextSnapshot_Next(snap, line);
+        }
+        TextSnapshot_Unlock(snap);
+
+        for (int i = 0; i < n && ok; i++) {
+            if (bytes[i]) {
+                ok = FileWriter_Write(bs->fw, bytes[i], lengths[i]);
+            }
+            else {
+                ok = LinePager_WritePagedOut(bs->tb->pager, bs->fw, &scratch, blocks[i], offsets[i], lengths[i]);
+            }
+            ok = ok && FileWriter_Write(bs->fw, "\n", 1);
+        }
+
+        TextSnapshot_Lock(snap);
+        bs->lines_written += n;
+        TextSnapshot_Unlock(snap);
+    }
+    ok = ok && FileWriter_Commit(bs->fw, bs->sync);
+    LinePagerScratch_Deinit(&scratch);
+
+    TextSnapshot_Lock(snap);
+    bs->ok = ok;
+    bs->finished = true;
+    TextSnapshot_Unlock(snap);
+    return NULL;
+}
+
+BackgroundSave *BackgroundSave_Start(TextBuffer *tb, const char *path, bool sync) {
+    if (tb->snapshot) {
+        logWarn("Cannot save in background, the TextBuffer already has a snapshot.");
+        return NULL;
+    }
+    FileWriter *fw = FileWriter_Open(path);
+    if (!fw) {
+        return NULL;
+    }
+    BackgroundSave *bs = malloc(sizeof(BackgroundSave));
+    if (!bs) {
+        logFatal("Cannot allocate memory for BackgroundSave.");
+    }
+    bs->tb = tb;
+    bs->snapshot = TextBuffer_TakeSnapshot(tb);
+    bs->fw = fw;
+    bs->sync = sync;
+    bs->lines_written = 0;
+    bs->finished = false;
+    bs->ok = false;
+
+    if (pthread_create(&bs->thread, NULL, save_thread, bs) != 0) {
+        logError("Cannot start thread for saving.");
+        TextBuffer_ReleaseSnapshot(tb);
+        FileWriter_Close(fw);
+        free(bs);
+        return NULL;
+    }
+    return bs;
+}
+
+bool BackgroundSave_Poll(BackgroundSave *bs, double *progress) {
+    TextSnapshot_Lock(bs->snapshot);
+    bool finished = bs->finished;
+    if (progress) {
+        size_t total = bs->snapshot->line_count;
+        *progress = total == 0 ? 1.0 : (double)bs->lines_written / (double)total;
+    }
+    TextSnapshot_Unlock(bs->snapshot);
+    return finished;
+}
+
+bool BackgroundSave_Finish(BackgroundSave *bs, FileWriterStats *stats) {
+    pthread_join(bs->thread, NULL);
+    bool ok = bs->ok;
+    if (stats) {
+        *stats = bs->fw->stats;
+    }
+    // the lines only match the file if nothing changed while saving
+    if (ok && !bs->snapshot->states) {
+        TextBuffer_MarkSaved(bs->tb, bs->fw->path);
+    }
+    else {
+        TextBuffer_InvalidateDiskState(bs->tb);
+    }
+    FileWriter_Close(bs->fw);
+    TextBuffer_ReleaseSnapshot(bs->tb);
+    free(bs);
+    return ok;
+}
@@ -0,0 +1,88 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file backgroundsave.h
+ * @brief Save a TextBuffer in a worker thread while editing goes on.
+ *
+ * A TextSnapshot of the buffer is taken (O(1)) and streamed to disk by a
+ * FileWriter in a separate thread. The main loop polls the progress and
+ * finishes the job when the worker is done.
+ *
+ * Usage:
+ * ```
+ * BackgroundSave *bs = BackgroundSave_Start(&tb, "foo.txt", true);
+ * // in the main loop
+ * double progress;
+ * if (BackgroundSave_Poll(bs, &progress)) {
+ *     bool ok = BackgroundSave_Finish(bs, NULL);
+ * }
+ * ```
+ */
+#ifndef BACKGROUNDSAVE_H
+#define BACKGROUNDSAVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "textbuffer.h"
+#include "textsnapshot.h"
+#include "io/filewriter.h"
+
+#define BACKGROUNDSAVE_BATCH 512   //< number of lines collected per lock of the snapshot
+
+typedef struct _BackgroundSave {
+    TextBuffer *tb;
+    TextSnapshot *snapshot;
+    FileWriter *fw;
+    bool sync;
+    pthread_t thread;
+
+    // protected by the lock of the snapshot
+    size_t lines_written;
+    bool finished;
+    bool ok;
+} BackgroundSave;
+
+/**
+ * @brief Take a snapshot of tb and start writing it to path.
+ *
+ * @param sync If true the data is `fsync()`ed before the file is replaced.
+ * @returns The running job or NULL if the file cannot be created or tb
+ *          already has a snapshot (e.g. another save is running).
+ */
+BackgroundSave *BackgroundSave_Start(TextBuffer *tb, const char *path, bool sync);
+
+/**
+ * @brief Check the state of the job without blocking.
+ *
+ * @param progress If not NULL it is set to the written fraction (0..1).
+ * @returns true if the worker is done.
+ */
+bool BackgroundSave_Poll(BackgroundSave *bs, double *progress);
+
+/**
+ * @brief Wait for the worker, release the snapshot and free the job.
+ *
+ * If the buffer was not changed while saving, it remembers the saved file
+ * for incremental saves (see TextBuffer_SaveTail()).
+ *
+ * @param stats If not NULL it is filled with the statistics of the writer.
+ * @returns true if the file was saved.
+ */
+bool BackgroundSave_Finish(BackgroundSave *bs, FileWriterStats *stats);
+
+#endif
@@ -0,0 +1,216 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE  // madvise()
+#include "fileview.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "common/logging.h"
+
+static uint64_t page_size(void) {
+    static uint64_t size = 0;
+    if (size == 0) {
+        long s = sysconf(_SC_PAGESIZE);
+        size = s > 0 ? (uint64_t)s : 4096;
+    }
+    return size;
+}
+
+static Line *create_line(const char *bytes, size_t length, uint64_t offset) {
+    if (length > 0 && bytes[length - 1] == '\r') {
+        length--;
+    }
+    Line *line = Line_Create();
+    String_Set(&line->text, String_FromCStr(bytes, length));
+    line->disk_offset = offset;
+    return line;
+}
+
+// don't split in the middle of an UTF-8 sequence
+static bool is_continuation_byte(char c) {
+    return ((unsigned char)c & 0xC0) == 0x80;
+}
+
+// create the line starting at offset and set *next to the offset of the following one
+static Line *read_line_at(const FileView *fv, uint64_t offset, uint64_t *next) {
+    const char *bytes = fv->data + offset;
+    size_t max = fv->size - offset < FILEVIEW_MAX_LINE ? fv->size - offset : FILEVIEW_MAX_LINE;
+    const char *newline = memchr(bytes, '\n', max);
+    if (newline) {
+        *next = offset + (newline - bytes) + 1;
+        return create_line(bytes, newline - bytes, offset);
+    }
+    size_t length = max;
+    while (offset + length < fv->size && length > 1 && is_continuation_byte(bytes[length])) {
+        length--;
+    }
+    *next = offset + length;
+    return create_line(bytes, length, offset);
+}
+
+// create the line that ends at end (the start of a loaded line) and set *start to its offset
+static Line *read_line_before(const FileView *fv, uint64_t end, uint64_t *start) {
+    uint64_t text_end = fv->data[end - 1] == '\n' ? end - 1 : end;
+    uint64_t limit = text_end > FILEVIEW_MAX_LINE ? text_end - FILEVIEW_MAX_LINE : 0;
+    uint64_t offset = text_end;
+    while (offset > limit && fv->data[offset - 1] != '\n') {
+        offset--;
+    }
+    while (offset > 0 && fv->data[offset - 1] != '\n' && offset < text_end && is_continuation_byte(fv->data[offset])) {
+        offset++;  // split line
+    }
+    *start = offset;
+    return create_line(fv->data + offset, text_end - offset, offset);
+}
+
+// give pages far away from the window back to the kernel
+static void release_pages(FileView *fv) {
+    uint64_t page = page_size();
+    if (fv->start > fv->touched_start + 2 * FILEVIEW_KEEP_MAPPED) {
+        uint64_t from = fv->touched_start / page * page;
+        uint64_t to = (fv->start - FILEVIEW_KEEP_MAPPED) / page * page;
+        madvise((void*)(fv->data + from), to - from, MADV_DONTNEED);
+        fv->touched_start = to;
+    }
+    if (fv->touched_end > fv->end + 2 * FILEVIEW_KEEP_MAPPED) {
+        uint64_t from = (fv->end + FILEVIEW_KEEP_MAPPED + page - 1) / page * page;
+        madvise((void*)(fv->data + from), fv->touched_end - from, MADV_DONTNEED);
+        fv->touched_end = from;
+    }
+}
+
+FileView *FileView_Open(const char *path, TextBuffer *tb) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+    FileView *fv = malloc(sizeof(FileView));
+    if (!fv) {
+        logFatal("Cannot allocate memory for FileView.");
+    }
+    fv->fd = fd;
+    fv->size = (uint64_t)st.st_size;
+    fv->data = NULL;
+    if (fv->size > 0) {
+        void *data = mmap(NULL, fv->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            logError("Cannot map %s: %s", path, strerror(errno));
+            close(fd);
+            free(fv);
+            return NULL;
+        }
+        fv->data = data;
+    }
+    fv->start = 0;
+    fv->end = 0;
+    fv->touched_start = 0;
+    fv->touched_end = 0;
+
+    TextBuffer_ReInit(tb);
+    if (fv->size > 0) {
+        // the empty line of the new buffer gets the first line
+        uint64_t next;
+        Line *first = read_line_at(fv, 0, &next);
+        String_Take(&tb->current_line->text, &first->text);
+        tb->current_line->disk_offset = 0;
+        Line_Destroy(first);
+        fv->end = next;
+        fv->touched_end = next;
+    }
+    FileView_Update(fv, tb, tb->current_line, 0);
+    return fv;
+}
+
+void FileView_Close(FileView *fv) {
+    if (!fv) {
+        return;
+    }
+    if (fv->data) {
+        munmap((void*)fv->data, fv->size);
+    }
+    close(fv->fd);
+    free(fv);
+}
+
+void FileView_Update(FileView *fv, TextBuffer *tb, const Line *first_visible, int height) {
+    if (!fv || !fv->data || !first_visible) {
+        return;
+    }
+    size_t before = 0;
+    Line *first = (Line*)first_visible;
+    while (first->prev) {
+        first = first->prev;
+        before++;
+    }
+    size_t after = 0;
+    Line *last = (Line*)first_visible;
+    while (last->next) {
+        last = last->next;
+        after++;
+    }
+    size_t wanted_after = FILEVIEW_MARGIN + (height > 0 ? height : 0);
+
+    // load lines towards the screen
+    while (before < FILEVIEW_MARGIN && fv->start > 0) {
+        first = read_line_before(fv, fv->start, &fv->start);
+        TextBuffer_InsertLineAtTop(tb, first);
+        tb->line_number_offset--;
+        before++;
+    }
+    while (after < wanted_after && fv->end < fv->size) {
+        last = read_line_at(fv, fv->end, &fv->end);
+        TextBuffer_InsertLineAtBottom(tb, last);
+        after++;
+    }
+
+    // drop lines that are far away (twice the margin, so scrolling back and forth doesn't thrash)
+    if (before > 2 * FILEVIEW_MARGIN) {
+        while (before > FILEVIEW_MARGIN) {
+            Line *next = first->next;
+            TextBuffer_DeleteLine(tb, first);
+            tb->line_number_offset++;
+            first = next;
+            before--;
+        }
+        fv->start = first->disk_offset;
+    }
+    if (after > 2 * wanted_after) {
+        while (after > wanted_after) {
+            Line *prev = last->prev;
+            fv->end = last->disk_offset;
+            TextBuffer_DeleteLine(tb, last);
+            last = prev;
+            after--;
+        }
+    }
+
+    if (fv->start < fv->touched_start) {
+        fv->touched_start = fv->start;
+    }
+    if (fv->end > fv->touched_end) {
+        fv->touched_end = fv->end;
+    }
+    release_pages(fv);
+}
@@ -0,0 +1,68 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file fileview.h
+ * @brief Read-only view of huge files with bounded memory.
+ *
+ * The file is mapped with `mmap()` and the TextBuffer only holds a window of
+ * lines around the screen. FileView_Update() materializes lines at one end of
+ * the window while the user scrolls towards it and drops them at the other
+ * end, so the number of `Line` objects does not depend on the file size.
+ * Pages of the mapping far away from the window are given back to the kernel.
+ *
+ * The first line of the buffer is line number tb->line_number_offset of the
+ * file. Lines longer than FILEVIEW_MAX_LINE bytes are split.
+ */
+#ifndef FILEVIEW_H
+#define FILEVIEW_H
+
+#include <stdint.h>
+#include "textbuffer.h"
+
+#define FILEVIEW_MARGIN 256                         //< lines kept in front of and behind the screen
+#define FILEVIEW_MAX_LINE (64 * 1024)               //< longer lines are split into several lines
+#define FILEVIEW_KEEP_MAPPED (8 * 1024 * 1024)      //< mapped bytes around the window that stay in memory
+
+typedef struct _FileView {
+    int fd;
+    const char *data;       //< the mapped file (NULL if it is empty)
+    uint64_t size;
+
+    uint64_t start;         //< file offset of the first line in the buffer
+    uint64_t end;           //< file offset behind the last line in the buffer
+
+    uint64_t touched_start; //< pages outside [touched_start, touched_end) are not in memory
+    uint64_t touched_end;
+} FileView;
+
+/**
+ * @brief Map path and load the lines at the beginning of the file into tb.
+ *
+ * @returns The view or NULL if the file cannot be opened.
+ */
+FileView *FileView_Open(const char *path, TextBuffer *tb);
+void FileView_Close(FileView *fv);
+
+/**
+ * @brief Move the window of loaded lines, so there are FILEVIEW_MARGIN lines around the screen.
+ *
+ * The cost depends on the window size only. first_visible must be part of tb
+ * and the current line must be on screen (it is never dropped).
+ */
+void FileView_Update(FileView *fv, TextBuffer *tb, const Line *first_visible, int height);
+
+#endif
@@ -0,0 +1,556 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "journal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include "textselection.h"
+#include "io/filewriter.h"
+#include "common/logging.h"
+
+typedef struct _JournalHeader {
+    char magic[8];
+    uint64_t document_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} JournalHeader;
+
+static void header_for_document(JournalHeader *header, const char *document_path) {
+    memset(header, 0, sizeof(JournalHeader));
+    memcpy(header->magic, JOURNAL_MAGIC, sizeof(header->magic));
+    struct stat st;
+    if (stat(document_path, &st) == 0) {
+        header->document_size = (uint64_t)st.st_size;
+        header->mtime_sec = (int64_t)st.st_mtim.tv_sec;
+        header->mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+    }
+}
+
+char *Journal_PathFor(const char *document_path) {
+    char *dir_buf = strdup(document_path);
+    char *base_buf = strdup(document_path);
+    if (!dir_buf || !base_buf) {
+        logFatal("Cannot allocate memory for journal path.");
+    }
+    const char *dir = dirname(dir_buf);
+    const char *base = basename(base_buf);
+    size_t size = strlen(dir) + strlen(base) + 16;
+    char *path = malloc(size);
+    if (!path) {
+        logFatal("Cannot allocate memory for journal path.");
+    }
+    snprintf(path, size, "%s/.%s.journal", dir, base);
+    free(dir_buf);
+    free(base_buf);
+    return path;
+}
+
+/*****************************************************************************
+ * Replay
+ *****************************************************************************/
+
+static char *read_all(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+    char *data = malloc((size_t)st.st_size + 1);
+    if (!data) {
+        logFatal("Cannot allocate memory for journal.");
+    }
+    size_t total = 0;
+    while (total < (size_t)st.st_size) {
+        ssize_t n = read(fd, data + total, (size_t)st.st_size - total);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        total += (size_t)n;
+    }
+    close(fd);
+    *size = total;
+    return data;
+}
+
+typedef struct _Reader {
+    const char *data;
+    size_t size;
+    size_t offset;
+} Reader;
+
+static bool read_bytes(Reader *r, void *out, size_t n) {
+    if (r->size - r->offset < n) {
+        return false;
+    }
+    memcpy(out, r->data + r->offset, n);
+    r->offset += n;
+    return true;
+}
+
+static bool apply_insert(TextBuffer *tb, Line *line, uint32_t col, const char *bytes, uint32_t length) {
+    if (col > String_Length(&line->text)) {
+        return false;
+    }
+    // let the gap do the work
+    tb->current_line = line;
+    tb->gap.position = col;
+    tb->gap.overlap = 0;
+    String_Set(&tb->gap.text, String_FromCStr(bytes, length));
+    TextBuffer_MergeGap(tb);
+    return true;
+}
+
+static bool apply_delete(TextBuffer *tb, Line *line, uint32_t col) {
+    size_t length = String_Length(&line->text);
+    if (col > length) {
+        return false;
+    }
+    tb->current_line = line;
+    if (col == length) {
+        TextBuffer_JoinNextLine(tb);
+        return true;
+    }
+    tb->gap.position = col + 1;
+    tb->gap.overlap = 1;
+    TextBuffer_MergeGap(tb);
+    return true;
+}
+
+static bool apply_newline(TextBuffer *tb, Line *line, uint32_t col) {
+    if (col > String_Length(&line->text)) {
+        return false;
+    }
+    tb->current_line = line;
+    tb->gap.position = col;
+    TextBuffer_SplitLine(tb);
+    return true;
+}
+
+static bool apply_record(TextBuffer *tb, Reader *r, bool *truncated) {
+    uint8_t op;
+    uint64_t line_number;
+    uint32_t col;
+    size_t start = r->offset;
+    *truncated = true;
+    if (!read_bytes(r, &op, 1) || !read_bytes(r, &line_number, 8) || !read_bytes(r, &col, 4)) {
+        return false;
+    }
+    Line *line = TextBuffer_GetLine(tb, line_number);
+
+    switch (op) {
+        case JOURNAL_OP_INSERT: {
+            uint32_t length;
+            if (!read_bytes(r, &length, 4) || r->size - r->offset < length) {
+                r->offset = start;
+                return false;
+            }
+            const char *bytes = r->data + r->offset;
+            r->offset += length;
+            *truncated = false;
+            return line && apply_insert(tb, line, col, bytes, length);
+        }
+        case JOURNAL_OP_DELETE:
+            *truncated = false;
+            return line && apply_delete(tb, line, col);
+        case JOURNAL_OP_NEWLINE:
+            *truncated = false;
+            return line && apply_newline(tb, line, col);
+        case JOURNAL_OP_DELETE_RANGE: {
+            uint64_t end_line_number;
+            uint32_t end_col;
+            if (!read_bytes(r, &end_line_number, 8) || !read_bytes(r, &end_col, 4)) {
+                r->offset = start;
+                return false;
+            }
+            *truncated = false;
+            Line *end_line = TextBuffer_GetLine(tb, end_line_number);
+            if (!line || !end_line || col > String_Length(&line->text) || end_col > String_Length(&end_line->text)) {
+                return false;
+            }
+            TextSelection sel = { .start = line, .start_idx = col, .end = end_line, .end_idx = end_col };
+            TextSelection_Delete(&sel, tb);
+            return true;
+        }
+        default:
+            *truncated = false;
+            return false;
+    }
+}
+
+JournalReplayResult Journal_Replay(TextBuffer *tb, const char *document_path, size_t *records) {
+    if (records) {
+        *records = 0;
+    }
+    char *path = Journal_PathFor(document_path);
+    size_t size;
+    char *data = read_all(path, &size);
+    free(path);
+    if (!data) {
+        return JOURNAL_REPLAY_NONE;
+    }
+
+    JournalHeader header, expected;
+    Reader r = { .data = data, .size = size, .offset = 0 };
+    if (!read_bytes(&r, &header, sizeof(JournalHeader)) || memcmp(header.magic, JOURNAL_MAGIC, sizeof(header.magic)) != 0) {
+        logError("Invalid journal for %s.", document_path);
+        free(data);
+        return JOURNAL_REPLAY_INVALID;
+    }
+    header_for_document(&expected, document_path);
+    if (memcmp(&header, &expected, sizeof(JournalHeader)) != 0) {
+        free(data);
+        return JOURNAL_REPLAY_STALE;
+    }
+
+    Journal *journal = tb->journal;
+    tb->journal = NULL;  // don't record the replay
+    TextBuffer_MergeGap(tb);
+
+    JournalReplayResult result = JOURNAL_REPLAY_OK;
+    size_t count = 0;
+    while (r.offset < r.size) {
+        bool truncated;
+        size_t record_start = r.offset;
+        if (!apply_record(tb, &r, &truncated)) {
+            // a torn record at the end is expected after a crash
+            if (!truncated) {
+                logError("Invalid record in journal of %s.", document_path);
+                result = JOURNAL_REPLAY_ERROR;
+            }
+            // the record is cut off too, new records must not be appended behind it
+            r.offset = record_start;
+            break;
+        }
+        count++;
+    }
+
+    if (r.offset < r.size) {
+        // drop everything that was not applied, so the journal can be continued
+        char *path = Journal_PathFor(document_path);
+        if (truncate(path, (off_t)r.offset) != 0) {
+            logError("Cannot truncate journal %s: %s", path, strerror(errno));
+        }
+        free(path);
+    }
+
+    tb->current_line = TextBuffer_GetFirstLine(tb);
+    tb->gap.position = 0;
+    tb->journal = journal;
+    free(data);
+    if (records) {
+        *records = count;
+    }
+    return result;
+}
+
+char *Journal_KeepStale(const char *document_path) {
+    char *path = Journal_PathFor(document_path);
+    size_t size = strlen(path) + 7;
+    char *stale_path = malloc(size);
+    if (!stale_path) {
+        logFatal("Cannot allocate memory for journal path.");
+    }
+    snprintf(stale_path, size, "%s.stale", path);
+    if (rename(path, stale_path) != 0) {
+        logError("Cannot keep journal %s: %s", path, strerror(errno));
+        free(stale_path);
+        stale_path = NULL;
+    }
+    free(path);
+    return stale_path;
+}
+
+/*****************************************************************************
+ * Recording
+ *****************************************************************************/
+
+static bool write_all(Journal *j, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(j->fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logError("Cannot write journal %s: %s", j->path, strerror(errno));
+            j->failed = true;
+            return false;
+        }
+        data += n;
+        size -= (size_t)n;
+        j->written += (size_t)n;
+    }
+    return true;
+}
+
+static int open_journal(const char *path, bool truncate) {
+    int flags = O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0);
+    int fd = open(path, flags, 0600);
+    if (fd < 0) {
+        logError("Cannot open journal %s: %s", path, strerror(errno));
+    }
+    return fd;
+}
+
+Journal *Journal_Create(const char *document_path, bool append) {
+    Journal *j = malloc(sizeof(Journal));
+    if (!j) {
+        logFatal("Cannot allocate memory for Journal.");
+    }
+    j->path = Journal_PathFor(document_path);
+    j->document_path = strdup(document_path);
+    j->pending = NULL;
+    j->pending_size = 0;
+    j->pending_capacity = 0;
+    j->written = 0;
+    j->unsynced = false;
+    j->failed = false;
+    j->last_insert = SIZE_MAX;
+    j->record_count = 0;
+
+    if (append) {
+        j->fd = open_journal(j->path, false);
+        struct stat st;
+        if (j->fd >= 0 && fstat(j->fd, &st) == 0 && (size_t)st.st_size >= sizeof(JournalHeader)) {
+            j->written = (size_t)st.st_size;
+            return j;
+        }
+        if (j->fd >= 0) {
+            close(j->fd);
+        }
+    }
+
+    j->fd = open_journal(j->path, true);
+    JournalHeader header;
+    header_for_document(&header, document_path);
+    if (j->fd < 0 || !write_all(j, (const char*)&header, sizeof(JournalHeader))) {
+        Journal_Destroy(j, false);
+        return NULL;
+    }
+    j->unsynced = true;
+    return j;
+}
+
+void Journal_Destroy(Journal *j, bool remove) {
+    if (!j) {
+        return;
+    }
+    if (j->fd >= 0) {
+        if (!remove) {
+            Journal_Sync(j);
+        }
+        close(j->fd);
+    }
+    if (remove) {
+        unlink(j->path);
+    }
+    free(j->pending);
+    free(j->path);
+    free(j->document_path);
+    free(j);
+}
+
+bool Journal_Flush(Journal *j) {
+    if (!j || j->failed) {
+        return false;
+    }
+    if (j->pending_size > 0) {
+        if (!write_all(j, j->pending, j->pending_size)) {
+            return false;
+        }
+        j->pending_size = 0;
+        j->unsynced = true;
+    }
+    j->last_insert = SIZE_MAX;
+    return true;
+}
+
+void Journal_Sync(Journal *j) {
+    if (!j || j->failed) {
+        return;
+    }
+    if (!Journal_Flush(j) || !j->unsynced) {
+        return;
+    }
+    if (fdatasync(j->fd) != 0) {
+        logError("Cannot sync journal %s: %s", j->path, strerror(errno));
+    }
+    j->unsynced = false;
+}
+
+static char *reserve(Journal *j, size_t size) {
+    if (j->pending_size + size > j->pending_capacity) {
+        size_t capacity = j->pending_capacity ? j->pending_capacity * 2 : 4096;
+        while (capacity < j->pending_size + size) {
+            capacity *= 2;
+        }
+        char *pending = realloc(j->pending, capacity);
+        if (!pending) {
+            logFatal("Cannot allocate memory for journal.");
+        }
+        j->pending = pending;
+        j->pending_capacity = capacity;
+    }
+    char *p = j->pending + j->pending_size;
+    j->pending_size += size;
+    return p;
+}
+
+// write the common part of a record
+static char *begin_record(Journal *j, JournalOp op, uint64_t line, uint32_t col, size_t extra) {
+    if (j->pending_size >= JOURNAL_FLUSH_SIZE) {
+        Journal_Flush(j);
+    }
+    j->last_insert = SIZE_MAX;
+    j->record_count++;
+    char *p = reserve(j, 1 + 8 + 4 + extra);
+    p[0] = (char)op;
+    memcpy(p + 1, &line, 8);
+    memcpy(p + 9, &col, 4);
+    return p + 13;
+}
+
+void Journal_RecordInsert(Journal *j, uint64_t line, uint32_t col, const char *bytes, size_t length, uint32_t char_count) {
+    if (!j || j->failed || length == 0) {
+        return;
+    }
+    // typing: extend the last insert record
+    if (j->last_insert != SIZE_MAX && j->last_insert_line == line && j->last_insert_end == col) {
+        char *length_field = j->pending + j->last_insert + 13;
+        uint32_t total;
+        memcpy(&total, length_field, 4);
+        total += (uint32_t)length;
+        memcpy(reserve(j, length), bytes, length);
+        // reserve() might have moved the buffer
+        memcpy(j->pending + j->last_insert + 13, &total, 4);
+        j->last_insert_end += char_count;
+        return;
+    }
+    uint32_t length32 = (uint32_t)length;
+    char *p = begin_record(j, JOURNAL_OP_INSERT, line, col, 4 + length);
+    memcpy(p, &length32, 4);
+    memcpy(p + 4, bytes, length);
+    j->last_insert = j->pending_size - (13 + 4 + length);
+    j->last_insert_line = line;
+    j->last_insert_end = col + char_count;
+}
+
+void Journal_RecordDelete(Journal *j, uint64_t line, uint32_t col) {
+    if (!j || j->failed) {
+        return;
+    }
+    begin_record(j, JOURNAL_OP_DELETE, line, col, 0);
+}
+
+void Journal_RecordNewline(Journal *j, uint64_t line, uint32_t col) {
+    if (!j || j->failed) {
+        return;
+    }
+    begin_record(j, JOURNAL_OP_NEWLINE, line, col, 0);
+}
+
+void Journal_RecordDeleteRange(Journal *j, uint64_t line, uint32_t col, uint64_t end_line, uint32_t end_col) {
+    if (!j || j->failed) {
+        return;
+    }
+    char *p = begin_record(j, JOURNAL_OP_DELETE_RANGE, line, col, 12);
+    memcpy(p, &end_line, 8);
+    memcpy(p + 8, &end_col, 4);
+}
+
+/*****************************************************************************
+ * Saving
+ *****************************************************************************/
+
+size_t Journal_Mark(Journal *j) {
+    if (!j) {
+        return 0;
+    }
+    // records after the mark must not be merged into records before it
+    j->last_insert = SIZE_MAX;
+    return j->written + j->pending_size;
+}
+
+bool Journal_Rebase(Journal *j, size_t mark) {
+    if (!j || j->failed || !Journal_Flush(j)) {
+        return false;
+    }
+    if (mark < sizeof(JournalHeader) || mark > j->written) {
+        logError("Invalid journal mark.");
+        return false;
+    }
+    // the records after the mark stay
+    size_t tail_size = j->written - mark;
+    char *tail = malloc(tail_size + 1);
+    if (!tail) {
+        logFatal("Cannot allocate memory for journal.");
+    }
+    int read_fd = open(j->path, O_RDONLY);
+    size_t got = 0;
+    while (read_fd >= 0 && got < tail_size) {
+        ssize_t n = pread(read_fd, tail + got, tail_size - got, (off_t)(mark + got));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        got += (size_t)n;
+    }
+    if (read_fd >= 0) {
+        close(read_fd);
+    }
+    if (got != tail_size) {
+        logError("Cannot read journal %s.", j->path);
+        free(tail);
+        return false;
+    }
+
+    JournalHeader header;
+    header_for_document(&header, j->document_path);
+    FileWriter *fw = FileWriter_Open(j->path);
+    bool ok = fw
+              && FileWriter_Write(fw, (const char*)&header, sizeof(JournalHeader))
+              && FileWriter_Write(fw, tail, tail_size)
+              && FileWriter_Commit(fw, true);
+    FileWriter_Close(fw);
+    free(tail);
+    if (!ok) {
+        return false;
+    }
+
+    close(j->fd);
+    j->fd = open_journal(j->path, false);
+    if (j->fd < 0) {
+        j->failed = true;
+        return false;
+    }
+    j->written = sizeof(JournalHeader) + tail_size;
+    j->unsynced = false;
+    return true;
+}
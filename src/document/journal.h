@@ -0,0 +1,164 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file journal.h
+ * @brief Append-only journal of all edits for crash recovery.
+ *
+ * Every editing operation is appended as a small binary record to a journal
+ * file next to the document (`.<name>.journal`). Records are collected in
+ * memory and handed to the kernel in batches, `fdatasync()` is done when the
+ * editor is idle. Consecutive typed characters are merged into one record.
+ *
+ * The header of the journal stores size and modification time of the
+ * document it belongs to. If the editor crashes, the journal is found on the
+ * next start and replayed against the (unchanged) document, so recovery
+ * time depends on the number of edits only.
+ *
+ * Positions are line numbers and character indices in the text as the user
+ * sees it (gap applied).
+ *
+ * Layout of a record (native byte order, the journal is machine local):
+ * ```
+ * u8 op | u64 line | u32 col | op specific data
+ *   JOURNAL_OP_INSERT:       u32 length | length bytes
+ *   JOURNAL_OP_DELETE:       -   (delete the char at col, join the next line if col is the line end)
+ *   JOURNAL_OP_NEWLINE:      -
+ *   JOURNAL_OP_DELETE_RANGE: u64 end_line | u32 end_col
+ * ```
+ */
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "textbuffer.h"
+
+#define JOURNAL_MAGIC "CEJRNL01"
+#define JOURNAL_FLUSH_SIZE (64 * 1024)  //< write the pending records if they exceed this size
+
+typedef enum {
+    JOURNAL_OP_INSERT = 1,
+    JOURNAL_OP_DELETE,
+    JOURNAL_OP_NEWLINE,
+    JOURNAL_OP_DELETE_RANGE
+} JournalOp;
+
+typedef enum {
+    JOURNAL_REPLAY_NONE,    //< there is no journal
+    JOURNAL_REPLAY_OK,      //< the journal was replayed
+    JOURNAL_REPLAY_STALE,   //< the journal belongs to another version of the document (ignored)
+    JOURNAL_REPLAY_ERROR,   //< a record could not be applied, the journal was cut off in front of it
+    JOURNAL_REPLAY_INVALID  //< the journal has no valid header (it has to be created again)
+} JournalReplayResult;
+
+typedef struct _Journal {
+    char *path;             //< path of the journal file
+    char *document_path;    //< path of the document
+    int fd;
+
+    char *pending;          //< records not written yet
+    size_t pending_size;
+    size_t pending_capacity;
+
+    size_t written;         //< bytes in the journal file
+    bool unsynced;          //< written but not fdatasync()ed yet
+    bool failed;            //< writing failed, the journal is disabled
+
+    // the last record is an insert that can be extended
+    size_t last_insert;     //< offset of that record in pending (or SIZE_MAX)
+    uint64_t last_insert_line;
+    uint32_t last_insert_end; //< col right after the inserted text
+
+    size_t record_count;
+} Journal;
+
+/**
+ * @brief Return the path of the journal for document_path (caller frees it).
+ */
+char *Journal_PathFor(const char *document_path);
+
+/**
+ * @brief Replay the journal of document_path against tb.
+ *
+ * tb must hold the document as it is on disk. Records that could not be
+ * applied (torn by the crash or invalid) are cut off the journal from the
+ * first of them on, so after JOURNAL_REPLAY_OK and JOURNAL_REPLAY_ERROR it can
+ * be continued with `Journal_Create(document_path, true)`. After
+ * JOURNAL_REPLAY_STALE and JOURNAL_REPLAY_INVALID it is kept with
+ * Journal_KeepStale() and created again.
+ *
+ * @param records If not NULL it is set to the number of replayed records.
+ */
+JournalReplayResult Journal_Replay(TextBuffer *tb, const char *document_path, size_t *records);
+
+/**
+ * @brief Move a journal that cannot be continued aside to `.<name>.journal.stale`.
+ *
+ * Used after JOURNAL_REPLAY_STALE and JOURNAL_REPLAY_INVALID, so its edits can
+ * still be recovered by hand. An older stale journal is replaced.
+ *
+ * @returns The new path (caller frees) or NULL if it could not be moved.
+ */
+char *Journal_KeepStale(const char *document_path);
+
+/**
+ * @brief Start journaling for document_path.
+ *
+ * @param append If true an existing journal (that was replayed) is continued,
+ *               otherwise it is replaced by an empty one.
+ * @returns The journal or NULL if it cannot be created.
+ */
+Journal *Journal_Create(const char *document_path, bool append);
+
+/**
+ * @brief Write everything and close the journal.
+ *
+ * @param remove If true the journal file is deleted (clean shutdown).
+ */
+void Journal_Destroy(Journal *j, bool remove);
+
+/* Recording, all of them do nothing if j is NULL. */
+void Journal_RecordInsert(Journal *j, uint64_t line, uint32_t col, const char *bytes, size_t length, uint32_t char_count);
+void Journal_RecordDelete(Journal *j, uint64_t line, uint32_t col);
+void Journal_RecordNewline(Journal *j, uint64_t line, uint32_t col);
+void Journal_RecordDeleteRange(Journal *j, uint64_t line, uint32_t col, uint64_t end_line, uint32_t end_col);
+
+/**
+ * @brief Hand the pending records to the kernel.
+ */
+bool Journal_Flush(Journal *j);
+
+/**
+ * @brief Flush and `fdatasync()` if needed. Call this when the editor is idle.
+ */
+void Journal_Sync(Journal *j);
+
+/**
+ * @brief Return the current end of the journal.
+ */
+size_t Journal_Mark(Journal *j);
+
+/**
+ * @brief The document was saved with all edits up to mark.
+ *
+ * The journal is rewritten for the new version of the document and keeps only
+ * the records after mark.
+ */
+bool Journal_Rebase(Journal *j, size_t mark);
+
+#endif
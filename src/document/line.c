@@ -15,6 +15,8 @@
  */
 
 #include "line.h"
+#include "lineintern.h"
+#include "syntax/highlighting.h"
 
 #include "common/logging.h"
 
@@ -27,6 +29,15 @@ Line *Line_Create() {
     new_line->prev = NULL;
     new_line->next = NULL;
     new_line->position = 0;
+    new_line->paged_out = false;
+    new_line->referenced = false;
+    new_line->shared = false;
+    new_line->compact_queued = false;
+    new_line->block_offset = 0;
+    new_line->block = NULL;
+    new_line->disk_offset = -1;
+    new_line->snapshot = NULL;
+    new_line->highlight = NULL;
     return new_line;
 }
 
@@ -34,7 +45,15 @@ void Line_Destroy(Line *line) {
     if (!line) {
         return;
     }
-    String_Deinit(&line->text);
+    if (line->shared) {
+        LineIntern_Release(&line->text);
+    }
+    else {
+        String_Deinit(&line->text);
+    }
+    if (line->highlight) {
+        SyntaxHighlightingString_Destroy(line->highlight);
+    }
     free(line);
 }
 
@@ -92,7 +111,7 @@ void Line_InsertAfter(Line *line, Line *new_line) {
     }
 }
 
-void Line_Delete(Line *line) {
+void Line_Unlink(Line *line) {
     if (!line) {
         return;
     }
@@ -102,5 +121,12 @@ void Line_Delete(Line *line) {
     if (line->next) {
         line->next->prev = line->prev;
     }
+}
+
+void Line_Delete(Line *line) {
+    if (!line) {
+        return;
+    }
+    Line_Unlink(line);
     Line_Destroy(line);
 }
\ No newline at end of file
@@ -16,15 +16,33 @@
 #ifndef LINE_H
 #define LINE_H
 
+#include <stdint.h>
 #include "common/string.h"
 
 #define LINE_POSITION_STEP 100
 
+struct _LineSnapshot;
+struct _LineBlock;
+struct _SyntaxHighlightingString;
+
 typedef struct _Line {
     String text;
 
     int position;
 
+    bool paged_out;         //< the text was dropped from memory, only its length is left (see linepager.h)
+    bool referenced;        //< accessed since the last visit of the pager
+    bool shared;            //< text.bytes are shared with identical lines and immutable (see lineintern.h)
+    bool compact_queued;    //< waits in the queue of LinePager_Compact()
+    uint32_t block_offset;  //< offset of the text in block
+    struct _LineBlock *block;   //< compressed block that holds the text of a paged out modified line
+
+    int64_t disk_offset;    //< offset in the file on disk while the line is unmodified, otherwise -1
+
+    struct _LineSnapshot *snapshot;  //< copy-on-write state while a TextSnapshot is alive (see textsnapshot.h)
+
+    struct _SyntaxHighlightingString *highlight;  //< highlighting of text, owned by the line (NULL if it was never highlighted)
+
     struct _Line *prev;
     struct _Line *next;
 } Line;
@@ -35,4 +53,9 @@ void Line_InsertBefore(Line *line, Line *new_line);
 void Line_InsertAfter(Line *line, Line *new_line);
 void Line_Delete(Line *line);
 
+/**
+ * @brief Remove the line from the list without destroying it.
+ */
+void Line_Unlink(Line *line);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,352 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE  // realpath()
+#include "lineindex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>     // PATH_MAX
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "io/filewriter.h"
+#include "common/logging.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define VARINT_MAX_BYTES 10
+#define WRITE_BUFFER_SIZE (64 * 1024)
+
+static uint64_t hash_bytes(uint64_t hash, const void *bytes, size_t size) {
+    const unsigned char *p = bytes;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ p[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+// hash evenly spread samples, so a changed file is noticed without reading all of it
+static bool sample_hash(int fd, uint64_t file_size, uint64_t *hash) {
+    char sample[LINEINDEX_SAMPLE_SIZE];
+    size_t sample_size = file_size < sizeof(sample) ? (size_t)file_size : sizeof(sample);
+    uint64_t last = file_size - sample_size;
+    *hash = FNV_OFFSET;
+    for (uint64_t i = 0; i < LINEINDEX_SAMPLES; i++) {
+        off_t offset = (off_t)(last / (LINEINDEX_SAMPLES - 1) * i);
+        size_t done = 0;
+        while (done < sample_size) {
+            ssize_t n = pread(fd, sample + done, sample_size - done, offset + (off_t)done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            done += (size_t)n;
+        }
+        *hash = hash_bytes(*hash, sample, sample_size);
+    }
+    return true;
+}
+
+static char *cache_dir(void) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char path[PATH_MAX];
+    if (xdg && xdg[0] == '/') {
+        snprintf(path, sizeof(path), "%s/clieditor", xdg);
+    }
+    else if (home) {
+        snprintf(path, sizeof(path), "%s/.cache/clieditor", home);
+    }
+    else {
+        return NULL;
+    }
+    return strdup(path);
+}
+
+// the real path identifies the file, document_path if it cannot be resolved
+static void real_path(const char *document_path, char *resolved) {
+    if (!realpath(document_path, resolved)) {
+        snprintf(resolved, PATH_MAX, "%s", document_path);
+    }
+}
+
+char *LineIndex_PathFor(const char *document_path) {
+    char *dir = cache_dir();
+    if (!dir) {
+        return NULL;
+    }
+    char resolved[PATH_MAX];
+    real_path(document_path, resolved);
+    size_t size = strlen(dir) + 32;
+    char *path = malloc(size);
+    if (!path) {
+        logFatal("Cannot allocate memory for line index path.");
+    }
+    snprintf(path, size, "%s/%016llx.idx", dir, (unsigned long long)hash_bytes(FNV_OFFSET, resolved, strlen(resolved)));
+    free(dir);
+    return path;
+}
+
+static size_t entries_start(uint64_t path_length) {
+    return (sizeof(LineIndexHeader) + (size_t)path_length + 7) & ~(size_t)7;
+}
+
+static bool read_varint(const uint8_t *bytes, size_t size, size_t *position, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 7 * VARINT_MAX_BYTES && *position < size; shift += 7) {
+        uint8_t byte = bytes[(*position)++];
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t write_varint(uint8_t *out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static size_t varint_size(uint64_t value) {
+    size_t n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
+
+// the entries must add up to the file exactly
+static bool check_entries(const LineIndex *index) {
+    LineIndexCursor cursor;
+    LineIndexCursor_Init(&cursor, index);
+    uint64_t offset;
+    size_t length, char_count;
+    uint64_t lines = 0;
+    while (LineIndexCursor_Next(&cursor, &offset, &length, &char_count)) {
+        lines++;
+    }
+    return lines == index->header->line_count
+           && cursor.position == index->header->entries_size
+           && cursor.offset == index->header->file_size;
+}
+
+bool LineIndex_Matches(const LineIndex *index, const struct stat *st) {
+    return index->header->file_size == (uint64_t)st->st_size
+           && index->header->mtime_sec == (int64_t)st->st_mtim.tv_sec
+           && index->header->mtime_nsec == (int64_t)st->st_mtim.tv_nsec;
+}
+
+// check the header against the document, its content is sampled
+static bool matches_document(const LineIndex *index, const char *document_path) {
+    const LineIndexHeader *header = index->header;
+    char resolved[PATH_MAX];
+    real_path(document_path, resolved);
+    if (header->path_length != strlen(resolved)
+        || memcmp(index->data + sizeof(LineIndexHeader), resolved, header->path_length) != 0) {
+        return false;  // hash collision
+    }
+    int fd = open(document_path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    uint64_t hash;
+    bool matches = fstat(fd, &st) == 0 && LineIndex_Matches(index, &st)
+                   && sample_hash(fd, header->file_size, &hash) && hash == header->sample_hash;
+    close(fd);
+    return matches;
+}
+
+LineIndex *LineIndex_Open(const char *document_path) {
+    char *path = LineIndex_PathFor(document_path);
+    if (!path) {
+        return NULL;
+    }
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LineIndexHeader)) {
+        close(fd);
+        return NULL;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    LineIndex *index = malloc(sizeof(LineIndex));
+    if (!index) {
+        logFatal("Cannot allocate memory for LineIndex.");
+    }
+    index->data = data;
+    index->size = (size_t)st.st_size;
+    index->header = data;
+
+    const LineIndexHeader *header = index->header;
+    bool valid = memcmp(header->magic, LINEINDEX_MAGIC, sizeof(header->magic)) == 0
+                 && header->path_length < PATH_MAX && header->entries_size <= index->size
+                 && entries_start(header->path_length) + header->entries_size == index->size;
+    if (valid) {
+        index->entries = (const uint8_t*)index->data + entries_start(header->path_length);
+        valid = matches_document(index, document_path) && check_entries(index);
+    }
+    if (!valid) {
+        LineIndex_Close(index);
+        return NULL;
+    }
+    return index;
+}
+
+void LineIndex_Close(LineIndex *index) {
+    if (!index) {
+        return;
+    }
+    munmap((void*)index->data, index->size);
+    free(index);
+}
+
+void LineIndexCursor_Init(LineIndexCursor *cursor, const LineIndex *index) {
+    cursor->index = index;
+    cursor->position = 0;
+    cursor->offset = 0;
+}
+
+bool LineIndexCursor_Next(LineIndexCursor *cursor, uint64_t *offset, size_t *length, size_t *char_count) {
+    const uint8_t *entries = cursor->index->entries;
+    size_t size = (size_t)cursor->index->header->entries_size;
+    size_t position = cursor->position;
+    uint64_t remaining = cursor->index->header->file_size - cursor->offset;
+    uint64_t bytes, extra_bytes;
+    if (!read_varint(entries, size, &position, &bytes) || !read_varint(entries, size, &position, &extra_bytes)
+        || extra_bytes > bytes || bytes >= remaining) {
+        return false;  // the line and its '\n' must be part of the file
+    }
+    cursor->position = position;
+    *offset = cursor->offset;
+    *length = (size_t)bytes;
+    *char_count = (size_t)(bytes - extra_bytes);
+    cursor->offset += bytes + 1;
+    return true;
+}
+
+// create the cache directory and its parents
+static bool make_dirs(char *path) {
+    for (char *p = path + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            bool ok = mkdir(path, 0700) == 0 || errno == EEXIST;
+            *p = '/';
+            if (!ok) {
+                return false;
+            }
+        }
+    }
+    return mkdir(path, 0700) == 0 || errno == EEXIST;
+}
+
+bool LineIndex_Save(const char *document_path, const TextBuffer *tb) {
+    if (!tb->disk_known || tb->dirty_line || tb->disk_size == 0) {
+        return false;  // not every line ends with "\n"
+    }
+    uint64_t offset = 0;
+    uint64_t line_count = 0;
+    uint64_t entries_size = 0;
+    for (const Line *line = TextBuffer_GetFirstLine(tb); line; line = line->next) {
+        if (line->disk_offset != (int64_t)offset) {
+            return false;
+        }
+        size_t length = line->text.bytes_size;
+        entries_size += varint_size(length) + varint_size(length - String_Length(&line->text));
+        offset += length + 1;
+        line_count++;
+    }
+    if (offset != tb->disk_size) {
+        return false;
+    }
+
+    LineIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LINEINDEX_MAGIC, sizeof(header.magic));
+    header.file_size = tb->disk_size;
+    header.mtime_sec = tb->disk_mtime_sec;
+    header.mtime_nsec = tb->disk_mtime_nsec;
+    header.line_count = line_count;
+    header.entries_size = entries_size;
+    int fd = open(document_path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool unchanged = fstat(fd, &st) == 0 && (uint64_t)st.st_size == tb->disk_size
+                     && (int64_t)st.st_mtim.tv_sec == tb->disk_mtime_sec
+                     && (int64_t)st.st_mtim.tv_nsec == tb->disk_mtime_nsec
+                     && sample_hash(fd, tb->disk_size, &header.sample_hash);
+    close(fd);
+    if (!unchanged) {
+        return false;
+    }
+    char resolved[PATH_MAX];
+    real_path(document_path, resolved);
+    header.path_length = strlen(resolved);
+
+    char *dir = cache_dir();
+    char *path = LineIndex_PathFor(document_path);
+    bool ok = dir && path && make_dirs(dir);
+    FileWriter *fw = ok ? FileWriter_Open(path) : NULL;
+    free(dir);
+    free(path);
+    if (!fw) {
+        return false;
+    }
+    static const char padding[8] = { 0 };
+    ok = FileWriter_Write(fw, (const char*)&header, sizeof(header))
+         && FileWriter_Write(fw, resolved, header.path_length)
+         && FileWriter_Write(fw, padding, entries_start(header.path_length) - sizeof(header) - header.path_length)
+         && FileWriter_Flush(fw);
+    // the writer does not copy, so the buffer is flushed before it's reused
+    uint8_t *buffer = malloc(WRITE_BUFFER_SIZE);
+    if (!buffer) {
+        logFatal("Cannot allocate memory for writing the line index.");
+    }
+    size_t used = 0;
+    for (const Line *line = TextBuffer_GetFirstLine(tb); line && ok; line = line->next) {
+        size_t length = line->text.bytes_size;
+        used += write_varint(buffer + used, length);
+        used += write_varint(buffer + used, length - String_Length(&line->text));
+        if (used > WRITE_BUFFER_SIZE - 2 * VARINT_MAX_BYTES || !line->next) {
+            ok = FileWriter_Write(fw, (const char*)buffer, used) && FileWriter_Flush(fw);
+            used = 0;
+        }
+    }
+    ok = ok && FileWriter_Commit(fw, false);
+    FileWriter_Close(fw);
+    free(buffer);
+    return ok;
+}
@@ -0,0 +1,124 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file lineindex.h
+ * @brief Cached line offsets, so a big file that was opened before is not scanned again.
+ *
+ * After a big file was loaded, the lengths of its lines are stored in a
+ * sidecar file in `$XDG_CACHE_HOME/clieditor/` (`~/.cache/clieditor/`). The
+ * name of the sidecar is a hash of the real path of the file. On the next
+ * start TextBuffer_LoadFromIndex() creates all lines paged out (see
+ * linepager.h) without reading the file, only the lines on the screen are
+ * read when they are drawn.
+ *
+ * The index is only used if the file has the size and modification time it
+ * had when the index was written and a hash of a few samples of its content
+ * still matches. The sidecar is mapped, nothing is copied:
+ * ```
+ * LineIndexHeader | path bytes | padding to 8 | entries
+ * entry: varint length | varint (length - characters)   (length without the '\n')
+ * ```
+ * Varints are LEB128, so most lines need two bytes. Only files where every
+ * line ends with a plain "\n" get an index (the lines must be paged out
+ * exactly as they were loaded).
+ */
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "textbuffer.h"
+
+#define LINEINDEX_MAGIC "CELIDX01"
+#define LINEINDEX_MIN_FILE_SIZE (16 * 1024 * 1024)  //< smaller files are scanned fast enough
+#define LINEINDEX_SAMPLES 16                        //< number of content samples that are hashed
+#define LINEINDEX_SAMPLE_SIZE 4096                  //< bytes per sample
+
+typedef struct _LineIndexHeader {
+    char magic[8];
+    uint64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t sample_hash;   //< hash of LINEINDEX_SAMPLES evenly spread samples of the file
+    uint64_t line_count;
+    uint64_t entries_size;  //< bytes of the entries
+    uint64_t path_length;   //< bytes of the real path of the file (without '\0')
+} LineIndexHeader;
+
+typedef struct _LineIndex {
+    const char *data;       //< the mapped sidecar
+    size_t size;
+    const LineIndexHeader *header;
+    const uint8_t *entries;
+} LineIndex;
+
+/**
+ * @brief Position in the entries of an index.
+ */
+typedef struct _LineIndexCursor {
+    const LineIndex *index;
+    size_t position;        //< byte position in the entries
+    uint64_t offset;        //< file offset of the next line
+} LineIndexCursor;
+
+/**
+ * @brief Return the path of the sidecar for document_path (caller frees it).
+ *
+ * @returns NULL if there is no cache directory (neither XDG_CACHE_HOME nor HOME is set).
+ */
+char *LineIndex_PathFor(const char *document_path);
+
+/**
+ * @brief Map the index of document_path.
+ *
+ * All entries are checked once, so reading them cannot fail later.
+ *
+ * @returns The index or NULL if there is none or it does not match the file anymore.
+ */
+LineIndex *LineIndex_Open(const char *document_path);
+void LineIndex_Close(LineIndex *index);
+
+/**
+ * @brief Return true if st (of the opened file) describes the file the index was written for.
+ */
+bool LineIndex_Matches(const LineIndex *index, const struct stat *st);
+
+void LineIndexCursor_Init(LineIndexCursor *cursor, const LineIndex *index);
+
+/**
+ * @brief Read the next line.
+ *
+ * @param offset Set to the file offset of the line.
+ * @param length Set to the length in bytes (without the '\n').
+ * @param char_count Set to the number of characters.
+ * @returns false if there are no more lines.
+ */
+bool LineIndexCursor_Next(LineIndexCursor *cursor, uint64_t *offset, size_t *length, size_t *char_count);
+
+/**
+ * @brief Write the index of document_path from the lines of tb.
+ *
+ * tb must just have been loaded from document_path by TextBuffer_LoadFromFile()
+ * and every line must have ended with "\n", nothing is written otherwise.
+ *
+ * @returns true if the index was written.
+ */
+bool LineIndex_Save(const char *document_path, const TextBuffer *tb);
+
+#endif
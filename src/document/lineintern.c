@@ -0,0 +1,216 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "lineintern.h"
+
+#include <stdint.h>
+#include <string.h>
+#include "common/logging.h"
+
+struct _TextChunk {
+    size_t texts;           //< SharedTexts in the chunk that are still used (+1 while it's filled)
+    size_t used;
+    char data[];
+};
+
+// the bytes of shared lines point into this struct
+typedef struct _SharedText {
+    size_t refs;
+    TextChunk *chunk;       //< chunk the text was packed into (NULL if it's allocated on its own)
+    char bytes[];
+} SharedText;
+
+static void release_chunk(TextChunk *chunk) {
+    if (--chunk->texts == 0) {
+        free(chunk);
+    }
+}
+
+static void release_shared_text(SharedText *shared) {
+    if (--shared->refs > 0) {
+        return;
+    }
+    if (shared->chunk) {
+        release_chunk(shared->chunk);
+    }
+    else {
+        free(shared);
+    }
+}
+
+static SharedText *shared_text_of(const String *text) {
+    return (SharedText*)(text->bytes - offsetof(SharedText, bytes));
+}
+
+// multiplicative hash over 8 bytes at a time (lines might contain '\0')
+static uint32_t hash_text(const void *p) {
+    const String *text = p;
+    const char *bytes = text->bytes;
+    size_t size = text->bytes_size;
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ size;
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+        bytes += 8;
+        size -= 8;
+    }
+    uint64_t rest = 0;
+    memcpy(&rest, bytes, size);
+    hash = (hash ^ rest) * 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 29;
+    return (uint32_t)hash;
+}
+
+static int compare_text(const void *a, const void *b) {
+    const String *x = a;
+    const String *y = b;
+    if (x->bytes_size != y->bytes_size) {
+        return x->bytes_size < y->bytes_size ? -1 : 1;
+    }
+    return memcmp(x->bytes, y->bytes, x->bytes_size);
+}
+
+// the keys are the texts of the lines themselves, nothing is copied
+static void *keep_key(const void *p) {
+    return (void*)p;
+}
+
+static void free_no_key(void *p) {
+    (void)p;
+}
+
+// replace the bytes of line by shared (which it doesn't reference yet)
+static void share(LineIntern *li, Line *line, SharedText *shared) {
+    li->saved_bytes += line->text.bytes_capacity;
+    free(line->text.bytes);
+    line->text.bytes = shared->bytes;
+    line->text.bytes_capacity = line->text.bytes_size + 1;
+    line->shared = true;
+    shared->refs++;
+    li->shared_lines++;
+}
+
+void LineIntern_Init(LineIntern *li) {
+    li->table = Table_CreateCustom(hash_text, compare_text, keep_key, free_no_key);
+    li->shared_lines = 0;
+    li->saved_bytes = 0;
+}
+
+void LineIntern_Deinit(LineIntern *li) {
+    Table_Destroy(li->table);
+    li->table = NULL;
+}
+
+void LineIntern_Add(LineIntern *li, Line *line) {
+    if (line->shared || line->text.bytes_size > LINEINTERN_MAX_LENGTH) {
+        return;
+    }
+    Line *first = Table_Get(li->table, &line->text);
+    if (!first) {
+        if (Table_GetUsage(li->table) >= LINEINTERN_MAX_ENTRIES) {
+            // start over, lines that are repeated often come back soon
+            Table_Clear(li->table);
+        }
+        Table_Set(li->table, &line->text, line, NULL);
+        return;
+    }
+    if (!first->shared) {
+        // the first duplicate, move the text of the first line to shared bytes
+        size_t size = first->text.bytes_size;
+        SharedText *shared = malloc(sizeof(SharedText) + size + 1);
+        if (!shared) {
+            logFatal("Cannot allocate memory for a shared line.");
+        }
+        shared->refs = 0;
+        shared->chunk = NULL;
+        memcpy(shared->bytes, first->text.bytes, size + 1);
+        share(li, first, shared);
+        li->saved_bytes -= sizeof(SharedText) + size + 1;
+    }
+    share(li, line, shared_text_of(&first->text));
+}
+
+void LineIntern_Unshare(Line *line) {
+    if (!line->shared) {
+        return;
+    }
+    size_t size = line->text.bytes_size;
+    char *bytes = malloc(size + 1);
+    if (!bytes) {
+        logFatal("Cannot allocate memory for unsharing a line.");
+    }
+    memcpy(bytes, line->text.bytes, size + 1);
+    release_shared_text(shared_text_of(&line->text));
+    line->text.bytes = bytes;
+    line->shared = false;
+}
+
+void LineIntern_Release(String *text) {
+    release_shared_text(shared_text_of(text));
+    text->bytes = NULL;
+    String_Deinit(text);
+}
+
+void LineIntern_Drop(Line *line) {
+    if (!line->shared) {
+        return;
+    }
+    release_shared_text(shared_text_of(&line->text));
+    line->text.bytes = NULL;
+    line->text.bytes_capacity = 0;
+    line->shared = false;
+}
+
+bool LineIntern_Pack(TextChunk **chunk, Line *line) {
+    if (line->shared) {
+        return false;
+    }
+    size_t size = line->text.bytes_size;
+    // keep the SharedTexts aligned
+    size_t entry = (sizeof(SharedText) + size + 1 + 7) & ~(size_t)7;
+    if (entry > LINEINTERN_CHUNK_SIZE / 4) {
+        return false;
+    }
+    if (!*chunk || (*chunk)->used + entry > LINEINTERN_CHUNK_SIZE) {
+        LineIntern_FinishChunk(chunk);
+        *chunk = malloc(sizeof(TextChunk) + LINEINTERN_CHUNK_SIZE);
+        if (!*chunk) {
+            logFatal("Cannot allocate memory for packing lines.");
+        }
+        (*chunk)->texts = 1;
+        (*chunk)->used = 0;
+    }
+    SharedText *shared = (SharedText*)((*chunk)->data + (*chunk)->used);
+    (*chunk)->used += entry;
+    (*chunk)->texts++;
+    shared->refs = 1;
+    shared->chunk = *chunk;
+    memcpy(shared->bytes, line->text.bytes, size + 1);
+
+    free(line->text.bytes);
+    line->text.bytes = shared->bytes;
+    line->text.bytes_capacity = size + 1;
+    line->shared = true;
+    return true;
+}
+
+void LineIntern_FinishChunk(TextChunk **chunk) {
+    if (*chunk) {
+        release_chunk(*chunk);
+        *chunk = NULL;
+    }
+}
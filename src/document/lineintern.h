@@ -0,0 +1,106 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file lineintern.h
+ * @brief Identical lines share their text while they are unmodified.
+ *
+ * While a file is loaded, every short line is looked up in a `Table` keyed
+ * by the content. If an identical line was loaded before, both lines point
+ * to the same reference counted bytes (Line.shared). Blank lines, separators
+ * and repeated log messages then need no buffer of their own.
+ *
+ * The table only remembers the last few thousand distinct lines. Unique lines
+ * would make it as big as the file otherwise, and the lookups slow.
+ *
+ * Shared bytes are immutable: TextBuffer_WillChangeLine() gives the line its
+ * own copy (LineIntern_Unshare()) before it's changed. If a snapshot is alive
+ * it takes over the reference instead (see textsnapshot.h), so a background
+ * save can still read the shared bytes.
+ *
+ * The text of lines that are not expected to change is also packed into big
+ * TextChunks (LineIntern_Pack()). That saves the malloc overhead and the
+ * slack of the buffers of `getline()`. A chunk is freed when none of its
+ * texts is used anymore.
+ *
+ * Only the bytes are shared, every line keeps its own multibyte index.
+ */
+#ifndef LINEINTERN_H
+#define LINEINTERN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "line.h"
+#include "common/table.h"
+
+#define LINEINTERN_MAX_LENGTH 256   //< longer lines are rarely identical, they are not looked up
+#define LINEINTERN_MAX_ENTRIES 4096 //< the table is cleared when it's full, so it stays in the cache
+#define LINEINTERN_CHUNK_SIZE (256 * 1024)  //< bytes of a TextChunk
+
+typedef struct _TextChunk TextChunk;
+
+typedef struct _LineIntern {
+    Table *table;           //< content -> first line with that content
+    size_t shared_lines;    //< lines that got shared bytes
+    size_t saved_bytes;     //< bytes of the buffers that were freed
+} LineIntern;
+
+void LineIntern_Init(LineIntern *li);
+
+/**
+ * @brief Free the lookup table, the shared bytes stay with their lines.
+ */
+void LineIntern_Deinit(LineIntern *li);
+
+/**
+ * @brief Share the text of line with an identical line that was added before.
+ *
+ * The lines must stay alive as long as li is used.
+ */
+void LineIntern_Add(LineIntern *li, Line *line);
+
+/**
+ * @brief Give a line with shared bytes its own copy.
+ */
+void LineIntern_Unshare(Line *line);
+
+/**
+ * @brief Drop the reference of line to shared bytes, but keep the length (see linepager.h).
+ */
+void LineIntern_Drop(Line *line);
+
+/**
+ * @brief Move the text of line into chunk, the line uses it as shared bytes then.
+ *
+ * A new chunk is started if *chunk is NULL or full.
+ *
+ * @returns false if the line is shared already or too long to be packed.
+ */
+bool LineIntern_Pack(TextChunk **chunk, Line *line);
+
+/**
+ * @brief Stop filling *chunk (it's freed once its texts are released).
+ */
+void LineIntern_FinishChunk(TextChunk **chunk);
+
+/**
+ * @brief Drop the reference of text to shared bytes and free the rest of text.
+ *
+ * Replaces String_Deinit() for the text of a shared line.
+ */
+void LineIntern_Release(String *text);
+
+#endif
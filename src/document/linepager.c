@@ -0,0 +1,650 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "linepager.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "textsnapshot.h"
+#include "common/lz.h"
+#include "common/logging.h"
+
+#define LINEPAGER_SCRATCH_SIZE (1024 * 1024)
+
+double LinePagerStats_CompressionRatio(const LinePagerStats *stats) {
+    if (!stats || stats->block_bytes == 0) {
+        return 0.0;
+    }
+    return (double)stats->block_raw_bytes / (double)stats->block_bytes;
+}
+
+double LinePagerStats_DecompressMicroseconds(const LinePagerStats *stats) {
+    if (!stats || stats->decompressions == 0) {
+        return 0.0;
+    }
+    return stats->decompress_seconds * 1e6 / (double)stats->decompressions;
+}
+
+static bool read_at(int fd, char *buffer, size_t length, int64_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pread(fd, buffer + done, length - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+static char *alloc_text(size_t length) {
+    char *bytes = malloc(length + 1);
+    if (!bytes) {
+        logFatal("Cannot allocate memory for a paged in line.");
+    }
+    bytes[length] = '\0';
+    return bytes;
+}
+
+// the caller holds the snapshot lock if there is a snapshot
+static void set_text(Line *line, char *bytes) {
+    line->text.bytes = bytes;
+    line->text.bytes_capacity = line->text.bytes_size + 1;
+    line->text.multibytes_invalid = true;
+    line->paged_out = false;
+    line->block = NULL;
+    line->block_offset = 0;
+}
+
+static void lock(LinePager *pager) {
+    // a background save might read the lines at the same time
+    if (pager->tb->snapshot) {
+        TextSnapshot_Lock(pager->tb->snapshot);
+    }
+}
+
+static void unlock(LinePager *pager) {
+    if (pager->tb->snapshot) {
+        TextSnapshot_Unlock(pager->tb->snapshot);
+    }
+}
+
+static void page_in(LinePager *pager, Line *line) {
+    size_t length = line->text.bytes_size;
+    char *bytes = alloc_text(length);
+    if (!read_at(pager->fd, bytes, length, line->disk_offset)) {
+        logError("Cannot read line at offset %lld back from the file.", (long long)line->disk_offset);
+        memset(bytes, '?', length);
+    }
+    lock(pager);
+    set_text(line, bytes);
+    unlock(pager);
+
+    pager->resident += length;
+    pager->stats.page_ins++;
+    pager->stats.paged_out_bytes -= length;
+}
+
+static double elapsed_seconds(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - since->tv_sec) + (double)(now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+static bool decompress_block(const LineBlock *block, char *dst) {
+    if (!block->compressed) {
+        memcpy(dst, block->data, block->raw_size);
+        return true;
+    }
+    return LZ_Decompress(block->data, block->size, dst, block->raw_size);
+}
+
+static void unlink_block(LineBlock **list, LineBlock *block) {
+    if (block->prev) {
+        block->prev->next = block->next;
+    }
+    else {
+        *list = block->next;
+    }
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+    block->prev = block->next = NULL;
+}
+
+static void push_block(LineBlock **list, LineBlock *block) {
+    block->prev = NULL;
+    block->next = *list;
+    if (*list) {
+        (*list)->prev = block;
+    }
+    *list = block;
+}
+
+static void free_block(LineBlock *block) {
+    free(block->data);
+    free(block->lines);
+    free(block);
+}
+
+static void free_blocks(LineBlock *list) {
+    while (list) {
+        LineBlock *next = list->next;
+        free_block(list);
+        list = next;
+    }
+}
+
+// give every line of the block its text back
+static void decompress(LinePager *pager, LineBlock *block) {
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    char *text = malloc(block->raw_size + 1);
+    if (!text) {
+        logFatal("Cannot allocate memory for decompressing lines.");
+    }
+    if (!decompress_block(block, text)) {
+        logError("Compressed lines are damaged.");
+        memset(text, '?', block->raw_size);
+    }
+
+    lock(pager);
+    for (size_t i = 0; i < block->line_count; i++) {
+        Line *line = block->lines[i];
+        char *bytes = alloc_text(line->text.bytes_size);
+        memcpy(bytes, text + line->block_offset, line->text.bytes_size);
+        set_text(line, bytes);
+    }
+    unlock(pager);
+    free(text);
+
+    pager->resident += block->raw_size;
+    pager->stats.blocks--;
+    pager->stats.block_raw_bytes -= block->raw_size;
+    pager->stats.block_bytes -= block->size;
+    pager->stats.decompressions++;
+    pager->stats.decompress_seconds += elapsed_seconds(&started);
+
+    unlink_block(&pager->blocks, block);
+    free(block->lines);
+    block->lines = NULL;
+    block->line_count = 0;
+    if (pager->tb->snapshot) {
+        // a background save might still write the lines from the block
+        push_block(&pager->retired, block);
+    }
+    else {
+        free_block(block);
+    }
+}
+
+static void remove_resident(LinePager *pager, const Line *line) {
+    pager->resident -= line->text.bytes_size < pager->resident ? line->text.bytes_size : pager->resident;
+}
+
+// drop the text, but keep bytes_size and char_count (the length is still known)
+static void drop_text(Line *line) {
+    String *text = &line->text;
+    if (line->shared) {
+        LineIntern_Drop(line);
+    }
+    else {
+        free(text->bytes);
+    }
+    free(text->multibytes);
+    text->bytes = NULL;
+    text->bytes_capacity = 0;
+    text->multibytes = NULL;
+    text->multibytes_size = 0;
+    text->multibytes_capacity = 0;
+    text->multibytes_invalid = true;
+    line->paged_out = true;
+}
+
+static void page_out(LinePager *pager, Line *line) {
+    drop_text(line);
+    remove_resident(pager, line);
+    pager->stats.page_outs++;
+    pager->stats.paged_out_bytes += line->text.bytes_size;
+}
+
+static bool is_cold(const LinePager *pager, const Line *line) {
+    return !line->referenced && line != pager->tb->current_line && !line->snapshot && !line->paged_out;
+}
+
+// compress a run of cold modified lines starting at first, returns the line after the block
+static Line *compress(LinePager *pager, Line *first) {
+    size_t line_count = 0;
+    size_t raw_size = 0;
+    Line *end = first;
+    while (end && is_cold(pager, end) && end->disk_offset < 0
+           && (line_count == 0 || raw_size + end->text.bytes_size <= LINEPAGER_BLOCK_SIZE)) {
+        line_count++;
+        raw_size += end->text.bytes_size;
+        end = end->next;
+    }
+
+    LineBlock *block = malloc(sizeof(LineBlock));
+    char *text = malloc(raw_size + 1);
+    size_t capacity = LZ_CompressBound(raw_size);
+    char *data = malloc(capacity);
+    Line **lines = malloc(line_count * sizeof(Line*));
+    if (!block || !text || !data || !lines) {
+        logFatal("Cannot allocate memory for compressing lines.");
+    }
+    size_t offset = 0;
+    size_t i = 0;
+    for (Line *line = first; line != end; line = line->next) {
+        memcpy(text + offset, line->text.bytes, line->text.bytes_size);
+        line->block_offset = (uint32_t)offset;
+        offset += line->text.bytes_size;
+        lines[i++] = line;
+    }
+
+    size_t size = LZ_Compress(text, raw_size, data, capacity);
+    block->compressed = size > 0 && size < raw_size;
+    if (!block->compressed) {
+        // still worth it, one allocation instead of one per line
+        size = raw_size;
+    }
+    block->data = malloc(size + 1);
+    if (!block->data) {
+        logFatal("Cannot allocate memory for compressing lines.");
+    }
+    memcpy(block->data, block->compressed ? data : text, size);
+    free(text);
+    free(data);
+    block->size = size;
+    block->raw_size = raw_size;
+    block->lines = lines;
+    block->line_count = line_count;
+    push_block(&pager->blocks, block);
+
+    for (i = 0; i < line_count; i++) {
+        drop_text(lines[i]);
+        lines[i]->block = block;
+    }
+
+    pager->resident -= raw_size < pager->resident ? raw_size : pager->resident;
+    pager->stats.blocks++;
+    pager->stats.block_raw_bytes += raw_size;
+    pager->stats.block_bytes += size;
+    return end;
+}
+
+// read back everything that depends on the file
+static void page_in_all(LinePager *pager) {
+    for (Line *line = TextBuffer_GetFirstLine(pager->tb); line; line = line->next) {
+        if (line->paged_out && !line->block) {
+            page_in(pager, line);
+        }
+    }
+}
+
+void LinePagerScratch_Init(LinePagerScratch *scratch) {
+    scratch->bytes = NULL;
+    scratch->used = 0;
+    scratch->capacity = 0;
+    scratch->block = NULL;
+    scratch->block_bytes = NULL;
+    scratch->block_capacity = 0;
+}
+
+void LinePagerScratch_Deinit(LinePagerScratch *scratch) {
+    free(scratch->bytes);
+    free(scratch->block_bytes);
+    LinePagerScratch_Init(scratch);
+}
+
+static void clear_compact_queue(LinePager *pager) {
+    for (size_t i = 0; i < pager->compact_queued; i++) {
+        pager->compact_queue[i]->compact_queued = false;
+    }
+    pager->compact_queued = 0;
+}
+
+static void unqueue_compact(LinePager *pager, Line *line) {
+    for (size_t i = 0; i < pager->compact_queued; i++) {
+        if (pager->compact_queue[i] == line) {
+            pager->compact_queue[i] = pager->compact_queue[--pager->compact_queued];
+            break;
+        }
+    }
+    line->compact_queued = false;
+}
+
+static void queue_compact(LinePager *pager, Line *line) {
+    if (line->compact_queued) {
+        return;
+    }
+    if (pager->compact_queued == LINEPAGER_COMPACT_QUEUE) {
+        // too many changes, a whole round visits them all
+        clear_compact_queue(pager);
+        pager->compact_again = true;
+        return;
+    }
+    line->compact_queued = true;
+    pager->compact_queue[pager->compact_queued++] = line;
+}
+
+// take a changed line from the queue, the current line stays there (it's likely to change again)
+static Line *next_queued(LinePager *pager) {
+    if (pager->compact_queued == 0) {
+        return NULL;
+    }
+    Line **last = &pager->compact_queue[pager->compact_queued - 1];
+    if (*last == pager->tb->current_line) {
+        if (pager->compact_queued == 1) {
+            return NULL;
+        }
+        *last = pager->compact_queue[0];
+        pager->compact_queue[0] = pager->tb->current_line;
+    }
+    Line *line = *last;
+    pager->compact_queued--;
+    line->compact_queued = false;
+    return line;
+}
+
+// returns true if line changed
+static bool compact_line(LinePager *pager, Line *line) {
+    bool changed = false;
+    if (LineIntern_Pack(&pager->chunk, line)) {
+        pager->stats.packed_lines++;
+        changed = true;
+    }
+    size_t bytes_capacity = line->text.bytes_capacity;
+    size_t multibytes_capacity = line->text.multibytes_capacity;
+    String_ShrinkToFit(&line->text);
+    return changed || line->text.bytes_capacity != bytes_capacity || line->text.multibytes_capacity != multibytes_capacity;
+}
+
+LinePager *TextBuffer_EnablePaging(TextBuffer *tb, const char *path, size_t budget) {
+    if (tb->pager) {
+        tb->pager->budget = budget;
+        return tb->pager;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        logError("Cannot open %s for paging: %s", path, strerror(errno));
+        return NULL;
+    }
+    LinePager *pager = malloc(sizeof(LinePager));
+    if (!pager) {
+        logFatal("Cannot allocate memory for LinePager.");
+    }
+    pager->tb = tb;
+    pager->fd = fd;
+    pager->budget = budget;
+    pager->resident = 0;
+    pager->round_resident = 0;
+    pager->blocks = NULL;
+    pager->retired = NULL;
+    pager->compact_hand = NULL;
+    pager->compact_again = true;
+    pager->compact_queued = 0;
+    pager->chunk = NULL;
+    pager->stats = (LinePagerStats){ 0 };
+    pager->hand = TextBuffer_GetFirstLine(tb);
+    for (Line *line = pager->hand; line; line = line->next) {
+        pager->resident += line->text.bytes_size;
+    }
+    tb->pager = pager;
+    return pager;
+}
+
+void LinePager_Destroy(LinePager *pager) {
+    if (!pager) {
+        return;
+    }
+    if (pager->fd >= 0) {
+        close(pager->fd);
+    }
+    free_blocks(pager->blocks);
+    free_blocks(pager->retired);
+    LineIntern_FinishChunk(&pager->chunk);
+    free(pager);
+}
+
+void LinePager_AddPagedOut(LinePager *pager, Line *line, int64_t offset, size_t length, size_t char_count) {
+    line->text.bytes_size = length;
+    line->text.char_count = char_count;
+    line->disk_offset = offset;
+    drop_text(line);
+    pager->stats.paged_out_bytes += length;
+}
+
+void TextBuffer_DisablePaging(TextBuffer *tb) {
+    if (!tb->pager) {
+        return;
+    }
+    while (tb->pager->blocks) {
+        decompress(tb->pager, tb->pager->blocks);
+    }
+    if (tb->pager->fd >= 0) {
+        page_in_all(tb->pager);
+    }
+    clear_compact_queue(tb->pager);
+    LinePager_Destroy(tb->pager);
+    tb->pager = NULL;
+}
+
+void LinePager_Balance(LinePager *pager) {
+    if (!pager || pager->tb->snapshot) {
+        return;
+    }
+    free_blocks(pager->retired);
+    pager->retired = NULL;
+    bool over_budget = pager->resident > pager->budget;
+    size_t steps = over_budget ? LINEPAGER_MAX_STEPS : LINEPAGER_IDLE_STEPS;
+    for (size_t i = 0; i < steps; i++) {
+        if (!pager->hand) {
+            // a round is complete, now the number of resident bytes is exact again
+            pager->resident = pager->round_resident;
+            pager->round_resident = 0;
+            pager->hand = TextBuffer_GetFirstLine(pager->tb);
+        }
+        Line *line = pager->hand;
+        pager->hand = line->next;
+        if (line->paged_out) {
+            continue;
+        }
+        bool clean = line->disk_offset >= 0;
+        if (over_budget && is_cold(pager, line) && (!clean || pager->fd >= 0)) {
+            if (clean) {
+                page_out(pager, line);
+            }
+            else {
+                pager->hand = compress(pager, line);
+            }
+            over_budget = pager->resident > pager->budget;
+            continue;
+        }
+        line->referenced = false;
+        pager->round_resident += line->text.bytes_size;
+    }
+}
+
+bool LinePager_Compact(LinePager *pager) {
+    if (!pager || pager->tb->snapshot) {
+        return false;
+    }
+    for (size_t i = 0; i < LINEPAGER_COMPACT_STEPS; i++) {
+        if (!pager->compact_hand && pager->compact_again) {
+            pager->compact_again = false;
+            pager->compact_hand = TextBuffer_GetFirstLine(pager->tb);
+        }
+        if (pager->compact_hand) {
+            Line *line = pager->compact_hand;
+            pager->compact_hand = line->next;
+            // lines in use are likely to change soon
+            if (line->paged_out || line->referenced || line == pager->tb->current_line) {
+                continue;
+            }
+            if (compact_line(pager, line)) {
+                pager->compact_again = true;
+            }
+            continue;
+        }
+        // between the rounds only the changed lines are visited
+        Line *line = next_queued(pager);
+        if (!line) {
+            return false;
+        }
+        if (!line->paged_out) {
+            compact_line(pager, line);
+        }
+    }
+    return true;
+}
+
+bool LinePager_CompactPending(const LinePager *pager) {
+    if (!pager) {
+        return false;
+    }
+    // the current line alone waits until it's left
+    return pager->compact_hand || pager->compact_again || pager->compact_queued > 1 ||
+           (pager->compact_queued == 1 && pager->compact_queue[0] != pager->tb->current_line);
+}
+
+void LinePager_Reopen(LinePager *pager, const char *path) {
+    if (!pager || pager->fd < 0) {
+        return;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        logWarn("Cannot open %s for paging, paging stopped.", path);
+        page_in_all(pager);
+    }
+    close(pager->fd);
+    pager->fd = fd;
+}
+
+void LinePager_Touch(LinePager *pager, Line *line) {
+    if (!pager || !line) {
+        return;
+    }
+    line->referenced = true;
+    if (line->block) {
+        decompress(pager, line->block);
+    }
+    else if (line->paged_out) {
+        page_in(pager, line);
+    }
+}
+
+void LinePager_WillChange(LinePager *pager, Line *line) {
+    if (!pager || !line) {
+        return;
+    }
+    queue_compact(pager, line);
+    // modified lines are counted with their old length until the round is complete
+    if (line->disk_offset < 0 || line->paged_out) {
+        return;
+    }
+    remove_resident(pager, line);
+}
+
+void LinePager_Inserted(LinePager *pager, Line *line) {
+    if (!pager || !line) {
+        return;
+    }
+    queue_compact(pager, line);
+}
+
+void LinePager_WillDelete(LinePager *pager, Line *line) {
+    if (!pager || !line) {
+        return;
+    }
+    if (pager->hand == line) {
+        pager->hand = line->next;
+    }
+    if (pager->compact_hand == line) {
+        pager->compact_hand = line->next;
+    }
+    if (line->compact_queued) {
+        unqueue_compact(pager, line);
+    }
+    if (line->block) {
+        // the block must not keep a pointer to the line
+        decompress(pager, line->block);
+    }
+    if (line->paged_out) {
+        pager->stats.paged_out_bytes -= line->text.bytes_size;
+        return;
+    }
+    remove_resident(pager, line);
+}
+
+static bool write_from_block(FileWriter *fw, LinePagerScratch *scratch, const LineBlock *block, size_t offset, size_t length) {
+    if (scratch->block != block) {
+        // the text of the last block might still be queued
+        if (!FileWriter_Flush(fw)) {
+            return false;
+        }
+        if (block->raw_size > scratch->block_capacity) {
+            char *bytes = realloc(scratch->block_bytes, block->raw_size);
+            if (!bytes) {
+                logFatal("Cannot allocate memory for writing compressed lines.");
+            }
+            scratch->block_bytes = bytes;
+            scratch->block_capacity = block->raw_size;
+        }
+        scratch->block = NULL;
+        if (!decompress_block(block, scratch->block_bytes)) {
+            logError("Compressed lines are damaged.");
+            return false;
+        }
+        scratch->block = block;
+    }
+    return FileWriter_Write(fw, scratch->block_bytes + offset, length);
+}
+
+bool LinePager_WritePagedOut(const LinePager *pager, FileWriter *fw, LinePagerScratch *scratch,
+                             const LineBlock *block, int64_t offset, size_t length) {
+    if (block) {
+        return write_from_block(fw, scratch, block, (size_t)offset, length);
+    }
+    if (scratch->used + length > scratch->capacity) {
+        // everything queued from the scratch buffer must be written before it is reused
+        if (!FileWriter_Flush(fw)) {
+            return false;
+        }
+        scratch->used = 0;
+        if (length > scratch->capacity) {
+            size_t capacity = length > LINEPAGER_SCRATCH_SIZE ? length : LINEPAGER_SCRATCH_SIZE;
+            char *bytes = realloc(scratch->bytes, capacity);
+            if (!bytes) {
+                logFatal("Cannot allocate memory for writing paged out lines.");
+            }
+            scratch->bytes = bytes;
+            scratch->capacity = capacity;
+        }
+    }
+    char *bytes = scratch->bytes + scratch->used;
+    if (!read_at(pager->fd, bytes, length, offset)) {
+        logError("Cannot read paged out line at offset %lld.", (long long)offset);
+        return false;
+    }
+    scratch->used += length;
+    return FileWriter_Write(fw, bytes, length);
+}
@@ -0,0 +1,226 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file linepager.h
+ * @brief Drop the text of unmodified lines that were not used for a while.
+ *
+ * Lines that are unchanged since the file was loaded (or saved) know their
+ * offset in the file (Line.disk_offset). If the text of those lines exceeds
+ * the memory budget, the pager frees it and keeps only the length. The text
+ * is read back from the file when the line is touched again (layout,
+ * highlighting, editing, saving).
+ *
+ * Modified lines cannot be read back from the file. Runs of cold modified
+ * lines are concatenated to a LineBlock and compressed (see common/lz.h)
+ * instead. Touching one line of a block decompresses the whole block, its
+ * lines are neighbours and likely needed soon as well.
+ *
+ * When the editor is idle, the text of the other cold lines is packed into
+ * big chunks (see lineintern.h) and the unused capacity of the rest is
+ * released. After a whole round over the document only the lines changed
+ * since then are visited, unless there are too many of them.
+ *
+ * Cold lines are found with the clock algorithm: a hand walks along the
+ * lines, a line that was touched since the last visit gets another round,
+ * every other line is paged out or compressed. The number of resident bytes
+ * is kept up to date incrementally and corrected after every round.
+ *
+ * The file is kept open, so saving (which replaces the file) doesn't take the
+ * text away. After a complete save the new file is opened.
+ * Nothing is paged out while a snapshot is alive (a background save reads the
+ * lines then), blocks that are decompressed meanwhile are kept until it is
+ * released.
+ */
+#ifndef LINEPAGER_H
+#define LINEPAGER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "textbuffer.h"
+#include "lineintern.h"
+#include "io/filewriter.h"
+
+#define LINEPAGER_IDLE_STEPS 4096           //< lines visited per LinePager_Balance() below the budget
+#define LINEPAGER_MAX_STEPS (256 * 1024)    //< lines visited per LinePager_Balance() above the budget
+#define LINEPAGER_BLOCK_SIZE (64 * 1024)    //< max uncompressed bytes of a LineBlock
+#define LINEPAGER_COMPACT_STEPS 4096        //< lines visited per LinePager_Compact()
+#define LINEPAGER_COMPACT_QUEUE 1024        //< changed lines remembered for LinePager_Compact(), more start a whole round
+
+typedef struct _LinePagerStats {
+    size_t page_ins;        //< lines read back from the file
+    size_t page_outs;       //< lines dropped from memory
+    size_t paged_out_bytes; //< bytes of text currently not in memory (neither compressed)
+
+    size_t blocks;              //< number of compressed blocks
+    size_t block_raw_bytes;     //< uncompressed size of the text in blocks
+    size_t block_bytes;         //< compressed size of the text in blocks
+    size_t decompressions;      //< blocks decompressed because a line was touched
+    double decompress_seconds;  //< time spent for decompressing
+
+    size_t packed_lines;        //< lines whose text was moved into a TextChunk
+} LinePagerStats;
+
+/**
+ * @brief Uncompressed size / compressed size of the blocks (0 if there are none).
+ */
+double LinePagerStats_CompressionRatio(const LinePagerStats *stats);
+
+/**
+ * @brief Average time in microseconds to decompress a block (0 if nothing was decompressed).
+ */
+double LinePagerStats_DecompressMicroseconds(const LinePagerStats *stats);
+
+/**
+ * @brief Compressed text of consecutive modified lines.
+ */
+typedef struct _LineBlock {
+    char *data;             //< compressed text (or the text itself if it doesn't compress)
+    size_t size;            //< bytes in data
+    size_t raw_size;        //< bytes of text
+    bool compressed;        //< false if data holds the text uncompressed
+    Line **lines;           //< lines with their text in the block (NULL after decompression)
+    size_t line_count;
+    struct _LineBlock *prev;
+    struct _LineBlock *next;
+} LineBlock;
+
+typedef struct _LinePager {
+    TextBuffer *tb;
+    int fd;                 //< file the offsets of the lines refer to (-1 if paging stopped)
+    size_t budget;          //< max bytes of resident line text
+    size_t resident;        //< bytes of resident line text (estimated between rounds)
+    Line *hand;             //< next line the clock visits
+    size_t round_resident;  //< resident bytes seen in the current round
+    LineBlock *blocks;      //< blocks holding text of paged out lines
+    LineBlock *retired;     //< decompressed blocks a snapshot might still read
+    Line *compact_hand;     //< next line the current round of LinePager_Compact() visits (NULL between rounds)
+    bool compact_again;     //< another whole round is due (the last one changed a line or the queue overflowed)
+    Line *compact_queue[LINEPAGER_COMPACT_QUEUE];   //< changed lines LinePager_Compact() visits between rounds
+    size_t compact_queued;  //< number of lines in compact_queue
+    TextChunk *chunk;       //< chunk that is filled by LinePager_Compact()
+    LinePagerStats stats;
+} LinePager;
+
+/**
+ * @brief Buffer for writing paged out lines without paging them in.
+ */
+typedef struct _LinePagerScratch {
+    char *bytes;
+    size_t used;
+    size_t capacity;
+
+    const LineBlock *block; //< block that is decompressed in block_bytes
+    char *block_bytes;
+    size_t block_capacity;
+} LinePagerScratch;
+
+void LinePagerScratch_Init(LinePagerScratch *scratch);
+void LinePagerScratch_Deinit(LinePagerScratch *scratch);
+
+/**
+ * @brief Enable paging for tb, whose disk offsets refer to path.
+ *
+ * If paging is enabled already, only the budget is changed.
+ *
+ * @param budget Bytes of clean line text that may stay in memory.
+ * @returns The pager (owned by tb) or NULL if the file cannot be opened.
+ */
+LinePager *TextBuffer_EnablePaging(TextBuffer *tb, const char *path, size_t budget);
+
+/**
+ * @brief Make line a paged out line whose text was never read (see lineindex.h).
+ *
+ * @param offset File offset of the text.
+ * @param length Bytes of the text.
+ * @param char_count Characters of the text.
+ */
+void LinePager_AddPagedOut(LinePager *pager, Line *line, int64_t offset, size_t length, size_t char_count);
+
+/**
+ * @brief Read (and decompress) all paged out lines back and stop paging.
+ */
+void TextBuffer_DisablePaging(TextBuffer *tb);
+
+/**
+ * @brief Free the pager without reading anything back (the lines are destroyed anyway).
+ */
+void LinePager_Destroy(LinePager *pager);
+
+/**
+ * @brief Visit some lines and page out cold ones if the budget is exceeded.
+ *
+ * Meant to be called regularly from the main loop.
+ */
+void LinePager_Balance(LinePager *pager);
+
+/**
+ * @brief Pack the text of some cold lines into big chunks and trim the slack of the others.
+ *
+ * Meant to be called when the editor is idle (see idle.h), it continues where
+ * it stopped the last time.
+ *
+ * @returns false if there is nothing left to do (or while a snapshot is
+ *          saved), so there is no need to call it until
+ *          LinePager_CompactPending() is true again.
+ */
+bool LinePager_Compact(LinePager *pager);
+
+/**
+ * @brief Return true if lines changed since LinePager_Compact() returned false.
+ */
+bool LinePager_CompactPending(const LinePager *pager);
+
+/**
+ * @brief The disk offsets were recalculated for the file at path (it was saved completely).
+ *
+ * Must be called *before* the offsets change: if the new file cannot be opened,
+ * everything is paged in from the old one and paging stops.
+ */
+void LinePager_Reopen(LinePager *pager, const char *path);
+
+/* Hooks called by the TextBuffer. They do nothing if pager is NULL. */
+
+/**
+ * @brief Make sure the text of line is in memory and mark it as used.
+ */
+void LinePager_Touch(LinePager *pager, Line *line);
+
+/**
+ * @brief line is going to be changed (it's touched already) or deleted.
+ */
+void LinePager_WillChange(LinePager *pager, Line *line);
+void LinePager_WillDelete(LinePager *pager, Line *line);
+
+/**
+ * @brief line was inserted into the TextBuffer.
+ */
+void LinePager_Inserted(LinePager *pager, Line *line);
+
+/**
+ * @brief Queue the text of a paged out line for writing without paging it in.
+ *
+ * The text is read (or decompressed) into scratch, fw is flushed before
+ * scratch is reused. Can be called from another thread while a snapshot is
+ * alive (blocks are neither created nor freed then).
+ *
+ * @param block block of the line (NULL if the line is read from the file)
+ * @param offset block_offset of the line if it's in a block, otherwise disk_offset
+ */
+bool LinePager_WritePagedOut(const LinePager *pager, FileWriter *fw, LinePagerScratch *scratch,
+                             const LineBlock *block, int64_t offset, size_t length);
+
+#endif
@@ -14,6 +14,9 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "document/textbuffer.h"
+#include "document/textsnapshot.h"
+#include "document/linepager.h"
+#include "document/lineintern.h"
 
 #include "common/logging.h"
 
@@ -30,10 +33,26 @@ void TextBuffer_Init(TextBuffer *tb) {
     tb->gap.position = 0;
     tb->current_line = Line_Create();
     tb->line_count = 1;
+    tb->last_line = tb->current_line;
+    tb->line_number_offset = 0;
+    tb->numbered_line = NULL;
+    tb->numbered_line_number = 0;
+    tb->highlight_line = tb->current_line;
+    tb->changes = 0;
+    TextBuffer_InvalidateDiskState(tb);
+    tb->snapshot = NULL;
+    tb->journal = NULL;
+    tb->pager = NULL;
     Gap_Init(&tb->gap);
 }
 
 void TextBuffer_Deinit(TextBuffer *tb) {
+    if (tb->snapshot) {
+        logWarn("TextBuffer deinitialized while a snapshot is alive.");
+        TextBuffer_ReleaseSnapshot(tb);
+    }
+    LinePager_Destroy(tb->pager);
+    tb->pager = NULL;
     Line *start = tb->current_line;
     while (start->prev) {
         start = start->prev;
@@ -48,16 +67,23 @@ void TextBuffer_Deinit(TextBuffer *tb) {
 }
 
 void TextBuffer_ReInit(TextBuffer *tb) {
+    size_t changes = tb->changes;
     TextBuffer_Deinit(tb);
     TextBuffer_Init(tb);
+    tb->changes = changes + 1;  // every line is new
 }
 
 void TextBuffer_TextAroundGap(const TextBuffer *tb, StringView *before, StringView *after) {
+    LinePager_Touch(tb->pager, tb->current_line);
     *before = String_Slice(&tb->current_line->text, 0, tb->gap.position - tb->gap.overlap);
     *after = String_Slice(&tb->current_line->text, tb->gap.position, String_Length(&tb->current_line->text));
 }
 
 void TextBuffer_MergeGap(TextBuffer *tb) {
+    if (String_Length(&tb->gap.text) == 0 && tb->gap.overlap == 0) {
+        return;  // nothing to merge
+    }
+    TextBuffer_WillChangeLine(tb, tb->current_line);
     String *line = &tb->current_line->text;
     // text after cursor position
     String after = String_Substring(line, tb->gap.position, String_Length(line) - tb->gap.position);
@@ -76,32 +102,232 @@ void TextBuffer_MergeGap(TextBuffer *tb) {
     tb->gap.overlap = 0;
 }
 
+/*
+ * Tracking of the clean prefix: every line in it still has its disk offset and
+ * its offset is below clean_bytes. Everything behind it needs to be written.
+ */
+static void disk_line_changed(TextBuffer *tb, Line *line) {
+    if (line->disk_offset >= 0 && (uint64_t)line->disk_offset < tb->clean_bytes) {
+        tb->clean_bytes = line->disk_offset;
+        tb->dirty_line = line;
+    }
+    line->disk_offset = -1;
+}
+
+static void disk_line_inserted(TextBuffer *tb, Line *new_line) {
+    Line *prev = new_line->prev;
+    if (!prev) {
+        tb->clean_bytes = 0;
+        tb->dirty_line = new_line;
+        return;
+    }
+    if (prev->disk_offset < 0) {
+        return;
+    }
+    uint64_t end = prev->disk_offset + prev->text.bytes_size + 1;
+    if (end <= tb->clean_bytes) {
+        tb->clean_bytes = end;
+        tb->dirty_line = new_line;
+    }
+}
+
+static void disk_line_deleted(TextBuffer *tb, Line *line) {
+    if (line->disk_offset >= 0 && (uint64_t)line->disk_offset < tb->clean_bytes) {
+        tb->clean_bytes = line->disk_offset;
+        tb->dirty_line = line->next;
+    }
+    else if (line == tb->dirty_line) {
+        tb->dirty_line = line->next;
+    }
+}
+
+void TextBuffer_SetDiskState(TextBuffer *tb, uint64_t size, int64_t mtime_sec, int64_t mtime_nsec) {
+    tb->disk_known = true;
+    tb->disk_size = size;
+    tb->disk_mtime_sec = mtime_sec;
+    tb->disk_mtime_nsec = mtime_nsec;
+    tb->clean_bytes = size;
+    tb->dirty_line = NULL;
+}
+
+void TextBuffer_InvalidateDiskState(TextBuffer *tb) {
+    tb->disk_known = false;
+    tb->disk_size = 0;
+    tb->disk_mtime_sec = 0;
+    tb->disk_mtime_nsec = 0;
+    tb->clean_bytes = 0;
+    tb->dirty_line = NULL;
+}
+
+// keep the cached line number valid (positions are ordered like the list)
+static void line_inserted(TextBuffer *tb, Line *new_line) {
+    if (tb->numbered_line && new_line->position < tb->numbered_line->position) {
+        tb->numbered_line_number++;
+    }
+    if (!new_line->next) {
+        tb->last_line = new_line;
+    }
+    disk_line_inserted(tb, new_line);
+    LinePager_Inserted(tb->pager, new_line);
+    if (!tb->highlight_line || new_line->position < tb->highlight_line->position) {
+        tb->highlight_line = new_line;
+    }
+    TextSnapshot_LineAdded(tb->snapshot, new_line);
+    tb->line_count++;
+    tb->changes++;
+}
+
+static void line_will_be_deleted(TextBuffer *tb, Line *line) {
+    LinePager_WillDelete(tb->pager, line);
+    tb->changes++;
+    if (line == tb->last_line) {
+        tb->last_line = line->prev ? line->prev : line->next;
+    }
+    disk_line_deleted(tb, line);
+    // the line after it does not follow the line in front of it anymore
+    if (!tb->highlight_line || line->position <= tb->highlight_line->position) {
+        tb->highlight_line = line->next;
+    }
+    if (!tb->numbered_line) {
+        return;
+    }
+    if (line == tb->numbered_line) {
+        if (line->next) {
+            tb->numbered_line = line->next;
+        }
+        else {
+            tb->numbered_line = line->prev;
+            tb->numbered_line_number--;
+        }
+    }
+    else if (line->position < tb->numbered_line->position) {
+        tb->numbered_line_number--;
+    }
+}
+
 void TextBuffer_InsertLineAfterCurrent(TextBuffer *tb, Line *new_line) {
+    TextSnapshot_WillChangeNext(tb->snapshot, tb->current_line);
     Line_InsertAfter(tb->current_line, new_line);
-    tb->line_count++;
+    line_inserted(tb, new_line);
 }
 
 void TextBuffer_InsertLineAtTop(TextBuffer *tb, Line *new_line) {
     Line *top = TextBuffer_GetFirstLine(tb);
     Line_InsertBefore(top, new_line);
-    tb->line_count++;
+    line_inserted(tb, new_line);
 }
 
 void TextBuffer_InsertLineAtBottom(TextBuffer *tb, Line *new_line) {
     Line *bottom = TextBuffer_GetLastLine(tb);
+    TextSnapshot_WillChangeNext(tb->snapshot, bottom);
     Line_InsertAfter(bottom, new_line);
-    tb->line_count++;
+    line_inserted(tb, new_line);
 }
 
 bool TextBuffer_DeleteLine(TextBuffer *tb, Line *line) {
     if (!line || line == tb->current_line) {
         return false;
     }
-    Line_Delete(line);
+    line_will_be_deleted(tb, line);
+    if (TextSnapshot_WillDeleteLine(tb->snapshot, line)) {
+        Line_Unlink(line);  // the snapshot destroys it later
+    }
+    else {
+        Line_Delete(line);
+    }
     tb->line_count--;
     return true;
 }
 
+void TextBuffer_WillChangeLine(TextBuffer *tb, Line *line) {
+    LinePager_Touch(tb->pager, line);
+    LinePager_WillChange(tb->pager, line);
+    disk_line_changed(tb, line);
+    TextSnapshot_WillChangeText(tb->snapshot, line);
+    LineIntern_Unshare(line);
+    tb->changes++;
+}
+
+void TextBuffer_SplitLine(TextBuffer *tb) {
+    LinePager_Touch(tb->pager, tb->current_line);
+    Line *new_line = Line_Create();
+
+    // get text after cursor
+    size_t after_cursor_len = String_Length(&tb->current_line->text) - tb->gap.position;
+    String after_cursor = String_Substring(&tb->current_line->text, tb->gap.position, after_cursor_len);
+    // shorten current line
+    TextBuffer_WillChangeLine(tb, tb->current_line);
+    String_Shorten(&tb->current_line->text, tb->gap.position);
+    // transfer ownership of after_cursor to new_line
+    String_Take(&new_line->text, &after_cursor);
+    // insert new line
+    TextBuffer_InsertLineAfterCurrent(tb, new_line);
+    tb->current_line = new_line;
+    tb->gap.position = 0;
+}
+
+bool TextBuffer_JoinNextLine(TextBuffer *tb) {
+    if (!tb->current_line->next) {
+        return false;
+    }
+    TextBuffer_WillChangeLine(tb, tb->current_line);
+    LinePager_Touch(tb->pager, tb->current_line->next);
+    String_Append(&tb->current_line->text, &tb->current_line->next->text);
+    TextBuffer_DeleteLine(tb, tb->current_line->next);
+    return true;
+}
+
+size_t TextBuffer_GetLineNumber(TextBuffer *tb, const Line *line) {
+    if (!tb->numbered_line) {
+        tb->numbered_line = TextBuffer_GetFirstLine(tb);
+        tb->numbered_line_number = 0;
+    }
+    Line *current = tb->numbered_line;
+    size_t number = tb->numbered_line_number;
+    if (line->position >= current->position) {
+        while (current && current != line) {
+            current = current->next;
+            number++;
+        }
+    }
+    else {
+        while (current && current != line) {
+            current = current->prev;
+            number--;
+        }
+    }
+    if (!current) {
+        logError("Line is not part of the TextBuffer.");
+        return 0;
+    }
+    tb->numbered_line = current;
+    tb->numbered_line_number = number;
+    return number;
+}
+
+Line *TextBuffer_GetLine(TextBuffer *tb, size_t number) {
+    if (number >= tb->line_count) {
+        return NULL;
+    }
+    // make sure the cache is valid
+    TextBuffer_GetLineNumber(tb, tb->current_line);
+    Line *current = tb->numbered_line;
+    size_t current_number = tb->numbered_line_number;
+    while (current && current_number < number) {
+        current = current->next;
+        current_number++;
+    }
+    while (current && current_number > number) {
+        current = current->prev;
+        current_number--;
+    }
+    if (current) {
+        tb->numbered_line = current;
+        tb->numbered_line_number = current_number;
+    }
+    return current;
+}
+
 Line *TextBuffer_GetFirstLine(const TextBuffer *tb) {
     Line *current = tb->current_line;
     while (current->prev) {
@@ -111,7 +337,8 @@ Line *TextBuffer_GetFirstLine(const TextBuffer *tb) {
 }
 
 Line *TextBuffer_GetLastLine(const TextBuffer *tb) {
-    Line *current = tb->current_line;
+    // the hint is never behind the last line, so walking forward is enough
+    Line *current = tb->last_line ? tb->last_line : tb->current_line;
     while (current->next) {
         current = current->next;
     }
@@ -64,6 +64,7 @@
 #ifndef TEXTBUFFER_H
 #define TEXTBUFFER_H
 
+#include <stdint.h>
 #include "common/string.h"
 #include "io/file.h"
 
@@ -78,11 +79,37 @@ typedef struct _Gap {
 void Gap_Init(Gap *gap);
 void Gap_Deinit(Gap *gap);
 
+struct _TextSnapshot;
+struct _Journal;
+struct _LinePager;
+
 typedef struct _TextBuffer {
     Line *current_line;
     Gap gap;
 
     size_t line_count;
+    Line *last_line;        //< hint for TextBuffer_GetLastLine() (the last line or a line before it)
+    size_t line_number_offset;  //< lines of the file in front of the first line (only a window is loaded, see fileview.h)
+
+    // last result of a line number lookup (kept up to date on insert/delete)
+    Line *numbered_line;
+    size_t numbered_line_number;
+
+    // state of the file on disk, used for saving only what changed (see TextBuffer_SaveTail())
+    bool disk_known;        //< the fields below describe the file the buffer was loaded from/saved to
+    uint64_t disk_size;
+    int64_t disk_mtime_sec;
+    int64_t disk_mtime_nsec;
+    uint64_t clean_bytes;   //< length of the file prefix that is still identical to the buffer
+    Line *dirty_line;       //< first line after the clean prefix (NULL if there is none)
+
+    // lines in front of it are highlighted and follow each other (see syntax/textlayoutbindings.h)
+    Line *highlight_line;   //< first line the highlighting has to check (NULL if there is none)
+    size_t changes;         //< counts inserted, deleted and changed lines (never reset)
+
+    struct _TextSnapshot *snapshot;  //< snapshot that is currently alive (see textsnapshot.h) or NULL
+    struct _Journal *journal;        //< edit journal for crash recovery (see journal.h) or NULL
+    struct _LinePager *pager;        //< drops the text of cold unmodified lines (see linepager.h) or NULL
 } TextBuffer;
 
 void TextBuffer_Init(TextBuffer *tb);
@@ -100,6 +127,53 @@ void TextBuffer_InsertLineAtTop(TextBuffer *tb, Line *new_line);
 void TextBuffer_InsertLineAtBottom(TextBuffer *tb, Line *new_line);
 bool TextBuffer_DeleteLine(TextBuffer *tb, Line *line);
 
+/**
+ * @brief Must be called before the text of line is modified directly.
+ *
+ * Gives a living snapshot the chance to preserve the original text and
+ * marks the line as different from the file on disk.
+ */
+void TextBuffer_WillChangeLine(TextBuffer *tb, Line *line);
+
+/**
+ * @brief Remember that the buffer matches the file on disk with the given size and mtime.
+ *
+ * The disk offsets of the lines must be set already.
+ */
+void TextBuffer_SetDiskState(TextBuffer *tb, uint64_t size, int64_t mtime_sec, int64_t mtime_nsec);
+
+/**
+ * @brief Forget about the file on disk (the next save needs to write everything).
+ */
+void TextBuffer_InvalidateDiskState(TextBuffer *tb);
+
+/**
+ * @brief Split the current line at the gap position (the gap needs to be merged).
+ *
+ * The text after the gap moves into a new line which becomes the current line.
+ */
+void TextBuffer_SplitLine(TextBuffer *tb);
+
+/**
+ * @brief Append the next line to the current line and delete it.
+ *
+ * @returns false if there is no next line.
+ */
+bool TextBuffer_JoinNextLine(TextBuffer *tb);
+
+/**
+ * @brief Return the 0-based number of line.
+ *
+ * The last result is cached, so the cost is the distance to the previous
+ * lookup (usually tiny while editing).
+ */
+size_t TextBuffer_GetLineNumber(TextBuffer *tb, const Line *line);
+
+/**
+ * @brief Return the line with the 0-based number or NULL if out of range.
+ */
+Line *TextBuffer_GetLine(TextBuffer *tb, size_t number);
+
 Line *TextBuffer_GetFirstLine(const TextBuffer *tb);
 Line *TextBuffer_GetLastLine(const TextBuffer *tb);
 
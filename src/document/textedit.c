@@ -14,6 +14,7 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "textedit.h"
+#include "journal.h"
 #include "common/logging.h"
 #include "common/utf8_helper.h"
 
@@ -129,6 +130,17 @@ void TextEdit_MoveDown(TextEdit *te) {
 }
 
 // --- Editing ---
+
+// visible column of the cursor (the end of the gap)
+static size_t cursor_col(const TextBuffer *tb) {
+    return tb->gap.position - tb->gap.overlap + String_Length(&tb->gap.text);
+}
+
+// line number of the current line, only needed for the journal
+static uint64_t current_line_number(TextBuffer *tb) {
+    return tb->journal ? TextBuffer_GetLineNumber(tb, tb->current_line) : 0;
+}
+
 void TextEdit_InsertChar(TextEdit *te, uint32_t cp) {
     char buf[5];
     size_t len = utf8_from_codepoint(cp, buf);
@@ -136,7 +148,9 @@ void TextEdit_InsertChar(TextEdit *te, uint32_t cp) {
         return;
     }
     buf[len] = '\0';
-    String_AddChar(&te->tb->gap.text, buf);
+    TextBuffer *tb = te->tb;
+    Journal_RecordInsert(tb->journal, current_line_number(tb), cursor_col(tb), buf, len, 1);
+    String_AddChar(&tb->gap.text, buf);
     te->tl->dirty = true;
 }
 
@@ -145,6 +159,7 @@ void TextEdit_DeleteChar(TextEdit *te) {
     te->tl->dirty = true;
     TextBuffer_MergeGap(tb);
     if (tb->gap.position - tb->gap.overlap + String_Length(&tb->gap.text) < String_Length(&tb->current_line->text)) {
+        Journal_RecordDelete(tb->journal, current_line_number(tb), cursor_col(tb));
         tb->gap.position++;
         tb->gap.overlap++;
         return;
@@ -153,18 +168,20 @@ void TextEdit_DeleteChar(TextEdit *te) {
     if (!tb->current_line->next) {
         return;  // no next line... nothing to do
     }
-    String_Append(&tb->current_line->text, &tb->current_line->next->text);
-    TextBuffer_DeleteLine(tb, tb->current_line->next);
+    Journal_RecordDelete(tb->journal, current_line_number(tb), cursor_col(tb));
+    TextBuffer_JoinNextLine(tb);
 }
 
 void TextEdit_Backspace(TextEdit *te) {
     TextBuffer *tb = te->tb;
     te->tl->dirty = true;
     if (String_Length(&tb->gap.text) > 0) {
+        Journal_RecordDelete(tb->journal, current_line_number(tb), cursor_col(tb) - 1);
         String_Shorten(&tb->gap.text, String_Length(&tb->gap.text) - 1);
         return;
     }
     if (tb->gap.position - tb->gap.overlap > 0) {
+        Journal_RecordDelete(tb->journal, current_line_number(tb), cursor_col(tb) - 1);
         tb->gap.overlap++;
         return;
     }
@@ -177,32 +194,24 @@ void TextEdit_Backspace(TextEdit *te) {
     }
     tb->current_line = tb->current_line->prev;
     tb->gap.position = String_Length(&tb->current_line->text);
-    String_Append(&tb->current_line->text, &tb->current_line->next->text);
-    TextBuffer_DeleteLine(tb, tb->current_line->next);
+    Journal_RecordDelete(tb->journal, current_line_number(tb), tb->gap.position);
+    TextBuffer_JoinNextLine(tb);
 }
 
 void TextEdit_Newline(TextEdit *te) {
     TextBuffer *tb = te->tb;
     TextBuffer_MergeGap(tb);
-    Line *new_line = Line_Create();
-
-    // get text after cursor
-    size_t after_cursor_len = String_Length(&tb->current_line->text) - tb->gap.position;
-    String after_cursor = String_Substring(&tb->current_line->text, tb->gap.position, after_cursor_len);
-    // shorten current line
-    String_Shorten(&tb->current_line->text, tb->gap.position);
-    // transfer ownership of after_cursor to new_line
-    String_Take(&new_line->text, &after_cursor);
-    // insert new line
-    TextBuffer_InsertLineAfterCurrent(tb, new_line);
-    tb->current_line = new_line;
-    tb->gap.position = 0;
+    Journal_RecordNewline(tb->journal, current_line_number(tb), tb->gap.position);
+    TextBuffer_SplitLine(tb);
     te->tl->dirty = true;
 }
 
 // --- Optional convenience ---
 void TextEdit_InsertString(TextEdit *te, const String *string) {
-    String_Append(&te->tb->gap.text, string);
+    TextBuffer *tb = te->tb;
+    Journal_RecordInsert(tb->journal, current_line_number(tb), cursor_col(tb),
+                         string->bytes, string->bytes_size, String_Length(string));
+    String_Append(&tb->gap.text, string);
     te->tl->dirty = true;
 }
 
@@ -13,36 +13,335 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#define _DEFAULT_SOURCE  // pwritev()
 #include "textio.h"
 
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include "textedit.h"
+#include "linepager.h"
+#include "lineintern.h"
+#include "common/logging.h"
+
+static bool set_disk_state_from_fd(TextBuffer *tb, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        TextBuffer_InvalidateDiskState(tb);
+        return false;
+    }
+    TextBuffer_SetDiskState(tb, (uint64_t)st.st_size, (int64_t)st.st_mtim.tv_sec, (int64_t)st.st_mtim.tv_nsec);
+    return true;
+}
+
+static bool set_disk_state_from_path(TextBuffer *tb, const char *path, uint64_t expected_size) {
+    struct stat st;
+    if (stat(path, &st) != 0 || (uint64_t)st.st_size != expected_size) {
+        return false;
+    }
+    TextBuffer_SetDiskState(tb, (uint64_t)st.st_size, (int64_t)st.st_mtim.tv_sec, (int64_t)st.st_mtim.tv_nsec);
+    return true;
+}
 
 void TextBuffer_LoadFromFile(TextBuffer *tb, File *file) {
     TextBuffer_ReInit(tb);
     Line *first = tb->current_line;
     Line *current = tb->current_line;
     String *line;
+    // lines are only located on disk up to the first one that would not be written back the same way
+    uint64_t offset = 0;
+    Line *first_inexact = NULL;
+    uint64_t inexact_offset = 0;
+    // identical lines share their bytes
+    LineIntern intern;
+    LineIntern_Init(&intern);
     while ((line = File_ReadLine(file)) != NULL) {
         String_Take(&current->text, line);
         String_Destroy(line);   // ownership was transfered, so no total destruction needed, but works anyway since NULL guards in String_Destroy()
+        LineIntern_Add(&intern, current);
+        if (!first_inexact && file->line_bytes == current->text.bytes_size + 1) {
+            current->disk_offset = offset;
+        }
+        else if (!first_inexact) {
+            first_inexact = current;  // "\r\n" or missing "\n" at the end
+            inexact_offset = offset;
+        }
+        offset += file->line_bytes;
         Line *newline = Line_Create();
         TextBuffer_InsertLineAfterCurrent(tb, newline);
         tb->current_line = newline;
         current = newline;
     }
+    LineIntern_Deinit(&intern);
     // current is now a last empty line which was not in the document
     // so delete it
     tb->current_line = first;  // change current line first
     if (tb->line_count > 1) {
         TextBuffer_DeleteLine(tb, current);  // delete last empty line
     }
+
+    set_disk_state_from_fd(tb, fileno(file->fp));
+    if (first_inexact) {
+        tb->clean_bytes = inexact_offset;
+        tb->dirty_line = first_inexact;
+    }
+    else if (first->disk_offset < 0) {
+        tb->clean_bytes = 0;  // empty file
+        tb->dirty_line = first;
+    }
+}
+
+bool TextBuffer_LoadFromIndex(TextBuffer *tb, const char *path, const LineIndex *index) {
+    TextBuffer_ReInit(tb);
+    LinePager *pager = TextBuffer_EnablePaging(tb, path, SIZE_MAX);
+    if (!pager) {
+        return false;
+    }
+    // the file might have changed since the index was checked
+    struct stat st;
+    if (fstat(pager->fd, &st) != 0 || !LineIndex_Matches(index, &st)) {
+        TextBuffer_ReInit(tb);
+        return false;
+    }
+    Line *first = tb->current_line;
+    Line *current = NULL;
+    LineIndexCursor cursor;
+    LineIndexCursor_Init(&cursor, index);
+    uint64_t offset;
+    size_t length, char_count;
+    while (LineIndexCursor_Next(&cursor, &offset, &length, &char_count)) {
+        if (current) {
+            Line *newline = Line_Create();
+            TextBuffer_InsertLineAfterCurrent(tb, newline);
+            tb->current_line = newline;
+        }
+        current = tb->current_line;
+        LinePager_AddPagedOut(pager, current, (int64_t)offset, length, char_count);
+    }
+    tb->current_line = first;
+    set_disk_state_from_fd(tb, pager->fd);
+    return true;
 }
 
 void TextBuffer_SaveToFile(TextBuffer *tb, File *file) {
     TextBuffer_MergeGap(tb);
     Line *current = TextBuffer_GetFirstLine(tb);
     while (current) {
+        LinePager_Touch(tb->pager, current);
         File_WriteLine(file, &current->text);
         current = current->next;
     }
 }
+
+
+bool TextBuffer_SaveToPath(TextBuffer *tb, const char *path, bool sync, FileWriterStats *stats) {
+    FileWriter *fw = FileWriter_Open(path);
+    if (!fw) {
+        return false;
+    }
+    TextBuffer_MergeGap(tb);
+    Line *current = TextBuffer_GetFirstLine(tb);
+    bool ok = true;
+    // paged out lines are copied from the old file (or decompressed) without keeping them in memory
+    LinePagerScratch scratch;
+    LinePagerScratch_Init(&scratch);
+    while (current && ok) {
+        if (current->paged_out) {
+            int64_t offset = current->block ? current->block_offset : current->disk_offset;
+            ok = LinePager_WritePagedOut(tb->pager, fw, &scratch, current->block, offset, current->text.bytes_size);
+        }
+        else {
+            ok = FileWriter_Write(fw, current->text.bytes, current->text.bytes_size);
+        }
+        ok = ok && FileWriter_Write(fw, "\n", 1);
+        current = current->next;
+    }
+    ok = ok && FileWriter_Commit(fw, sync);
+    if (stats) {
+        *stats = fw->stats;
+    }
+    FileWriter_Close(fw);
+    LinePagerScratch_Deinit(&scratch);
+    if (ok) {
+        TextBuffer_MarkSaved(tb, path);
+    }
+    else {
+        TextBuffer_InvalidateDiskState(tb);
+    }
+    return ok;
+}
+
+void TextBuffer_MarkSaved(TextBuffer *tb, const char *path) {
+    // paged out lines are read from the new file from now on
+    LinePager_Reopen(tb->pager, path);
+    uint64_t offset = 0;
+    for (Line *line = TextBuffer_GetFirstLine(tb); line; line = line->next) {
+        line->disk_offset = offset;
+        offset += line->text.bytes_size + 1;
+    }
+    if (!set_disk_state_from_path(tb, path, offset)) {
+        TextBuffer_InvalidateDiskState(tb);
+    }
+}
+
+// pwritev() all iovecs, handle partial writes
+static bool pwrite_all(int fd, struct iovec *iov, int count, uint64_t *offset, FileWriterStats *stats) {
+    while (count > 0) {
+        ssize_t written = pwritev(fd, iov, count, (off_t)*offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logError("Cannot write file: %s", strerror(errno));
+            return false;
+        }
+        stats->write_calls++;
+        stats->bytes_written += (size_t)written;
+        *offset += (uint64_t)written;
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+bool TextBuffer_SaveTail(TextBuffer *tb, const char *path, bool sync, FileWriterStats *stats) {
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    FileWriterStats local = { .bytes_written = 0, .write_calls = 0, .seconds = 0.0 };
+
+    if (!tb->disk_known || tb->snapshot) {
+        return false;
+    }
+    TextBuffer_MergeGap(tb);
+
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    // the file must still be the version the buffer knows
+    struct stat st;
+    if (fstat(fd, &st) != 0
+        || (uint64_t)st.st_size != tb->disk_size
+        || (int64_t)st.st_mtim.tv_sec != tb->disk_mtime_sec
+        || (int64_t)st.st_mtim.tv_nsec != tb->disk_mtime_nsec
+        || tb->clean_bytes > tb->disk_size
+        || tb->disk_size - tb->clean_bytes > TEXTIO_TAIL_MAX_REWRITE) {
+        close(fd);
+        return false;
+    }
+
+    // their old bytes are overwritten, so lines that are paged out need to come back first
+    for (Line *line = tb->dirty_line; line; line = line->next) {
+        LinePager_Touch(tb->pager, line);
+    }
+
+    // write the lines after the clean prefix in place
+    struct iovec iov[FILEWRITER_MAX_IOV];
+    int count = 0;
+    uint64_t offset = tb->clean_bytes;
+    uint64_t line_offset = tb->clean_bytes;
+    bool ok = true;
+    for (Line *line = tb->dirty_line; line && ok; line = line->next) {
+        if (count + 2 > FILEWRITER_MAX_IOV) {
+            ok = pwrite_all(fd, iov, count, &offset, &local);
+            count = 0;
+        }
+        iov[count++] = (struct iovec){ .iov_base = line->text.bytes, .iov_len = line->text.bytes_size };
+        iov[count++] = (struct iovec){ .iov_base = "\n", .iov_len = 1 };
+        line->disk_offset = line_offset;
+        line_offset += line->text.bytes_size + 1;
+    }
+    ok = ok && pwrite_all(fd, iov, count, &offset, &local);
+    ok = ok && ftruncate(fd, (off_t)offset) == 0;
+    ok = ok && (!sync || fdatasync(fd) == 0);
+    ok = ok && set_disk_state_from_fd(tb, fd);
+    close(fd);
+
+    if (!ok) {
+        // the file is damaged now, only a full save can fix it
+        logError("Saving the end of %s in place failed.", path);
+        TextBuffer_InvalidateDiskState(tb);
+        return false;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    local.seconds = (double)(now.tv_sec - started.tv_sec) + (double)(now.tv_nsec - started.tv_nsec) / 1e9;
+    if (stats) {
+        *stats = local;
+    }
+    return true;
+}
+Line *TextBuffer_Follow(TextBuffer *tb, FileFollower *ff) {
+    const char *data;
+    size_t length = FileFollower_Poll(ff, &data);
+    if (length == 0) {
+        return NULL;
+    }
+    const char *end = data + length;
+    uint64_t offset = ff->data_offset;
+    // the new lines match the file if everything before them does
+    bool clean = tb->disk_known && !tb->dirty_line && tb->clean_bytes == offset && tb->disk_size == offset;
+
+    Line *last = TextBuffer_GetLastLine(tb);
+    Line *first_new = NULL;
+    // the empty line of an empty file is filled instead of keeping it in front
+    bool fill_empty = offset == 0 && tb->line_count == 1 && String_Length(&last->text) == 0;
+    if (ff->data_continues_line || fill_empty) {
+        const char *newline = memchr(data, '\n', length);
+        size_t bytes = newline - data;
+        if (bytes > 0 && data[bytes - 1] == '\r') {
+            bytes--;
+        }
+        String rest = String_FromCStr(data, bytes);
+        TextBuffer_WillChangeLine(tb, last);
+        String_Append(&last->text, &rest);
+        String_Deinit(&rest);
+        offset += newline + 1 - data;
+        data = newline + 1;
+        clean = false;
+        first_new = last;
+    }
+
+    while (data < end) {
+        const char *newline = memchr(data, '\n', end - data);
+        size_t bytes = newline - data;
+        if (bytes > 0 && data[bytes - 1] == '\r') {
+            bytes--;
+            clean = false;  // would be saved without "\r"
+        }
+        Line *line = Line_Create();
+        String_Set(&line->text, String_FromCStr(data, bytes));
+        TextBuffer_InsertLineAtBottom(tb, line);
+        if (clean) {
+            line->disk_offset = offset;
+        }
+        if (!first_new) {
+            first_new = line;
+        }
+        offset += newline + 1 - data;
+        data = newline + 1;
+    }
+
+    if (clean) {
+        // the mtime is only known if nothing was appended to the file in the meantime
+        struct stat st;
+        if (fstat(ff->fd, &st) == 0 && (uint64_t)st.st_size == offset) {
+            TextBuffer_SetDiskState(tb, offset, (int64_t)st.st_mtim.tv_sec, (int64_t)st.st_mtim.tv_nsec);
+        }
+        else {
+            TextBuffer_SetDiskState(tb, offset, 0, 0);  // the next poll gets it right
+        }
+    }
+    return first_new;
+}
@@ -16,11 +16,79 @@
 #ifndef TEXTIO_H
 #define TEXTIO_H
 
+#include <stdbool.h>
 #include "textbuffer.h"
+#include "lineindex.h"
 #include "io/file.h"
+#include "io/filewriter.h"
+#include "io/filefollower.h"
+
+#define TEXTIO_TAIL_MAX_REWRITE (16 * 1024 * 1024)    //< overwrite at most this many bytes in place, save atomically otherwise
 
 
 void TextBuffer_LoadFromFile(TextBuffer *tb, File *file);
+
+/**
+ * @brief Load path with the cached line offsets of index, without reading the file.
+ *
+ * All lines are paged out, paging is enabled without a budget.
+ *
+ * @returns false if path cannot be opened or does not match index (tb is empty then).
+ */
+bool TextBuffer_LoadFromIndex(TextBuffer *tb, const char *path, const LineIndex *index);
+
+/**
+ * @brief Write tb line by line to an already opened file (buffered by stdio).
+ */
 void TextBuffer_SaveToFile(TextBuffer *tb, File *file);
 
+/**
+ * @brief Save tb to path.
+ *
+ * The lines are handed to the kernel in large `writev()` batches directly from
+ * the line buffers. The text is written to a temporary file that replaces
+ * path only if everything was written, so the original file survives a crash
+ * during the save.
+ *
+ * @param sync If true the data is `fsync()`ed before the file is replaced.
+ * @param stats If not NULL it is filled with the number of bytes, syscalls and the time needed.
+ * @returns true on success.
+ */
+bool TextBuffer_SaveToPath(TextBuffer *tb, const char *path, bool sync, FileWriterStats *stats);
+
+/**
+ * @brief Save only what changed behind the unchanged beginning of the file.
+ *
+ * If path is still the file the buffer was loaded from (or last saved to),
+ * the lines after the clean prefix are written in place with `pwritev()` and
+ * the file is truncated to the new size. Appending a line to a huge file
+ * therefore writes only that line.
+ *
+ * This is not done if the file changed on disk, the buffer never was
+ * saved/loaded, line breaks would change ("\r\n"), a snapshot is alive or
+ * more than TEXTIO_TAIL_MAX_REWRITE bytes of the old file would be
+ * overwritten (in place writing is not crash safe, so keep it small).
+ *
+ * @returns false if the file was not saved, use the full save then.
+ */
+bool TextBuffer_SaveTail(TextBuffer *tb, const char *path, bool sync, FileWriterStats *stats);
+
+/**
+ * @brief The buffer was written completely to path (e.g. by a BackgroundSave).
+ *
+ * Recalculates the disk offsets of all lines, so later saves can be incremental.
+ */
+void TextBuffer_MarkSaved(TextBuffer *tb, const char *path);
+
+/**
+ * @brief Append the lines that were added to the followed file since the last call.
+ *
+ * The lines are appended at the bottom, so the cost only depends on the amount
+ * of new data (at most FILEFOLLOWER_MAX_READ bytes per call). If the buffer
+ * was unchanged, the new lines are marked as identical to the file on disk.
+ *
+ * @returns The first new (or continued) line or NULL if nothing changed.
+ */
+Line *TextBuffer_Follow(TextBuffer *tb, FileFollower *ff);
+
 #endif
\ No newline at end of file
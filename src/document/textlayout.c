@@ -14,6 +14,7 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "textlayout.h"
+#include "linepager.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -264,6 +265,34 @@ bool TextLayout_ScrollDown(TextLayout *tl) {
     return true;
 }
 
+// the last row shows the end of the document (or is empty)
+static bool end_visible(TextLayout *tl) {
+    VisualLine *vl = &tl->cache[tl->first_visual_line_idx + tl->height - 1];
+    if (!vl->src) {
+        return true;
+    }
+    int text_length = String_Length(&vl->src->text);
+    if (vl->src == tl->tb->current_line) {
+        text_length += String_Length(&tl->tb->gap.text) - tl->tb->gap.overlap;
+    }
+    return !vl->src->next && vl->offset + vl->length >= text_length;
+}
+
+void TextLayout_ScrollToEnd(TextLayout *tl) {
+    if (!tl || !tl->tb || tl->height <= 0 || tl->width <= 0) {
+        return;
+    }
+    Line *first = TextBuffer_GetLastLine(tl->tb);
+    for (int i = 1; i < tl->height && first->prev; i++) {
+        first = first->prev;
+    }
+    TextLayout_SetFirstLine(tl, first, 0);
+    TextLayout_Recalc(tl, 0);
+    // wrapped lines need more than one row
+    while (!end_visible(tl) && TextLayout_ScrollDown(tl)) {
+    }
+}
+
 static void increase_cache_capacity(TextLayout *tl) {
     if (!tl) {
         return;
@@ -288,6 +317,7 @@ static void increase_cache_capacity(TextLayout *tl) {
 
 // vl: target, line: src, offset: position in line to start, with: display width
 static void calc_visual_line(VisualLine *vl, Line *line, int offset, TextLayout *tl) {
+    LinePager_Touch(tl->tb->pager, line);
     int width = tl->width;
     int tabstop = tl->tabstop;
     const TextBuffer *tb = tl->tb;
@@ -397,6 +427,8 @@ VisualLine *TextLayout_GetVisualLine(TextLayout *tl, int y) {
     if (tl->cache[y + tl->first_visual_line_idx].src == NULL) {
         return NULL;
     }
+    // the line is drawn from this, keep its text in memory
+    LinePager_Touch(tl->tb->pager, tl->cache[y + tl->first_visual_line_idx].src);
     return &tl->cache[y + tl->first_visual_line_idx];
 }
 
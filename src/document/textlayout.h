@@ -113,6 +113,13 @@ bool TextLayout_ScrollUp(TextLayout *tl);
  */
 bool TextLayout_ScrollDown(TextLayout *tl);
 
+/**
+ * @brief Scroll so that the end of the document is in the last row of the screen.
+ *
+ * Only the last screen of lines is looked at, so the cost doesn't depend on the document size.
+ */
+void TextLayout_ScrollToEnd(TextLayout *tl);
+
 /**
  * @brief Recalc the TextLayout cache, starting at line start_y.
  * 
@@ -15,6 +15,10 @@
  */
 #include "textselection.h"
 
+#include <limits.h>
+#include "journal.h"
+#include "linepager.h"
+
 void TextSelection_Init(TextSelection *ts) {
     ts->start = NULL;
     ts->start_idx = 0;
@@ -74,6 +78,21 @@ bool TextSelection_IsSelected(TextSelection *ts, Line *line, int idx) {
     return check_begin && check_end;
 }
 
+bool TextSelection_GetRange(const TextSelection *ts, const Line *line, int *from, int *to) {
+    if (!ts || !ts->start || !ts->end || !line) {
+        return false;
+    }
+    Line *start, *end;
+    int start_idx, end_idx;
+    ordered(ts, &start, &start_idx, &end, &end_idx);
+    if (line->position < start->position || line->position > end->position) {
+        return false;
+    }
+    *from = line == start ? start_idx : 0;
+    *to = line == end ? end_idx : INT_MAX;
+    return *from < *to;
+}
+
 bool TextSelection_Started(TextSelection *ts) {
     return ts->start != NULL;
 }
@@ -96,7 +115,7 @@ TextSelection TextSelection_Ordered(const TextSelection *ts) {
     return o;
 }
 
-String TextSelection_Extract(TextSelection *ts) {
+String TextSelection_Extract(TextSelection *ts, const TextBuffer *tb) {
     if (!ts || !ts->start || !ts->end) {
         return String_Empty();
     }
@@ -104,6 +123,9 @@ String TextSelection_Extract(TextSelection *ts) {
     Line *start, *end;
     int start_idx, end_idx;
     ordered(ts, &start, &start_idx, &end, &end_idx);
+    for (Line *line = start; line != end->next; line = line->next) {
+        LinePager_Touch(tb->pager, line);
+    }
 
     String out;
 
@@ -134,10 +156,16 @@ void TextSelection_Delete(TextSelection *ts, TextBuffer *tb) {
         return;
     }
     TextSelection sel = TextSelection_Ordered(ts);
+    if (tb->journal) {
+        Journal_RecordDeleteRange(tb->journal, TextBuffer_GetLineNumber(tb, sel.start), sel.start_idx,
+                                  TextBuffer_GetLineNumber(tb, sel.end), sel.end_idx);
+    }
 
+    LinePager_Touch(tb->pager, sel.end);
     String end = String_Substring(&sel.end->text, sel.end_idx, String_Length(&sel.end->text) - sel.end_idx);
     
     if (sel.start == sel.end) {
+        TextBuffer_WillChangeLine(tb, sel.start);
         String_Shorten(&sel.start->text, sel.start_idx);
         String_Append(&sel.start->text, &end);
     }
@@ -150,6 +178,7 @@ void TextSelection_Delete(TextSelection *ts, TextBuffer *tb) {
             current = current->prev;
             TextBuffer_DeleteLine(tb, current->next);
         }
+        TextBuffer_WillChangeLine(tb, sel.start);
         String_Shorten(&sel.start->text, sel.start_idx);
         String_Append(&sel.start->text, &end);
     }
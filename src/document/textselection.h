@@ -35,6 +35,15 @@ void TextSelection_Abort(TextSelection *ts);
 
 bool TextSelection_IsSelected(TextSelection *ts, Line *line, int idx);
 
+/**
+ * @brief Get the selected characters of line, [from, to) (to is INT_MAX if the selection continues in the next line).
+ *
+ * The same as calling TextSelection_IsSelected() for every character, but only once per line.
+ *
+ * @returns false if nothing of line is selected.
+ */
+bool TextSelection_GetRange(const TextSelection *ts, const Line *line, int *from, int *to);
+
 bool TextSelection_Started(TextSelection *ts);
 
 void TextSelection_Begin(TextSelection *ts, Line *line, int idx);
@@ -42,7 +51,7 @@ void TextSelection_End(TextSelection *ts, Line *line, int idx);
 
 TextSelection TextSelection_Ordered(const TextSelection *ts);
 
-String TextSelection_Extract(TextSelection *ts);
+String TextSelection_Extract(TextSelection *ts, const TextBuffer *tb);
 void TextSelection_Delete(TextSelection *ts, TextBuffer *tb);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,169 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "textsnapshot.h"
+
+#include <stdlib.h>
+#include "lineintern.h"
+#include "common/logging.h"
+
+static LineSnapshot *get_state(TextSnapshot *snap, Line *line) {
+    if (line->snapshot) {
+        return line->snapshot;
+    }
+    LineSnapshot *state = malloc(sizeof(LineSnapshot));
+    if (!state) {
+        logFatal("Cannot allocate memory for LineSnapshot.");
+    }
+    state->line = line;
+    String_Init(&state->text);
+    state->next = NULL;
+    state->text_saved = false;
+    state->text_shared = false;
+    state->next_saved = false;
+    state->added = false;
+    state->parked = false;
+    state->chain = snap->states;
+    snap->states = state;
+    line->snapshot = state;
+    return state;
+}
+
+TextSnapshot *TextBuffer_TakeSnapshot(TextBuffer *tb) {
+    if (tb->snapshot) {
+        return NULL;
+    }
+    TextSnapshot *snap = malloc(sizeof(TextSnapshot));
+    if (!snap) {
+        logFatal("Cannot allocate memory for TextSnapshot.");
+    }
+    TextBuffer_MergeGap(tb);
+    pthread_mutex_init(&snap->lock, NULL);
+    snap->first = TextBuffer_GetFirstLine(tb);
+    snap->line_count = tb->line_count;
+    snap->states = NULL;
+    snap->saved_lines = 0;
+    tb->snapshot = snap;
+    return snap;
+}
+
+void TextBuffer_ReleaseSnapshot(TextBuffer *tb) {
+    TextSnapshot *snap = tb->snapshot;
+    if (!snap) {
+        return;
+    }
+    LineSnapshot *state = snap->states;
+    while (state) {
+        LineSnapshot *tmp = state->chain;
+        if (state->parked) {
+            Line_Destroy(state->line);
+        }
+        else {
+            state->line->snapshot = NULL;
+        }
+        if (state->text_shared) {
+            LineIntern_Release(&state->text);
+        }
+        else {
+            String_Deinit(&state->text);
+        }
+        free(state);
+        state = tmp;
+    }
+    pthread_mutex_destroy(&snap->lock);
+    free(snap);
+    tb->snapshot = NULL;
+}
+
+void TextSnapshot_Lock(TextSnapshot *snap) {
+    pthread_mutex_lock(&snap->lock);
+}
+
+void TextSnapshot_Unlock(TextSnapshot *snap) {
+    pthread_mutex_unlock(&snap->lock);
+}
+
+Line *TextSnapshot_Next(const TextSnapshot *snap, const Line *line) {
+    (void)snap;
+    if (line->snapshot && line->snapshot->next_saved) {
+        return line->snapshot->next;
+    }
+    return line->next;
+}
+
+const String *TextSnapshot_Text(const TextSnapshot *snap, const Line *line) {
+    (void)snap;
+    if (line->snapshot && line->snapshot->text_saved) {
+        return &line->snapshot->text;
+    }
+    return &line->text;
+}
+
+void TextSnapshot_WillChangeText(TextSnapshot *snap, Line *line) {
+    if (!snap || !line) {
+        return;
+    }
+    // fast path: already preserved or not part of the snapshot
+    if (line->snapshot && (line->snapshot->text_saved || line->snapshot->added)) {
+        return;
+    }
+    TextSnapshot_Lock(snap);
+    LineSnapshot *state = get_state(snap, line);
+    // move the original bytes away, the line continues with a copy
+    String_Deinit(&state->text);
+    state->text = line->text;
+    line->text = String_Copy(&state->text);
+    state->text_saved = true;
+    state->text_shared = line->shared;
+    line->shared = false;
+    snap->saved_lines++;
+    TextSnapshot_Unlock(snap);
+}
+
+void TextSnapshot_WillChangeNext(TextSnapshot *snap, Line *line) {
+    if (!snap || !line) {
+        return;
+    }
+    if (line->snapshot && (line->snapshot->next_saved || line->snapshot->added)) {
+        return;
+    }
+    TextSnapshot_Lock(snap);
+    LineSnapshot *state = get_state(snap, line);
+    state->next = line->next;
+    state->next_saved = true;
+    TextSnapshot_Unlock(snap);
+}
+
+void TextSnapshot_LineAdded(TextSnapshot *snap, Line *line) {
+    if (!snap || !line) {
+        return;
+    }
+    TextSnapshot_Lock(snap);
+    get_state(snap, line)->added = true;
+    TextSnapshot_Unlock(snap);
+}
+
+bool TextSnapshot_WillDeleteLine(TextSnapshot *snap, Line *line) {
+    if (!snap || !line) {
+        return false;
+    }
+    TextSnapshot_WillChangeNext(snap, line->prev);
+    TextSnapshot_WillChangeNext(snap, line);
+    TextSnapshot_Lock(snap);
+    // also lines that were added later are parked, so no state is left dangling
+    get_state(snap, line)->parked = true;
+    TextSnapshot_Unlock(snap);
+    return true;
+}
@@ -0,0 +1,125 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file textsnapshot.h
+ * @brief Immutable view of a TextBuffer that stays valid while editing goes on.
+ *
+ * Taking a snapshot is O(1): nothing is copied. Instead the TextBuffer reports
+ * every change *before* it happens and the snapshot keeps what the change
+ * would destroy (copy-on-write at line granularity):
+ *
+ * - If the text of a line changes for the first time, the original String is
+ *   moved into the snapshot and the line continues with a copy. The original
+ *   bytes are never touched again until the snapshot is released.
+ * - If the successor of a line changes for the first time, the original
+ *   successor is remembered.
+ * - Deleted lines are parked (not destroyed) until the snapshot is released.
+ * - Lines inserted later are marked, so they are ignored by the snapshot.
+ *
+ * So the memory needed is O(changed lines).
+ *
+ * The snapshot is meant to be read from another thread. Reading the structure
+ * (TextSnapshot_Next(), TextSnapshot_Text()) needs the lock, but the bytes of a
+ * returned String stay valid and unchanged after unlocking until the snapshot
+ * is released.
+ */
+#ifndef TEXTSNAPSHOT_H
+#define TEXTSNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "common/string.h"
+#include "textbuffer.h"
+
+typedef struct _LineSnapshot {
+    Line *line;             //< line this state belongs to
+    String text;            //< original text (if text_saved)
+    Line *next;             //< original successor (if next_saved)
+    bool text_saved;
+    bool text_shared;       //< text holds a reference to shared bytes (see lineintern.h)
+    bool next_saved;
+    bool added;             //< line was inserted after the snapshot was taken
+    bool parked;            //< line was deleted, destroy it on release
+    struct _LineSnapshot *chain;    //< all states of a snapshot are chained for the cleanup
+} LineSnapshot;
+
+typedef struct _TextSnapshot {
+    pthread_mutex_t lock;
+    Line *first;            //< first line at snapshot time
+    size_t line_count;      //< number of lines at snapshot time
+    LineSnapshot *states;
+    size_t saved_lines;     //< number of lines whose text was preserved
+} TextSnapshot;
+
+/**
+ * @brief Take a snapshot of tb.
+ *
+ * The gap is merged first. There can be only one snapshot per buffer at a time.
+ *
+ * @returns The snapshot (owned by tb) or NULL if there already is one.
+ */
+TextSnapshot *TextBuffer_TakeSnapshot(TextBuffer *tb);
+
+/**
+ * @brief Release the snapshot of tb and free everything it preserved.
+ *
+ * Nobody may read the snapshot anymore.
+ */
+void TextBuffer_ReleaseSnapshot(TextBuffer *tb);
+
+/**
+ * @brief Lock the snapshot for reading.
+ */
+void TextSnapshot_Lock(TextSnapshot *snap);
+void TextSnapshot_Unlock(TextSnapshot *snap);
+
+/**
+ * @brief Return the successor of line at snapshot time (lock needed).
+ */
+Line *TextSnapshot_Next(const TextSnapshot *snap, const Line *line);
+
+/**
+ * @brief Return the text of line at snapshot time (lock needed).
+ */
+const String *TextSnapshot_Text(const TextSnapshot *snap, const Line *line);
+
+/* Hooks called by the TextBuffer. They do nothing if there is no snapshot. */
+
+/**
+ * @brief The text of line is going to change.
+ */
+void TextSnapshot_WillChangeText(TextSnapshot *snap, Line *line);
+
+/**
+ * @brief The successor of line is going to change.
+ */
+void TextSnapshot_WillChangeNext(TextSnapshot *snap, Line *line);
+
+/**
+ * @brief line was just inserted.
+ */
+void TextSnapshot_LineAdded(TextSnapshot *snap, Line *line);
+
+/**
+ * @brief line is going to be deleted.
+ *
+ * @returns true if the snapshot took the line (the caller must only unlink it).
+ */
+bool TextSnapshot_WillDeleteLine(TextSnapshot *snap, Line *line);
+
+#endif
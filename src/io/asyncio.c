@@ -0,0 +1,441 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE  // preadv(), pwritev()
+#include "asyncio.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "common/logging.h"
+
+/*****************************************************************************
+ * io_uring
+ *****************************************************************************/
+
+static int uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void *field(void *ring, unsigned offset) {
+    return (char*)ring + offset;
+}
+
+static void uring_unmap(AsyncIO *aio) {
+    if (aio->sqes) {
+        munmap(aio->sqes, aio->sqes_size);
+    }
+    if (aio->cq_ring && aio->cq_ring != aio->sq_ring) {
+        munmap(aio->cq_ring, aio->cq_ring_size);
+    }
+    if (aio->sq_ring) {
+        munmap(aio->sq_ring, aio->sq_ring_size);
+    }
+    close(aio->ring_fd);
+}
+
+static bool uring_init(AsyncIO *aio) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    aio->ring_fd = uring_setup(aio->depth, &params);
+    if (aio->ring_fd < 0) {
+        return false;
+    }
+    aio->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    aio->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && aio->cq_ring_size > aio->sq_ring_size) {
+        aio->sq_ring_size = aio->cq_ring_size;
+    }
+    aio->sq_ring = mmap(NULL, aio->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        aio->ring_fd, IORING_OFF_SQ_RING);
+    aio->cq_ring = NULL;
+    aio->sqes = NULL;
+    if (aio->sq_ring == MAP_FAILED) {
+        aio->sq_ring = NULL;
+        uring_unmap(aio);
+        return false;
+    }
+    if (single_mmap) {
+        aio->cq_ring = aio->sq_ring;
+    }
+    else {
+        aio->cq_ring = mmap(NULL, aio->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            aio->ring_fd, IORING_OFF_CQ_RING);
+        if (aio->cq_ring == MAP_FAILED) {
+            aio->cq_ring = NULL;
+            uring_unmap(aio);
+            return false;
+        }
+    }
+    aio->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    aio->sqes = mmap(NULL, aio->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     aio->ring_fd, IORING_OFF_SQES);
+    if (aio->sqes == MAP_FAILED) {
+        aio->sqes = NULL;
+        uring_unmap(aio);
+        return false;
+    }
+    aio->sq_tail = field(aio->sq_ring, params.sq_off.tail);
+    aio->sq_mask = field(aio->sq_ring, params.sq_off.ring_mask);
+    aio->sq_array = field(aio->sq_ring, params.sq_off.array);
+    aio->cq_head = field(aio->cq_ring, params.cq_off.head);
+    aio->cq_tail = field(aio->cq_ring, params.cq_off.tail);
+    aio->cq_mask = field(aio->cq_ring, params.cq_off.ring_mask);
+    aio->cqes = field(aio->cq_ring, params.cq_off.cqes);
+    return true;
+}
+
+static bool uring_submit(AsyncIO *aio, AsyncIORequest *request) {
+    // only this thread writes the tail, the kernel reads it
+    unsigned tail = *aio->sq_tail;
+    unsigned index = tail & *aio->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe*)aio->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = request->op == ASYNCIO_READ ? IORING_OP_READV : IORING_OP_WRITEV;
+    sqe->fd = request->fd;
+    sqe->addr = (uint64_t)(uintptr_t)request->iov;
+    sqe->len = (unsigned)request->iov_count;
+    sqe->off = request->offset;
+    sqe->user_data = (uint64_t)(uintptr_t)request;
+    aio->sq_array[index] = index;
+    __atomic_store_n(aio->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    int submitted;
+    do {
+        submitted = uring_enter(aio->ring_fd, 1, 0, 0);
+    } while (submitted < 0 && errno == EINTR);
+    if (submitted != 1) {
+        // take the entry back, the kernel did not consume it
+        __atomic_store_n(aio->sq_tail, tail, __ATOMIC_RELEASE);
+        return false;
+    }
+    return true;
+}
+
+// mark all completed requests as done
+static void uring_reap(AsyncIO *aio) {
+    unsigned head = *aio->cq_head;
+    while (head != __atomic_load_n(aio->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = (struct io_uring_cqe*)aio->cqes + (head & *aio->cq_mask);
+        AsyncIORequest *request = (AsyncIORequest*)(uintptr_t)cqe->user_data;
+        request->result = cqe->res;
+        request->done = true;
+        aio->in_flight--;
+        head++;
+    }
+    __atomic_store_n(aio->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static void uring_wait(AsyncIO *aio, AsyncIORequest *request) {
+    uring_reap(aio);
+    while (!request->done) {
+        if (uring_enter(aio->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            logFatal("Waiting for io_uring failed: %s", strerror(errno));
+        }
+        uring_reap(aio);
+    }
+}
+
+/*****************************************************************************
+ * Threads
+ *****************************************************************************/
+
+static ssize_t perform(const AsyncIORequest *request) {
+    ssize_t result;
+    do {
+        result = request->op == ASYNCIO_READ
+                 ? preadv(request->fd, request->iov, request->iov_count, (off_t)request->offset)
+                 : pwritev(request->fd, request->iov, request->iov_count, (off_t)request->offset);
+    } while (result < 0 && errno == EINTR);
+    return result < 0 ? -errno : result;
+}
+
+static void *worker(void *arg) {
+    AsyncIO *aio = arg;
+    pthread_mutex_lock(&aio->mutex);
+    while (true) {
+        while (!aio->queue_head && !aio->stopping) {
+            pthread_cond_wait(&aio->work, &aio->mutex);
+        }
+        if (!aio->queue_head) {
+            break;  // stopping
+        }
+        AsyncIORequest *request = aio->queue_head;
+        aio->queue_head = request->next;
+        if (!aio->queue_head) {
+            aio->queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&aio->mutex);
+        ssize_t result = perform(request);
+        pthread_mutex_lock(&aio->mutex);
+        request->result = result;
+        request->done = true;
+        pthread_cond_broadcast(&aio->finished);
+    }
+    pthread_mutex_unlock(&aio->mutex);
+    return NULL;
+}
+
+static void threads_stop(AsyncIO *aio) {
+    pthread_mutex_lock(&aio->mutex);
+    aio->stopping = true;
+    pthread_cond_broadcast(&aio->work);
+    pthread_mutex_unlock(&aio->mutex);
+    for (size_t i = 0; i < aio->thread_count; i++) {
+        pthread_join(aio->threads[i], NULL);
+    }
+    pthread_cond_destroy(&aio->work);
+    pthread_cond_destroy(&aio->finished);
+    pthread_mutex_destroy(&aio->mutex);
+}
+
+static bool threads_init(AsyncIO *aio) {
+    pthread_mutex_init(&aio->mutex, NULL);
+    pthread_cond_init(&aio->work, NULL);
+    pthread_cond_init(&aio->finished, NULL);
+    aio->queue_head = NULL;
+    aio->queue_tail = NULL;
+    aio->stopping = false;
+    aio->thread_count = 0;
+    size_t count = aio->depth < ASYNCIO_THREADS ? aio->depth : ASYNCIO_THREADS;
+    while (aio->thread_count < count) {
+        if (pthread_create(&aio->threads[aio->thread_count], NULL, worker, aio) != 0) {
+            break;
+        }
+        aio->thread_count++;
+    }
+    if (aio->thread_count == 0) {
+        threads_stop(aio);
+        return false;
+    }
+    return true;
+}
+
+static void threads_submit(AsyncIO *aio, AsyncIORequest *request) {
+    pthread_mutex_lock(&aio->mutex);
+    request->next = NULL;
+    if (aio->queue_tail) {
+        aio->queue_tail->next = request;
+    }
+    else {
+        aio->queue_head = request;
+    }
+    aio->queue_tail = request;
+    pthread_cond_signal(&aio->work);
+    pthread_mutex_unlock(&aio->mutex);
+}
+
+static void threads_wait(AsyncIO *aio, AsyncIORequest *request) {
+    pthread_mutex_lock(&aio->mutex);
+    while (!request->done) {
+        pthread_cond_wait(&aio->finished, &aio->mutex);
+    }
+    pthread_mutex_unlock(&aio->mutex);
+    aio->in_flight--;
+}
+
+/*****************************************************************************
+ * AsyncIO
+ *****************************************************************************/
+
+AsyncIO *AsyncIO_Create(unsigned depth, AsyncIOBackend backend) {
+    AsyncIO *aio = malloc(sizeof(AsyncIO));
+    if (!aio) {
+        logFatal("Cannot allocate memory for AsyncIO.");
+    }
+    aio->depth = depth > 0 ? depth : 1;
+    aio->in_flight = 0;
+    if (backend != ASYNCIO_BACKEND_THREADS && uring_init(aio)) {
+        aio->backend = ASYNCIO_BACKEND_URING;
+        return aio;
+    }
+    if (backend != ASYNCIO_BACKEND_URING && threads_init(aio)) {
+        aio->backend = ASYNCIO_BACKEND_THREADS;
+        return aio;
+    }
+    free(aio);
+    return NULL;
+}
+
+void AsyncIO_Destroy(AsyncIO *aio) {
+    if (!aio) {
+        return;
+    }
+    if (aio->backend == ASYNCIO_BACKEND_URING) {
+        // the kernel might still write into buffers of pending requests
+        while (aio->in_flight > 0) {
+            if (uring_enter(aio->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                break;
+            }
+            uring_reap(aio);
+        }
+        uring_unmap(aio);
+    }
+    else {
+        threads_stop(aio);  // the workers finish the queue first
+    }
+    free(aio);
+}
+
+bool AsyncIO_Submit(AsyncIO *aio, AsyncIORequest *request) {
+    if (aio->in_flight >= aio->depth) {
+        return false;
+    }
+    request->done = false;
+    request->result = 0;
+    if (aio->backend == ASYNCIO_BACKEND_URING) {
+        if (!uring_submit(aio, request)) {
+            return false;
+        }
+    }
+    else {
+        threads_submit(aio, request);
+    }
+    aio->in_flight++;
+    return true;
+}
+
+void AsyncIO_Wait(AsyncIO *aio, AsyncIORequest *request) {
+    if (aio->backend == ASYNCIO_BACKEND_URING) {
+        uring_wait(aio, request);
+    }
+    else {
+        threads_wait(aio, request);
+    }
+}
+
+const char *AsyncIO_BackendName(const AsyncIO *aio) {
+    return aio->backend == ASYNCIO_BACKEND_URING ? "io_uring" : "threads";
+}
+
+/*****************************************************************************
+ * AsyncReader
+ *****************************************************************************/
+
+static void submit_block(AsyncReader *reader, unsigned slot) {
+    AsyncIORequest *request = &reader->requests[slot];
+    reader->iov[slot].iov_base = reader->buffers[slot];
+    reader->iov[slot].iov_len = ASYNCIO_READ_BLOCK;
+    request->op = ASYNCIO_READ;
+    request->fd = reader->fd;
+    request->iov = &reader->iov[slot];
+    request->iov_count = 1;
+    request->offset = reader->next_offset;
+    if (!AsyncIO_Submit(reader->aio, request)) {
+        // read it right away
+        request->result = perform(request);
+        request->done = true;
+        reader->submitted[slot] = false;
+    }
+    else {
+        reader->submitted[slot] = true;
+    }
+    reader->next_offset += ASYNCIO_READ_BLOCK;
+}
+
+AsyncReader *AsyncReader_Open(int fd, AsyncIOBackend backend) {
+    AsyncIO *aio = AsyncIO_Create(ASYNCIO_READ_DEPTH, backend);
+    if (!aio) {
+        return NULL;
+    }
+    AsyncReader *reader = malloc(sizeof(AsyncReader));
+    if (!reader) {
+        logFatal("Cannot allocate memory for AsyncReader.");
+    }
+    reader->aio = aio;
+    reader->fd = fd;
+    reader->head = 0;
+    reader->returned = false;
+    reader->next_offset = 0;
+    reader->end = false;
+    for (unsigned i = 0; i < ASYNCIO_READ_DEPTH; i++) {
+        reader->buffers[i] = malloc(ASYNCIO_READ_BLOCK);
+        if (!reader->buffers[i]) {
+            logFatal("Cannot allocate memory for AsyncReader.");
+        }
+    }
+    for (unsigned i = 0; i < ASYNCIO_READ_DEPTH; i++) {
+        submit_block(reader, i);
+    }
+    return reader;
+}
+
+void AsyncReader_Close(AsyncReader *reader) {
+    if (!reader) {
+        return;
+    }
+    AsyncIO_Destroy(reader->aio);
+    for (unsigned i = 0; i < ASYNCIO_READ_DEPTH; i++) {
+        free(reader->buffers[i]);
+    }
+    free(reader);
+}
+
+bool AsyncReader_Next(AsyncReader *reader, const char **bytes, size_t *length) {
+    unsigned slot = reader->head;
+    if (reader->returned) {
+        // the caller is done with the previous block, its buffer reads ahead now
+        unsigned previous = (slot + ASYNCIO_READ_DEPTH - 1) % ASYNCIO_READ_DEPTH;
+        if (!reader->end) {
+            submit_block(reader, previous);
+        }
+        reader->returned = false;
+    }
+    AsyncIORequest *request = &reader->requests[slot];
+    if (reader->submitted[slot]) {
+        AsyncIO_Wait(reader->aio, request);
+        reader->submitted[slot] = false;
+    }
+    else if (!request->done) {
+        return false;
+    }
+    if (request->result < 0) {
+        logError("Cannot read file: %s", strerror((int)-request->result));
+        reader->end = true;
+        return false;
+    }
+    // a short read is not necessarily the end, read the rest of the block
+    size_t done = (size_t)request->result;
+    while (done < ASYNCIO_READ_BLOCK) {
+        ssize_t n = pread(reader->fd, reader->buffers[slot] + done, ASYNCIO_READ_BLOCK - done,
+                          (off_t)(request->offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            reader->end = true;
+            break;
+        }
+        done += (size_t)n;
+    }
+    request->done = false;  // the slot is empty until it's submitted again
+    if (done == 0) {
+        return false;
+    }
+    *bytes = reader->buffers[slot];
+    *length = done;
+    reader->head = (slot + 1) % ASYNCIO_READ_DEPTH;
+    reader->returned = true;
+    return true;
+}
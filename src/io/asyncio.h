@@ -0,0 +1,170 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file asyncio.h
+ * @brief Asynchronous reads and writes, so several large requests are in flight at once.
+ *
+ * An `AsyncIO` hands `preadv()`/`pwritev()` like requests to the kernel
+ * without waiting for them. It uses io_uring (with the raw syscalls, no
+ * liburing) and falls back to a few worker threads that do the calls if
+ * io_uring is not available (old kernel, seccomp, ...).
+ *
+ * The data of a request must stay valid until AsyncIO_Wait() returned for it.
+ * Requests are waited for one by one, the caller keeps the order it needs.
+ *
+ * `AsyncReader` builds read-ahead on top of it: the blocks of a file are
+ * returned in order while the following ones are already read.
+ *
+ * Usage:
+ * ```
+ * AsyncReader *r = AsyncReader_Open(fd, ASYNCIO_BACKEND_AUTO);
+ * const char *bytes;
+ * size_t length;
+ * while (AsyncReader_Next(r, &bytes, &length)) {
+ *     ...
+ * }
+ * AsyncReader_Close(r);
+ * ```
+ */
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define ASYNCIO_THREADS 4                       //< workers of the thread backend
+#define ASYNCIO_READ_BLOCK (1024 * 1024)        //< bytes per read of an AsyncReader
+#define ASYNCIO_READ_DEPTH 4                    //< blocks an AsyncReader reads ahead
+
+typedef enum {
+    ASYNCIO_BACKEND_AUTO,       //< io_uring if possible, threads otherwise
+    ASYNCIO_BACKEND_URING,
+    ASYNCIO_BACKEND_THREADS
+} AsyncIOBackend;
+
+typedef enum {
+    ASYNCIO_READ,
+    ASYNCIO_WRITE
+} AsyncIOOp;
+
+typedef struct _AsyncIORequest {
+    AsyncIOOp op;
+    int fd;
+    const struct iovec *iov;    //< must stay valid until the request is done
+    int iov_count;
+    uint64_t offset;            //< file offset
+
+    ssize_t result;             //< bytes transferred or -errno
+    bool done;
+    struct _AsyncIORequest *next;   //< queue of the thread backend
+} AsyncIORequest;
+
+typedef struct _AsyncIO {
+    AsyncIOBackend backend;     //< the backend that is used (never ASYNCIO_BACKEND_AUTO)
+    unsigned depth;             //< max requests in flight
+    unsigned in_flight;
+
+    // io_uring
+    int ring_fd;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;              //< same as sq_ring if the kernel maps both at once
+    size_t cq_ring_size;
+    void *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    void *cqes;
+
+    // threads
+    pthread_t threads[ASYNCIO_THREADS];
+    size_t thread_count;
+    pthread_mutex_t mutex;
+    pthread_cond_t work;        //< signaled when a request is queued
+    pthread_cond_t finished;    //< signaled when a request is done
+    AsyncIORequest *queue_head;
+    AsyncIORequest *queue_tail;
+    bool stopping;
+} AsyncIO;
+
+/**
+ * @brief Create an AsyncIO that can have depth requests in flight.
+ *
+ * @returns NULL if the requested backend is not available.
+ */
+AsyncIO *AsyncIO_Create(unsigned depth, AsyncIOBackend backend);
+
+/**
+ * @brief Wait for all requests and free aio.
+ */
+void AsyncIO_Destroy(AsyncIO *aio);
+
+/**
+ * @brief Start request (op, fd, iov, iov_count and offset must be set).
+ *
+ * @returns false if depth requests are in flight already or the kernel refused it.
+ */
+bool AsyncIO_Submit(AsyncIO *aio, AsyncIORequest *request);
+
+/**
+ * @brief Block until request is done, request->result is set then.
+ */
+void AsyncIO_Wait(AsyncIO *aio, AsyncIORequest *request);
+
+const char *AsyncIO_BackendName(const AsyncIO *aio);
+
+typedef struct _AsyncReader {
+    AsyncIO *aio;
+    int fd;
+    AsyncIORequest requests[ASYNCIO_READ_DEPTH];
+    struct iovec iov[ASYNCIO_READ_DEPTH];
+    char *buffers[ASYNCIO_READ_DEPTH];
+    bool submitted[ASYNCIO_READ_DEPTH];
+    unsigned head;              //< slot of the next block in file order
+    bool returned;              //< the block in the slot before head was returned to the caller
+    uint64_t next_offset;       //< offset of the next block that is submitted
+    bool end;                   //< the end of the file was reached, nothing more is submitted
+} AsyncReader;
+
+/**
+ * @brief Read fd from the beginning, ASYNCIO_READ_DEPTH blocks ahead.
+ *
+ * The file position of fd is not used.
+ *
+ * @returns NULL if no backend is available.
+ */
+AsyncReader *AsyncReader_Open(int fd, AsyncIOBackend backend);
+void AsyncReader_Close(AsyncReader *reader);
+
+/**
+ * @brief Return the next block of the file.
+ *
+ * The block stays valid until the next call.
+ *
+ * @returns false at the end of the file or if reading failed.
+ */
+bool AsyncReader_Next(AsyncReader *reader, const char **bytes, size_t *length);
+
+#endif
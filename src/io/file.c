@@ -21,6 +21,7 @@
 #include <unistd.h>     // access()
 #include <libgen.h>     // dirname()
 #include <errno.h>
+#include <sys/stat.h>
 #include "common/config.h"
 #include "common/logging.h"
 
@@ -32,6 +33,12 @@ static File *create_file_object() {
     file->path = NULL;
     file->fp   = NULL;
     file->access = FILE_ACCESS_READ;
+    file->line_bytes = 0;
+    file->reader = NULL;
+    file->no_reader = false;
+    file->block = NULL;
+    file->block_length = 0;
+    file->block_position = 0;
     return file;
 }
 
@@ -134,24 +141,74 @@ void File_Close(File *file) {
     if (file->path) {
         free(file->path);
     }
+    AsyncReader_Close(file->reader);
     if (file->fp && file->fp != stdin) {
         fclose(file->fp);
     }
     free(file);
 }
 
+// read the next line from the blocks of the AsyncReader (the line break is kept)
+static ssize_t read_line_ahead(File *file, char **lineptr) {
+    char *line = NULL;
+    size_t length = 0;
+    while (true) {
+        if (file->block_position == file->block_length) {
+            if (!AsyncReader_Next(file->reader, &file->block, &file->block_length)) {
+                file->block_length = 0;
+                file->block_position = 0;
+                break;
+            }
+            file->block_position = 0;
+        }
+        const char *start = file->block + file->block_position;
+        size_t available = file->block_length - file->block_position;
+        const char *newline = memchr(start, '\n', available);
+        size_t take = newline ? (size_t)(newline - start) + 1 : available;
+        // usually the whole line is in the block, so this is the only allocation
+        char *grown = realloc(line, length + take + 1);
+        if (!grown) {
+            logFatal("Cannot allocate memory for line.");
+        }
+        line = grown;
+        memcpy(line + length, start, take);
+        length += take;
+        file->block_position += take;
+        if (newline) {
+            break;
+        }
+    }
+    if (length == 0) {
+        free(line);
+        return -1;
+    }
+    line[length] = '\0';
+    *lineptr = line;
+    return (ssize_t)length;
+}
+
 String *File_ReadLine(File *file) {
     if (!file || !file->fp || file->access != FILE_ACCESS_READ) {
         logError("Invalid file handle.");
         return NULL;
     }
+    if (!file->reader && !file->no_reader) {
+        struct stat st;
+        int fd = fileno(file->fp);
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            file->reader = AsyncReader_Open(fd, ASYNCIO_BACKEND_AUTO);
+        }
+        file->no_reader = !file->reader;
+    }
     char *lineptr = NULL;
     size_t length = 0;
-    ssize_t bytes_read = getline(&lineptr, &length, file->fp);
+    ssize_t bytes_read = file->reader ? read_line_ahead(file, &lineptr) : getline(&lineptr, &length, file->fp);
     if (bytes_read == -1) {
         free(lineptr);
+        file->line_bytes = 0;
         return NULL;
     }
+    file->line_bytes = (size_t)bytes_read;
     if (bytes_read > 0 && lineptr[bytes_read-1] == '\n') {
         lineptr[--bytes_read] = '\0';
     }
@@ -200,5 +257,4 @@ void File_WriteLine(File *file, const String *line) {
     const char *str = String_AsCStr(line);
     fputs(str, file->fp);
     fputc('\n', file->fp);
-    fflush(file->fp);
 }
@@ -19,6 +19,7 @@
 #include <limits.h>     // PATH_MAX
 #include "stdio.h"
 #include "common/string.h"
+#include "asyncio.h"
 
 typedef enum {
     FILE_ACCESS_READ,
@@ -32,6 +33,14 @@ typedef struct _File {
     char *path;             //< pathname of the file
     FILE *fp;               //< file handler
     FileAccessType access;  //< read/write access
+    size_t line_bytes;      //< bytes consumed by the last File_ReadLine() (including line break)
+
+    // File_ReadLine() reads regular files ahead with an AsyncReader
+    AsyncReader *reader;
+    bool no_reader;         //< not a regular file or no backend, stdio is used
+    const char *block;      //< block of the reader that is split into lines
+    size_t block_length;
+    size_t block_position;
 } File;
 
 /**
@@ -73,6 +82,13 @@ void File_Close(File *file);
 /**
  * @brief Read a line from a file.
  * 
+ * The line break ("\n" or "\r\n") is removed. The number of bytes that were
+ * consumed from the file is stored in file->line_bytes.
+ *
+ * Regular files are read in large blocks, the following blocks are read
+ * while the lines of the current one are processed (see asyncio.h). Don't
+ * mix it with other reads of the same File.
+ *
  * @returns The read line as a new created UTF8String.
  *          The caller is responsible for freeing it with
  *          UTF8String_Destroy()
@@ -86,6 +102,9 @@ char *File_Read(File *file);
 
 /**
  * @brief Write a line to a file.
+ *
+ * The output is buffered by stdio and written when the buffer is full or the
+ * file is closed.
  */
 void File_WriteLine(File *file, const String *line);
 
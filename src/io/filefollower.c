@@ -0,0 +1,150 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "filefollower.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "common/logging.h"
+
+FileFollower *FileFollower_Create(const char *path, uint64_t offset) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        logError("Cannot open %s for following: %s", path, strerror(errno));
+        return NULL;
+    }
+    FileFollower *ff = malloc(sizeof(FileFollower));
+    if (!ff) {
+        logFatal("Cannot allocate memory for FileFollower.");
+    }
+    ff->fd = fd;
+    ff->offset = offset;
+    ff->changed = true;  // the file might have grown since it was loaded
+    ff->buffer = NULL;
+    ff->used = 0;
+    ff->consumed = 0;
+    ff->capacity = 0;
+    ff->data_offset = offset;
+    ff->truncated = false;
+
+    // a file without "\n" at the end continues in its last line
+    char last = '\n';
+    ff->data_continues_line = offset > 0 && pread(fd, &last, 1, offset - 1) == 1 && last != '\n';
+
+    ff->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ff->inotify_fd >= 0 && inotify_add_watch(ff->inotify_fd, path, IN_MODIFY) < 0) {
+        close(ff->inotify_fd);
+        ff->inotify_fd = -1;
+    }
+    if (ff->inotify_fd < 0) {
+        logWarn("inotify is not available, %s is polled.", path);
+    }
+    return ff;
+}
+
+void FileFollower_Destroy(FileFollower *ff) {
+    if (!ff) {
+        return;
+    }
+    if (ff->inotify_fd >= 0) {
+        close(ff->inotify_fd);
+    }
+    close(ff->fd);
+    free(ff->buffer);
+    free(ff);
+}
+
+// read all pending events, return true if there was any
+static bool drain_events(FileFollower *ff) {
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool any = false;
+    while (read(ff->inotify_fd, events, sizeof(events)) > 0) {
+        any = true;
+    }
+    return any;
+}
+
+static void reserve(FileFollower *ff, size_t size) {
+    if (size <= ff->capacity) {
+        return;
+    }
+    size_t capacity = ff->capacity ? ff->capacity : FILEFOLLOWER_MAX_READ;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    char *buffer = realloc(ff->buffer, capacity);
+    if (!buffer) {
+        logFatal("Cannot allocate memory for FileFollower.");
+    }
+    ff->buffer = buffer;
+    ff->capacity = capacity;
+}
+
+size_t FileFollower_Poll(FileFollower *ff, const char **data) {
+    *data = NULL;
+    if (!ff || ff->truncated) {
+        return 0;
+    }
+
+    // drop what was handed out by the last poll
+    if (ff->consumed > 0) {
+        memmove(ff->buffer, ff->buffer + ff->consumed, ff->used - ff->consumed);
+        ff->used -= ff->consumed;
+        ff->data_offset += ff->consumed;
+        ff->consumed = 0;
+        ff->data_continues_line = false;
+    }
+
+    if (ff->inotify_fd < 0 || drain_events(ff)) {
+        ff->changed = true;
+    }
+    if (!ff->changed) {
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(ff->fd, &st) == 0 && (uint64_t)st.st_size < ff->offset) {
+        logWarn("Followed file was truncated.");
+        ff->truncated = true;
+        return 0;
+    }
+
+    reserve(ff, ff->used + FILEFOLLOWER_MAX_READ);
+    ssize_t bytes_read = pread(ff->fd, ff->buffer + ff->used, FILEFOLLOWER_MAX_READ, ff->offset);
+    if (bytes_read < 0) {
+        if (errno != EINTR && errno != EAGAIN) {
+            logError("Cannot read followed file: %s", strerror(errno));
+        }
+        return 0;
+    }
+    ff->used += bytes_read;
+    ff->offset += bytes_read;
+    // a full read means there is probably more, read it with the next poll
+    ff->changed = bytes_read == FILEFOLLOWER_MAX_READ;
+
+    // hand out everything up to the last "\n"
+    size_t end = ff->used;
+    while (end > 0 && ff->buffer[end - 1] != '\n') {
+        end--;
+    }
+    ff->consumed = end;
+    *data = end > 0 ? ff->buffer : NULL;
+    return end;
+}
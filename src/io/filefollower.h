@@ -0,0 +1,81 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file filefollower.h
+ * @brief Read what is appended to a file (like `tail -f`).
+ *
+ * The follower remembers the offset up to which the file was read and only
+ * reads the bytes behind it. With inotify the file is only touched when the
+ * kernel reported a modification, otherwise every poll tries a (cheap) read.
+ *
+ * A poll never blocks and reads at most FILEFOLLOWER_MAX_READ bytes, so a file
+ * that grows very fast can not stall the main loop. Only complete lines are
+ * handed out, a line that is still being written stays in the buffer.
+ *
+ * Usage:
+ * ```
+ * FileFollower *ff = FileFollower_Create("foo.log", size_already_read);
+ * const char *data;
+ * size_t length = FileFollower_Poll(ff, &data);  // "\n" terminated lines
+ * FileFollower_Destroy(ff);
+ * ```
+ */
+#ifndef FILEFOLLOWER_H
+#define FILEFOLLOWER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FILEFOLLOWER_MAX_READ (1024 * 1024)    //< read at most this many bytes per poll
+
+typedef struct _FileFollower {
+    int fd;                 //< the followed file
+    int inotify_fd;         //< -1 if inotify is not available (every poll reads then)
+
+    uint64_t offset;        //< everything before this file offset was read
+    bool changed;           //< there might be new data in the file
+
+    char *buffer;           //< data read but not handed out yet (and the data of the last poll)
+    size_t used;            //< number of valid bytes in buffer
+    size_t consumed;        //< bytes at the start of buffer handed out by the last poll
+    size_t capacity;
+
+    uint64_t data_offset;       //< file offset of the data returned by the last poll
+    bool data_continues_line;   //< the data continues a line that was incomplete when following started
+    bool truncated;             //< the file got shorter, nothing is read anymore
+} FileFollower;
+
+/**
+ * @brief Follow path, starting at offset (usually the size of the file when it was loaded).
+ *
+ * @returns The follower or NULL if the file cannot be opened.
+ */
+FileFollower *FileFollower_Create(const char *path, uint64_t offset);
+void FileFollower_Destroy(FileFollower *ff);
+
+/**
+ * @brief Read what was appended since the last poll.
+ *
+ * data is set to the complete lines (each terminated by "\n") that are new,
+ * it stays valid until the next poll.
+ *
+ * @returns The number of bytes at data (0 if there is nothing new).
+ */
+size_t FileFollower_Poll(FileFollower *ff, const char **data);
+
+#endif
@@ -0,0 +1,310 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#define _DEFAULT_SOURCE  // pwritev()
+#include "filewriter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>     // PATH_MAX
+#include <unistd.h>
+#include <fcntl.h>
+#include <libgen.h>     // dirname(), basename()
+#include <sys/stat.h>
+#include "common/logging.h"
+
+static double elapsed_seconds(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - since->tv_sec) + (double)(now.tv_nsec - since->tv_nsec) / 1e9;
+}
+
+double FileWriterStats_Throughput(const FileWriterStats *stats) {
+    if (!stats || stats->seconds <= 0.0) {
+        return 0.0;
+    }
+    return (double)stats->bytes_written / (1024.0 * 1024.0) / stats->seconds;
+}
+
+// resolve symlinks, so the link itself is not replaced by the rename
+static char *resolve_target(const char *path) {
+    char resolved[PATH_MAX];
+    if (realpath(path, resolved)) {
+        return strdup(resolved);
+    }
+    return strdup(path);
+}
+
+static char *create_tmp_path(const char *target) {
+    char *dir_buf = strdup(target);
+    char *base_buf = strdup(target);
+    if (!dir_buf || !base_buf) {
+        logFatal("Cannot allocate memory for FileWriter path.");
+    }
+    const char *dir = dirname(dir_buf);
+    const char *base = basename(base_buf);
+
+    size_t size = strlen(dir) + strlen(base) + 16;
+    char *tmp = malloc(size);
+    if (!tmp) {
+        logFatal("Cannot allocate memory for FileWriter path.");
+    }
+    snprintf(tmp, size, "%s/.%s.XXXXXX", dir, base);
+    free(dir_buf);
+    free(base_buf);
+    return tmp;
+}
+
+FileWriter *FileWriter_Open(const char *path) {
+    if (!path || strlen(path) == 0) {
+        logError("Invalid path for FileWriter.");
+        return NULL;
+    }
+    FileWriter *fw = malloc(sizeof(FileWriter));
+    if (!fw) {
+        logFatal("Cannot allocate memory for FileWriter.");
+    }
+    fw->path = resolve_target(path);
+    fw->tmp_path = create_tmp_path(fw->path);
+    fw->aio = NULL;
+    fw->aio_created = false;
+    fw->batch = 0;
+    fw->iov_count = 0;
+    fw->pending_bytes = 0;
+    fw->offset = 0;
+    for (int i = 0; i < FILEWRITER_DEPTH; i++) {
+        fw->in_flight[i] = false;
+    }
+    fw->failed = false;
+    fw->committed = false;
+    fw->stats = (FileWriterStats){ .bytes_written = 0, .write_calls = 0, .seconds = 0.0 };
+    clock_gettime(CLOCK_MONOTONIC, &fw->started);
+
+    fw->fd = mkstemp(fw->tmp_path);
+    if (fw->fd < 0) {
+        logError("Cannot create temporary file %s: %s", fw->tmp_path, strerror(errno));
+        free(fw->tmp_path);
+        free(fw->path);
+        free(fw);
+        return NULL;
+    }
+    return fw;
+}
+
+static ssize_t write_sync(int fd, const struct iovec *iov, int count, uint64_t offset) {
+    ssize_t written;
+    do {
+        written = pwritev(fd, iov, count, (off_t)offset);
+    } while (written < 0 && errno == EINTR);
+    return written < 0 ? -errno : written;
+}
+
+// account for a finished write, the rest of a partial write is written synchronously
+static bool complete_write(FileWriter *fw, AsyncIORequest *request) {
+    struct iovec *iov = (struct iovec*)request->iov;
+    int count = request->iov_count;
+    uint64_t offset = request->offset;
+    ssize_t written = request->result;
+    while (true) {
+        if (written < 0) {
+            logError("Write to %s failed: %s", fw->tmp_path, strerror((int)-written));
+            fw->failed = true;
+            return false;
+        }
+        fw->stats.bytes_written += (size_t)written;
+        offset += (uint64_t)written;
+
+        // skip everything that was written completely (partial writes are possible)
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count == 0) {
+            return true;
+        }
+        iov->iov_base = (char*)iov->iov_base + written;
+        iov->iov_len -= written;
+        written = write_sync(fw->fd, iov, count, offset);
+        fw->stats.write_calls++;
+    }
+}
+
+static bool wait_batch(FileWriter *fw, int batch) {
+    if (!fw->in_flight[batch]) {
+        return true;
+    }
+    AsyncIO_Wait(fw->aio, &fw->requests[batch]);
+    fw->in_flight[batch] = false;
+    return complete_write(fw, &fw->requests[batch]);
+}
+
+// start writing the batch that was filled and make the next one available,
+// more is true if the batch is full and further data follows
+static bool submit_batch(FileWriter *fw, bool more) {
+    if (fw->failed) {
+        return false;
+    }
+    if (fw->iov_count == 0) {
+        return true;
+    }
+    int batch = fw->batch;
+    AsyncIORequest *request = &fw->requests[batch];
+    request->op = ASYNCIO_WRITE;
+    request->fd = fw->fd;
+    request->iov = fw->iov[batch];
+    request->iov_count = fw->iov_count;
+    request->offset = fw->offset;
+    fw->offset += fw->pending_bytes;
+    fw->stats.write_calls++;
+    fw->iov_count = 0;
+    fw->pending_bytes = 0;
+    fw->batch = (batch + 1) % FILEWRITER_DEPTH;
+
+    // small files are written with a single pwritev(), the backend (io_uring or
+    // threads) only pays off if there are several batches
+    if (more && !fw->aio_created) {
+        fw->aio = AsyncIO_Create(FILEWRITER_DEPTH, ASYNCIO_BACKEND_AUTO);  // NULL: synchronous writes
+        fw->aio_created = true;
+    }
+    if (fw->aio && AsyncIO_Submit(fw->aio, request)) {
+        fw->in_flight[batch] = true;
+    }
+    else {
+        request->result = write_sync(fw->fd, request->iov, request->iov_count, request->offset);
+        if (!complete_write(fw, request)) {
+            return false;
+        }
+    }
+    // the iovecs of the next batch are reused
+    return wait_batch(fw, fw->batch);
+}
+
+bool FileWriter_Flush(FileWriter *fw) {
+    if (!submit_batch(fw, false)) {
+        return false;
+    }
+    // oldest first
+    for (int i = 0; i < FILEWRITER_DEPTH; i++) {
+        if (!wait_batch(fw, (fw->batch + i) % FILEWRITER_DEPTH)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FileWriter_Write(FileWriter *fw, const char *bytes, size_t length) {
+    if (!fw || fw->failed) {
+        return false;
+    }
+    if (length == 0) {
+        return true;
+    }
+    if (fw->iov_count == FILEWRITER_MAX_IOV) {
+        if (!submit_batch(fw, true)) {
+            return false;
+        }
+    }
+    struct iovec *iov = &fw->iov[fw->batch][fw->iov_count];
+    iov->iov_base = (void*)bytes;
+    iov->iov_len = length;
+    fw->iov_count++;
+    fw->pending_bytes += length;
+
+    if (fw->pending_bytes >= FILEWRITER_MAX_PENDING) {
+        return submit_batch(fw, true);
+    }
+    return true;
+}
+
+bool FileWriter_Commit(FileWriter *fw, bool sync) {
+    if (!fw || fw->committed) {
+        return false;
+    }
+    if (!FileWriter_Flush(fw)) {
+        return false;
+    }
+
+    // keep the permissions of the file that is replaced
+    struct stat st;
+    if (stat(fw->path, &st) == 0) {
+        fchmod(fw->fd, st.st_mode & 07777);
+    }
+    else {
+        mode_t mask = umask(0);
+        umask(mask);
+        fchmod(fw->fd, 0666 & ~mask);
+    }
+
+    if (sync && fsync(fw->fd) != 0) {
+        logError("fsync of %s failed: %s", fw->tmp_path, strerror(errno));
+        fw->failed = true;
+        return false;
+    }
+    if (close(fw->fd) != 0) {
+        logError("close of %s failed: %s", fw->tmp_path, strerror(errno));
+        fw->fd = -1;
+        fw->failed = true;
+        return false;
+    }
+    fw->fd = -1;
+
+    if (rename(fw->tmp_path, fw->path) != 0) {
+        logError("Cannot replace %s: %s", fw->path, strerror(errno));
+        fw->failed = true;
+        return false;
+    }
+    fw->committed = true;
+
+    if (sync) {
+        // make the rename itself durable
+        char *dir_buf = strdup(fw->path);
+        if (dir_buf) {
+            int dir_fd = open(dirname(dir_buf), O_RDONLY);
+            if (dir_fd >= 0) {
+                fsync(dir_fd);
+                close(dir_fd);
+            }
+            free(dir_buf);
+        }
+    }
+
+    fw->stats.seconds = elapsed_seconds(&fw->started);
+    return true;
+}
+
+void FileWriter_Close(FileWriter *fw) {
+    if (!fw) {
+        return;
+    }
+    // the kernel must be done with the buffers and the file
+    for (int i = 0; i < FILEWRITER_DEPTH; i++) {
+        if (fw->in_flight[i]) {
+            AsyncIO_Wait(fw->aio, &fw->requests[i]);
+        }
+    }
+    AsyncIO_Destroy(fw->aio);
+    if (fw->fd >= 0) {
+        close(fw->fd);
+    }
+    if (!fw->committed) {
+        unlink(fw->tmp_path);
+    }
+    free(fw->tmp_path);
+    free(fw->path);
+    free(fw);
+}
@@ -0,0 +1,133 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file filewriter.h
+ * @brief Batched and crash safe writing of complete files.
+ *
+ * A `FileWriter` collects pointers to the data it should write in an `iovec`
+ * list and hands them to the kernel with a single `pwritev()` once the batch
+ * is full. Up to FILEWRITER_DEPTH batches are written at the same time (see
+ * asyncio.h), so the kernel always has the next batch while one is written.
+ * The asynchronous backend is only set up once a batch is full, a small file
+ * is written with a single `pwritev()`.
+ * The data is *not* copied, so everything passed to `FileWriter_Write()` must
+ * stay untouched until the next FileWriter_Flush() or FileWriter_Commit().
+ *
+ * Everything is written to a temporary file in the directory of the target.
+ * Only `FileWriter_Commit()` replaces the target (with `rename()`), so a crash
+ * while saving never destroys the original file.
+ *
+ * Usage:
+ * ```
+ * FileWriter *fw = FileWriter_Open("foo.txt");
+ * FileWriter_Write(fw, "bar\n", 4);
+ * bool ok = FileWriter_Commit(fw, true);
+ * FileWriter_Close(fw);
+ * ```
+ */
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include "asyncio.h"
+
+#define FILEWRITER_MAX_IOV 1024                 //< max number of iovecs per writev() (IOV_MAX on Linux)
+#define FILEWRITER_MAX_PENDING (4 * 1024 * 1024) //< start writing a batch if this many bytes are pending
+#define FILEWRITER_DEPTH 4                      //< batches that are written at the same time
+
+/**
+ * @brief Information about a finished (or running) write.
+ */
+typedef struct _FileWriterStats {
+    size_t bytes_written;   //< total number of bytes written
+    size_t write_calls;     //< number of writes (batches) needed
+    double seconds;         //< wall clock time from opening to committing
+} FileWriterStats;
+
+/**
+ * @brief Return the throughput in MB/s (0 if nothing was measured).
+ */
+double FileWriterStats_Throughput(const FileWriterStats *stats);
+
+typedef struct _FileWriter {
+    char *path;             //< path of the target file (symlinks resolved)
+    char *tmp_path;         //< path of the temporary file
+    int fd;                 //< file descriptor of the temporary file
+
+    AsyncIO *aio;           //< NULL if there is no backend, the batches are written synchronously then
+    bool aio_created;       //< the backend is created with the first full batch
+    struct iovec iov[FILEWRITER_DEPTH][FILEWRITER_MAX_IOV]; //< one iovec list per batch
+    AsyncIORequest requests[FILEWRITER_DEPTH];
+    bool in_flight[FILEWRITER_DEPTH];
+    int batch;              //< the batch that is filled
+    int iov_count;          //< number of used entries in the batch
+    size_t pending_bytes;   //< number of bytes in the batch
+    uint64_t offset;        //< file offset of the batch
+
+    bool failed;            //< true if any write failed (commit will be refused)
+    bool committed;         //< true if the target was replaced successfully
+
+    struct timespec started;
+    FileWriterStats stats;
+} FileWriter;
+
+/**
+ * @brief Create a writer for `path`.
+ *
+ * The temporary file is created immediately. The target does not need to exist.
+ *
+ * @returns The writer or NULL if the temporary file cannot be created.
+ */
+FileWriter *FileWriter_Open(const char *path);
+
+/**
+ * @brief Queue `length` bytes at `bytes` for writing.
+ *
+ * The bytes are not copied and must stay valid until the next
+ * FileWriter_Flush() or FileWriter_Commit().
+ *
+ * @returns false if an earlier write failed.
+ */
+bool FileWriter_Write(FileWriter *fw, const char *bytes, size_t length);
+
+/**
+ * @brief Write everything that is pending and wait until it's written.
+ */
+bool FileWriter_Flush(FileWriter *fw);
+
+/**
+ * @brief Flush, optionally `fsync()` and atomically replace the target file.
+ *
+ * The permissions of an existing target are kept.
+ *
+ * @returns true if the target was replaced.
+ */
+bool FileWriter_Commit(FileWriter *fw, bool sync);
+
+/**
+ * @brief Close the writer and free it.
+ *
+ * If the writer was not committed the temporary file is removed and the
+ * target stays untouched.
+ */
+void FileWriter_Close(FileWriter *fw);
+
+#endif
@@ -0,0 +1,155 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "idle.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+typedef enum {
+    IDLE_TASK_FREE,
+    IDLE_TASK_SLEEPING,
+    IDLE_TASK_AWAKE
+} IdleTaskState;
+
+typedef struct _IdleTask {
+    IdleTaskState state;
+    IdlePriority priority;
+    IdleCallback callback;
+    void *user_data;
+} IdleTask;
+
+static IdleTask tasks[MAX_IDLE_TASKS];
+static uint8_t last_run[IDLE_PRIORITIES];  // for round robin within a priority
+static IdleInterrupt interrupt = NULL;
+static IdleStats stats;
+
+static uint64_t now_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+static void init_task(IdleTask *task) {
+    task->state = IDLE_TASK_FREE;
+    task->priority = IDLE_PRIORITY_LOW;
+    task->callback = NULL;
+    task->user_data = NULL;
+}
+
+// the awake task with the highest priority that is next after the last one run
+static int next_task() {
+    for (int priority = 0; priority < IDLE_PRIORITIES; priority++) {
+        for (int i = 1; i <= MAX_IDLE_TASKS; i++) {
+            int id = (last_run[priority] + i) % MAX_IDLE_TASKS;
+            if (tasks[id].state == IDLE_TASK_AWAKE && tasks[id].priority == (IdlePriority)priority) {
+                return id;
+            }
+        }
+    }
+    return NO_IDLE_TASK;
+}
+
+void Idle_Init(IdleInterrupt interrupted) {
+    for (int i = 0; i < MAX_IDLE_TASKS; i++) {
+        init_task(&tasks[i]);
+    }
+    for (int i = 0; i < IDLE_PRIORITIES; i++) {
+        last_run[i] = MAX_IDLE_TASKS - 1;
+    }
+    interrupt = interrupted;
+    stats = (IdleStats){ 0 };
+}
+
+void Idle_Deinit() {
+    // No special deinitialization needed, the tasks are managed statically.
+}
+
+uint8_t Idle_Add(IdlePriority priority, IdleCallback callback, void *user_data) {
+    if (!callback || priority >= IDLE_PRIORITIES) {
+        return NO_IDLE_TASK;
+    }
+    for (int i = 0; i < MAX_IDLE_TASKS; i++) {
+        if (tasks[i].state == IDLE_TASK_FREE) {
+            IdleTask *task = &tasks[i];
+            task->state = IDLE_TASK_AWAKE;
+            task->priority = priority;
+            task->callback = callback;
+            task->user_data = user_data;
+            return i;
+        }
+    }
+    return NO_IDLE_TASK;
+}
+
+void Idle_Remove(uint8_t id) {
+    if (id >= MAX_IDLE_TASKS) {
+        return;
+    }
+    init_task(&tasks[id]);
+}
+
+void Idle_Wake(uint8_t id) {
+    if (id >= MAX_IDLE_TASKS || tasks[id].state == IDLE_TASK_FREE) {
+        return;
+    }
+    tasks[id].state = IDLE_TASK_AWAKE;
+}
+
+bool Idle_HasWork() {
+    return next_task() != NO_IDLE_TASK;
+}
+
+bool Idle_Run(uint32_t budget_us) {
+    uint64_t started = now_us();
+    uint64_t last = started;
+    bool ran = false;
+    while (true) {
+        int id = next_task();
+        if (id == NO_IDLE_TASK) {
+            break;
+        }
+        if (interrupt && interrupt()) {
+            stats.preempted++;
+            break;
+        }
+        IdleTask *task = &tasks[id];
+        last_run[task->priority] = id;
+        bool more = task->callback(task->user_data);
+        // the callback might have removed itself
+        if (!more && task->state == IDLE_TASK_AWAKE) {
+            task->state = IDLE_TASK_SLEEPING;
+        }
+        ran = true;
+        stats.steps++;
+
+        uint64_t now = now_us();
+        if (now - last > stats.longest_step_us) {
+            stats.longest_step_us = (uint32_t)(now - last);
+        }
+        last = now;
+        if (now - started >= budget_us) {
+            break;
+        }
+    }
+    if (ran) {
+        stats.slices++;
+    }
+    return Idle_HasWork();
+}
+
+const IdleStats *Idle_GetStats() {
+    return &stats;
+}
@@ -0,0 +1,71 @@
+/* Copyright (C) 2025 defname
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * idle.h
+ * Runs work that must stay on the main thread (it touches the TextBuffer) in
+ * the gaps between input events.
+ * A task is a callback that does a small, bounded amount of work per call
+ * (well below IDLE_SLICE_US) and returns whether there is more to do.
+ * Idle_Run() calls the tasks until its time budget is used up, always the
+ * highest priority first and round robin within a priority. It stops at once
+ * when input arrives, so typing never waits for more than one call.
+ * A task that returned false sleeps until Idle_Wake() is called for it.
+ */
+
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_IDLE_TASKS 16
+#define NO_IDLE_TASK MAX_IDLE_TASKS
+#define IDLE_SLICE_US 2000  // time budget of one Idle_Run() in the main loop
+
+typedef enum {
+    IDLE_PRIORITY_HIGH,     // visible results, e.g. highlighting the screen
+    IDLE_PRIORITY_NORMAL,
+    IDLE_PRIORITY_LOW,      // whole document work, e.g. compaction
+    IDLE_PRIORITIES
+} IdlePriority;
+
+// do a small step of work, return true if there is more to do
+typedef bool (*IdleCallback)(void *user_data);
+// return true if the slice should end immediately (e.g. input is pending)
+typedef bool (*IdleInterrupt)(void);
+
+typedef struct _IdleStats {
+    uint64_t slices;            // Idle_Run() calls that ran anything
+    uint64_t steps;             // task calls
+    uint64_t preempted;         // slices ended by the interrupt
+    uint32_t longest_step_us;   // the worst delay a task caused for input
+} IdleStats;
+
+void Idle_Init(IdleInterrupt interrupted);  // interrupted may be NULL
+void Idle_Deinit();
+
+// return id of the task (NO_IDLE_TASK if there is no free slot), it is awake
+uint8_t Idle_Add(IdlePriority priority, IdleCallback callback, void *user_data);
+void Idle_Remove(uint8_t id);
+void Idle_Wake(uint8_t id);     // the task has work again
+bool Idle_HasWork();
+
+// run tasks for up to budget_us microseconds, return true if there is still work
+bool Idle_Run(uint32_t budget_us);
+const IdleStats *Idle_GetStats();
+
+#endif
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/select.h>
+#include <poll.h>
 #include "common/utf8_helper.h"
 #include "io/terminal.h"
 #include "common/logging.h"
@@ -72,12 +73,38 @@ bool InputEvent_IsValid(const InputEvent *ev) {
     return utf8_is_ascii(ev->ch);
 }
 
+// readable when background work has results (-1 if none)
+static int wake_fd = -1;
+static int timeout_ms = INPUT_TIMEOUT_MS;
+
 void Input_Init() {
 }
 
 void Input_Deinit() {
 }
 
+void Input_SetWakeFd(int fd) {
+    wake_fd = fd;
+}
+
+void Input_SetTimeout(int ms) {
+    timeout_ms = ms;
+}
+
+// wait for input like the terminal read timeout, but return early for a wakeup
+static bool wait_for_input(int fd, int ms) {
+    struct pollfd fds[2] = {
+        { .fd = fd, .events = POLLIN },
+        { .fd = wake_fd, .events = POLLIN },  // ignored if negative
+    };
+    int rv = poll(fds, 2, ms);
+    return rv > 0 && (fds[0].revents & POLLIN);
+}
+
+bool Input_Pending() {
+    return wait_for_input(terminal.fd_in, 0);
+}
+
 // helper: read mit Timeout (ms)
 static ssize_t read_with_timeout(int fd, unsigned char *c, int timeout_ms) {
     fd_set set;
@@ -306,6 +333,11 @@ InputEvent Input_Read() {
 
     int fd = terminal.fd_in;
 
+    if (!wait_for_input(fd, timeout_ms)) {
+        // the pending input must not be flushed here
+        return input_invalidevent;
+    }
+
     // read the first byte
     unsigned char c;
     ssize_t byted_read = read(fd, &c, 1);
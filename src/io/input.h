@@ -37,6 +37,7 @@
 
 
 #define INPUT_BUFFER_SIZE   24
+#define INPUT_TIMEOUT_MS    100     //< same as the VTIME of the terminal
 
 typedef enum {
     KEY_NONE,
@@ -75,5 +76,23 @@ void Input_Init();      //< deprecated
 void Input_Deinit();    //< deprecated
 InputEvent Input_Read();
 
+/**
+ * Let Input_Read() return an invalid event as soon as `fd` becomes readable
+ * (e.g. ThreadPool_Fd()), so results of background work are shown without
+ * waiting for the input timeout. The fd is not read. -1 to disable.
+ */
+void Input_SetWakeFd(int fd);
+
+/**
+ * Max time Input_Read() waits for input (INPUT_TIMEOUT_MS by default), 0 to
+ * return at once, e.g. while there is idle work (see idle.h).
+ */
+void Input_SetTimeout(int ms);
+
+/**
+ * True if there is terminal input waiting to be read.
+ */
+bool Input_Pending();
+
 
 #endif
\ No newline at end of file
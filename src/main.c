@@ -18,12 +18,21 @@
 #include <time.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>     // PATH_MAX
 #include "io/terminal.h"
 #include "io/screen.h"
 #include "io/input.h"
 #include "document/textbuffer.h"
 #include "document/textio.h"
+#include "document/backgroundsave.h"
+#include "document/journal.h"
+#include "document/fileview.h"
+#include "document/linepager.h"
+#include "document/lineindex.h"
 #include "io/timer.h"
+#include "io/idle.h"
+#include "io/filefollower.h"
 #include "widgets/components/bottombar.h"
 #include "widgets/app.h"
 #include "widgets/components/editorview.h"
@@ -33,6 +42,7 @@
 #include "common/callback.h"
 #include "common/logging.h"
 #include "common/iniparser.h"
+#include "common/threadpool.h"
 
 #include "syntax/loader.h"
 
@@ -40,8 +50,21 @@
 #include "widgets/primitives/menu.h"
 
 
+#define FOLLOW_MAX_POLLS 4  // per main loop iteration (each reads up to FILEFOLLOWER_MAX_READ bytes)
+
 TextBuffer tb;
 SyntaxHighlighting *highlighting;
+BackgroundSave *saving = NULL;  // running save job
+int saving_percent = 0;         // last progress shown
+size_t saving_journal_mark = 0; // journal position at the start of the save
+bool clean_exit = false;        // the journal is kept if the editor ends unexpectedly
+bool follow = false;            // -f, append what is written to the file
+FileFollower *follower = NULL;
+bool viewer = false;            // -R, read-only view that only loads the lines around the screen
+FileView *fileview = NULL;
+uint8_t compact_task = NO_IDLE_TASK;  // packs and trims the lines between key presses
+uint8_t highlight_task = NO_IDLE_TASK;  // highlights the lines that are not on screen
+ThreadPool *pool = NULL;        // background work, finished tasks are handed back in the main loop
 
 
 static void print_help(const char *program_name) {
@@ -50,12 +73,16 @@ static void print_help(const char *program_name) {
     puts("  -s <format>   Specify a format for syntax highlighting.");
     puts("                The syntax definition file <format>.ini need to");
     puts("                present in data/syntax.");
+    puts("  -R            Read-only viewer for huge files, only the lines");
+    puts("                around the screen are kept in memory.");
+    puts("  -f            Follow the file (like tail -f), lines appended to");
+    puts("                it are shown while the editor is running.");
     exit(0);
 }
 
 static void parse_arguments(int argc, char *argv[]) {
     int opt;
-    while ((opt = getopt(argc, argv, "hs:")) != -1) {
+    while ((opt = getopt(argc, argv, "hs:fR")) != -1) {
         switch (opt) {
             case 'h':
                 print_help(argv[0]);
@@ -63,6 +90,12 @@ static void parse_arguments(int argc, char *argv[]) {
             case 's':
                 Config_SetSyntax(optarg);
                 break;
+            case 'f':
+                follow = true;
+                break;
+            case 'R':
+                viewer = true;
+                break;
             case '?':
                 fprintf(stderr, "Unknown option: -%c\n", optopt);
                 exit(1);
@@ -95,33 +128,167 @@ static void onMenuClick(void *menu, void *entry) {
     (void)menu;
     (void)entry;
     if (strcmp(entry, "exit") == 0) {
+        clean_exit = true;
         exit(0);
     }
     if (strcmp(entry, "save") == 0) {
-        File *file = File_Open(Config_GetFilename(), FILE_ACCESS_WRITE);
-        if (!file) {
-            // Show error message
-            // TODO
-            Notification_Notify(app.notification, "Cannot open file for writing.", NOTIFICATION_ERROR);
-            Widget_Hide(AS_WIDGET(menu));
+        Widget_Hide(AS_WIDGET(menu));
+        if (viewer) {
+            Notification_Notify(app.notification, "The viewer is read-only.", NOTIFICATION_WARNING);
+            return;
+        }
+        if (saving) {
+            Notification_Notify(app.notification, "Saving is already in progress.", NOTIFICATION_WARNING);
             return;
         }
-        TextBuffer_SaveToFile(&tb, file);
-        File_Close(file);
+        Table *conf = Config_GetModuleConfig("file");
+        bool sync = Config_GetNumber(conf, "fsync", 1) != 0;
+        saving_journal_mark = Journal_Mark(tb.journal);
+        // appended lines only? then there is no need to write the whole file
+        FileWriterStats stats;
+        if (TextBuffer_SaveTail(&tb, Config_GetFilename(), sync, &stats)) {
+            Journal_Rebase(tb.journal, saving_journal_mark);
+            char msg[128];
+            snprintf(msg, sizeof(msg), "File saved (%.1f KB written in %.0f ms)",
+                     (double)stats.bytes_written / 1024.0, stats.seconds * 1000.0);
+            Notification_Notify(app.notification, msg, NOTIFICATION_SUCCESS);
+            return;
+        }
+        saving = BackgroundSave_Start(&tb, Config_GetFilename(), sync);
+        if (!saving) {
+            Notification_Notify(app.notification, "Cannot save file.", NOTIFICATION_ERROR);
+            return;
+        }
+        saving_percent = 0;
+        Notification_Notify(app.notification, "Saving...", NOTIFICATION_NORMAL);
+    }
+    if (strcmp(entry, "stats") == 0) {
         Widget_Hide(AS_WIDGET(menu));
-        Notification_Notify(app.notification, "File saved", NOTIFICATION_SUCCESS);
+        if (!tb.pager) {
+            Notification_Notify(app.notification, "Paging is disabled.", NOTIFICATION_NORMAL);
+            return;
+        }
+        const LinePagerStats *stats = &tb.pager->stats;
+        char msg[224];
+        snprintf(msg, sizeof(msg), "Paged out %.1f MB, compressed %.1f MB to %.1f MB (%.1fx), %.0f us per decompression, packed %zu lines",
+                 (double)stats->paged_out_bytes / (1024.0 * 1024.0),
+                 (double)stats->block_raw_bytes / (1024.0 * 1024.0), (double)stats->block_bytes / (1024.0 * 1024.0),
+                 LinePagerStats_CompressionRatio(stats), LinePagerStats_DecompressMicroseconds(stats),
+                 stats->packed_lines);
+        Notification_Notify(app.notification, msg, NOTIFICATION_NORMAL);
+    }
+    if (strcmp(entry, "workers") == 0) {
+        Widget_Hide(AS_WIDGET(menu));
+        const ThreadPoolStats *stats = &pool->stats;
+        const ChannelStats *results = &pool->done->stats;
+        const IdleStats *idle = Idle_GetStats();
+        char msg[320];
+        snprintf(msg, sizeof(msg), "%zu workers: %zu tasks run, %zu cancelled, %zu stolen; results: %zu queued (max %zu), %zu contended, %zu overflowed; "
+                 "idle: %llu slices, %llu preempted, longest step %u us",
+                 pool->worker_count, atomic_load(&stats->completed), atomic_load(&stats->cancelled), atomic_load(&stats->stolen),
+                 Channel_Depth(pool->done), atomic_load(&results->max_depth), atomic_load(&results->contended),
+                 atomic_load(&results->full),
+                 (unsigned long long)idle->slices, (unsigned long long)idle->preempted, idle->longest_step_us);
+        Notification_Notify(app.notification, msg, NOTIFICATION_NORMAL);
     }
 }
 
+// report the progress of a running save and finish it when it is done
+static void update_saving() {
+    if (!saving) {
+        return;
+    }
+    double progress;
+    if (!BackgroundSave_Poll(saving, &progress)) {
+        int percent = (int)(progress * 100.0);
+        if (percent != saving_percent) {
+            saving_percent = percent;
+            char msg[64];
+            snprintf(msg, sizeof(msg), "Saving... %d%%", percent);
+            Notification_Notify(app.notification, msg, NOTIFICATION_NORMAL);
+        }
+        return;
+    }
+    FileWriterStats stats;
+    bool ok = BackgroundSave_Finish(saving, &stats);
+    saving = NULL;
+    Idle_Wake(compact_task);  // was paused for the snapshot
+    if (!ok) {
+        Notification_Notify(app.notification, "Cannot save file.", NOTIFICATION_ERROR);
+        return;
+    }
+    // edits made while saving stay in the journal
+    Journal_Rebase(tb.journal, saving_journal_mark);
+    char msg[128];
+    snprintf(msg, sizeof(msg), "File saved (%.1f MB, %.1f MB/s)",
+             (double)stats.bytes_written / (1024.0 * 1024.0), FileWriterStats_Throughput(&stats));
+    Notification_Notify(app.notification, msg, NOTIFICATION_SUCCESS);
+}
+
+// append what was written to the followed file
+static void update_follow(Editor *editor) {
+    if (!follower) {
+        return;
+    }
+    bool at_end = Editor_AtEnd(editor);
+    Line *first_new = TextBuffer_Follow(&tb, follower);
+    // keep up with fast writers, but don't stall the input for too long
+    for (int i = 1; i < FOLLOW_MAX_POLLS && follower->changed; i++) {
+        Line *more = TextBuffer_Follow(&tb, follower);
+        first_new = first_new ? first_new : more;
+    }
+    if (first_new) {
+        Editor_LinesAppended(editor, first_new, at_end);
+        Idle_Wake(highlight_task);
+    }
+    if (follower->truncated) {
+        FileFollower_Destroy(follower);
+        follower = NULL;
+        Notification_Notify(app.notification, "File was truncated, stopped following.", NOTIFICATION_WARNING);
+    }
+}
+
+// idle task: pack and trim some lines
+static bool compact_step(void *user_data) {
+    (void)user_data;
+    return LinePager_Compact(tb.pager);
+}
+
+// idle task: check and highlight some lines (user_data is the editor)
+static bool highlight_step(void *user_data) {
+    return SyntaxHighlightingBinding_Step(&((Editor*)user_data)->sh_binding, SH_BINDING_STEP_LINES);
+}
+
+// the workers highlighted a batch of lines, the idle task checks them
+static void highlight_job_done(void *caller, void *data) {
+    (void)caller;
+    (void)data;
+    Idle_Wake(highlight_task);
+}
+
 /************************************
  * Cleanup                          *
  ************************************/
 static void finish() {  // called automatically (set with atexit())
+    if (saving) {
+        BackgroundSave_Finish(saving, NULL);  // don't lose a file that is just saved
+        saving = NULL;
+    }
+    Input_SetWakeFd(-1);
+    ThreadPool_Destroy(pool);  // before anything the tasks might use
+    pool = NULL;
+    Journal_Destroy(tb.journal, clean_exit);
+    tb.journal = NULL;
+    FileFollower_Destroy(follower);
+    follower = NULL;
     Timer_Deinit();
+    Idle_Deinit();
     App_Deinit();
     Config_Deinit();
     SyntaxHighlighting_Destroy(highlighting);
     TextBuffer_Deinit(&tb);
+    FileView_Close(fileview);
+    fileview = NULL;
     Input_Deinit();
     Screen_Deinit();
     Terminal_Deinit();
@@ -146,6 +313,7 @@ int main(int argc, char *argv[]) {
     Screen_Init(onResize);
     Input_Init();
     Timer_Init();
+    Idle_Init(Input_Pending);
 
     // initial screen draw
     Screen_Draw();
@@ -178,37 +346,86 @@ int main(int argc, char *argv[]) {
     }
 
 
+    // Load config
+    File *config_file = File_OpenConfig(FILE_ACCESS_READ);
+    if (config_file) {
+        char *content = File_Read(config_file);
+        if (content) {
+            Config_LoadIni(content);
+            free(content);
+        }
+        File_Close(config_file);
+    }
+    pool = ThreadPool_Create(Config_GetNumber(Config_GetModuleConfig("performance"), "workers", 0));
+    Input_SetWakeFd(ThreadPool_Fd(pool));  // finished tasks end the wait for input
+
     const char * fn = Config_GetFilename();
     bool failure_on_file_load = false;  // the failure message can only be shown after initializing the widget system
-    if (strcmp(fn, "") != 0) {
+    bool line_index = Config_GetNumber(Config_GetModuleConfig("file"), "line_index", 1);
+    // a big file that was loaded before has cached line offsets, so it's not read at all
+    LineIndex *index = NULL;
+    if (strcmp(fn, "") != 0 && !viewer && line_index) {
+        index = LineIndex_Open(fn);
+    }
+    if (strcmp(fn, "") != 0 && viewer) {
+        fileview = FileView_Open(fn, &tb);
+        failure_on_file_load = !fileview;
+    }
+    else if (index && TextBuffer_LoadFromIndex(&tb, fn, index)) {
+        LineIndex_Close(index);
+    }
+    else if (strcmp(fn, "") != 0) {
+        LineIndex_Close(index);
         File *file;        
         file = File_Open(fn, FILE_ACCESS_READ);
 
         if (file) {
             TextBuffer_LoadFromFile(&tb, file);
             File_Close(file);
+            if (line_index && tb.disk_size >= LINEINDEX_MIN_FILE_SIZE) {
+                LineIndex_Save(fn, &tb);
+            }
         }
         else {
             failure_on_file_load = true;
         }
     }
 
-    // Load config
-    File *config_file = File_OpenConfig(FILE_ACCESS_READ);
-    if (config_file) {
-        char *content = File_Read(config_file);
-        if (content) {
-            Config_LoadIni(content);
-            free(content);
+    // recover unsaved edits and start journaling
+    // (not while following, the journal only matches the file as it was loaded)
+    JournalReplayResult replay_result = JOURNAL_REPLAY_NONE;
+    size_t replayed_records = 0;
+    char *stale_journal = NULL;
+    if (strcmp(fn, "") != 0 && !follow && !viewer && Config_GetNumber(Config_GetModuleConfig("file"), "journal", 1)) {
+        replay_result = Journal_Replay(&tb, fn, &replayed_records);
+        bool append = replay_result == JOURNAL_REPLAY_OK || replay_result == JOURNAL_REPLAY_ERROR;
+        if (replay_result == JOURNAL_REPLAY_STALE || replay_result == JOURNAL_REPLAY_INVALID) {
+            // the unsaved edits of the old journal are not thrown away
+            stale_journal = Journal_KeepStale(fn);
         }
-        File_Close(config_file);
+        tb.journal = Journal_Create(fn, append);
+    }
+
+    // keep only the recently used unmodified lines in memory (the viewer has its own window)
+    int memory_budget = Config_GetNumber(Config_GetModuleConfig("file"), "memory_budget", 256);
+    if (strcmp(fn, "") != 0 && !viewer && !failure_on_file_load) {
+        // without a budget the pager still compacts the lines
+        TextBuffer_EnablePaging(&tb, fn, memory_budget > 0 ? (size_t)memory_budget * 1024 * 1024 : SIZE_MAX);
+        compact_task = Idle_Add(IDLE_PRIORITY_LOW, compact_step, NULL);
     }
 
     App_Init(Screen_GetWidth(), Screen_GetHeight());
  
     EditorView *editor = EditorView_Create(AS_WIDGET(&app), &tb);
     Widget_Focus(AS_WIDGET(editor));
-    editor->editor->sh_binding.sh = highlighting;
+    // no highlighting in the viewer, the blocks open in front of its window of the file are unknown
+    editor->editor->sh_binding.sh = viewer ? NULL : highlighting;
+    editor->editor->sh_binding.pool = pool;
+    editor->editor->sh_binding.job_done = Callback_New(highlight_job_done, NULL);
+    if (!viewer) {
+        highlight_task = Idle_Add(IDLE_PRIORITY_NORMAL, highlight_step, editor->editor);
+    }
+    editor->editor->read_only = viewer;
     (void)editor;
     BottomBar *bottombar = BottomBar_Create(AS_WIDGET(&app));
     (void)bottombar;
@@ -220,6 +437,16 @@ int main(int argc, char *argv[]) {
             .shortcut = 's',
             .callback = Callback_New(onMenuClick, "save")
         },
+        {
+            .text = "Memory stats",
+            .shortcut = 'm',
+            .callback = Callback_New(onMenuClick, "stats")
+        },
+        {
+            .text = "Worker stats",
+            .shortcut = 'w',
+            .callback = Callback_New(onMenuClick, "workers")
+        },
         {
             .text = "Exit",
             .shortcut = 'q',
@@ -233,10 +460,43 @@ int main(int argc, char *argv[]) {
     App_onParentResize(Screen_GetWidth(), Screen_GetHeight());  // trigger on_resize on all widgets
 
 
+    if (follow && !viewer && !failure_on_file_load && strcmp(fn, "") != 0) {
+        follower = FileFollower_Create(fn, tb.disk_size);
+        if (!follower) {
+            Notification_Notify(app.notification, "Cannot follow file.", NOTIFICATION_WARNING);
+        }
+        else {
+            // start at the end like tail -f
+            TextBuffer_MergeGap(&tb);
+            tb.current_line = TextBuffer_GetLastLine(&tb);
+            tb.gap.position = 0;
+            TextLayout_ScrollToEnd(&editor->editor->tl);
+        }
+    }
+
     // failure message from file load 
     if (failure_on_file_load) {
         Notification_Notify(app.notification, "Cannot open file for reading.", NOTIFICATION_WARNING);
     }
+    if (replay_result == JOURNAL_REPLAY_OK) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "Recovered %zu unsaved edits.", replayed_records);
+        Notification_Notify(app.notification, msg, NOTIFICATION_SUCCESS);
+    }
+    else if (stale_journal) {
+        char msg[PATH_MAX + 64];
+        bool stale = replay_result == JOURNAL_REPLAY_STALE;
+        snprintf(msg, sizeof(msg), "%s, journal kept as %s.",
+                 stale ? "File changed since the last crash" : "Journal is damaged", stale_journal);
+        Notification_Notify(app.notification, msg, stale ? NOTIFICATION_WARNING : NOTIFICATION_ERROR);
+    }
+    else if (replay_result == JOURNAL_REPLAY_STALE) {
+        Notification_Notify(app.notification, "File changed since the last crash, journal discarded.", NOTIFICATION_WARNING);
+    }
+    else if (replay_result == JOURNAL_REPLAY_ERROR || replay_result == JOURNAL_REPLAY_INVALID) {
+        Notification_Notify(app.notification, "Journal is damaged, edits might be lost.", NOTIFICATION_ERROR);
+    }
+    free(stale_journal);
 
 
     /************************************
@@ -244,14 +504,31 @@ int main(int argc, char *argv[]) {
      ************************************/
     while (1) {
         Timer_Update();
+        update_saving();
+        update_follow(editor->editor);
+        ThreadPool_Poll(pool);
         
+        // don't wait for input while there is idle work, the work yields to input anyway
+        Input_SetTimeout(Idle_HasWork() ? 0 : INPUT_TIMEOUT_MS);
         InputEvent input = Input_Read();
+        if (!InputEvent_IsValid(&input)) {
+            Journal_Sync(tb.journal);  // idle, make the journal durable
+            Idle_Run(IDLE_SLICE_US);
+        }
+        else {
+            if (LinePager_CompactPending(tb.pager)) {
+                Idle_Wake(compact_task);  // the input changed lines
+            }
+            Idle_Wake(highlight_task);
+        }
         
         if (InputEvent_IsValid(&input) && !App_HandleInput(input)) {
             if (input.key == KEY_ESC) {
                 Widget_FocusAndReturn(AS_WIDGET(menu), AS_WIDGET(&app));
             }
         }
+        FileView_Update(fileview, &tb, editor->editor->tl.first_line, editor->editor->tl.height);
+        LinePager_Balance(tb.pager);
 
         App_Update();
         Config_Loaded();
@@ -44,11 +44,15 @@ SyntaxBlockDef *SyntaxBlockDef_Create() {
         logFatal("Cannot allocate memory for SyntaxBlockDef.");
     }
     block->name = NULL;
+    block->start = NULL;
+    block->end = NULL;
     block->only_start = false;
     block->children = NULL;
     block->children_count = 0;
     block->ends_on = NULL;
     block->ends_on_count = 0;
+    block->matcher = NULL;
+    block->index = 0;
     return block;
 }
 
@@ -63,8 +67,9 @@ void SyntaxBlockDef_Destroy(SyntaxBlockDef *block) {
     if (block->name) {
         free(block->name);
     }
-    regfree(&block->start);
-    regfree(&block->end);
+    Regexp_Destroy(block->start);
+    Regexp_Destroy(block->end);
+    Regexp_Destroy(block->matcher);
 
     free(block);
 }
@@ -81,8 +86,8 @@ SyntaxBlockDef *SyntaxBlockDef_FromTable(const char *name, const Table *table, S
     block->color = (uint8_t)TypedTable_GetNumber(table, "color");
 
     if (strcmp(name, "root") == 0) {
-        regcomp(&block->start, "^", REG_EXTENDED);  // matches always without consuming
-        regcomp(&block->end, "a^", REG_EXTENDED);   // matches never
+        block->start = Regexp_Compile("^", NULL, 0);  // matches always without consuming
+        block->end = NULL;  // never ends (the highlighter doesn't search for it)
         block->only_start = false;
         return block;
     }
@@ -92,40 +97,33 @@ SyntaxBlockDef *SyntaxBlockDef_FromTable(const char *name, const Table *table, S
             SYNTAXDEFINITION_BLOCK_NO_START_REGEX, 
             String_Format("Block \"%s\" has no start regex defined.", name)
         );
-        free(block->name);
-        free(block);
+        SyntaxBlockDef_Destroy(block);
         return NULL;
     }
-    int ret = regcomp(&block->start, start_regex, REG_EXTENDED);
-    if (ret != 0) {
-        char errbuf[256];
-        regerror(ret, &block->start, errbuf, sizeof(errbuf));
+    char errbuf[256];
+    block->start = Regexp_Compile(start_regex, errbuf, sizeof(errbuf));
+    if (!block->start) {
         set_error(error,
             SYNTAXDEFINITION_REGEX_ERROR_START, 
             String_Format("Error in start regex \"%s\" in block \"%s\": %s", start_regex, name, errbuf)
         );
-        free(block->name);
-        free(block);
+        SyntaxBlockDef_Destroy(block);
         return NULL;
     }
     if (end_regex) {
-        ret = regcomp(&block->end, end_regex, REG_EXTENDED);
-        if (ret != 0) {
-            char errbuf[256];
-            regerror(ret, &block->end, errbuf, sizeof(errbuf));
+        block->end = Regexp_Compile(end_regex, errbuf, sizeof(errbuf));
+        if (!block->end) {
             set_error(error,
                 SYNTAXDEFINITION_REGEX_ERROR_END, 
                 String_Format("Error in end regex \"%s\" in block \"%s\": %s", end_regex, name, errbuf)
             );
-            regfree(&block->start);
-            free(block->name);
-            free(block);
+            SyntaxBlockDef_Destroy(block);
             return NULL;
         }
         block->only_start = false;
     }
     else {
-        regcomp(&block->end, "^", REG_EXTENDED);  // matches everything without consuming
+        block->end = Regexp_Compile("^", NULL, 0);  // matches everything without consuming
     }
 
     return block;
@@ -202,6 +200,7 @@ static SyntaxDefinitionError build_blocks(SyntaxDefinition *def, const Table *ta
             Table_Set(blocks, block_name, mapping, free);
 
             // add the block to the list of all blocks (important for freeing also unreferenced blocks later)
+            block->index = def->blocks_count;
             def->blocks[def->blocks_count++] = block;
 
             if (strcmp(block_name, "root") == 0) {
@@ -325,6 +324,31 @@ SyntaxDefinitionError link_ends_with(SyntaxDefinition *def, Table *blocks) {
     return NO_ERROR;
 }
 
+// combine everything that is searched for inside a block, so a line is scanned only once per block
+static void build_matchers(SyntaxDefinition *def) {
+    for (size_t i=0; i<def->blocks_count; i++) {
+        SyntaxBlockDef *block = def->blocks[i];
+        if (block->only_start) {
+            continue;
+        }
+        size_t count = block->children_count + block->ends_on_count + 1;
+        Regexp **parts = malloc(sizeof(Regexp*) * count);
+        if (!parts) {
+            logFatal("Cannot allocate memory for SyntaxBlockDef matcher.");
+        }
+        // on the same position the lowest index wins: the end beats an ends_on block, which beats a child
+        size_t n = 0;
+        parts[n++] = block->end;
+        for (size_t j=0; j<block->ends_on_count; j++) {
+            parts[n++] = block->ends_on[j]->start;
+        }
+        for (size_t j=0; j<block->children_count; j++) {
+            parts[n++] = block->children[j]->start;
+        }
+        block->matcher = Regexp_Union(parts, n);
+        free(parts);
+    }
+}
 
 SyntaxDefinition *SyntaxDefinition_FromTable(const Table *table, SyntaxDefinitionError *error) {
     if (!table) {
@@ -371,6 +395,8 @@ SyntaxDefinition *SyntaxDefinition_FromTable(const Table *table, SyntaxDefinitio
     // cleanup
     Table_Destroy(blocks);
 
+    build_matchers(def);
+
     return def;
 }
 
@@ -48,7 +48,8 @@
  * start = if|then|else
  * ```
  *
- * Each block must define a `start` regex (an extended POSIX regular expression).
+ * Each block must define a `start` regex (an extended POSIX regular expression,
+ * see common/regexp.h).
  * Optionally, a block may also define an `end` regex.
  *
  * Blocks without an `end` expression represent single tokens or patterns that
@@ -66,7 +67,8 @@
 #define SYNTAX_DEFINITION_H
 
 #include <stdint.h>
-#include <regex.h>
+#include <stdbool.h>
+#include "common/regexp.h"
 #include "common/table.h"
 #include "common/string.h"
 
@@ -99,23 +101,13 @@ typedef struct _SyntaxDefinitionError {
 void SyntaxDefinitionError_Deinit(SyntaxDefinitionError *error);
 
 
-/**
- * @brief Helper struct to cache regex match results. This information are used by the Highlight module.
- */
-typedef struct _MatchCache {
-    ssize_t offset;     // total **byte offset** from where match was calculated
-    regmatch_t match;   // last match
-    bool done;          // if true the last match was already found   
-} MatchCache;
-
-
 /**
  * @brief Holds the definition of a syntax block.
  */
 typedef struct _SyntaxBlockDef {
     char *name;      //< name of the block definition. for easier debugging
-    regex_t start;      //< compiled regex to determine the begin of the block
-    regex_t end;        //< compiled regex to determine the end of the block (optional)
+    Regexp *start;      //< compiled regex to determine the begin of the block
+    Regexp *end;        //< compiled regex to determine the end of the block (optional)
     
     bool only_start;    //< if true only start is tested and no children are allowed
     
@@ -127,8 +119,8 @@ typedef struct _SyntaxBlockDef {
     
     uint8_t color;      //< the color to render the block
 
-    MatchCache start_cache; //< used by the Highlight module
-    MatchCache end_cache;   //< used by the Highlight module
+    Regexp *matcher;    //< union of end, the start of the ends_on blocks and the start of the children (in this order), NULL for only_start blocks
+    size_t index;       //< position in SyntaxDefinition->blocks
 } SyntaxBlockDef;
 
 SyntaxBlockDef *SyntaxBlockDef_Create();
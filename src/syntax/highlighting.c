@@ -1,4 +1,7 @@
 #include "highlighting.h"
+
+#include <stdint.h>
+#include <string.h>
 #include "common/logging.h"
 
 /*****************************************************************************/
@@ -27,8 +30,8 @@ SyntaxHighlightingString *SyntaxHighlightingString_Create(const String *text) {
     shs->tags = NULL;
     shs->tags_count = 0;
     shs->tags_capacity = 0;
-    Stack_Init(&shs->open_blocks_at_begin);
-    Stack_Init(&shs->open_blocks_at_end);
+    shs->open_blocks_at_begin = NULL;
+    shs->open_blocks_at_end = NULL;
 
     shs->tags = malloc(sizeof(SyntaxHighlightingTag) * SHS_TAGS_INITIAL_CAPACITY);
     if (!shs->tags) {
@@ -47,8 +50,6 @@ void SyntaxHighlightingString_Destroy(SyntaxHighlightingString *shs) {
     shs->tags_count = 0;
     shs->tags_capacity = 0;
     shs->text = NULL;
-    Stack_Deinit(&shs->open_blocks_at_begin);
-    Stack_Deinit(&shs->open_blocks_at_end);
 
     free(shs);
 }
@@ -84,41 +85,167 @@ void SyntaxHighlightingString_Clear(SyntaxHighlightingString *shs) {
         return;
     }
     shs->tags_count = 0;
-    Stack_Clear(&shs->open_blocks_at_end);
+    shs->open_blocks_at_end = NULL;
+}
+
+// index of the first tag behind offset (tags are sorted by their offsets)
+static size_t upper_bound(const SyntaxHighlightingString *shs, size_t offset) {
+    size_t low = 0;
+    size_t high = shs->tags_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (shs->tags[mid].byte_offset <= offset) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low;
 }
 
 const SyntaxHighlightingTag *SyntaxHighlightingString_GetTag(const SyntaxHighlightingString *shs, size_t offset) {
-    // TODO: Need massive optimization
+    const SyntaxHighlightingTag *tag = SyntaxHighlightingString_FindTag(shs, offset);
+    return tag && tag->byte_offset == offset ? tag : NULL;
+}
+
+const SyntaxHighlightingTag *SyntaxHighlightingString_FindTag(const SyntaxHighlightingString *shs, size_t offset) {
+    if (!shs || shs->tags_count == 0) {
+        return NULL;
+    }
+    size_t index = upper_bound(shs, offset);
+    return index > 0 ? &shs->tags[index - 1] : NULL;
+}
+
+void SyntaxHighlightingTagCursor_Init(SyntaxHighlightingTagCursor *cursor, const SyntaxHighlightingString *shs) {
+    cursor->shs = shs;
+    cursor->next = 0;
+}
+
+const SyntaxHighlightingTag *SyntaxHighlightingTagCursor_Seek(SyntaxHighlightingTagCursor *cursor, size_t offset) {
+    const SyntaxHighlightingString *shs = cursor->shs;
     if (!shs || shs->tags_count == 0) {
         return NULL;
     }
-    for (size_t i=shs->tags_count; i>0; i--) {
-        if (shs->tags[i-1].byte_offset == offset) {
-            return &shs->tags[i-1];
+    if (cursor->next > 0 && shs->tags[cursor->next - 1].byte_offset > offset) {
+        // backwards
+        cursor->next = upper_bound(shs, offset);
+        return cursor->next > 0 ? &shs->tags[cursor->next - 1] : NULL;
+    }
+    size_t first = cursor->next;
+    while (cursor->next < shs->tags_count && shs->tags[cursor->next].byte_offset <= offset) {
+        cursor->next++;
+    }
+    return cursor->next > first ? &shs->tags[cursor->next - 1] : NULL;
+}
+
+size_t SyntaxHighlightingTagCursor_NextOffset(const SyntaxHighlightingTagCursor *cursor) {
+    const SyntaxHighlightingString *shs = cursor->shs;
+    if (!shs || cursor->next >= shs->tags_count) {
+        return SIZE_MAX;
+    }
+    return shs->tags[cursor->next].byte_offset;
+}
+
+/*****************************************************************************/
+/* SyntaxHighlightingContext                                                 */
+
+SyntaxHighlightingContext *SyntaxHighlightingContext_Create(const SyntaxDefinition *def, bool copy_matchers) {
+    SyntaxHighlightingContext *context = calloc(1, sizeof(SyntaxHighlightingContext));
+    if (!context) {
+        logFatal("Cannot allocate memory for SyntaxHighlightingContext.");
+    }
+    size_t count = def->blocks_count ? def->blocks_count : 1;
+    context->matchers = calloc(count, sizeof(Regexp*));
+    context->caches = calloc(count, sizeof(MatchCache));
+    if (!context->matchers || !context->caches) {
+        logFatal("Cannot allocate memory for SyntaxHighlightingContext.");
+    }
+    context->blocks_count = def->blocks_count;
+    context->own_matchers = copy_matchers;
+    for (size_t i=0; i<def->blocks_count; i++) {
+        const Regexp *matcher = def->blocks[i]->matcher;
+        context->matchers[i] = copy_matchers ? Regexp_Copy(matcher) : (Regexp*)matcher;
+    }
+    return context;
+}
+
+void SyntaxHighlightingContext_Destroy(SyntaxHighlightingContext *context) {
+    if (!context) {
+        return;
+    }
+    for (size_t i=0; i<context->blocks_count; i++) {
+        if (context->own_matchers) {
+            Regexp_Destroy(context->matchers[i]);
         }
+        free(context->caches[i].starts);
     }
-    return NULL;
+    free(context->matchers);
+    free(context->caches);
+    free(context);
 }
 
 /*****************************************************************************/
 /* SyntaxHighlighting                                                        */
 
+static uint32_t hash_stack(const void *p) {
+    const SyntaxStack *stack = p;
+    uint64_t hash = ((uint64_t)(uintptr_t)stack->block * 0x9e3779b97f4a7c15ull) ^ (uint64_t)(uintptr_t)stack->parent;
+    hash *= 0xff51afd7ed558ccdull;
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// stacks are equal if their top blocks are and their (interned) parents are the same
+static int compare_stack(const void *a, const void *b) {
+    const SyntaxStack *x = a;
+    const SyntaxStack *y = b;
+    if (x->block != y->block) {
+        return x->block < y->block ? -1 : 1;
+    }
+    if (x->parent != y->parent) {
+        return x->parent < y->parent ? -1 : 1;
+    }
+    return 0;
+}
+
+// the keys are the stacks themselves, they are freed as values
+static void *keep_key(const void *p) {
+    return (void*)p;
+}
+
+static void free_no_key(void *p) {
+    (void)p;
+}
+
 void SyntaxHighlighting_Init(SyntaxHighlighting *hl, SyntaxDefinition *def) {
     hl->def = def;
-    hl->strings = Table_CreatePtr();
+    hl->stacks = Table_CreateCustom(hash_stack, compare_stack, keep_key, free_no_key);
+    pthread_mutex_init(&hl->lock, NULL);
+    hl->root = def ? SyntaxHighlighting_Push(hl, NULL, def->root) : NULL;
+    hl->context = def ? SyntaxHighlightingContext_Create(def, false) : NULL;
+    hl->spare_contexts = NULL;
 }
 
 void SyntaxHighlighting_Deinit(SyntaxHighlighting *hl) {
     if (!hl) {
         return;
     }
-    if (hl->strings) {
-        Table_Destroy(hl->strings);
+    SyntaxHighlightingContext_Destroy(hl->context);
+    while (hl->spare_contexts) {
+        SyntaxHighlightingContext *next = hl->spare_contexts->next;
+        SyntaxHighlightingContext_Destroy(hl->spare_contexts);
+        hl->spare_contexts = next;
+    }
+    if (hl->stacks) {
+        Table_Destroy(hl->stacks);
     }
     if (hl->def) {
         SyntaxDefinition_Destroy(hl->def);
     }
-    hl->strings = NULL;
+    pthread_mutex_destroy(&hl->lock);
+    hl->context = NULL;
+    hl->stacks = NULL;
+    hl->root = NULL;
     hl->def = NULL;
 }
 
@@ -139,186 +266,518 @@ void SyntaxHighlighting_Destroy(SyntaxHighlighting *hl) {
     free(hl);
 }
 
-static bool regexec_with_cache(const regex_t *regex, const char *str, size_t offset, MatchCache *cache, regmatch_t *match) {
-    if (cache->done) {
+// fill the starts table of regex for str from offset on (once per line), false if the regex has no table
+static bool fill_starts(Regexp *regex, const String *str, size_t offset, MatchCache *cache) {
+    if (cache->starts_capacity < str->bytes_size + 1) {
+        free(cache->starts);
+        cache->starts_capacity = str->bytes_size + 1;
+        cache->starts = malloc(sizeof(uint16_t) * cache->starts_capacity);
+        if (!cache->starts) {
+            logFatal("Cannot allocate memory for the starts table.");
+        }
+    }
+    // the entries in front of offset are not filled, the offsets only grow within a line
+    cache->starts_valid = Regexp_FindStarts(regex, str->bytes, str->bytes_size, offset, cache->starts);
+    return cache->starts_valid;
+}
+
+static bool regexec_with_cache(Regexp *regex, const String *str, size_t offset, MatchCache *cache, RegexpMatch *match) {
+    if (!regex || cache->done) {
         return false;
     }
-    if (cache->match.rm_so + cache->offset >= (regoff_t)offset) {
+    if (cache->valid && cache->match.start >= offset) {
         *match = cache->match;
-        match->rm_so = cache->match.rm_so + cache->offset - offset;
-        match->rm_eo = cache->match.rm_eo + cache->offset - offset;
         return true;
     }
-    if (regexec(regex, str + offset, 1, match, 0) == 0) {
+    // The regex sees the whole line, so ^ only matches at its begin and \b sees the bytes in
+    // front of offset. On long lines the runs that find the end of a match can read far behind
+    // it for every candidate (e.g. `\[.*\]` on many '['), which is quadratic. Once they have
+    // read more than the line, one backward pass finds the starts of all matches instead.
+    bool found;
+    if (cache->starts_valid || (str->bytes_size >= SH_LONG_LINE &&
+                                regex->stats.scanned - cache->scanned > str->bytes_size &&
+                                fill_starts(regex, str, offset, cache)))
+    {
+        found = Regexp_SearchStarts(regex, str->bytes, str->bytes_size, offset, cache->starts, match);
+    }
+    else {
+        found = Regexp_Search(regex, str->bytes, str->bytes_size, offset, match);
+    }
+    if (found) {
         cache->match = *match;
-        cache->offset = offset;
+        cache->valid = true;
         return true;
     }
     cache->done = true;
     return false;
 }
 
-static SyntaxBlockDef *find_first_block(SyntaxBlockDef **block_list, size_t block_list_count, const char *str, size_t offset, regmatch_t *match) {
-    bool had_match = false;
-    regmatch_t first_match = {0};
-    SyntaxBlockDef *first_block = NULL;
-    for (size_t i=0; i<block_list_count; i++) {
-        SyntaxBlockDef *curr = block_list[i];
-        regmatch_t curr_match;
-        if (regexec_with_cache(&curr->start, str, offset, &curr->start_cache, &curr_match)) {
-            if (!had_match || curr_match.rm_so < first_match.rm_so) {
-                first_match = curr_match;
-                first_block = curr;
-                had_match = true;
-            }
-        }
+static void init_match_cache(SyntaxHighlightingContext *context) {
+    for (size_t i=0; i<context->blocks_count; i++) {
+        MatchCache *cache = &context->caches[i];
+        cache->valid = false;
+        cache->done = false;
+        cache->starts_valid = false;
+        cache->scanned = context->matchers[i] ? context->matchers[i]->stats.scanned : 0;
     }
-    if (had_match) {
-        *match = first_match;
-        return first_block;
-    }
-    return NULL;
-}
-
-static SyntaxBlockDef *find_first_child(const char *str, size_t offset, SyntaxBlockDef *current, regmatch_t *match) {
-    return find_first_block(current->children, current->children_count, str, offset, match);
 }
 
-static SyntaxBlockDef *find_first_ends_on_block(const char *str, size_t offset, SyntaxBlockDef *current, regmatch_t *match) {
-    return find_first_block(current->ends_on, current->ends_on_count, str, offset, match);
+const SyntaxStack *SyntaxHighlighting_Push(SyntaxHighlighting *sh, const SyntaxStack *stack, SyntaxBlockDef *block) {
+    SyntaxStack key = { .block = block, .parent = stack, .depth = stack ? stack->depth + 1 : 1 };
+    pthread_mutex_lock(&sh->lock);
+    SyntaxStack *interned = Table_Get(sh->stacks, &key);
+    if (!interned) {
+        interned = malloc(sizeof(SyntaxStack));
+        if (!interned) {
+            logFatal("Cannot allocate memory for SyntaxStack.");
+        }
+        *interned = key;
+        Table_Set(sh->stacks, interned, interned, free);
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return interned;
 }
 
-static bool find_end_of_block(const char *str, size_t offset, SyntaxBlockDef *current, regmatch_t *match) {
-    return regexec_with_cache(&current->end, str, offset, &current->end_cache, match);
+// SyntaxHighlighting_Push() that asks the cache of the context first (the stacks never change)
+static const SyntaxStack *push(SyntaxHighlighting *sh, SyntaxHighlightingContext *context,
+                               const SyntaxStack *stack, SyntaxBlockDef *block)
+{
+    SyntaxStack key = { .block = block, .parent = stack };
+    SyntaxStackCacheEntry *entry = &context->stacks[hash_stack(&key) & (SH_CONTEXT_STACK_CACHE - 1)];
+    if (!entry->stack || entry->parent != stack || entry->block != block) {
+        entry->parent = stack;
+        entry->block = block;
+        entry->stack = SyntaxHighlighting_Push(sh, stack, block);
+    }
+    return entry->stack;
 }
 
-
-static void init_match_cache(SyntaxHighlighting *sh) {
-    for (size_t i=0; i<sh->def->blocks_count; i++) {
-        SyntaxBlockDef *block = sh->def->blocks[i];
-        block->start_cache.match.rm_so = -1;
-        block->start_cache.match.rm_eo = -1;
-        block->start_cache.offset = 0;
-        block->start_cache.done = false;
-        block->end_cache.match.rm_so = -1;
-        block->end_cache.match.rm_eo = -1;
-        block->end_cache.offset = 0;
-        block->end_cache.done = false;
-
-    }
+const SyntaxStack *SyntaxHighlighting_HighlightString(SyntaxHighlighting *sh, const String *text,
+                                                      const SyntaxStack *open_blocks_at_begin,
+                                                      SyntaxHighlightingString **highlight)
+{
+    return SyntaxHighlighting_HighlightStringWith(sh, sh->context, text, open_blocks_at_begin, highlight);
 }
 
-const Stack *SyntaxHighlighting_HighlightString(SyntaxHighlighting *sh, const String *text, const Stack *open_blocks_at_begin) {
-    // check if there is already old infomation about text in the table
-    SyntaxHighlightingString *shs = Table_Get(sh->strings, text);
+const SyntaxStack *SyntaxHighlighting_HighlightStringWith(SyntaxHighlighting *sh, SyntaxHighlightingContext *context,
+                                                          const String *text, const SyntaxStack *open_blocks_at_begin,
+                                                          SyntaxHighlightingString **highlight)
+{
+    SyntaxHighlightingString *shs = *highlight;
     if (shs) {
         // if open_blocks_at_begin changed, clear the old information and reuse the existing shs
         SyntaxHighlightingString_Clear(shs);
     }
     else {
-        // if there is no object present in sh->strings table create one and store it
+        // the caller (usually the Line of text) owns the new shs
         shs = SyntaxHighlightingString_Create(text);
-        // Only set it in the table if it's new. If it existed, we just cleared it
-        // and will now re-populate it.
-        Table_Set(sh->strings, text, shs, (void(*)(void*))SyntaxHighlightingString_Destroy);
+        *highlight = shs;
     }
 
-    // create a working copy of the stack
-    if (open_blocks_at_begin) {
-        Stack_CopyTo(&shs->open_blocks_at_begin, open_blocks_at_begin);
-        Stack_CopyTo(&shs->open_blocks_at_end, open_blocks_at_begin);
-    }
-    else {
-        // or create a new one if open_blocks_at_begin is NULL
-        Stack_Clear(&shs->open_blocks_at_begin);
-        Stack_Push(&shs->open_blocks_at_begin, sh->def->root);
-        Stack_CopyTo(&shs->open_blocks_at_end, &shs->open_blocks_at_begin);
-    }
+    // the root block is open if nothing else is known
+    shs->open_blocks_at_begin = open_blocks_at_begin ? open_blocks_at_begin : sh->root;
+    const SyntaxStack *open_blocks = shs->open_blocks_at_begin;
 
-    // initialize the cache fields of the SyntaxBlockDefs
-    init_match_cache(sh);
+    // initialize the match caches of the blocks
+    init_match_cache(context);
 
     // iterate over the string
     size_t offset = 0;
     for (;;) {
-        // take the current block from the stack (but keep it there)
-        SyntaxBlockDef *current_block = (SyntaxBlockDef*)Stack_Peek(&shs->open_blocks_at_end);
-
-        // find the first child block
-        regmatch_t child_match;
-        SyntaxBlockDef *child = find_first_child(text->bytes, offset, current_block, &child_match);
-        // find the first ends_on block
-        regmatch_t ends_on_match;
-        SyntaxBlockDef *ends_on = find_first_ends_on_block(text->bytes, offset, current_block, &ends_on_match);
-
-        // find the block_end
-        regmatch_t end_match = {0, 0};  // current position with no consumption
-        bool end_found = true;   // true for the case current_block is an only start block
-        if (!current_block->only_start) {
-            end_found = find_end_of_block(text->bytes, offset, current_block, &end_match);
+        // the current block is on top of the stack
+        SyntaxBlockDef *current_block = open_blocks->block;
+
+        // a block without end pattern ends right behind its start
+        if (current_block->only_start) {
+            open_blocks = open_blocks->parent;
+
+            SyntaxHighlightingTag tag;
+            tag.text = text;
+            tag.byte_offset = offset;
+            tag.block = open_blocks->block;  // new current block
+            SyntaxHighlightingString_AddTag(shs, tag);
+            continue;
         }
 
-        // check if child is the first match
-        if (child
-            && (!ends_on || child_match.rm_so < ends_on_match.rm_so)
-            && (!end_found || child_match.rm_so < end_match.rm_so))
+        // the first match of the end, an ends_on block or a child (on the same position in this order)
+        RegexpMatch match;
+        if (!regexec_with_cache(context->matchers[current_block->index], text, offset,
+                                &context->caches[current_block->index], &match))
         {
+            // neither the beginning of a new block nor the end of the current block found
+            shs->open_blocks_at_end = open_blocks;
+            return open_blocks;
+        }
+
+        if (match.pattern > current_block->ends_on_count) {
+            SyntaxBlockDef *child = current_block->children[match.pattern - 1 - current_block->ends_on_count];
             // if there is a child block found create and add a tag to SyntaxHighlightingString tag list
             SyntaxHighlightingTag tag;
             tag.text = text;
-            tag.byte_offset = offset + child_match.rm_so;
+            tag.byte_offset = match.start;
             tag.block = child;
             SyntaxHighlightingString_AddTag(shs, tag);
 
             // increase the offset to the end of the match
-            offset += child_match.rm_eo;
+            offset = match.end;
 
             // push the child to the stack to continue with it in the next iteration
-            Stack_Push(&shs->open_blocks_at_end, (void*)child);
+            open_blocks = push(sh, context, open_blocks, child);
             continue;
         }
-        // check if ends_on is the first match
-        if (ends_on
-            && (!end_found || ends_on_match.rm_so < end_match.rm_so))
-        {
-            // the current block ends by the occurence of the ends_on block
-            Stack_Pop(&shs->open_blocks_at_end);  // removes current (which was just peeked before)
+        if (match.pattern > 0 && match.pattern <= current_block->ends_on_count) {
+            SyntaxBlockDef *ends_on = current_block->ends_on[match.pattern - 1];
 
             // add a tag for the beginning of the ends_on block
             SyntaxHighlightingTag tag;
             tag.text = text;
-            tag.byte_offset = offset + ends_on_match.rm_so;
+            tag.byte_offset = match.start;
             tag.block = ends_on;
             SyntaxHighlightingString_AddTag(shs, tag);
 
-            // add the ends_on block to the stack
-            Stack_Push(&shs->open_blocks_at_end, (void*)ends_on);
+            // the current block ends by the occurence of the ends_on block, which replaces it on the stack
+            open_blocks = push(sh, context, open_blocks->parent, ends_on);
 
             // increase the offset to the end of the match
-            offset += ends_on_match.rm_eo;
+            offset = match.end;
             continue;
         }
-        // last case.... if end_found it's the first match automatically
-        if (end_found) {
-            // end of block found so remove it from stack
-            Stack_Pop(&shs->open_blocks_at_end);  // removes current (which was just peeked before)
+        // last case.... the end of the current block
+        // end of block found so remove it from stack
+        open_blocks = open_blocks->parent;
+        if (!open_blocks) {
+            // if this happens there is an error in the SyntaxDefinition.
+            // the end pattern of the root block must *never* match
+            shs->open_blocks_at_end = NULL;
+            return NULL;
+        }
 
-            // and add a tag for the (new) begin of the surrounding block
-            SyntaxHighlightingTag tag;
-            tag.text = text;
-            tag.byte_offset = offset + end_match.rm_eo;  // the current block goes behind the match of its end
-            tag.block = Stack_Peek(&shs->open_blocks_at_end);  // new current block
-            SyntaxHighlightingString_AddTag(shs, tag);
+        // and add a tag for the (new) begin of the surrounding block
+        SyntaxHighlightingTag tag;
+        tag.text = text;
+        tag.byte_offset = match.end;  // the current block goes behind the match of its end
+        tag.block = open_blocks->block;  // new current block
+        SyntaxHighlightingString_AddTag(shs, tag);
 
-            // increase offset
-            offset += end_match.rm_eo;
-            continue;
+        // increase offset
+        offset = match.end;
+    }
+}
+
+/*****************************************************************************/
+/* Parallel highlighting                                                     */
+
+typedef struct _ParallelJob {
+    SyntaxHighlighting *sh;
+    const String *const *texts;
+    SyntaxHighlightingString **const *highlights;
+    pthread_mutex_t mutex;
+    pthread_cond_t finished;    //< signaled when the last chunk of the workers is done
+    size_t running;             //< chunks the workers did not finish yet
+} ParallelJob;
+
+typedef struct _ParallelChunk {
+    ParallelJob *job;
+    size_t first;               //< index of the first string
+    size_t end;                 //< index behind the last string
+} ParallelChunk;
+
+static SyntaxHighlightingContext *acquire_context(SyntaxHighlighting *sh) {
+    pthread_mutex_lock(&sh->lock);
+    SyntaxHighlightingContext *context = sh->spare_contexts;
+    if (context) {
+        sh->spare_contexts = context->next;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    // the copies keep their DFA caches, so the next job of the workers starts warm
+    // (only the calling thread of SyntaxHighlighting_HighlightStrings() and
+    // SyntaxHighlighting_StartJob() creates them)
+    return context ? context : SyntaxHighlightingContext_Create(sh->def, true);
+}
+
+static void release_context(SyntaxHighlighting *sh, SyntaxHighlightingContext *context) {
+    pthread_mutex_lock(&sh->lock);
+    context->next = sh->spare_contexts;
+    sh->spare_contexts = context;
+    pthread_mutex_unlock(&sh->lock);
+}
+
+static const SyntaxStack *highlight_range(SyntaxHighlighting *sh, SyntaxHighlightingContext *context,
+                                          const String *const *texts, SyntaxHighlightingString **const *highlights,
+                                          size_t first, size_t end, const SyntaxStack *open_blocks)
+{
+    for (size_t i = first; i < end; i++) {
+        open_blocks = SyntaxHighlighting_HighlightStringWith(sh, context, texts[i], open_blocks, highlights[i]);
+    }
+    return open_blocks;
+}
+
+// worker: highlight a chunk starting with only the root block open
+static void highlight_chunk(void *data, const CancelToken *token) {
+    (void)token;
+    ParallelChunk *chunk = data;
+    ParallelJob *job = chunk->job;
+    SyntaxHighlightingContext *context = acquire_context(job->sh);
+    highlight_range(job->sh, context, job->texts, job->highlights, chunk->first, chunk->end, job->sh->root);
+    release_context(job->sh, context);
+
+    pthread_mutex_lock(&job->mutex);
+    if (--job->running == 0) {
+        pthread_cond_signal(&job->finished);
+    }
+    pthread_mutex_unlock(&job->mutex);
+}
+
+const SyntaxStack *SyntaxHighlighting_HighlightStrings(SyntaxHighlighting *sh, ThreadPool *pool,
+                                                       const String *const *texts,
+                                                       SyntaxHighlightingString **const *highlights, size_t count,
+                                                       const SyntaxStack *open_blocks)
+{
+    size_t chunk_count = 1;
+    if (pool && pool->worker_count > 0) {
+        // the calling thread highlights the first chunk
+        size_t max_chunks = pool->worker_count * SH_PARALLEL_CHUNKS_PER_WORKER + 1;
+        chunk_count = count / SH_PARALLEL_MIN_LINES;
+        chunk_count = chunk_count < max_chunks ? chunk_count : max_chunks;
+    }
+    if (chunk_count <= 1) {
+        return highlight_range(sh, sh->context, texts, highlights, 0, count, open_blocks);
+    }
+
+    ParallelJob job = {
+        .sh = sh,
+        .texts = texts,
+        .highlights = highlights,
+        .running = chunk_count - 1
+    };
+    pthread_mutex_init(&job.mutex, NULL);
+    pthread_cond_init(&job.finished, NULL);
+    ParallelChunk *chunks = malloc(sizeof(ParallelChunk) * chunk_count);
+    if (!chunks) {
+        logFatal("Cannot allocate memory for the chunks to highlight.");
+    }
+    for (size_t c = 0; c < chunk_count; c++) {
+        chunks[c].job = &job;
+        chunks[c].first = count * c / chunk_count;
+        chunks[c].end = count * (c + 1) / chunk_count;
+    }
+    // the contexts copy the matchers of the definition, which only the calling thread may touch,
+    // so they are created here (no more workers than contexts run at the same time)
+    size_t context_count = pool->worker_count < chunk_count - 1 ? pool->worker_count : chunk_count - 1;
+    SyntaxHighlightingContext *contexts = NULL;
+    for (size_t c = 0; c < context_count; c++) {
+        SyntaxHighlightingContext *context = acquire_context(sh);
+        context->next = contexts;
+        contexts = context;
+    }
+    while (contexts) {
+        SyntaxHighlightingContext *next = contexts->next;
+        release_context(sh, contexts);
+        contexts = next;
+    }
+    for (size_t c = 1; c < chunk_count; c++) {
+        ThreadPool_Submit(pool, THREADPOOL_PRIORITY_LOW, highlight_chunk, NULL, &chunks[c], NULL);
+    }
+    open_blocks = highlight_range(sh, sh->context, texts, highlights, chunks[0].first, chunks[0].end, open_blocks);
+
+    pthread_mutex_lock(&job.mutex);
+    while (job.running > 0) {
+        pthread_cond_wait(&job.finished, &job.mutex);
+    }
+    pthread_mutex_unlock(&job.mutex);
+
+    // The workers guessed the blocks open at the begin of their chunks. Highlight the lines
+    // of a chunk again until one starts with the blocks that are really open in front of it,
+    // from there on the guess did not make a difference anymore (the stacks are interned).
+    // Lines in front of i are right and open_blocks are open at the end of line i - 1.
+    size_t i = chunks[0].end;
+    for (size_t c = 1; c < chunk_count; c++) {
+        while (i < chunks[c].end &&
+               (*highlights[i])->open_blocks_at_begin != (open_blocks ? open_blocks : sh->root))
+        {
+            open_blocks = SyntaxHighlighting_HighlightStringWith(sh, sh->context, texts[i], open_blocks, highlights[i]);
+            i++;
+        }
+        if (i < chunks[c].end) {
+            i = chunks[c].end;
+            open_blocks = (*highlights[i - 1])->open_blocks_at_end;
         }
-        // neither the beginning of a new block nor the end of the current block found
-        return &shs->open_blocks_at_end;
     }
 
-    // if this happens there is an error in the SyntaxDefinition.
-    // the end pattern of the root block must *never* match
-    return NULL;
+    free(chunks);
+    pthread_cond_destroy(&job.finished);
+    pthread_mutex_destroy(&job.mutex);
+    return open_blocks;
+}
+
+/*****************************************************************************/
+/* SyntaxHighlightingJob                                                     */
+
+typedef struct _JobChunk {
+    struct _SyntaxHighlightingJob *job;
+    size_t first;               //< index of the first string
+    size_t end;                 //< index behind the last string
+} JobChunk;
+
+struct _SyntaxHighlightingJob {
+    SyntaxHighlighting *sh;
+    String *texts;                          //< copies of the strings (they don't own their bytes)
+    char *bytes;                            //< the bytes of all copies
+    SyntaxHighlightingString **highlights;  //< highlighting of texts[i] (NULL if it was taken)
+    size_t count;
+    const SyntaxStack *open_blocks;         //< blocks open at the beginning of the first string
+    JobChunk *chunks;
+    SyntaxHighlightingContext *contexts;    //< contexts the chunks can take (protected by sh->lock)
+    CancelToken *token;
+    Callback done;
+    size_t running;                         //< chunks that are not done (only touched by the main thread)
+    bool destroyed;                         //< destroyed while chunks were running, the last one frees it
+};
+
+// worker: highlight a chunk of a job, only the first one knows the blocks open in front of it
+static void highlight_job_chunk(void *data, const CancelToken *token) {
+    JobChunk *chunk = data;
+    SyntaxHighlightingJob *job = chunk->job;
+    SyntaxHighlighting *sh = job->sh;
+    // no more chunks than contexts run at the same time
+    pthread_mutex_lock(&sh->lock);
+    SyntaxHighlightingContext *context = job->contexts;
+    job->contexts = context->next;
+    pthread_mutex_unlock(&sh->lock);
+
+    const SyntaxStack *open_blocks = chunk->first == 0 ? job->open_blocks : sh->root;
+    for (size_t i = chunk->first; i < chunk->end && !CancelToken_IsCancelled(token); i++) {
+        open_blocks = SyntaxHighlighting_HighlightStringWith(sh, context, &job->texts[i], open_blocks, &job->highlights[i]);
+    }
+
+    pthread_mutex_lock(&sh->lock);
+    context->next = job->contexts;
+    job->contexts = context;
+    pthread_mutex_unlock(&sh->lock);
+}
+
+static void free_job(SyntaxHighlightingJob *job) {
+    while (job->contexts) {
+        SyntaxHighlightingContext *next = job->contexts->next;
+        release_context(job->sh, job->contexts);
+        job->contexts = next;
+    }
+    for (size_t i = 0; i < job->count; i++) {
+        if (job->highlights[i]) {
+            SyntaxHighlightingString_Destroy(job->highlights[i]);
+        }
+    }
+    CancelToken_Release(job->token);
+    free(job->bytes);
+    free(job->texts);
+    free(job->highlights);
+    free(job->chunks);
+    free(job);
+}
+
+// main thread: the last chunk that is done hands the job over
+static void job_chunk_done(void *data, bool cancelled) {
+    (void)cancelled;
+    SyntaxHighlightingJob *job = ((JobChunk*)data)->job;
+    if (--job->running > 0) {
+        return;
+    }
+    if (job->destroyed) {
+        free_job(job);
+        return;
+    }
+    Callback_Call(&job->done, job);
+}
+
+SyntaxHighlightingJob *SyntaxHighlighting_StartJob(SyntaxHighlighting *sh, ThreadPool *pool,
+                                                   const String *const *texts, size_t count,
+                                                   const SyntaxStack *open_blocks, Callback done)
+{
+    size_t max_chunks = pool->worker_count * SH_PARALLEL_CHUNKS_PER_WORKER;
+    size_t chunk_count = count / SH_PARALLEL_MIN_LINES;
+    chunk_count = chunk_count < max_chunks ? chunk_count : max_chunks;
+    chunk_count = chunk_count > 0 ? chunk_count : 1;
+
+    SyntaxHighlightingJob *job = malloc(sizeof(SyntaxHighlightingJob));
+    String *copies = malloc(sizeof(String) * (count > 0 ? count : 1));
+    SyntaxHighlightingString **highlights = calloc(count > 0 ? count : 1, sizeof(SyntaxHighlightingString*));
+    JobChunk *chunks = malloc(sizeof(JobChunk) * chunk_count);
+    size_t bytes_size = 0;
+    for (size_t i = 0; i < count; i++) {
+        bytes_size += texts[i]->bytes_size + 1;
+    }
+    char *bytes = malloc(bytes_size > 0 ? bytes_size : 1);
+    if (!job || !copies || !highlights || !chunks || !bytes) {
+        logFatal("Cannot allocate memory for the lines to highlight.");
+    }
+    // one block for all bytes, copying thousands of lines one by one takes longer than an idle slice
+    char *next = bytes;
+    for (size_t i = 0; i < count; i++) {
+        size_t size = texts[i]->bytes_size;
+        memcpy(next, texts[i]->bytes, size);
+        next[size] = '\0';
+        copies[i] = (String){
+            .bytes = next,
+            .char_count = texts[i]->char_count,
+            .bytes_capacity = size + 1,
+            .multibytes = NULL,
+            .multibytes_size = 0,
+            .multibytes_capacity = 0,
+            .multibytes_invalid = true,
+            .bytes_size = size,
+        };
+        next += size + 1;
+    }
+    job->sh = sh;
+    job->texts = copies;
+    job->bytes = bytes;
+    job->highlights = highlights;
+    job->count = count;
+    job->open_blocks = open_blocks;
+    job->chunks = chunks;
+    job->contexts = NULL;
+    job->token = CancelToken_Create();
+    job->done = done;
+    job->running = chunk_count;
+    job->destroyed = false;
+
+    // the contexts copy the matchers of the definition, which only the calling thread may touch
+    size_t context_count = pool->worker_count < chunk_count ? pool->worker_count : chunk_count;
+    for (size_t c = 0; c < context_count; c++) {
+        SyntaxHighlightingContext *context = acquire_context(sh);
+        context->next = job->contexts;
+        job->contexts = context;
+    }
+    for (size_t c = 0; c < chunk_count; c++) {
+        chunks[c].job = job;
+        chunks[c].first = count * c / chunk_count;
+        chunks[c].end = count * (c + 1) / chunk_count;
+        ThreadPool_Submit(pool, THREADPOOL_PRIORITY_LOW, highlight_job_chunk, job_chunk_done, &chunks[c], job->token);
+    }
+    return job;
+}
+
+SyntaxHighlightingString *SyntaxHighlightingJob_Take(SyntaxHighlightingJob *job, size_t i, const String *text) {
+    SyntaxHighlightingString *shs = job->highlights[i];
+    job->highlights[i] = NULL;
+    if (shs) {
+        shs->text = text;
+        for (size_t t = 0; t < shs->tags_count; t++) {
+            shs->tags[t].text = text;
+        }
+    }
+    return shs;
+}
+
+void SyntaxHighlightingJob_Destroy(SyntaxHighlightingJob *job) {
+    if (!job) {
+        return;
+    }
+    if (job->running > 0) {
+        // the chunks that did not start are skipped, the others stop early
+        CancelToken_Cancel(job->token);
+        job->destroyed = true;
+        return;
+    }
+    free_job(job);
 }
@@ -28,10 +28,12 @@
 #define SYNTAX_HIGHLIGHTING_H
 
 #include <stddef.h>
+#include <pthread.h>
 #include "definition.h"
-#include "common/stack.h"
 #include "common/table.h"
 #include "common/string.h"
+#include "common/threadpool.h"
+#include "common/callback.h"
 
 /**
  * @brief Holds information about the beginning of a block.
@@ -51,6 +53,21 @@ void SyntaxHighlightingTag_Init(SyntaxHighlightingTag *tag);
 void SyntaxHighlightingTag_Deinit(SyntaxHighlightingTag *tag);
 
 
+/**
+ * @brief An immutable stack of open blocks.
+ *
+ * The stacks are interned by their `SyntaxHighlighting` (see SyntaxHighlighting_Push()):
+ * there is only one object for every combination of open blocks, so two stacks are
+ * equal if their addresses are. Pushing a block onto a stack gives the stack that
+ * has it as `parent`, popping is just `parent`. Lines with the same open blocks
+ * share the stack, it lives as long as the `SyntaxHighlighting`.
+ */
+typedef struct _SyntaxStack {
+    SyntaxBlockDef *block;              //< the innermost open block
+    const struct _SyntaxStack *parent;  //< the blocks around it (NULL for the bottom of the stack)
+    size_t depth;                       //< number of open blocks
+} SyntaxStack;
+
 /**
  * @brief Holds the complete highlighting information for the String `text`.
  */
@@ -60,8 +77,8 @@ typedef struct _SyntaxHighlightingString {
     size_t tags_count;              //< number of tags in `tags`
     size_t tags_capacity;           //< capacity of `tags`
 
-    Stack open_blocks_at_begin;     //< Stack of (SyntaxBlockDef*) elements that are open
-    Stack open_blocks_at_end;       //< Stack of (SyntaxBlockDef*) elements that are open at the end of `text`
+    const SyntaxStack *open_blocks_at_begin;    //< blocks that are open at the begin of `text`
+    const SyntaxStack *open_blocks_at_end;      //< blocks that are open at the end of `text`
 } SyntaxHighlightingString;
 
 #define SHS_TAGS_INITIAL_CAPACITY 16
@@ -76,7 +93,7 @@ void SyntaxHighlightingString_Clear(SyntaxHighlightingString *shs);
 /**
  * @brief Return the tag for the given offset or NULL if there is no tag for the offset.
  * 
- * @param shs The `SyntaxHighlightingString` from the `SyntaxHighlighting->strings` table.
+ * @param shs The `SyntaxHighlightingString` of the line (see `Line->highlight`).
  * @param offset The offset in bytes.
  * @returns
  * A pointer to the internal SyntaxHighlightingTag. This pointer is only valid until the
@@ -84,12 +101,111 @@ void SyntaxHighlightingString_Clear(SyntaxHighlightingString *shs);
  */
 const SyntaxHighlightingTag *SyntaxHighlightingString_GetTag(const SyntaxHighlightingString *shs, size_t offset);
 
+/**
+ * @brief Return the tag that is in effect at offset, the last one at or before it (binary search).
+ *
+ * @returns NULL if there is no tag before offset (the block open at the beginning is in effect).
+ */
+const SyntaxHighlightingTag *SyntaxHighlightingString_FindTag(const SyntaxHighlightingString *shs, size_t offset);
+
+/**
+ * @brief Walks the tags of a `SyntaxHighlightingString` along with the characters that are drawn.
+ *
+ * The tags are sorted by their offsets, so for increasing offsets every tag is
+ * passed exactly once (O(1) amortized per character). Seeking backwards falls
+ * back to a binary search.
+ *
+ * Usage:
+ * ```
+ * SyntaxHighlightingTagCursor cursor;
+ * SyntaxHighlightingTagCursor_Init(&cursor, shs);
+ * for (each character at byte_offset) {
+ *     const SyntaxHighlightingTag *tag = SyntaxHighlightingTagCursor_Seek(&cursor, byte_offset);
+ *     if (tag) {
+ *         // the block changes
+ *     }
+ * }
+ * ```
+ */
+typedef struct _SyntaxHighlightingTagCursor {
+    const SyntaxHighlightingString *shs;
+    size_t next;                    //< index of the first tag behind the last offset
+} SyntaxHighlightingTagCursor;
+
+/** @brief Start in front of the first tag (shs may be NULL). */
+void SyntaxHighlightingTagCursor_Init(SyntaxHighlightingTagCursor *cursor, const SyntaxHighlightingString *shs);
+
+/**
+ * @brief Pass all tags up to offset (including).
+ *
+ * @returns The last tag that was passed (the one in effect at offset) or NULL if
+ *          the block did not change since the last call. After seeking backwards
+ *          the tag in effect is returned, NULL means the block open at the beginning.
+ */
+const SyntaxHighlightingTag *SyntaxHighlightingTagCursor_Seek(SyntaxHighlightingTagCursor *cursor, size_t offset);
+
+/**
+ * @brief Offset of the next tag that was not passed yet (SIZE_MAX if there is none).
+ *
+ * Seeking to offsets before it doesn't change anything, so it only needs to be
+ * called when it's reached.
+ */
+size_t SyntaxHighlightingTagCursor_NextOffset(const SyntaxHighlightingTagCursor *cursor);
+
+#define SH_LONG_LINE 4096     //< lines from this length on may switch to a starts table (see Regexp_FindStarts())
+#define SH_CONTEXT_STACK_CACHE 64       //< pushed stacks a context remembers (a power of 2)
+#define SH_PARALLEL_MIN_LINES 1024      //< lines a worker highlights at least (see SyntaxHighlighting_HighlightStrings())
+#define SH_PARALLEL_CHUNKS_PER_WORKER 4 //< chunks per worker, so the workers finish at about the same time
+
+/**
+ * @brief Helper struct to cache regex match results of a block while a line is highlighted.
+ */
+typedef struct _MatchCache {
+    bool valid;         // true if match holds the last match
+    RegexpMatch match;  // last match (byte offsets in the whole text)
+    bool done;          // if true the last match was already found
+    uint16_t *starts;       // starts table of the matcher for long lines (see Regexp_FindStarts())
+    size_t starts_capacity; // number of allocated entries in starts
+    bool starts_valid;      // true if starts was filled for the current line
+    size_t scanned;         // stats.scanned of the matcher at the begin of the line
+} MatchCache;
+
+/**
+ * @brief A stack that was pushed recently (see SyntaxHighlighting_Push()).
+ */
+typedef struct _SyntaxStackCacheEntry {
+    const SyntaxStack *parent;
+    const SyntaxBlockDef *block;
+    const SyntaxStack *stack;       //< the interned stack with block pushed onto parent (NULL if the entry is empty)
+} SyntaxStackCacheEntry;
+
+/**
+ * @brief Everything that changes while a line is highlighted.
+ *
+ * Searching changes the DFA caches of the matchers, so only one thread at a time
+ * may use a context. The context of a `SyntaxHighlighting` uses the matchers of
+ * its definition and belongs to the thread that calls SyntaxHighlighting_HighlightString(),
+ * the workers of SyntaxHighlighting_HighlightStrings() get contexts with copies.
+ */
+typedef struct _SyntaxHighlightingContext {
+    Regexp **matchers;      //< matcher of every block (indexed by SyntaxBlockDef->index)
+    bool own_matchers;      //< true if the matchers are copies
+    MatchCache *caches;     //< match cache of every block (indexed by SyntaxBlockDef->index)
+    size_t blocks_count;    //< number of matchers and caches
+    SyntaxStackCacheEntry stacks[SH_CONTEXT_STACK_CACHE];  //< found without taking the lock of the interned stacks
+    struct _SyntaxHighlightingContext *next;    //< next spare context
+} SyntaxHighlightingContext;
+
 /**
  * @brief Holds the highlighting information for text of multiple `Strings`.
  */
 typedef struct _SyntaxHighlighting {
     SyntaxDefinition *def;    //< SyntaxDefinition to use for highlighting 
-    Table *strings;                 //< Table of (String -> SyntaxHighlightingString*) elements (holds the ownership of the SyntaxHighlightingString's)
+    Table *stacks;                  //< the interned SyntaxStacks (a stack is key and value, the table owns them)
+    const SyntaxStack *root;        //< the stack with only the root block open
+    pthread_mutex_t lock;           //< protects stacks and spare_contexts
+    SyntaxHighlightingContext *context;         //< used by SyntaxHighlighting_HighlightString()
+    SyntaxHighlightingContext *spare_contexts;  //< contexts of the workers that are not in use
 } SyntaxHighlighting;
 
 
@@ -114,21 +230,109 @@ SyntaxHighlighting *SyntaxHighlighting_Create(SyntaxDefinition *def);
 /** @brief Destroy `sh` */
 void SyntaxHighlighting_Destroy(SyntaxHighlighting *sh);
 
+/**
+ * @brief The interned stack with `block` pushed onto `stack`.
+ *
+ * The same arguments always give the same stack. Can be called from any thread.
+ */
+const SyntaxStack *SyntaxHighlighting_Push(SyntaxHighlighting *sh, const SyntaxStack *stack, SyntaxBlockDef *block);
+
+/**
+ * @brief Create a context for the blocks of `def` (see `SyntaxHighlightingContext`).
+ *
+ * With `copy_matchers` the context searches with its own copies of the matchers,
+ * otherwise with the matchers of `def`.
+ */
+SyntaxHighlightingContext *SyntaxHighlightingContext_Create(const SyntaxDefinition *def, bool copy_matchers);
+void SyntaxHighlightingContext_Destroy(SyntaxHighlightingContext *context);
+
 /**
  * @brief Highlight a string according to given context.
  * 
- * Add a `SyntaxHighlightingString`to `hl->strings` or update an existing one.
- * The table uses the pointer address of text as key, so make sure it does not change.
+ * The result is stored in `*highlight`. If it is NULL a new `SyntaxHighlightingString` is
+ * created and the caller takes its ownership (a `Line` keeps it in `Line->highlight` and
+ * destroys it with the line), otherwise the existing one is updated.
  * open_blocks should only be NULL for the first line. In any other case if should be set to
  * SyntaxHighlighlightingString->open_blocks_at_end of the previous line/text.
  * 
  * @param hl The `SyntaxHighlighting` instance to use.
  * @param text The text to hightlight.
- * @param open_blocks An pointer to a `Stack` instance that holds the open blocks at the beginning of string. If NULL it's assumed that the root block is current.
+ * @param open_blocks The blocks that are open at the beginning of string (interned by `hl`). If NULL only the root block is open.
+ * @param highlight Where the highlighting of `text` is kept.
  * 
  * @returns
- * A reference to the `Stack` containing all open blocks at the end of `text`. 
+ * The blocks that are open at the end of `text`.
+ */
+const SyntaxStack *SyntaxHighlighting_HighlightString(SyntaxHighlighting *sh, const String *text,
+                                                      const SyntaxStack *open_blocks,
+                                                      SyntaxHighlightingString **highlight);
+
+/**
+ * @brief Like SyntaxHighlighting_HighlightString() with the matchers and caches of `context`.
+ */
+const SyntaxStack *SyntaxHighlighting_HighlightStringWith(SyntaxHighlighting *sh, SyntaxHighlightingContext *context,
+                                                          const String *text, const SyntaxStack *open_blocks,
+                                                          SyntaxHighlightingString **highlight);
+
+/**
+ * @brief Highlight `count` strings that follow each other, in parallel on the workers of `pool`.
+ *
+ * The strings are split into chunks. The calling thread highlights the first one,
+ * the workers highlight the others starting with a guess (only the root block is
+ * open). Then the lines at the beginning of each chunk are highlighted again with
+ * the blocks that are really open at the end of the chunk in front of it, until a
+ * line starts with the same blocks as before. So the result is the same as
+ * highlighting one string after another with SyntaxHighlighting_HighlightString().
+ *
+ * Returns when everything is done, the strings must not change meanwhile.
+ *
+ * @param pool The workers to use, NULL to highlight everything on the calling thread.
+ * @param highlights Where the highlighting of `texts[i]` is kept (like `highlight` of
+ *                   SyntaxHighlighting_HighlightString()).
+ * @param open_blocks The blocks that are open at the beginning of the first string.
+ *
+ * @returns The blocks that are open at the end of the last string.
+ */
+const SyntaxStack *SyntaxHighlighting_HighlightStrings(SyntaxHighlighting *sh, ThreadPool *pool,
+                                                       const String *const *texts,
+                                                       SyntaxHighlightingString **const *highlights, size_t count,
+                                                       const SyntaxStack *open_blocks);
+
+/**
+ * @brief Strings that are highlighted by the workers of a pool in the background.
+ */
+typedef struct _SyntaxHighlightingJob SyntaxHighlightingJob;
+
+/**
+ * @brief Highlight `count` strings that follow each other on the workers of `pool`, without waiting.
+ *
+ * The strings are copied, so they may change or go away meanwhile. Like in
+ * SyntaxHighlighting_HighlightStrings() every chunk but the first one starts with
+ * a guess, but nothing is highlighted again: the caller has to check if a string
+ * starts with the blocks open at the end of the string in front of it.
+ *
+ * @param pool The workers to use, it must have at least one.
+ * @param open_blocks The blocks that are open at the beginning of the first string.
+ * @param done Called on the main thread by ThreadPool_Poll() when every string is
+ *             highlighted (the job is the caller). Not called if the job is destroyed before.
+ */
+SyntaxHighlightingJob *SyntaxHighlighting_StartJob(SyntaxHighlighting *sh, ThreadPool *pool,
+                                                   const String *const *texts, size_t count,
+                                                   const SyntaxStack *open_blocks, Callback done);
+
+/**
+ * @brief Take the highlighting of string `i` of a job that is done.
+ *
+ * The caller takes its ownership, it belongs to `text` from now on (the string
+ * the copy was made of).
+ */
+SyntaxHighlightingString *SyntaxHighlightingJob_Take(SyntaxHighlightingJob *job, size_t i, const String *text);
+
+/**
+ * @brief Destroy a job, the results that were not taken are dropped.
+ *
+ * If the workers are not done yet the job is cancelled and freed when they are.
  */
-const Stack *SyntaxHighlighting_HighlightString(SyntaxHighlighting *sh, const String *text, const Stack *open_blocks);
+void SyntaxHighlightingJob_Destroy(SyntaxHighlightingJob *job);
 
 #endif
\ No newline at end of file
@@ -1,51 +1,83 @@
+#include <stdint.h>
 #include "textlayoutbindings.h"
+#include "document/linepager.h"
+#include "common/logging.h"
 
 void SyntaxHighlightingBinding_Init(SyntaxHighlightingBinding *binding, TextLayout *tl, SyntaxHighlighting *sh) {
     binding->tl = tl;
     binding->sh = sh;
-    binding->need_full_update = true;
+    binding->pool = NULL;
+    binding->job_done = Callback_New(NULL, NULL);
+    binding->job = NULL;
+    binding->job_line = NULL;
+    binding->job_count = 0;
+    binding->job_changes = 0;
+    binding->job_dropped = false;
 }
 
 void SyntaxHighlightingBinding_Deinit(SyntaxHighlightingBinding *binding) {
+    SyntaxHighlightingJob_Destroy(binding->job);
+    binding->job = NULL;
     binding->tl = NULL;
     binding->sh = NULL;
+    binding->pool = NULL;
 }
 
-static bool stack_equal(const Stack *a, const Stack *b) {
-    if (a->size != b->size) {
-        return false;
+static bool is_bound(const SyntaxHighlightingBinding *binding) {
+    return binding && binding->sh && binding->tl && binding->tl->tb;
+}
+
+// the blocks open at the end of the line before line (NULL if that line was never highlighted)
+static const SyntaxStack *open_blocks_before(const SyntaxHighlightingBinding *binding, const Line *line) {
+    if (!line->prev) {
+        return binding->sh->root;
     }
-    for (size_t i=0; i<a->size; i++) {
-        if (a->items[i] != b->items[i]) {
-            return false;
-        }
+    const SyntaxHighlightingString *shs = line->prev->highlight;
+    return shs ? shs->open_blocks_at_end : NULL;
+}
+
+// SyntaxHighlightingBinding_Step() has to check the line (again)
+static void mark_unchecked(SyntaxHighlightingBinding *binding, const Line *line) {
+    TextBuffer *tb = (TextBuffer*)binding->tl->tb;
+    if (!tb->highlight_line || line->position < tb->highlight_line->position) {
+        tb->highlight_line = (Line*)line;
+    }
+}
+
+static const SyntaxStack *highlight_line(SyntaxHighlightingBinding *binding, const Line *line, const SyntaxStack *open_blocks) {
+    TextBuffer *tb = (TextBuffer*)binding->tl->tb;
+    if (line == tb->current_line) {
+        // this is super dirty cause the gap funcitonality is totally disabled this way!!!
+        // NEED A BETTER SOLUTION
+        TextBuffer_MergeGap(tb);
     }
-    return true;
+    LinePager_Touch(tb->pager, (Line*)line);
+    return SyntaxHighlighting_HighlightString(binding->sh, &line->text, open_blocks, &((Line*)line)->highlight);
 }
 
-static void update_following_lines(SyntaxHighlightingBinding *binding, const Line *first_line, const Line *last_line, Stack *open_blocks) {
-    const Stack *open_blocks_begin = open_blocks;
+// returns the line after last_line if the lines after it might not follow anymore, NULL otherwise
+static const Line *update_following_lines(SyntaxHighlightingBinding *binding, const Line *first_line, const Line *last_line, const SyntaxStack *open_blocks) {
+    const SyntaxStack *open_blocks_begin = open_blocks ? open_blocks : binding->sh->root;
     const Line *line = first_line;
     while (line) {
         if (line != first_line) {
-            SyntaxHighlightingString *shs = Table_Get(binding->sh->strings, &line->text);
-            if (shs && stack_equal(&shs->open_blocks_at_begin, open_blocks_begin)) {
-                break;
+            const SyntaxHighlightingString *shs = line->highlight;
+            // the stacks are interned, the same blocks are open if they are the same stack
+            if (shs && shs->open_blocks_at_begin == open_blocks_begin) {
+                return NULL;
             }
         }
-        // open_blocks == NULL is also handled by the function
-        const Stack *open_blocks_end = SyntaxHighlighting_HighlightString(binding->sh, &line->text, open_blocks_begin);
-        open_blocks_begin = open_blocks_end;
-        //Stack_Destroy(open_blocks_end);
+        open_blocks_begin = highlight_line(binding, line, open_blocks_begin);
         if (line == last_line) {
-            break;
+            return line->next;
         }
         line = line->next;
     }
+    return NULL;
 }
 
 void SyntaxHighlightingBinding_UpdateLine(SyntaxHighlightingBinding *binding, const Line *line, const Line *last_line) {
-    if (!binding || !binding->sh || !binding->tl || !binding->tl->tb || !line) {
+    if (!is_bound(binding) || !line) {
         return;
     }
 
@@ -53,37 +85,28 @@ void SyntaxHighlightingBinding_UpdateLine(SyntaxHighlightingBinding *binding, co
         last_line = line;
     }
 
-    Line *prev_line = line->prev;
-    Stack *open_blocks = NULL;
-    if (prev_line) {
-        // check if highlighting for the previous line is already calculated
-        SyntaxHighlightingString *shs = Table_Get(binding->sh->strings, &prev_line->text);
-        if (shs) {
-            // use the open_blocks from the end of previous line
-            open_blocks = &shs->open_blocks_at_end;
-        }
-        else {
-            // highlighting for the line is not calculated so far
-            // so run this function for thr previous line
-            SyntaxHighlightingBinding_UpdateLine(binding, prev_line, last_line);
-            return;
-        }
+    // go back to the first line whose previous line is highlighted already, but not too far
+    // (jumping into a large file that was never highlighted must not highlight everything in front)
+    const SyntaxStack *open_blocks;
+    size_t catchup = 0;
+    while (!(open_blocks = open_blocks_before(binding, line)) && catchup < SH_BINDING_CATCHUP_LINES) {
+        line = line->prev;
+        catchup++;
     }
-    if (line == binding->tl->tb->current_line) {
-        // this is super dirty cause the gap funcitonality is totally disabled this way!!!
-        // NEED A BETTER SOLUTION
-        TextBuffer_MergeGap((TextBuffer*)binding->tl->tb);
+    if (!open_blocks) {
+        // guess that no blocks are open, the background corrects it
+        mark_unchecked(binding, line);
     }
 
     // update all lines until last_line (including)
-    update_following_lines(binding, line, last_line, open_blocks);
-    if (open_blocks) {
-        //Stack_Destroy(open_blocks);
+    const Line *unchecked = update_following_lines(binding, line, last_line, open_blocks);
+    if (unchecked) {
+        mark_unchecked(binding, unchecked);
     }
 }
 
 void SyntaxHighlightingBinding_Update(SyntaxHighlightingBinding *binding) {
-    if (!binding || !binding->sh || !binding->tl || !binding->tl->tb) {
+    if (!is_bound(binding)) {
         return;
     }
     const TextBuffer *tb = binding->tl->tb;
@@ -96,18 +119,193 @@ void SyntaxHighlightingBinding_Update(SyntaxHighlightingBinding *binding) {
     SyntaxHighlightingBinding_UpdateLine(binding, current, last);
 }
 
-void SyntaxHighlightingBinding_UpdateAll(SyntaxHighlightingBinding *binding, bool force) {
-    if (!binding || !binding->tl || !binding->tl->tb) {
+void SyntaxHighlightingBinding_UpdateVisible(SyntaxHighlightingBinding *binding) {
+    if (!is_bound(binding)) {
         return;
     }
-    if (!force && !binding->need_full_update) {
+    VisualLine *first_vl = TextLayout_GetVisualLine(binding->tl, 0);
+    VisualLine *last_vl = TextLayout_GetVisualLine(binding->tl, binding->tl->height - 1);
+    if (!first_vl) {
         return;
     }
-    binding->need_full_update = false;
-    SyntaxHighlightingBinding_UpdateLine(
-        binding,
-        TextBuffer_GetFirstLine(binding->tl->tb),
-        TextBuffer_GetLastLine(binding->tl->tb)
-    );
+    const Line *last = last_vl ? last_vl->src : TextBuffer_GetLastLine(binding->tl->tb);
+    // start with the first line that is not highlighted or does not follow the line before it
+    // (a guessed state in front of the screen stays until the background gets there)
+    const Line *line = first_vl->src;
+    while (line) {
+        const SyntaxStack *open_blocks = open_blocks_before(binding, line);
+        if (!line->highlight || (open_blocks && line->highlight->open_blocks_at_begin != open_blocks)) {
+            SyntaxHighlightingBinding_UpdateLine(binding, line, last);
+            return;
+        }
+        if (line == last) {
+            return;
+        }
+        line = line->next;
+    }
+}
+
+void SyntaxHighlightingBinding_UpdateAppended(SyntaxHighlightingBinding *binding, const Line *first_new) {
+    if (!is_bound(binding) || !first_new) {
+        return;
+    }
+    VisualLine *first_vl = TextLayout_GetVisualLine(binding->tl, 0);
+    VisualLine *last_vl = TextLayout_GetVisualLine(binding->tl, binding->tl->height - 1);
+    const Line *last = last_vl ? last_vl->src : TextBuffer_GetLastLine(binding->tl->tb);
+    const Line *line = first_new;
+    if (first_vl && first_vl->src->position > line->position) {
+        line = first_vl->src;  // skip the lines that scrolled by unseen
+    }
+    if (line->position > last->position) {
+        return;  // nothing new on screen
+    }
+    const SyntaxStack *open_blocks = NULL;
+    if (first_new->prev) {
+        SyntaxHighlightingString *shs = first_new->prev->highlight;
+        open_blocks = shs ? shs->open_blocks_at_end : NULL;
+    }
+    while (line) {
+        open_blocks = highlight_line(binding, line, open_blocks);
+        if (line == last) {
+            break;
+        }
+        line = line->next;
+    }
+}
 
-}
\ No newline at end of file
+// highlight up to SH_BINDING_PARALLEL_LINES lines from line on with the workers, returns the line behind them
+static Line *highlight_parallel(SyntaxHighlightingBinding *binding, Line *line, const SyntaxStack **open_blocks) {
+    TextBuffer *tb = (TextBuffer*)binding->tl->tb;
+    const String **texts = malloc(sizeof(String*) * SH_BINDING_PARALLEL_LINES);
+    SyntaxHighlightingString ***highlights = malloc(sizeof(SyntaxHighlightingString**) * SH_BINDING_PARALLEL_LINES);
+    if (!texts || !highlights) {
+        logFatal("Cannot allocate memory for the lines to highlight.");
+    }
+    // the workers only read the text, the buffer does not change until they are done
+    size_t count = 0;
+    for (; line && count < SH_BINDING_PARALLEL_LINES; line = line->next) {
+        if (line == tb->current_line) {
+            TextBuffer_MergeGap(tb);
+        }
+        LinePager_Touch(tb->pager, line);
+        texts[count] = &line->text;
+        highlights[count] = &line->highlight;
+        count++;
+    }
+    *open_blocks = SyntaxHighlighting_HighlightStrings(binding->sh, binding->pool, texts,
+                                                       (SyntaxHighlightingString **const *)highlights, count, *open_blocks);
+    free(texts);
+    free(highlights);
+    return line;
+}
+
+// the workers are done (called by ThreadPool_Poll()), caller is the job
+static void job_done(void *caller, void *data) {
+    SyntaxHighlightingJob *job = caller;
+    SyntaxHighlightingBinding *binding = data;
+    TextBuffer *tb = (TextBuffer*)binding->tl->tb;
+    // the lines are known to be alive and to have the text of the copies only if nothing changed
+    if (tb->changes == binding->job_changes) {
+        Line *line = binding->job_line;
+        for (size_t i = 0; i < binding->job_count; i++, line = line->next) {
+            if (!line->highlight) {  // it was highlighted on screen meanwhile otherwise
+                line->highlight = SyntaxHighlightingJob_Take(job, i, &line->text);
+            }
+        }
+        // the lines at the beginning of the chunks are checked by the next steps
+        mark_unchecked(binding, binding->job_line);
+    }
+    else {
+        // lines that change all the time (e.g. a followed file) must not keep the lines from being highlighted
+        binding->job_dropped = true;
+    }
+    SyntaxHighlightingJob_Destroy(job);
+    binding->job = NULL;
+    binding->job_line = NULL;
+    Callback_Call(&binding->job_done, binding);
+}
+
+// start a job for up to SH_BINDING_PARALLEL_LINES lines from line on, the lines are left as they are
+static void start_job(SyntaxHighlightingBinding *binding, Line *line, const SyntaxStack *open_blocks) {
+    TextBuffer *tb = (TextBuffer*)binding->tl->tb;
+    const String **texts = malloc(sizeof(String*) * SH_BINDING_PARALLEL_LINES);
+    if (!texts) {
+        logFatal("Cannot allocate memory for the lines to highlight.");
+    }
+    binding->job_line = line;
+    size_t count = 0;
+    for (; line && count < SH_BINDING_PARALLEL_LINES; line = line->next) {
+        if (line == tb->current_line) {
+            TextBuffer_MergeGap(tb);
+        }
+        LinePager_Touch(tb->pager, line);
+        texts[count++] = &line->text;
+    }
+    binding->job_count = count;
+    binding->job_changes = tb->changes;
+    binding->job = SyntaxHighlighting_StartJob(binding->sh, binding->pool, texts, count, open_blocks,
+                                               Callback_New(job_done, binding));
+    free(texts);
+}
+
+// a single worker is not faster than the main thread, it would only delay the lines
+static bool has_workers(const SyntaxHighlightingBinding *binding) {
+    return binding->pool && binding->pool->worker_count >= 2;
+}
+
+// with wait the workers highlight their batch while the calling thread waits for them
+static bool step(SyntaxHighlightingBinding *binding, size_t max_lines, bool wait) {
+    if (!is_bound(binding) || binding->job) {
+        return false;
+    }
+    TextBuffer *tb = (TextBuffer*)binding->tl->tb;
+    Line *line = tb->highlight_line;
+    if (!line) {
+        return false;
+    }
+    // all lines in front of highlight_line are highlighted and follow each other
+    const SyntaxStack *open_blocks = open_blocks_before(binding, line);
+    if (has_workers(binding) && !line->highlight && wait) {
+        tb->highlight_line = highlight_parallel(binding, line, &open_blocks);
+        return tb->highlight_line != NULL;
+    }
+    if (has_workers(binding) && !line->highlight && !binding->job_dropped) {
+        start_job(binding, line, open_blocks);
+        return false;
+    }
+    binding->job_dropped = false;
+    size_t highlighted = 0;
+    size_t checked = 0;
+    while (line && highlighted < max_lines && checked < SH_BINDING_CHECK_LINES) {
+        const SyntaxHighlightingString *shs = line->highlight;
+        if (open_blocks && shs && shs->open_blocks_at_begin == open_blocks) {
+            open_blocks = shs->open_blocks_at_end;
+        }
+        else {
+            open_blocks = highlight_line(binding, line, open_blocks);
+            highlighted++;
+        }
+        checked++;
+        line = line->next;
+    }
+    tb->highlight_line = line;
+    return line != NULL;
+}
+
+bool SyntaxHighlightingBinding_Step(SyntaxHighlightingBinding *binding, size_t max_lines) {
+    return step(binding, max_lines, false);
+}
+
+void SyntaxHighlightingBinding_UpdateAll(SyntaxHighlightingBinding *binding, bool force) {
+    if (!is_bound(binding)) {
+        return;
+    }
+    SyntaxHighlightingJob_Destroy(binding->job);
+    binding->job = NULL;
+    binding->job_line = NULL;
+    if (force) {
+        mark_unchecked(binding, TextBuffer_GetFirstLine(binding->tl->tb));
+    }
+    while (step(binding, SIZE_MAX, true)) {
+    }
+}
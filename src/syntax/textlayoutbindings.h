@@ -2,20 +2,100 @@
 #define SYNTAX_TEXTLAYOUTBINDINGS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "highlighting.h"
 #include "document/textlayout.h"
 
+/*
+ * Highlighting is computed lazily. Only the lines on screen are highlighted
+ * right away, starting with the blocks open at the end of the line before
+ * them. If that line was never highlighted, at most SH_BINDING_CATCHUP_LINES
+ * lines in front of the screen are highlighted first and the blocks open in
+ * front of them are guessed (none).
+ *
+ * Everything else is done in the background by SyntaxHighlightingBinding_Step()
+ * (an idle task, see io/idle.h): it walks the buffer from TextBuffer.highlight_line
+ * on and highlights every line whose state does not continue the state of the
+ * line before it, so wrong guesses are corrected later. Every highlighted line
+ * keeps its state (the interned stacks of the open blocks), so each of them is
+ * a checkpoint to start from and checking a line is a pointer comparison.
+ * Lines that were never highlighted are highlighted in large batches by the
+ * workers of a thread pool if the binding has one with two workers or more (see
+ * SyntaxHighlighting_StartJob()). The main loop goes on meanwhile and the lines
+ * keep no highlighting until the workers are done. Then ThreadPool_Poll() hands
+ * the results to the lines, unless any line of the buffer changed in between,
+ * and the following steps check them like any other line (the lines at the
+ * beginning of the chunks of the workers started with a guess).
+ */
+
+#define SH_BINDING_CATCHUP_LINES 1000   //< lines highlighted in front of the screen before the state is guessed
+#define SH_BINDING_STEP_LINES 256       //< lines highlighted per idle step
+#define SH_BINDING_CHECK_LINES 65536    //< lines checked (but not highlighted) per idle step
+#define SH_BINDING_PARALLEL_LINES 16384 //< lines highlighted per job of the workers
+
 typedef struct _SyntaxHighlightingBinding {
     TextLayout *tl;
     SyntaxHighlighting *sh;
-    bool need_full_update;
+    ThreadPool *pool;       //< workers for the lines that were never highlighted (may be NULL)
+    Callback job_done;      //< called when the workers are done (e.g. to wake the idle task)
+
+    // lines the workers highlight right now
+    SyntaxHighlightingJob *job;     //< NULL if there are none
+    Line *job_line;                 //< first line of the job
+    size_t job_count;               //< lines in the job
+    size_t job_changes;             //< TextBuffer.changes when the job was started
+    bool job_dropped;               //< the last job was dropped, the next step highlights on the main thread
 } SyntaxHighlightingBinding;
 
 void SyntaxHighlightingBinding_Init(SyntaxHighlightingBinding *binding, TextLayout *tl, SyntaxHighlighting *sh);
 void SyntaxHighlightingBinding_Deinit(SyntaxHighlightingBinding *binding);
 
+/**
+ * @brief Highlight the lines from line to last_line (including).
+ *
+ * Lines in front of line that were never highlighted are highlighted first, but
+ * not more than SH_BINDING_CATCHUP_LINES of them. The lines after last_line are
+ * left to the background (SyntaxHighlightingBinding_Step()).
+ */
 void SyntaxHighlightingBinding_UpdateLine(SyntaxHighlightingBinding *binding, const Line *line, const Line *last_line);
+/**
+ * @brief Highlight from the current line to the end of the screen (after an edit).
+ */
 void SyntaxHighlightingBinding_Update(SyntaxHighlightingBinding *binding);
+/**
+ * @brief Highlight the lines on screen that are not highlighted or out of date.
+ *
+ * Cheap if all of them are highlighted already, call it before drawing.
+ */
+void SyntaxHighlightingBinding_UpdateVisible(SyntaxHighlightingBinding *binding);
+/**
+ * @brief Highlight lines that were appended at the end of the buffer (follow mode).
+ *
+ * Only the appended lines that are on screen are highlighted, starting with the
+ * blocks open at the end of the line before first_new. Lines that scrolled by
+ * unseen are highlighted in the background (SyntaxHighlightingBinding_Step()).
+ */
+void SyntaxHighlightingBinding_UpdateAppended(SyntaxHighlightingBinding *binding, const Line *first_new);
+/**
+ * @brief Check and highlight lines from TextBuffer.highlight_line on.
+ *
+ * Highlights at most max_lines lines and checks at most SH_BINDING_CHECK_LINES
+ * lines that are up to date. If the first line was never highlighted and there
+ * is a pool, a job for the workers is started with SH_BINDING_PARALLEL_LINES
+ * lines instead.
+ *
+ * @returns true if there are lines left to check, false as well while the workers
+ *          highlight lines (job_done is called when they are done).
+ */
+bool SyntaxHighlightingBinding_Step(SyntaxHighlightingBinding *binding, size_t max_lines);
+/**
+ * @brief Check and highlight all lines now (synchronously).
+ *
+ * A job of the workers is dropped, the workers highlight the lines that were
+ * never highlighted while the calling thread waits for them.
+ *
+ * With force all lines are checked, not only those from TextBuffer.highlight_line on.
+ */
 void SyntaxHighlightingBinding_UpdateAll(SyntaxHighlightingBinding *binding, bool force);
 
-#endif
\ No newline at end of file
+#endif
@@ -17,6 +17,8 @@
 
 #include <ctype.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <limits.h>
 #include "display/canvas.h"
 #include "io/input.h"
 #include "common/logging.h"
@@ -40,36 +42,68 @@ static void editor_destroy(Widget *self) {
     TextSelection_Deinit(&editor->ts);
     TextLayout_Deinit(&editor->tl);
     TextEdit_Deinit(&editor->te);
+    free(editor->draw_cells);
+    free(editor->draw_runs);
 }
 
 
-void draw_char(TextLayout *tl, Canvas *canvas, uint32_t cp, int x_pos, bool has_cursor) {
-    Style orig_style;
-    if (has_cursor) {
-        orig_style = canvas->current_style;
-        canvas->current_style.attributes |= STYLE_UNDERLINE;
+// make room for count cells in the draw buffers
+static void reserve_draw_cells(Editor *editor, int count) {
+    if (count <= editor->draw_capacity) {
+        return;
     }
-    if (cp == '\t') {
-        int tabwidth = TextLayout_CalcTabWidth(tl, x_pos);
-        for (int i=0; i<tabwidth; i++) {
-            Canvas_PutChar(canvas, ' ');
-        }
+    int capacity = editor->draw_capacity ? editor->draw_capacity : 256;
+    while (capacity < count) {
+        capacity *= 2;
     }
-    else {
-        Canvas_PutChar(canvas, cp);
+    editor->draw_cells = realloc(editor->draw_cells, capacity * sizeof(uint32_t));
+    editor->draw_runs = realloc(editor->draw_runs, capacity * sizeof(StyleRun));
+    if (!editor->draw_cells || !editor->draw_runs) {
+        logFatal("Cannot allocate memory for drawing the editor.");
+    }
+    editor->draw_capacity = capacity;
+}
+
+// collects the cells of a visual line and merges equally styled neighbours into runs
+typedef struct {
+    Editor *editor;
+    int cells;
+    int runs;
+} RunBuilder;
+
+// following cells use style (continues the last run if it has the same style)
+static void start_run(RunBuilder *rb, const Style *style) {
+    StyleRun *last = rb->runs > 0 ? &rb->editor->draw_runs[rb->runs - 1] : NULL;
+    if (!last || !Style_Equal(&last->style, style)) {
+        rb->editor->draw_runs[rb->runs++] = (StyleRun){ .length = 0, .style = *style };
     }
-    if (has_cursor) {
-        canvas->current_style = orig_style;
+}
+
+static void add_cells(RunBuilder *rb, uint32_t cp, int count) {
+    for (int i=0; i<count; i++) {
+        rb->editor->draw_cells[rb->cells++] = cp;
+    }
+    rb->editor->draw_runs[rb->runs - 1].length += count;
+}
+
+static void draw_runs(RunBuilder *rb, Canvas *canvas) {
+    const uint32_t *cells = rb->editor->draw_cells;
+    for (int i=0; i<rb->runs; i++) {
+        const StyleRun *run = &rb->editor->draw_runs[i];
+        canvas->current_style = run->style;
+        Canvas_PutChars(canvas, cells, run->length);
+        cells += run->length;
     }
+    rb->cells = 0;
+    rb->runs = 0;
 }
 
 // draw line and return new y_offset (changes to one if the cursor wraps to the next line)
-static int draw_visual_line(Editor *editor, Canvas *canvas, int y, int y_offset) {
+static int draw_visual_line(Editor *editor, Canvas *canvas, int y, int y_offset, const CursorLayoutInfo *cursor) {
     // 1 --- Setup stuff
 
     // get visual line
     VisualLine *line = TextLayout_GetVisualLine(&editor->tl, y);
-    TextSelection *ts = &editor->ts;
 
     if (!line){  // no visual line at this position
         return y_offset;
@@ -80,86 +114,112 @@ static int draw_visual_line(Editor *editor, Canvas *canvas, int y, int y_offset)
         is_gap_line = true;
     }
     // setup syntax highlighting stuff
-    SyntaxHighlighting *sh = editor->sh_binding.sh;
-    SyntaxHighlightingString *shs = !sh ? NULL : Table_Get(sh->strings, &line->src->text);
+    SyntaxHighlightingString *shs = editor->sh_binding.sh ? line->src->highlight : NULL;
 
     // Move cursor to the start position
     Canvas_MoveCursor(canvas, 0, y + y_offset);
 
-    // get information about the cursor
-    CursorLayoutInfo cursor;
-    TextLayout_GetCursorLayoutInfo(&editor->tl, &cursor);
-
-    
     // change the style if it's the current line
-    if (shs && Stack_Peek(&shs->open_blocks_at_begin)) {
-        SyntaxBlockDef *first_block = Stack_Peek(&shs->open_blocks_at_begin);
-        canvas->current_style.fg = first_block->color;
-    }
     Style orig_style = canvas->current_style;
     Style line_style = orig_style;
+    if (shs && shs->open_blocks_at_begin) {
+        line_style.fg = shs->open_blocks_at_begin->block->color;
+    }
     if (is_gap_line) {
         line_style.bg = editor->config.active.bg;
     }
-    
+    Style cursor_style = editor->config.cursor;
+    if (editor->cursor_visible) {
+        cursor_style.attributes |= STYLE_UNDERLINE;
+    }
+    bool cursor_on_line = line == cursor->line && editor->mode == EDITOR_MODE_INPUT;
+
+    // the selected part of the line, in characters of this visual line
+    int selected_from = 0;
+    int selected_to = 0;
+    if (TextSelection_GetRange(&editor->ts, line->src, &selected_from, &selected_to)) {
+        selected_from -= line->offset;
+        selected_to = selected_to == INT_MAX ? INT_MAX : selected_to - line->offset;
+    }
 
-    // 2 --- Draw characters loop
+    // a tab takes several cells, but all of them fit into the line (plus the cursor behind it)
+    reserve_draw_cells(editor, line->length + editor->tl.width + 1);
+    RunBuilder rb = { .editor = editor, .cells = 0, .runs = 0 };
+
+    // 2 --- Collect the cells and their styles
+    // (the tags are passed in order, a wrapped line starts with the ones of the part before)
+    SyntaxHighlightingTagCursor tags;
+    SyntaxHighlightingTagCursor_Init(&tags, shs);
+    size_t next_tag = SyntaxHighlightingTagCursor_NextOffset(&tags);
+    // without a gap and multibyte characters a character is a byte
+    // (VisualLine_GetChar() brings the multibyte information up to date first)
+    const char *bytes = NULL;
+    if (!line->gap && line->length > 0 && VisualLine_GetChar(line, 0) && line->src->text.multibytes_size == 0) {
+        bytes = line->src->text.bytes + line->offset;
+    }
+    const Style *run_style = NULL;  // a new run starts if the style changes
     for (int i=0; i<line->length; i++) {
         // get the character to draw (might not be in line->src->text.bytes if it's in the gap in general)
         // in the moment the gap is always merged when updateing the syntax highlighting, so it should
         // work at the moment
         // Pay attention in future changes!
-        const char *ch = VisualLine_GetChar(line, i);
+        const char *ch = bytes ? bytes + i : VisualLine_GetChar(line, i);
 
         // This will not always work if is_gap_line and the gap is not merged!!
-        size_t byte_offset = byte_offset = ch - line->src->text.bytes;
-        
-        const SyntaxHighlightingTag *tag = SyntaxHighlightingString_GetTag(shs, byte_offset);
-        if (tag) {
-            canvas->current_style.fg = tag->block->color;
-            line_style.fg = tag->block->color;
+        size_t byte_offset = ch - line->src->text.bytes;
+
+        if (byte_offset >= next_tag) {
+            const SyntaxHighlightingTag *tag = SyntaxHighlightingTagCursor_Seek(&tags, byte_offset);
+            if (tag) {
+                line_style.fg = tag->block->color;
+                run_style = NULL;
+            }
+            next_tag = SyntaxHighlightingTagCursor_NextOffset(&tags);
         }
-        
 
-        uint32_t cp = utf8_to_codepoint(ch);
-        bool has_cursor = (line == cursor.line && i == cursor.idx && editor->mode == EDITOR_MODE_INPUT);
-        if (TextSelection_IsSelected(ts, line->src, line->offset + i)) {
-            canvas->current_style = editor->config.selected;
+        const Style *style = &line_style;
+        if (cursor_on_line && i == cursor->idx) {
+            style = &cursor_style;
         }
-        else {
-            canvas->current_style = line_style;
+        else if (i >= selected_from && i < selected_to) {
+            style = &editor->config.selected;
         }
-        Style char_style = canvas->current_style;
-        if (has_cursor) {
-            char_style = editor->config.cursor;
+        if (style != run_style) {
+            start_run(&rb, style);
+            run_style = style;
         }
-        canvas->current_style = char_style;
-        draw_char(&editor->tl, canvas, cp, line->char_x[i], has_cursor && editor->cursor_visible);
-        canvas->current_style = line_style;
-    }
 
-    canvas->current_style = line_style;
+        uint32_t cp = (unsigned char)*ch < 0x80 ? (uint32_t)*ch : utf8_to_codepoint(ch);
+        if (cp == '\t') {
+            add_cells(&rb, ' ', TextLayout_CalcTabWidth(&editor->tl, line->char_x[i]));
+        }
+        else {
+            add_cells(&rb, cp, 1);
+        }
+    }
+    draw_runs(&rb, canvas);
 
- 
     int x = line->width;
 
     // if the cursor is behind the last character of the line draw it
-    bool has_cursor = (line == cursor.line && line->length == cursor.idx && editor->mode == EDITOR_MODE_INPUT);
-    if (has_cursor) {
+    if (cursor_on_line && line->length == cursor->idx) {
         // if it goes out of screen wrap the line first
         if (x == editor->tl.width) {
             y_offset++;
             x = 0;
             Canvas_MoveCursor(canvas, 0, y + y_offset);
         }
-        draw_char(&editor->tl, canvas, ' ', x,  editor->cursor_visible);
+        start_run(&rb, &cursor_style);
+        add_cells(&rb, ' ', 1);
         x++;
     }
 
     // fill the line with spaces (to overwrite artifacts from earlier draws)
-    for ( ; x<editor->tl.width; x++) {
-        draw_char(&editor->tl, canvas, ' ', x, false);
+    if (x < editor->tl.width) {
+        start_run(&rb, &line_style);
+        add_cells(&rb, ' ', editor->tl.width - x);
     }
+    draw_runs(&rb, canvas);
 
     // restore the previous style
     canvas->current_style = orig_style;
@@ -176,7 +236,7 @@ static void editor_draw(const Widget *self, Canvas *canvas) {
     int y = 0;
     int y_offset = 0;
     for (y=0; y+y_offset<editor->tl.height; y++) {
-        y_offset = draw_visual_line(editor, canvas, y, y_offset);
+        y_offset = draw_visual_line(editor, canvas, y, y_offset, &cursor);
     }
 }
 
@@ -304,7 +364,7 @@ static bool editor_handle_input(Widget *self, InputEvent input) {
     }
 
     // selection
-    if (input.mods == KEY_MOD_SHIFT) {
+    if (input.mods == KEY_MOD_SHIFT && !editor->read_only) {
         TextBuffer_MergeGap(tb);
         TextSelection_Select(ts, tb->current_line, tb->gap.position);
         bool handled = false;
@@ -348,7 +408,7 @@ static bool editor_handle_input(Widget *self, InputEvent input) {
         bool input_handled = false;
         input_handled = input_handled || handle_input_cursor_movement(editor, input, cursor);
         input_handled = input_handled || handle_input_scrolling(editor, input);
-        input_handled = input_handled || handle_input_text_editing(editor, input, cursor);
+        input_handled = input_handled || (!editor->read_only && handle_input_text_editing(editor, input, cursor));
         if (input_handled) {
             SyntaxHighlightingBinding_Update(&editor->sh_binding);
             return true;
@@ -388,9 +448,8 @@ static void editor_update(Widget *self) {
         editor->tl.dirty = true;
     }
 
-    // initialize highlighting
-    // will only be called once due to internal flags
-    SyntaxHighlightingBinding_UpdateAll(&editor->sh_binding, false);
+    // highlight what is on screen, the rest is highlighted in the background
+    SyntaxHighlightingBinding_UpdateVisible(&editor->sh_binding);
 }
 
 static void editor_on_config_changed(Widget *self) {
@@ -438,6 +497,7 @@ void Editor_Init(Editor *self, Widget *parent, TextBuffer *tb) {
     TextSelection_Init(&self->ts);
 
     self->mode = EDITOR_MODE_INPUT;
+    self->read_only = false;
 
     self->cursor_timer = Timer_Start(500, alternate_cursor_visibility, self);
     Timer_Pause(self->cursor_timer);  // start when getting focus
@@ -456,6 +516,10 @@ void Editor_Init(Editor *self, Widget *parent, TextBuffer *tb) {
     self->config.cursor.bg = Color_GetCodeById(COLOR_HIGHLIGHT_BG);
 
     SyntaxHighlightingBinding_Init(&self->sh_binding, &self->tl, NULL);
+
+    self->draw_cells = NULL;
+    self->draw_runs = NULL;
+    self->draw_capacity = 0;
 }
 
 Editor *Editor_Create(Widget *parent, TextBuffer *tb) {
@@ -472,4 +536,25 @@ void Editor_Resize(Editor *editor, int w, int h) {
     self->width = w;
     self->height = h;
     TextLayout_SetDimensions(&AS_EDITOR(self)->tl, self->width, self->height);
-}
\ No newline at end of file
+}
+
+bool Editor_AtEnd(const Editor *editor) {
+    return editor->mode == EDITOR_MODE_INPUT && !editor->tb->current_line->next;
+}
+
+void Editor_LinesAppended(Editor *editor, const Line *first_new, bool follow) {
+    if (!first_new) {
+        return;
+    }
+    TextBuffer *tb = editor->tb;
+    if (follow) {
+        TextBuffer_MergeGap(tb);
+        tb->current_line = TextBuffer_GetLastLine(tb);
+        tb->gap.position = 0;
+        TextLayout_ScrollToEnd(&editor->tl);
+    }
+    else {
+        editor->tl.dirty = true;  // the new lines might be on screen
+    }
+    SyntaxHighlightingBinding_UpdateAppended(&editor->sh_binding, first_new);
+}
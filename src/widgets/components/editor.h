@@ -38,6 +38,14 @@ typedef struct {
     Style cursor;
 } EditorConfig;
 
+/**
+ * @brief Cells of a visual line that are drawn with the same style.
+ */
+typedef struct {
+    int length;         //< number of cells
+    Style style;
+} StyleRun;
+
 typedef struct {
     Widget base;
 
@@ -47,6 +55,7 @@ typedef struct {
     TextSelection ts;
 
     EditorMode mode;
+    bool read_only;     //< ignore everything that would change the text (viewer mode)
     
     uint8_t cursor_timer;
     bool cursor_visible;
@@ -54,6 +63,11 @@ typedef struct {
     SyntaxHighlightingBinding sh_binding;
 
     EditorConfig config;
+
+    // reused for every visual line that is drawn
+    uint32_t *draw_cells;   //< code points of the cells (tabs expanded)
+    StyleRun *draw_runs;    //< styles of draw_cells
+    int draw_capacity;      //< entries of both arrays
 } Editor;
 
 #define AS_EDITOR(w) ((Editor*)(w))
@@ -63,4 +77,17 @@ Editor *Editor_Create(Widget *parent, TextBuffer *tb);
 
 void Editor_Resize(Editor *editor, int w, int h);
 
+/**
+ * @brief Return true if the cursor is in the last line (the view follows appended lines then).
+ */
+bool Editor_AtEnd(const Editor *editor);
+
+/**
+ * @brief Lines were appended at the end of the buffer (e.g. by following the file).
+ *
+ * If follow is true the cursor moves to the last line and the view scrolls to the end.
+ * Only the rows that get visible are laid out and highlighted.
+ */
+void Editor_LinesAppended(Editor *editor, const Line *first_new, bool follow);
+
 #endif
\ No newline at end of file
@@ -18,13 +18,8 @@
 
 
 static int get_first_line_number(TextLayout *tl) {
-    Line *line = tl->first_line;
-    int i = 1;
-    while (line->prev) {
-        i++;
-        line = line->prev;
-    }
-    return i;
+    // cached lookup, only walks the distance scrolled since the last frame
+    return (int)(tl->tb->line_number_offset + TextBuffer_GetLineNumber((TextBuffer*)tl->tb, tl->first_line)) + 1;
 }
 
 static int get_max_width(int max_nr) {
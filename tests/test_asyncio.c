@@ -0,0 +1,146 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "acutest.h"
+#include "io/asyncio.h"
+#include "io/file.h"
+
+static const AsyncIOBackend backends[] = { ASYNCIO_BACKEND_URING, ASYNCIO_BACKEND_THREADS };
+
+static void make_tmp_path(char *path, size_t size) {
+    snprintf(path, size, "/tmp/clieditor_test_XXXXXX");
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0);
+    close(fd);
+}
+
+static char *pattern(size_t size) {
+    char *data = malloc(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (char)('a' + (i * 7 + i / 4096) % 26);
+    }
+    return data;
+}
+
+void test_write_and_read(void) {
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        AsyncIO *aio = AsyncIO_Create(4, backends[b]);
+        if (!aio) {
+            TEST_CHECK(backends[b] == ASYNCIO_BACKEND_URING);  // the threads always work
+            continue;
+        }
+        TEST_CASE(AsyncIO_BackendName(aio));
+        char path[64];
+        make_tmp_path(path, sizeof(path));
+        int fd = open(path, O_RDWR);
+        TEST_ASSERT(fd >= 0);
+
+        // four writes in flight, a fifth is refused
+        size_t size = 3 * ASYNCIO_READ_BLOCK + 12345;
+        char *data = pattern(size);
+        size_t part = size / 4 + 1;
+        AsyncIORequest requests[5];
+        struct iovec iov[5];
+        for (int i = 0; i < 4; i++) {
+            size_t start = part * i;
+            iov[i].iov_base = data + start;
+            iov[i].iov_len = start + part > size ? size - start : part;
+            requests[i] = (AsyncIORequest){ .op = ASYNCIO_WRITE, .fd = fd, .iov = &iov[i], .iov_count = 1, .offset = start };
+            TEST_CHECK(AsyncIO_Submit(aio, &requests[i]));
+        }
+        iov[4] = iov[0];
+        requests[4] = requests[0];
+        TEST_CHECK(!AsyncIO_Submit(aio, &requests[4]));
+        for (int i = 3; i >= 0; i--) {
+            AsyncIO_Wait(aio, &requests[i]);
+            TEST_CHECK(requests[i].done && requests[i].result == (ssize_t)iov[i].iov_len);
+        }
+        AsyncIO_Destroy(aio);
+
+        // read it back in blocks
+        AsyncReader *reader = AsyncReader_Open(fd, backends[b]);
+        TEST_ASSERT(reader != NULL);
+        size_t total = 0;
+        bool equal = true;
+        const char *bytes;
+        size_t length;
+        while (AsyncReader_Next(reader, &bytes, &length)) {
+            equal = equal && total + length <= size && memcmp(bytes, data + total, length) == 0;
+            total += length;
+        }
+        TEST_CHECK(equal);
+        TEST_CHECK(total == size);
+        TEST_CHECK(!AsyncReader_Next(reader, &bytes, &length));
+        AsyncReader_Close(reader);
+
+        free(data);
+        close(fd);
+        unlink(path);
+    }
+}
+
+void test_read_empty(void) {
+    char path[64];
+    make_tmp_path(path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    AsyncReader *reader = AsyncReader_Open(fd, ASYNCIO_BACKEND_AUTO);
+    TEST_ASSERT(reader != NULL);
+    const char *bytes;
+    size_t length;
+    TEST_CHECK(!AsyncReader_Next(reader, &bytes, &length));
+    AsyncReader_Close(reader);
+    close(fd);
+    unlink(path);
+}
+
+void test_read_lines_across_blocks(void) {
+    char path[64];
+    make_tmp_path(path, sizeof(path));
+    FILE *fp = fopen(path, "wb");
+    TEST_ASSERT(fp != NULL);
+    // short lines that cross the block borders, a line longer than a block, CRLF
+    for (int i = 0; i < 100000; i++) {
+        fprintf(fp, "line %d\n", i);
+    }
+    for (size_t i = 0; i < ASYNCIO_READ_BLOCK + 100; i++) {
+        fputc('x', fp);
+    }
+    fputs("\r\nlast", fp);
+    fclose(fp);
+
+    File *file = File_Open(path, FILE_ACCESS_READ);
+    TEST_ASSERT(file != NULL);
+    bool equal = true;
+    for (int i = 0; i < 100000; i++) {
+        String *line = File_ReadLine(file);
+        TEST_ASSERT(line != NULL);
+        char expected[32];
+        int n = snprintf(expected, sizeof(expected), "line %d", i);
+        equal = equal && strcmp(line->bytes, expected) == 0 && file->line_bytes == (size_t)n + 1;
+        String_Destroy(line);
+    }
+    TEST_CHECK(equal);
+    TEST_CHECK(file->reader != NULL);
+    String *long_line = File_ReadLine(file);
+    TEST_ASSERT(long_line != NULL);
+    TEST_CHECK(long_line->bytes_size == ASYNCIO_READ_BLOCK + 100);
+    TEST_CHECK(file->line_bytes == ASYNCIO_READ_BLOCK + 102);
+    String_Destroy(long_line);
+    String *last = File_ReadLine(file);
+    TEST_ASSERT(last != NULL);
+    TEST_CHECK(strcmp(last->bytes, "last") == 0 && file->line_bytes == 4);
+    String_Destroy(last);
+    TEST_CHECK(File_ReadLine(file) == NULL);
+    File_Close(file);
+    unlink(path);
+}
+
+TEST_LIST = {
+    { "AsyncIO: Write and read", test_write_and_read },
+    { "AsyncIO: Read empty file", test_read_empty },
+    { "AsyncIO: Read lines across blocks", test_read_lines_across_blocks },
+    { NULL, NULL }
+};
@@ -0,0 +1,125 @@
+#define _DEFAULT_SOURCE  // sched_yield()
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+
+#include "acutest.h"
+#include "common/channel.h"
+
+static bool readable(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    return poll(&pfd, 1, 0) == 1;
+}
+
+void test_fifo(void) {
+    Channel *ch = Channel_Create(5);
+    TEST_ASSERT(ch != NULL);
+    TEST_CHECK(ch->capacity == 8);
+    void *item;
+    TEST_CHECK(!Channel_Receive(ch, &item));
+    for (uintptr_t i = 1; i <= 8; i++) {
+        TEST_CHECK(Channel_Send(ch, (void*)i));
+    }
+    // full
+    TEST_CHECK(!Channel_Send(ch, (void*)9));
+    TEST_CHECK(atomic_load(&ch->stats.full) == 1);
+    TEST_CHECK(Channel_Depth(ch) == 8);
+    TEST_CHECK(atomic_load(&ch->stats.max_depth) == 8);
+
+    for (uintptr_t i = 1; i <= 8; i++) {
+        TEST_CHECK(Channel_Receive(ch, &item) && (uintptr_t)item == i);
+    }
+    TEST_CHECK(!Channel_Receive(ch, &item));
+    // the slots are reused
+    TEST_CHECK(Channel_Send(ch, (void*)10));
+    TEST_CHECK(Channel_Receive(ch, &item) && (uintptr_t)item == 10);
+    Channel_Destroy(ch);
+}
+
+void test_wakeup(void) {
+    Channel *ch = Channel_Create(16);
+    int fd = Channel_Fd(ch);
+    TEST_ASSERT(fd >= 0);
+    TEST_CHECK(!readable(fd));
+    Channel_Send(ch, (void*)1);
+    Channel_Send(ch, (void*)2);
+    TEST_CHECK(readable(fd));
+
+    void *item;
+    while (Channel_Receive(ch, &item)) {
+    }
+    TEST_CHECK(!readable(fd));
+    // signals again after it was drained
+    Channel_Send(ch, (void*)3);
+    TEST_CHECK(readable(fd));
+    Channel_Destroy(ch);
+}
+
+#define PRODUCERS 4
+#define ITEMS_PER_PRODUCER 100000
+
+typedef struct {
+    Channel *ch;
+    uintptr_t id;
+} Producer;
+
+static void *produce(void *arg) {
+    Producer *producer = arg;
+    for (uintptr_t i = 0; i < ITEMS_PER_PRODUCER; i++) {
+        // item: producer in the high bits, sequence number in the low bits
+        void *item = (void*)((producer->id << 24) | i);
+        while (!Channel_Send(producer->ch, item)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+void test_producers(void) {
+    Channel *ch = Channel_Create(256);
+    pthread_t threads[PRODUCERS];
+    Producer producers[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; i++) {
+        producers[i] = (Producer){ ch, (uintptr_t)i };
+        pthread_create(&threads[i], NULL, produce, &producers[i]);
+    }
+
+    uintptr_t expected[PRODUCERS] = { 0 };
+    size_t received = 0;
+    bool in_order = true;
+    while (received < PRODUCERS * ITEMS_PER_PRODUCER) {
+        void *item;
+        if (!Channel_Receive(ch, &item)) {
+            sched_yield();
+            continue;
+        }
+        uintptr_t id = (uintptr_t)item >> 24;
+        uintptr_t sequence = (uintptr_t)item & 0xffffff;
+        // every producer's items arrive in the order they were sent
+        in_order = in_order && id < PRODUCERS && sequence == expected[id];
+        expected[id] = sequence + 1;
+        received++;
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    TEST_CHECK(in_order);
+    void *item;
+    TEST_CHECK(!Channel_Receive(ch, &item));
+    TEST_CHECK(atomic_load(&ch->stats.sent) == PRODUCERS * ITEMS_PER_PRODUCER);
+    TEST_CHECK(atomic_load(&ch->stats.received) == PRODUCERS * ITEMS_PER_PRODUCER);
+    TEST_CHECK(atomic_load(&ch->stats.max_depth) <= ch->capacity);
+    TEST_MSG("contended: %zu, full: %zu", atomic_load(&ch->stats.contended), atomic_load(&ch->stats.full));
+    Channel_Destroy(ch);
+}
+
+TEST_LIST = {
+    { "Channel: FIFO", test_fifo },
+    { "Channel: Wakeup", test_wakeup },
+    { "Channel: Producers", test_producers },
+    { NULL, NULL }
+};
@@ -0,0 +1,136 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "acutest.h"
+#include "io/filefollower.h"
+#include "document/textbuffer.h"
+#include "document/textio.h"
+
+typedef struct {
+    char dir[64];
+    char path[128];
+    TextBuffer tb;
+    FileFollower *ff;
+} TestFixture;
+
+static void write_file(const char *path, const char *content, const char *mode) {
+    FILE *fp = fopen(path, mode);
+    TEST_ASSERT(fp != NULL);
+    fputs(content, fp);
+    fclose(fp);
+}
+
+static void setup_fixture(TestFixture *f, const char *content) {
+    snprintf(f->dir, sizeof(f->dir), "/tmp/clieditor_test_XXXXXX");
+    TEST_ASSERT(mkdtemp(f->dir) != NULL);
+    snprintf(f->path, sizeof(f->path), "%s/doc.log", f->dir);
+    write_file(f->path, content, "wb");
+
+    TextBuffer_Init(&f->tb);
+    File *file = File_Open(f->path, FILE_ACCESS_READ);
+    TEST_ASSERT(file != NULL);
+    TextBuffer_LoadFromFile(&f->tb, file);
+    File_Close(file);
+
+    f->ff = FileFollower_Create(f->path, f->tb.disk_size);
+    TEST_ASSERT(f->ff != NULL);
+}
+
+static void teardown_fixture(TestFixture *f) {
+    FileFollower_Destroy(f->ff);
+    TextBuffer_Deinit(&f->tb);
+    unlink(f->path);
+    rmdir(f->dir);
+}
+
+static bool line_is(const Line *line, const char *text) {
+    return line && line->text.bytes_size == strlen(text) && memcmp(line->text.bytes, text, strlen(text)) == 0;
+}
+
+void test_follow_append(void) {
+    TestFixture f;
+    setup_fixture(&f, "one\ntwo\n");
+
+    TEST_CHECK(TextBuffer_Follow(&f.tb, f.ff) == NULL);
+
+    write_file(f.path, "three\nfour\nfi", "ab");
+    Line *first_new = TextBuffer_Follow(&f.tb, f.ff);
+    TEST_CHECK(line_is(first_new, "three"));
+    TEST_CHECK(line_is(TextBuffer_GetLastLine(&f.tb), "four"));  // "fi" is not complete
+    TEST_CHECK(f.tb.line_count == 4);
+    TEST_CHECK(first_new->disk_offset == 8);
+
+    write_file(f.path, "ve\n", "ab");
+    first_new = TextBuffer_Follow(&f.tb, f.ff);
+    TEST_CHECK(line_is(first_new, "five"));
+    TEST_CHECK(first_new->disk_offset == 19);
+    TEST_CHECK(f.tb.line_count == 5);
+
+    // the buffer still matches the file, so there is nothing to save
+    TEST_CHECK(f.tb.disk_size == 24);
+    TEST_CHECK(f.tb.clean_bytes == 24);
+    FileWriterStats stats;
+    TEST_CHECK(TextBuffer_SaveTail(&f.tb, f.path, false, &stats));
+    TEST_CHECK(stats.bytes_written == 0);
+
+    teardown_fixture(&f);
+}
+
+void test_follow_incomplete_last_line(void) {
+    TestFixture f;
+    setup_fixture(&f, "one\ntw");
+
+    write_file(f.path, "o\nthree\n", "ab");
+    Line *first_new = TextBuffer_Follow(&f.tb, f.ff);
+    TEST_CHECK(line_is(first_new, "two"));  // continued
+    TEST_CHECK(line_is(first_new->next, "three"));
+    TEST_CHECK(f.tb.line_count == 3);
+
+    teardown_fixture(&f);
+}
+
+void test_follow_large_batches(void) {
+    TestFixture f;
+    setup_fixture(&f, "");
+
+    // more than one read per poll
+    const size_t line_count = 200000;
+    FILE *fp = fopen(f.path, "ab");
+    TEST_ASSERT(fp != NULL);
+    for (size_t i = 0; i < line_count; i++) {
+        fprintf(fp, "log line %zu\n", i);
+    }
+    fclose(fp);
+
+    int polls = 0;
+    while (TextBuffer_Follow(&f.tb, f.ff)) {
+        polls++;
+    }
+    TEST_CHECK(polls > 1);
+    TEST_CHECK(f.tb.line_count == line_count);  // the empty line of the empty file was filled
+    TEST_CHECK(line_is(TextBuffer_GetLastLine(&f.tb), "log line 199999"));
+
+    teardown_fixture(&f);
+}
+
+void test_follow_truncated(void) {
+    TestFixture f;
+    setup_fixture(&f, "one\ntwo\n");
+
+    write_file(f.path, "x\n", "wb");
+    TEST_CHECK(TextBuffer_Follow(&f.tb, f.ff) == NULL);
+    TEST_CHECK(f.ff->truncated);
+    TEST_CHECK(f.tb.line_count == 2);
+
+    teardown_fixture(&f);
+}
+
+TEST_LIST = {
+    { "FileFollower: Append lines", test_follow_append },
+    { "FileFollower: Incomplete last line", test_follow_incomplete_last_line },
+    { "FileFollower: Large batches", test_follow_large_batches },
+    { "FileFollower: Truncated file", test_follow_truncated },
+    { NULL, NULL }
+};
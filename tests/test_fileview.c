@@ -0,0 +1,126 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "acutest.h"
+#include "document/fileview.h"
+#include "document/textbuffer.h"
+
+typedef struct {
+    char dir[64];
+    char path[128];
+    TextBuffer tb;
+    FileView *fv;
+} TestFixture;
+
+static void setup_fixture(TestFixture *f, size_t line_count) {
+    snprintf(f->dir, sizeof(f->dir), "/tmp/clieditor_test_XXXXXX");
+    TEST_ASSERT(mkdtemp(f->dir) != NULL);
+    snprintf(f->path, sizeof(f->path), "%s/big.txt", f->dir);
+    FILE *fp = fopen(f->path, "wb");
+    TEST_ASSERT(fp != NULL);
+    for (size_t i = 0; i < line_count; i++) {
+        fprintf(fp, "line %zu\n", i);
+    }
+    fclose(fp);
+
+    TextBuffer_Init(&f->tb);
+    f->fv = FileView_Open(f->path, &f->tb);
+    TEST_ASSERT(f->fv != NULL);
+}
+
+static void teardown_fixture(TestFixture *f) {
+    TextBuffer_Deinit(&f->tb);
+    FileView_Close(f->fv);
+    unlink(f->path);
+    rmdir(f->dir);
+}
+
+static bool line_is_number(const Line *line, size_t number) {
+    char expected[32];
+    int n = snprintf(expected, sizeof(expected), "line %zu", number);
+    return line && line->text.bytes_size == (size_t)n && memcmp(line->text.bytes, expected, n) == 0;
+}
+
+// move the screen (and the cursor with it) n lines down
+static Line *scroll(TestFixture *f, Line *first_visible, long n) {
+    for (; n > 0 && first_visible->next; n--) {
+        first_visible = first_visible->next;
+    }
+    for (; n < 0 && first_visible->prev; n++) {
+        first_visible = first_visible->prev;
+    }
+    f->tb.current_line = first_visible;
+    FileView_Update(f->fv, &f->tb, first_visible, 20);
+    return first_visible;
+}
+
+void test_fileview_window(void) {
+    const size_t total = 100000;
+    TestFixture f;
+    setup_fixture(&f, total);
+
+    Line *first_visible = f.tb.current_line;
+    TEST_CHECK(line_is_number(first_visible, 0));
+    TEST_CHECK(f.tb.line_count <= 3 * FILEVIEW_MARGIN + 20);
+
+    // scroll to the end in screen steps, the window stays small
+    size_t max_lines = 0;
+    for (size_t i = 0; i < total / 20; i++) {
+        first_visible = scroll(&f, first_visible, 20);
+        if (f.tb.line_count > max_lines) {
+            max_lines = f.tb.line_count;
+        }
+    }
+    TEST_CHECK(max_lines <= 2 * (2 * FILEVIEW_MARGIN + 20) + 1);
+    TEST_MSG("max lines: %zu", max_lines);
+    TEST_CHECK(line_is_number(TextBuffer_GetLastLine(&f.tb), total - 1));
+
+    // line numbers are still correct
+    size_t number = f.tb.line_number_offset + TextBuffer_GetLineNumber(&f.tb, first_visible);
+    TEST_CHECK(line_is_number(first_visible, number));
+
+    // and back to the top
+    for (size_t i = 0; i < total / 20 + 1; i++) {
+        first_visible = scroll(&f, first_visible, -20);
+    }
+    TEST_CHECK(line_is_number(first_visible, 0));
+    TEST_CHECK(f.tb.line_number_offset == 0);
+    TEST_CHECK(TextBuffer_GetFirstLine(&f.tb) == first_visible);
+
+    teardown_fixture(&f);
+}
+
+void test_fileview_long_line(void) {
+    TestFixture f;
+    snprintf(f.dir, sizeof(f.dir), "/tmp/clieditor_test_XXXXXX");
+    TEST_ASSERT(mkdtemp(f.dir) != NULL);
+    snprintf(f.path, sizeof(f.path), "%s/long.txt", f.dir);
+    FILE *fp = fopen(f.path, "wb");
+    TEST_ASSERT(fp != NULL);
+    for (size_t i = 0; i < FILEVIEW_MAX_LINE * 2 + 10; i++) {
+        fputc('x', fp);
+    }
+    fputs("\nend\n", fp);
+    fclose(fp);
+
+    TextBuffer_Init(&f.tb);
+    f.fv = FileView_Open(f.path, &f.tb);
+    TEST_ASSERT(f.fv != NULL);
+
+    // split into three parts
+    Line *line = TextBuffer_GetFirstLine(&f.tb);
+    TEST_CHECK(line->text.bytes_size == FILEVIEW_MAX_LINE);
+    TEST_CHECK(line->next->text.bytes_size == FILEVIEW_MAX_LINE);
+    TEST_CHECK(line->next->next->text.bytes_size == 10);
+    TEST_CHECK(f.tb.line_count == 4);
+
+    teardown_fixture(&f);
+}
+
+TEST_LIST = {
+    { "FileView: Window follows the screen", test_fileview_window },
+    { "FileView: Long lines are split", test_fileview_long_line },
+    { NULL, NULL }
+};
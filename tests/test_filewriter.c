@@ -0,0 +1,202 @@
+#include "acutest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "io/filewriter.h"
+#include "document/textio.h"
+
+static void make_tmp_dir(char *dir, size_t size) {
+    snprintf(dir, size, "/tmp/clieditor_test_XXXXXX");
+    TEST_ASSERT(mkdtemp(dir) != NULL);
+}
+
+static char *read_file(const char *path, size_t *size) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        *size = 0;
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long l = ftell(fp);
+    rewind(fp);
+    char *buf = malloc(l + 1);
+    size_t n = fread(buf, 1, l, fp);
+    buf[n] = '\0';
+    fclose(fp);
+    *size = n;
+    return buf;
+}
+
+static void write_file(const char *path, const char *content) {
+    FILE *fp = fopen(path, "wb");
+    TEST_ASSERT(fp != NULL);
+    fputs(content, fp);
+    fclose(fp);
+}
+
+static size_t count_dir_entries(const char *dir) {
+    DIR *d = opendir(dir);
+    TEST_ASSERT(d != NULL);
+    size_t n = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            n++;
+        }
+    }
+    closedir(d);
+    return n;
+}
+
+void test_writer_commit(void) {
+    char dir[64], path[128];
+    make_tmp_dir(dir, sizeof(dir));
+    snprintf(path, sizeof(path), "%s/out.txt", dir);
+
+    FileWriter *fw = FileWriter_Open(path);
+    TEST_ASSERT(fw != NULL);
+    TEST_CHECK(FileWriter_Write(fw, "Hello", 5));
+    TEST_CHECK(FileWriter_Write(fw, ", ", 2));
+    TEST_CHECK(FileWriter_Write(fw, "World\n", 6));
+    // nothing visible before the commit
+    TEST_CHECK(access(path, F_OK) != 0);
+    TEST_CHECK(FileWriter_Commit(fw, true));
+    TEST_CHECK(fw->stats.bytes_written == 13);
+    TEST_CHECK(fw->stats.write_calls == 1);
+    // a single batch is written without setting up the asynchronous backend
+    TEST_CHECK(!fw->aio_created);
+    FileWriter_Close(fw);
+
+    size_t size;
+    char *content = read_file(path, &size);
+    TEST_ASSERT(content != NULL);
+    TEST_CHECK(strcmp(content, "Hello, World\n") == 0);
+    free(content);
+
+    // no temporary files left
+    TEST_CHECK(count_dir_entries(dir) == 1);
+
+    unlink(path);
+    rmdir(dir);
+}
+
+void test_writer_abort_keeps_original(void) {
+    char dir[64], path[128];
+    make_tmp_dir(dir, sizeof(dir));
+    snprintf(path, sizeof(path), "%s/out.txt", dir);
+    write_file(path, "original\n");
+
+    FileWriter *fw = FileWriter_Open(path);
+    TEST_ASSERT(fw != NULL);
+    FileWriter_Write(fw, "new content\n", 12);
+    FileWriter_Flush(fw);
+    FileWriter_Close(fw);  // not committed
+
+    size_t size;
+    char *content = read_file(path, &size);
+    TEST_CHECK(strcmp(content, "original\n") == 0);
+    free(content);
+    TEST_CHECK(count_dir_entries(dir) == 1);
+
+    unlink(path);
+    rmdir(dir);
+}
+
+void test_writer_keeps_permissions(void) {
+    char dir[64], path[128];
+    make_tmp_dir(dir, sizeof(dir));
+    snprintf(path, sizeof(path), "%s/script.sh", dir);
+    write_file(path, "#!/bin/sh\n");
+    chmod(path, 0750);
+
+    FileWriter *fw = FileWriter_Open(path);
+    FileWriter_Write(fw, "#!/bin/sh\necho\n", 15);
+    TEST_CHECK(FileWriter_Commit(fw, false));
+    FileWriter_Close(fw);
+
+    struct stat st;
+    TEST_ASSERT(stat(path, &st) == 0);
+    TEST_CHECK((st.st_mode & 07777) == 0750);
+
+    unlink(path);
+    rmdir(dir);
+}
+
+void test_writer_several_batches(void) {
+    char dir[64], path[128];
+    make_tmp_dir(dir, sizeof(dir));
+    snprintf(path, sizeof(path), "%s/out.txt", dir);
+
+    FileWriter *fw = FileWriter_Open(path);
+    TEST_ASSERT(fw != NULL);
+    for (size_t i = 0; i < FILEWRITER_MAX_IOV; i++) {
+        TEST_CHECK(FileWriter_Write(fw, "ab", 2));
+    }
+    TEST_CHECK(!fw->aio_created);
+    // the batch is full, so the backend is set up for this one and the following
+    TEST_CHECK(FileWriter_Write(fw, "c", 1));
+    TEST_CHECK(fw->aio_created);
+    TEST_CHECK(FileWriter_Commit(fw, false));
+    TEST_CHECK(fw->stats.bytes_written == 2 * FILEWRITER_MAX_IOV + 1);
+    TEST_CHECK(fw->stats.write_calls == 2);
+    FileWriter_Close(fw);
+
+    size_t size;
+    char *content = read_file(path, &size);
+    TEST_ASSERT(content != NULL);
+    TEST_CHECK(size == 2 * FILEWRITER_MAX_IOV + 1);
+    TEST_CHECK(content[size - 1] == 'c');
+    free(content);
+
+    unlink(path);
+    rmdir(dir);
+}
+
+void test_save_textbuffer_batched(void) {
+    char dir[64], path[128];
+    make_tmp_dir(dir, sizeof(dir));
+    snprintf(path, sizeof(path), "%s/doc.txt", dir);
+
+    const size_t line_count = 10000;
+    TextBuffer tb;
+    TextBuffer_Init(&tb);
+    String_Set(&tb.current_line->text, String_FromCStr("line 0", 6));
+    for (size_t i = 1; i < line_count; i++) {
+        Line *line = Line_Create();
+        String_Set(&line->text, String_Format("line %zu", i));
+        TextBuffer_InsertLineAtBottom(&tb, line);
+    }
+    // unmerged gap content must be saved as well
+    String_Set(&tb.gap.text, String_FromCStr("X", 1));
+    tb.gap.position = 0;
+
+    FileWriterStats stats;
+    TEST_CHECK(TextBuffer_SaveToPath(&tb, path, false, &stats));
+    // two iovecs per line, so far less syscalls than lines
+    TEST_CHECK(stats.write_calls <= line_count * 2 / FILEWRITER_MAX_IOV + 1);
+    TEST_MSG("write_calls: %zu", stats.write_calls);
+
+    size_t size;
+    char *content = read_file(path, &size);
+    TEST_ASSERT(content != NULL);
+    TEST_CHECK(size == stats.bytes_written);
+    TEST_CHECK(strncmp(content, "Xline 0\nline 1\n", 15) == 0);
+    TEST_CHECK(strcmp(content + size - 10, "line 9999\n") == 0);
+    free(content);
+
+    TextBuffer_Deinit(&tb);
+    unlink(path);
+    rmdir(dir);
+}
+
+TEST_LIST = {
+    { "FileWriter: Commit", test_writer_commit },
+    { "FileWriter: Abort keeps original", test_writer_abort_keeps_original },
+    { "FileWriter: Keep permissions", test_writer_keeps_permissions },
+    { "FileWriter: Several batches", test_writer_several_batches },
+    { "FileWriter: Save TextBuffer", test_save_textbuffer_batched },
+    { NULL, NULL }
+};
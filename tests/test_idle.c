@@ -0,0 +1,106 @@
+#define _DEFAULT_SOURCE  // usleep()
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "acutest.h"
+#include "io/idle.h"
+
+static char order[64];
+static int order_length;
+
+typedef struct {
+    char name;
+    int remaining;  // steps until the task has no more work
+    int sleep_us;
+} Job;
+
+static bool step(void *user_data) {
+    Job *job = user_data;
+    if (order_length < (int)sizeof(order) - 1) {
+        order[order_length++] = job->name;
+        order[order_length] = '\0';
+    }
+    if (job->sleep_us) {
+        usleep(job->sleep_us);
+    }
+    return --job->remaining > 0;
+}
+
+static void reset(IdleInterrupt interrupted) {
+    Idle_Init(interrupted);
+    order_length = 0;
+    order[0] = '\0';
+}
+
+void test_priorities(void) {
+    reset(NULL);
+    Job low = { 'l', 2, 0 }, a = { 'a', 2, 0 }, b = { 'b', 3, 0 };
+    Idle_Add(IDLE_PRIORITY_LOW, step, &low);
+    Idle_Add(IDLE_PRIORITY_HIGH, step, &a);
+    Idle_Add(IDLE_PRIORITY_HIGH, step, &b);
+    TEST_CHECK(Idle_HasWork());
+    TEST_CHECK(!Idle_Run(1000000));
+    // round robin within a priority, lower priorities only when nothing else is left
+    TEST_CHECK(strcmp(order, "ababbll") == 0);
+    TEST_MSG("order: %s", order);
+    TEST_CHECK(Idle_GetStats()->steps == 7 && Idle_GetStats()->slices == 1);
+}
+
+void test_sleep_and_wake(void) {
+    reset(NULL);
+    Job job = { 'x', 1, 0 };
+    uint8_t id = Idle_Add(IDLE_PRIORITY_NORMAL, step, &job);
+    TEST_ASSERT(id != NO_IDLE_TASK);
+    Idle_Run(1000);
+    TEST_CHECK(!Idle_HasWork());
+    // not called while sleeping
+    Idle_Run(1000);
+    TEST_CHECK(strcmp(order, "x") == 0);
+
+    job.remaining = 1;
+    Idle_Wake(id);
+    TEST_CHECK(Idle_HasWork());
+    Idle_Run(1000);
+    TEST_CHECK(strcmp(order, "xx") == 0);
+
+    Idle_Remove(id);
+    Idle_Wake(id);
+    TEST_CHECK(!Idle_HasWork());
+}
+
+void test_budget(void) {
+    reset(NULL);
+    Job job = { 'x', 1000, 500 };
+    Idle_Add(IDLE_PRIORITY_LOW, step, &job);
+    // stops after the step that used up the budget
+    TEST_CHECK(Idle_Run(2000));
+    TEST_CHECK(order_length >= 1 && order_length <= 5);
+    TEST_MSG("steps: %d", order_length);
+    TEST_CHECK(Idle_GetStats()->longest_step_us >= 500);
+}
+
+static int interrupt_after;
+
+static bool input_arrives(void) {
+    return interrupt_after-- <= 0;
+}
+
+void test_preemption(void) {
+    reset(input_arrives);
+    interrupt_after = 3;
+    Job job = { 'x', 1000, 0 };
+    Idle_Add(IDLE_PRIORITY_LOW, step, &job);
+    TEST_CHECK(Idle_Run(1000000));
+    TEST_CHECK(order_length == 3);
+    TEST_CHECK(Idle_GetStats()->preempted == 1);
+}
+
+TEST_LIST = {
+    { "Idle: Priorities", test_priorities },
+    { "Idle: Sleep and wake", test_sleep_and_wake },
+    { "Idle: Budget", test_budget },
+    { "Idle: Preemption", test_preemption },
+    { NULL, NULL }
+};
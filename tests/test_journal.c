@@ -0,0 +1,333 @@
+#include <locale.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Initialize locale for every test to ensure wcwidth and other functions work correctly with UTF-8
+#define TEST_INIT setlocale(LC_ALL, "");
+
+#include "acutest.h"
+#include "document/textbuffer.h"
+#include "document/textlayout.h"
+#include "document/textedit.h"
+#include "document/textselection.h"
+#include "document/textio.h"
+#include "document/journal.h"
+#include "common/string.h"
+
+typedef struct {
+    char dir[64];
+    char path[128];
+    TextBuffer tb;
+    TextLayout tl;
+    TextEdit te;
+} TestFixture;
+
+static void load_document(TextBuffer *tb, const char *path) {
+    TextBuffer_Init(tb);
+    File *file = File_Open(path, FILE_ACCESS_READ);
+    TEST_ASSERT(file != NULL);
+    TextBuffer_LoadFromFile(tb, file);
+    File_Close(file);
+}
+
+static void setup_fixture(TestFixture *f, const char *content) {
+    snprintf(f->dir, sizeof(f->dir), "/tmp/clieditor_test_XXXXXX");
+    TEST_ASSERT(mkdtemp(f->dir) != NULL);
+    snprintf(f->path, sizeof(f->path), "%s/doc.txt", f->dir);
+    FILE *fp = fopen(f->path, "w");
+    TEST_ASSERT(fp != NULL);
+    fputs(content, fp);
+    fclose(fp);
+
+    load_document(&f->tb, f->path);
+    TextLayout_Init(&f->tl, &f->tb, 80, 25);
+    TextEdit_Init(&f->te, &f->tb, &f->tl);
+    f->tb.journal = Journal_Create(f->path, false);
+    TEST_ASSERT(f->tb.journal != NULL);
+}
+
+static void teardown_fixture(TestFixture *f) {
+    Journal_Destroy(f->tb.journal, true);
+    f->tb.journal = NULL;
+    TextEdit_Deinit(&f->te);
+    TextLayout_Deinit(&f->tl);
+    TextBuffer_Deinit(&f->tb);
+    unlink(f->path);
+    rmdir(f->dir);
+}
+
+// join the lines of tb with '|'
+static String buffer_content(TextBuffer *tb) {
+    TextBuffer_MergeGap(tb);
+    String out = String_Empty();
+    Line *line = TextBuffer_GetFirstLine(tb);
+    while (line) {
+        String_Append(&out, &line->text);
+        line = line->next;
+        if (line) {
+            String_AddChar(&out, "|");
+        }
+    }
+    return out;
+}
+
+// "crash": the journal is not removed, then replay it into a fresh buffer
+static void check_recovery(TestFixture *f, const char *expected) {
+    String content = buffer_content(&f->tb);
+    TEST_CHECK(strcmp(String_AsCStr(&content), expected) == 0);
+    TEST_MSG("Live: '%s', Expected: '%s'", String_AsCStr(&content), expected);
+    String_Deinit(&content);
+
+    Journal_Flush(f->tb.journal);
+
+    TextBuffer recovered;
+    load_document(&recovered, f->path);
+    size_t records;
+    TEST_CHECK(Journal_Replay(&recovered, f->path, &records) == JOURNAL_REPLAY_OK);
+    content = buffer_content(&recovered);
+    TEST_CHECK(strcmp(String_AsCStr(&content), expected) == 0);
+    TEST_MSG("Recovered: '%s', Expected: '%s'", String_AsCStr(&content), expected);
+    String_Deinit(&content);
+    TextBuffer_Deinit(&recovered);
+}
+
+static void type(TestFixture *f, const char *text) {
+    for (const char *c = text; *c; c++) {
+        TextEdit_InsertChar(&f->te, (uint32_t)*c);
+    }
+}
+
+void test_line_numbers(void) {
+    TextBuffer tb;
+    TextBuffer_Init(&tb);
+    for (int i = 0; i < 10; i++) {
+        TextBuffer_InsertLineAtBottom(&tb, Line_Create());
+    }
+    Line *fifth = TextBuffer_GetLine(&tb, 5);
+    TEST_CHECK(TextBuffer_GetLineNumber(&tb, fifth) == 5);
+    TEST_CHECK(TextBuffer_GetLineNumber(&tb, TextBuffer_GetLastLine(&tb)) == 10);
+    TEST_CHECK(TextBuffer_GetLine(&tb, 11) == NULL);
+
+    // cache stays valid when lines are inserted or deleted before
+    TextBuffer_InsertLineAtTop(&tb, Line_Create());
+    TEST_CHECK(TextBuffer_GetLineNumber(&tb, TextBuffer_GetLastLine(&tb)) == 11);
+    TextBuffer_DeleteLine(&tb, TextBuffer_GetLine(&tb, 3));
+    TEST_CHECK(TextBuffer_GetLineNumber(&tb, fifth) == 5);
+    TEST_CHECK(TextBuffer_GetLine(&tb, 5) == fifth);
+
+    // and when the cached line itself is deleted
+    TextBuffer_DeleteLine(&tb, fifth);
+    TEST_CHECK(TextBuffer_GetLineNumber(&tb, TextBuffer_GetFirstLine(&tb)) == 0);
+    TEST_CHECK(TextBuffer_GetLineNumber(&tb, TextBuffer_GetLastLine(&tb)) == 9);
+
+    TextBuffer_Deinit(&tb);
+}
+
+void test_journal_typing_is_merged(void) {
+    TestFixture f;
+    setup_fixture(&f, "hello\nworld\n");
+
+    f.tb.gap.position = 5;
+    type(&f, " there, how are you?");
+    TEST_CHECK(f.tb.journal->record_count == 1);
+
+    check_recovery(&f, "hello there, how are you?|world");
+    teardown_fixture(&f);
+}
+
+void test_journal_edits(void) {
+    TestFixture f;
+    setup_fixture(&f, "first line\nsecond line\nthird line\n");
+
+    // insert in the middle and split the line
+    f.tb.gap.position = 5;
+    type(&f, "!");
+    TextEdit_Newline(&f.te);
+    type(&f, "> ");
+    // backspace in the gap and before it
+    TextEdit_Backspace(&f.te);
+    TextEdit_Backspace(&f.te);
+    TextEdit_Backspace(&f.te);
+    // join with the next line (delete at end of line)
+    TextBuffer_MergeGap(&f.tb);
+    f.tb.gap.position = String_Length(&f.tb.current_line->text);
+    TextEdit_DeleteChar(&f.te);
+    // delete a char in the middle
+    TextEdit_MoveLeft(&f.te);
+    TextEdit_DeleteChar(&f.te);
+    // backspace at the beginning of a line joins with the previous line
+    TextBuffer_MergeGap(&f.tb);
+    f.tb.current_line = TextBuffer_GetLastLine(&f.tb);
+    f.tb.gap.position = 0;
+    TextEdit_Backspace(&f.te);
+    type(&f, "#");
+
+    check_recovery(&f, "first! linsecond line#third line");
+    teardown_fixture(&f);
+}
+
+void test_journal_selection_delete(void) {
+    TestFixture f;
+    setup_fixture(&f, "aaaa\nbbbb\ncccc\ndddd\n");
+
+    TextSelection ts;
+    TextSelection_Init(&ts);
+    TextSelection_Begin(&ts, TextBuffer_GetLine(&f.tb, 2), 2);
+    TextSelection_End(&ts, TextBuffer_GetLine(&f.tb, 1), 1);
+    TextSelection_Delete(&ts, &f.tb);
+    TextSelection_Deinit(&ts);
+
+    check_recovery(&f, "aaaa|bcc|dddd");
+    teardown_fixture(&f);
+}
+
+void test_journal_torn_record(void) {
+    TestFixture f;
+    setup_fixture(&f, "abc\n");
+    type(&f, "x");
+    TextEdit_Newline(&f.te);
+    Journal_Flush(f.tb.journal);
+
+    // cut the last record in half
+    char *journal_path = Journal_PathFor(f.path);
+    struct stat st;
+    TEST_ASSERT(stat(journal_path, &st) == 0);
+    TEST_ASSERT(truncate(journal_path, st.st_size - 3) == 0);
+
+    TextBuffer recovered;
+    load_document(&recovered, f.path);
+    size_t records;
+    TEST_CHECK(Journal_Replay(&recovered, f.path, &records) == JOURNAL_REPLAY_OK);
+    TEST_CHECK(records == 1);
+    String content = buffer_content(&recovered);
+    TEST_CHECK(strcmp(String_AsCStr(&content), "xabc") == 0);
+    String_Deinit(&content);
+    TextBuffer_Deinit(&recovered);
+
+    free(journal_path);
+    teardown_fixture(&f);
+}
+
+// "crash" and recover into the fixture itself, so editing can go on
+static void recover_fixture(TestFixture *f, JournalReplayResult expected, size_t expected_records) {
+    Journal_Destroy(f->tb.journal, false);
+    f->tb.journal = NULL;
+    TextEdit_Deinit(&f->te);
+    TextLayout_Deinit(&f->tl);
+    TextBuffer_Deinit(&f->tb);
+
+    load_document(&f->tb, f->path);
+    size_t records = 0;
+    JournalReplayResult result = Journal_Replay(&f->tb, f->path, &records);
+    TEST_CHECK(result == expected);
+    TEST_CHECK(records == expected_records);
+    TextLayout_Init(&f->tl, &f->tb, 80, 25);
+    TextEdit_Init(&f->te, &f->tb, &f->tl);
+    if (result == JOURNAL_REPLAY_STALE || result == JOURNAL_REPLAY_INVALID) {
+        free(Journal_KeepStale(f->path));
+    }
+    f->tb.journal = Journal_Create(f->path, result == JOURNAL_REPLAY_OK || result == JOURNAL_REPLAY_ERROR);
+    TEST_ASSERT(f->tb.journal != NULL);
+}
+
+void test_journal_invalid_record(void) {
+    TestFixture f;
+    setup_fixture(&f, "abc\n");
+    type(&f, "x");
+    Journal_Flush(f.tb.journal);
+    char *journal_path = Journal_PathFor(f.path);
+    struct stat st;
+    TEST_ASSERT(stat(journal_path, &st) == 0);
+    off_t second_record = st.st_size;
+    TextEdit_Newline(&f.te);
+    type(&f, "y");
+    Journal_Flush(f.tb.journal);
+
+    // replace the op of the record in the middle by an unknown one
+    FILE *fp = fopen(journal_path, "r+b");
+    TEST_ASSERT(fp != NULL);
+    TEST_ASSERT(fseek(fp, second_record, SEEK_SET) == 0);
+    fputc(0xff, fp);
+    fclose(fp);
+
+    // the journal is cut in front of the bad record, new edits are not lost behind it
+    recover_fixture(&f, JOURNAL_REPLAY_ERROR, 1);
+    TEST_ASSERT(stat(journal_path, &st) == 0);
+    TEST_CHECK(st.st_size == second_record);
+    type(&f, "z");
+    check_recovery(&f, "zxabc");
+
+    free(journal_path);
+    teardown_fixture(&f);
+}
+
+void test_journal_invalid_header(void) {
+    TestFixture f;
+    setup_fixture(&f, "abc\n");
+    type(&f, "x");
+    Journal_Flush(f.tb.journal);
+
+    char *journal_path = Journal_PathFor(f.path);
+    FILE *fp = fopen(journal_path, "r+b");
+    TEST_ASSERT(fp != NULL);
+    fputc('?', fp);
+    fclose(fp);
+
+    // the journal is created again instead of appending to the broken one
+    recover_fixture(&f, JOURNAL_REPLAY_INVALID, 0);
+    type(&f, "z");
+    check_recovery(&f, "zabc");
+
+    // and the broken one is kept for recovery by hand
+    char stale_path[256];
+    snprintf(stale_path, sizeof(stale_path), "%s.stale", journal_path);
+    fp = fopen(stale_path, "rb");
+    TEST_ASSERT(fp != NULL);
+    TEST_CHECK(fgetc(fp) == '?');
+    fclose(fp);
+    unlink(stale_path);
+
+    free(journal_path);
+    teardown_fixture(&f);
+}
+
+void test_journal_stale_and_rebase(void) {
+    TestFixture f;
+    setup_fixture(&f, "one\ntwo\n");
+    type(&f, "A");
+
+    // save and keep on editing during the save
+    size_t mark = Journal_Mark(f.tb.journal);
+    TextBuffer_MergeGap(&f.tb);
+    TEST_CHECK(TextBuffer_SaveToPath(&f.tb, f.path, false, NULL));
+    type(&f, "B");
+    TEST_CHECK(Journal_Rebase(f.tb.journal, mark));
+
+    check_recovery(&f, "ABone|two");
+
+    // another program changes the file
+    FILE *fp = fopen(f.path, "a");
+    fputs("three\n", fp);
+    fclose(fp);
+    TextBuffer other;
+    load_document(&other, f.path);
+    TEST_CHECK(Journal_Replay(&other, f.path, NULL) == JOURNAL_REPLAY_STALE);
+    TextBuffer_Deinit(&other);
+
+    teardown_fixture(&f);
+}
+
+TEST_LIST = {
+    { "TextBuffer: Line numbers", test_line_numbers },
+    { "Journal: Typing is merged", test_journal_typing_is_merged },
+    { "Journal: Edits", test_journal_edits },
+    { "Journal: Selection delete", test_journal_selection_delete },
+    { "Journal: Torn record", test_journal_torn_record },
+    { "Journal: Invalid record", test_journal_invalid_record },
+    { "Journal: Invalid header", test_journal_invalid_header },
+    { "Journal: Stale journal and rebase", test_journal_stale_and_rebase },
+    { NULL, NULL }
+};
@@ -0,0 +1,169 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "acutest.h"
+#include "document/textbuffer.h"
+#include "document/textio.h"
+#include "document/lineindex.h"
+#include "document/linepager.h"
+
+typedef struct {
+    char dir[64];
+    char path[128];
+    char cache[128];
+} TestFixture;
+
+static void write_lines(const char *path, size_t line_count, const char *ending) {
+    FILE *fp = fopen(path, "wb");
+    TEST_ASSERT(fp != NULL);
+    for (size_t i = 0; i < line_count; i++) {
+        fprintf(fp, "zeile %zu äöü%s", i, ending);
+    }
+    fclose(fp);
+}
+
+// the index goes to a cache directory of its own
+static void setup_fixture(TestFixture *f, size_t line_count, const char *ending) {
+    snprintf(f->dir, sizeof(f->dir), "/tmp/clieditor_test_XXXXXX");
+    TEST_ASSERT(mkdtemp(f->dir) != NULL);
+    snprintf(f->path, sizeof(f->path), "%s/doc.txt", f->dir);
+    snprintf(f->cache, sizeof(f->cache), "%s/cache", f->dir);
+    setenv("XDG_CACHE_HOME", f->cache, 1);
+    write_lines(f->path, line_count, ending);
+}
+
+static void teardown_fixture(TestFixture *f) {
+    char *index_path = LineIndex_PathFor(f->path);
+    unlink(index_path);
+    free(index_path);
+    char clieditor[160];
+    snprintf(clieditor, sizeof(clieditor), "%s/clieditor", f->cache);
+    rmdir(clieditor);
+    rmdir(f->cache);
+    unlink(f->path);
+    rmdir(f->dir);
+}
+
+static void load(TextBuffer *tb, const char *path) {
+    TextBuffer_Init(tb);
+    File *file = File_Open(path, FILE_ACCESS_READ);
+    TEST_ASSERT(file != NULL);
+    TextBuffer_LoadFromFile(tb, file);
+    File_Close(file);
+}
+
+static Line *get_line(const TextBuffer *tb, size_t number) {
+    Line *line = TextBuffer_GetFirstLine(tb);
+    for (size_t i = 0; i < number; i++) {
+        line = line->next;
+    }
+    return line;
+}
+
+void test_save_and_load(void) {
+    TestFixture f;
+    setup_fixture(&f, 3000, "\n");
+    TextBuffer tb;
+    load(&tb, f.path);
+    TEST_CHECK(LineIndex_Save(f.path, &tb));
+    TextBuffer_Deinit(&tb);
+
+    LineIndex *index = LineIndex_Open(f.path);
+    TEST_ASSERT(index != NULL);
+    TEST_CHECK(index->header->line_count == 3000);
+    // two bytes per line
+    TEST_CHECK(index->header->entries_size == 3000 * 2);
+
+    TextBuffer_Init(&tb);
+    TEST_ASSERT(TextBuffer_LoadFromIndex(&tb, f.path, index));
+    LineIndex_Close(index);
+    TEST_CHECK(tb.line_count == 3000);
+    TEST_CHECK(tb.disk_known && tb.dirty_line == NULL);
+    // nothing was read
+    size_t paged_out = 0;
+    for (const Line *line = TextBuffer_GetFirstLine(&tb); line; line = line->next) {
+        paged_out += line->paged_out;
+    }
+    TEST_CHECK(paged_out == 3000);
+
+    Line *line = get_line(&tb, 1234);
+    TEST_CHECK(String_Length(&line->text) == strlen("zeile 1234 ") + 3);
+    LinePager_Touch(tb.pager, line);
+    TEST_CHECK(strcmp(line->text.bytes, "zeile 1234 äöü") == 0);
+    TEST_CHECK(String_Length(&line->text) == strlen("zeile 1234 ") + 3);
+
+    // edit and save like a normally loaded file
+    Line *first = TextBuffer_GetFirstLine(&tb);
+    TextBuffer_WillChangeLine(&tb, first);
+    String_Set(&first->text, String_FromCStr("edited", 6));
+    TEST_CHECK(TextBuffer_SaveToPath(&tb, f.path, false, NULL));
+    TextBuffer_Deinit(&tb);
+
+    load(&tb, f.path);
+    TEST_CHECK(tb.line_count == 3000);
+    TEST_CHECK(strcmp(TextBuffer_GetFirstLine(&tb)->text.bytes, "edited") == 0);
+    TEST_CHECK(strcmp(get_line(&tb, 2999)->text.bytes, "zeile 2999 äöü") == 0);
+    TextBuffer_Deinit(&tb);
+    // the file has changed, so the index is stale
+    TEST_CHECK(LineIndex_Open(f.path) == NULL);
+
+    teardown_fixture(&f);
+}
+
+void test_stale_index(void) {
+    TestFixture f;
+    setup_fixture(&f, 1000, "\n");
+    TextBuffer tb;
+    load(&tb, f.path);
+    TEST_ASSERT(LineIndex_Save(f.path, &tb));
+    TextBuffer_Deinit(&tb);
+
+    // same size and modification time, but other content
+    struct stat st;
+    TEST_ASSERT(stat(f.path, &st) == 0);
+    FILE *fp = fopen(f.path, "r+b");
+    TEST_ASSERT(fp != NULL);
+    fputs("ZEILE", fp);
+    fclose(fp);
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    TEST_ASSERT(utimensat(AT_FDCWD, f.path, times, 0) == 0);
+    TEST_CHECK(LineIndex_Open(f.path) == NULL);
+
+    // another size
+    write_lines(f.path, 1001, "\n");
+    TEST_CHECK(LineIndex_Open(f.path) == NULL);
+
+    teardown_fixture(&f);
+}
+
+void test_inexact_file(void) {
+    TestFixture f;
+    setup_fixture(&f, 100, "\r\n");
+    TextBuffer tb;
+    load(&tb, f.path);
+    TEST_CHECK(!LineIndex_Save(f.path, &tb));
+    TextBuffer_Deinit(&tb);
+    TEST_CHECK(LineIndex_Open(f.path) == NULL);
+
+    // no "\n" at the end
+    FILE *fp = fopen(f.path, "wb");
+    TEST_ASSERT(fp != NULL);
+    fputs("a\nb", fp);
+    fclose(fp);
+    load(&tb, f.path);
+    TEST_CHECK(!LineIndex_Save(f.path, &tb));
+    TextBuffer_Deinit(&tb);
+
+    teardown_fixture(&f);
+}
+
+TEST_LIST = {
+    { "LineIndex: Save and load", test_save_and_load },
+    { "LineIndex: Stale index", test_stale_index },
+    { "LineIndex: Inexact file", test_inexact_file },
+    { NULL, NULL }
+};
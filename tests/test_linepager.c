@@ -0,0 +1,374 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <stdint.h>
+
+#include "acutest.h"
+#include "document/textbuffer.h"
+#include "document/textio.h"
+#include "document/linepager.h"
+#include "document/backgroundsave.h"
+
+typedef struct {
+    char dir[64];
+    char path[128];
+    TextBuffer tb;
+} TestFixture;
+
+static void setup_fixture(TestFixture *f, size_t line_count) {
+    snprintf(f->dir, sizeof(f->dir), "/tmp/clieditor_test_XXXXXX");
+    TEST_ASSERT(mkdtemp(f->dir) != NULL);
+    snprintf(f->path, sizeof(f->path), "%s/doc.txt", f->dir);
+    FILE *fp = fopen(f->path, "wb");
+    TEST_ASSERT(fp != NULL);
+    for (size_t i = 0; i < line_count; i++) {
+        fprintf(fp, "line %zu\n", i);
+    }
+    fclose(fp);
+
+    TextBuffer_Init(&f->tb);
+    File *file = File_Open(f->path, FILE_ACCESS_READ);
+    TEST_ASSERT(file != NULL);
+    TextBuffer_LoadFromFile(&f->tb, file);
+    File_Close(file);
+}
+
+static void teardown_fixture(TestFixture *f) {
+    TextBuffer_Deinit(&f->tb);
+    unlink(f->path);
+    rmdir(f->dir);
+}
+
+static size_t count_paged_out(const TextBuffer *tb) {
+    size_t n = 0;
+    for (const Line *line = TextBuffer_GetFirstLine(tb); line; line = line->next) {
+        n += line->paged_out;
+    }
+    return n;
+}
+
+// page out as much as possible
+static void balance_fully(LinePager *pager) {
+    for (int i = 0; i < 4; i++) {
+        LinePager_Balance(pager);
+    }
+}
+
+static Line *get_line(const TextBuffer *tb, size_t number) {
+    Line *line = TextBuffer_GetFirstLine(tb);
+    for (size_t i = 0; i < number; i++) {
+        line = line->next;
+    }
+    return line;
+}
+
+static bool file_has_lines(const char *path, size_t line_count, const char *first) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return false;
+    }
+    char buf[64];
+    size_t i = 0;
+    bool all_equal = true;
+    while (fgets(buf, sizeof(buf), fp)) {
+        char expected[64];
+        if (i == 0 && first) {
+            snprintf(expected, sizeof(expected), "%s\n", first);
+        }
+        else {
+            snprintf(expected, sizeof(expected), "line %zu\n", i);
+        }
+        all_equal = all_equal && strcmp(buf, expected) == 0;
+        i++;
+    }
+    fclose(fp);
+    return all_equal && i == line_count;
+}
+
+void test_page_out_and_in(void) {
+    TestFixture f;
+    setup_fixture(&f, 1000);
+    LinePager *pager = TextBuffer_EnablePaging(&f.tb, f.path, 100);
+    TEST_ASSERT(pager != NULL);
+    TEST_CHECK(pager->resident > 100);
+
+    balance_fully(pager);
+    TEST_CHECK(pager->resident <= 100);
+    TEST_MSG("resident: %zu", pager->resident);
+    // the current line is never paged out
+    TEST_CHECK(!f.tb.current_line->paged_out);
+    size_t paged_out = count_paged_out(&f.tb);
+    TEST_CHECK(paged_out > 900);
+    TEST_CHECK(pager->stats.page_outs == paged_out);
+
+    // the length is kept, the text comes back on touch
+    Line *line = get_line(&f.tb, 500);
+    TEST_ASSERT(line->paged_out);
+    TEST_CHECK(line->text.bytes_size == 8);
+    LinePager_Touch(pager, line);
+    TEST_CHECK(!line->paged_out);
+    TEST_CHECK(strcmp(line->text.bytes, "line 500") == 0);
+    TEST_CHECK(pager->stats.page_ins == 1);
+
+    // editing a paged out line reads it back first
+    Line *other = line->next;
+    TEST_ASSERT(other->paged_out);
+    TextBuffer_WillChangeLine(&f.tb, other);
+    TEST_CHECK(strcmp(other->text.bytes, "line 501") == 0);
+
+    TextBuffer_DisablePaging(&f.tb);
+    TEST_CHECK(count_paged_out(&f.tb) == 0);
+    teardown_fixture(&f);
+}
+
+void test_save_paged_out(void) {
+    TestFixture f;
+    setup_fixture(&f, 5000);
+    LinePager *pager = TextBuffer_EnablePaging(&f.tb, f.path, 1000);
+    TEST_ASSERT(pager != NULL);
+    balance_fully(pager);
+    TEST_ASSERT(count_paged_out(&f.tb) > 4000);
+
+    Line *first = TextBuffer_GetFirstLine(&f.tb);
+    TextBuffer_WillChangeLine(&f.tb, first);
+    String_Set(&first->text, String_FromCStr("edited", 6));
+
+    TEST_CHECK(TextBuffer_SaveToPath(&f.tb, f.path, false, NULL));
+    TEST_CHECK(file_has_lines(f.path, 5000, "edited"));
+    // paged out lines stay paged out and are read from the new file
+    TEST_CHECK(count_paged_out(&f.tb) > 4000);
+    TEST_CHECK(f.tb.pager->fd >= 0);
+    Line *line = get_line(&f.tb, 3999);
+    TEST_ASSERT(line->paged_out);
+    LinePager_Touch(pager, line);
+    TEST_CHECK(strcmp(line->text.bytes, "line 3999") == 0);
+
+    teardown_fixture(&f);
+}
+
+void test_background_save_paged_out(void) {
+    TestFixture f;
+    setup_fixture(&f, 5000);
+    LinePager *pager = TextBuffer_EnablePaging(&f.tb, f.path, 1000);
+    TEST_ASSERT(pager != NULL);
+    balance_fully(pager);
+    size_t paged_out = count_paged_out(&f.tb);
+    TEST_ASSERT(paged_out > 4000);
+
+    BackgroundSave *bs = BackgroundSave_Start(&f.tb, f.path, false);
+    TEST_ASSERT(bs != NULL);
+    // nothing is paged out while the worker reads the lines
+    LinePager_Balance(pager);
+    TEST_CHECK(count_paged_out(&f.tb) == paged_out);
+    while (!BackgroundSave_Poll(bs, NULL)) {
+        sched_yield();
+    }
+    TEST_CHECK(BackgroundSave_Finish(bs, NULL));
+    TEST_CHECK(file_has_lines(f.path, 5000, NULL));
+
+    Line *line = get_line(&f.tb, 3999);
+    TEST_ASSERT(line->paged_out);
+    LinePager_Touch(pager, line);
+    TEST_CHECK(strcmp(line->text.bytes, "line 3999") == 0);
+
+    teardown_fixture(&f);
+}
+
+// modify lines first..last-1 to repetitive CSV records
+static void edit_lines(TextBuffer *tb, size_t first, size_t last) {
+    Line *line = get_line(tb, first);
+    for (size_t i = first; i < last; i++) {
+        TextBuffer_WillChangeLine(tb, line);
+        String_Set(&line->text, String_Format("2025-03-01,sensor-%zu,temperature,21.5,ok", i % 8));
+        line = line->next;
+    }
+}
+
+static bool is_edited(const Line *line, size_t number) {
+    char expected[64];
+    snprintf(expected, sizeof(expected), "2025-03-01,sensor-%zu,temperature,21.5,ok", number % 8);
+    return strcmp(line->text.bytes, expected) == 0;
+}
+
+void test_compress_modified(void) {
+    TestFixture f;
+    setup_fixture(&f, 5000);
+    edit_lines(&f.tb, 1000, 3000);
+    LinePager *pager = TextBuffer_EnablePaging(&f.tb, f.path, 1000);
+    TEST_ASSERT(pager != NULL);
+    balance_fully(pager);
+
+    Line *line = get_line(&f.tb, 2000);
+    TEST_ASSERT(line->paged_out);
+    TEST_ASSERT(line->block != NULL);
+    TEST_CHECK(pager->stats.blocks > 0);
+    TEST_CHECK(pager->stats.block_raw_bytes > 2000 * 30);
+    TEST_CHECK(LinePagerStats_CompressionRatio(&pager->stats) > 3.0);
+    TEST_MSG("ratio: %.1f", LinePagerStats_CompressionRatio(&pager->stats));
+
+    // touching a line decompresses its whole block
+    size_t blocks = pager->stats.blocks;
+    LinePager_Touch(pager, line);
+    TEST_CHECK(!line->paged_out && line->block == NULL);
+    TEST_CHECK(is_edited(line, 2000));
+    TEST_CHECK(!line->prev->paged_out && is_edited(line->prev, 1999));
+    TEST_CHECK(pager->stats.blocks == blocks - 1);
+    TEST_CHECK(pager->stats.decompressions == 1);
+
+    // deleting a compressed line gives its neighbours their text back
+    Line *deleted = get_line(&f.tb, 2900);
+    TEST_ASSERT(deleted->block != NULL);
+    Line *next = deleted->next;
+    TextBuffer_DeleteLine(&f.tb, deleted);
+    TEST_CHECK(!next->paged_out && is_edited(next, 2901));
+
+    // saving writes compressed lines without decompressing them in the buffer
+    size_t decompressions = pager->stats.decompressions;
+    TEST_CHECK(TextBuffer_SaveToPath(&f.tb, f.path, false, NULL));
+    TEST_CHECK(pager->stats.decompressions == decompressions);
+    FILE *fp = fopen(f.path, "r");
+    TEST_ASSERT(fp != NULL);
+    char buf[64];
+    size_t number = 0;
+    bool all_equal = true;
+    while (fgets(buf, sizeof(buf), fp)) {
+        if (number == 2900) {
+            number++;
+        }
+        char expected[64];
+        if (number >= 1000 && number < 3000) {
+            snprintf(expected, sizeof(expected), "2025-03-01,sensor-%zu,temperature,21.5,ok\n", number % 8);
+        }
+        else {
+            snprintf(expected, sizeof(expected), "line %zu\n", number);
+        }
+        all_equal = all_equal && strcmp(buf, expected) == 0;
+        number++;
+    }
+    fclose(fp);
+    TEST_CHECK(all_equal);
+    TEST_CHECK(number == 5000);
+
+    TextBuffer_DisablePaging(&f.tb);
+    TEST_CHECK(count_paged_out(&f.tb) == 0);
+    TEST_CHECK(is_edited(get_line(&f.tb, 2500), 2500));
+    teardown_fixture(&f);
+}
+
+void test_background_save_compressed(void) {
+    TestFixture f;
+    setup_fixture(&f, 5000);
+    edit_lines(&f.tb, 0, 5000);
+    LinePager *pager = TextBuffer_EnablePaging(&f.tb, f.path, 1000);
+    TEST_ASSERT(pager != NULL);
+    balance_fully(pager);
+    TEST_ASSERT(pager->stats.blocks > 0);
+
+    BackgroundSave *bs = BackgroundSave_Start(&f.tb, f.path, false);
+    TEST_ASSERT(bs != NULL);
+    // blocks decompressed while saving stay readable for the worker
+    Line *line = get_line(&f.tb, 2500);
+    TEST_ASSERT(line->block != NULL);
+    LinePager_Touch(pager, line);
+    TEST_CHECK(pager->retired != NULL);
+    while (!BackgroundSave_Poll(bs, NULL)) {
+        sched_yield();
+    }
+    TEST_CHECK(BackgroundSave_Finish(bs, NULL));
+    LinePager_Balance(pager);
+    TEST_CHECK(pager->retired == NULL);
+
+    FILE *fp = fopen(f.path, "r");
+    TEST_ASSERT(fp != NULL);
+    char buf[64];
+    size_t number = 0;
+    bool all_equal = true;
+    while (fgets(buf, sizeof(buf), fp)) {
+        char expected[64];
+        snprintf(expected, sizeof(expected), "2025-03-01,sensor-%zu,temperature,21.5,ok\n", number % 8);
+        all_equal = all_equal && strcmp(buf, expected) == 0;
+        number++;
+    }
+    fclose(fp);
+    TEST_CHECK(all_equal);
+    TEST_CHECK(number == 5000);
+
+    teardown_fixture(&f);
+}
+
+void test_compact(void) {
+    TestFixture f;
+    setup_fixture(&f, 5000);
+    edit_lines(&f.tb, 1000, 1010);
+    LinePager *pager = TextBuffer_EnablePaging(&f.tb, f.path, SIZE_MAX);
+    TEST_ASSERT(pager != NULL);
+    for (size_t i = 0; i < 5000 / LINEPAGER_COMPACT_STEPS + 1; i++) {
+        LinePager_Compact(pager);
+    }
+    // all lines but the current one are packed
+    TEST_CHECK(pager->stats.packed_lines == 4999);
+    TEST_MSG("packed: %zu", pager->stats.packed_lines);
+    Line *line = get_line(&f.tb, 500);
+    TEST_CHECK(line->shared && line->text.bytes_capacity == line->text.bytes_size + 1);
+    TEST_CHECK(strcmp(line->text.bytes, "line 500") == 0);
+    TEST_CHECK(is_edited(get_line(&f.tb, 1005), 1005));
+
+    // packed lines are copied on the first write
+    TextBuffer_WillChangeLine(&f.tb, line);
+    TEST_CHECK(!line->shared);
+    String_AddChar(&line->text, "!");
+    TEST_CHECK(strcmp(line->text.bytes, "line 500!") == 0);
+    TEST_CHECK(strcmp(line->next->text.bytes, "line 501") == 0);
+
+    // nothing to do until lines change, then only the changed ones are visited
+    while (LinePager_Compact(pager)) {
+    }
+    TEST_CHECK(!LinePager_CompactPending(pager));
+    size_t packed = pager->stats.packed_lines;
+    TextBuffer_WillChangeLine(&f.tb, line->next);
+    String_AddChar(&line->next->text, "!");
+    TEST_CHECK(LinePager_CompactPending(pager));
+    TEST_CHECK(!LinePager_Compact(pager));
+    TEST_CHECK(pager->stats.packed_lines == packed + 1);
+    TEST_CHECK(line->next->shared && strcmp(line->next->text.bytes, "line 501!") == 0);
+    TEST_CHECK(!LinePager_CompactPending(pager));
+
+    // the current line waits until it's left
+    TextBuffer_WillChangeLine(&f.tb, f.tb.current_line);
+    TEST_CHECK(!LinePager_CompactPending(pager));
+
+    // too many changes start a whole round
+    Line *changed = get_line(&f.tb, 1);
+    for (size_t i = 0; i <= LINEPAGER_COMPACT_QUEUE; i++) {
+        TextBuffer_WillChangeLine(&f.tb, changed);
+        changed = changed->next;
+    }
+    TEST_CHECK(pager->compact_again && !get_line(&f.tb, 1)->compact_queued);
+
+    // and can still be paged out
+    pager->budget = 1000;
+    balance_fully(pager);
+    TEST_CHECK(count_paged_out(&f.tb) > 4000);
+    Line *paged_out = get_line(&f.tb, 3999);
+    TEST_ASSERT(paged_out->paged_out);
+    LinePager_Touch(pager, paged_out);
+    TEST_CHECK(strcmp(paged_out->text.bytes, "line 3999") == 0);
+
+    TEST_CHECK(TextBuffer_SaveToPath(&f.tb, f.path, false, NULL));
+    TextBuffer_DisablePaging(&f.tb);
+    TEST_CHECK(strcmp(get_line(&f.tb, 500)->text.bytes, "line 500!") == 0);
+    TEST_CHECK(strcmp(get_line(&f.tb, 4999)->text.bytes, "line 4999") == 0);
+    teardown_fixture(&f);
+}
+
+TEST_LIST = {
+    { "LinePager: Page out and in", test_page_out_and_in },
+    { "LinePager: Save with paged out lines", test_save_paged_out },
+    { "LinePager: Background save with paged out lines", test_background_save_paged_out },
+    { "LinePager: Compress modified lines", test_compress_modified },
+    { "LinePager: Background save with compressed lines", test_background_save_compressed },
+    { "LinePager: Compact", test_compact },
+    { NULL, NULL }
+};
@@ -0,0 +1,92 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "acutest.h"
+#include "common/lz.h"
+
+// compress and decompress, returns the compressed size (0 on failure)
+static size_t roundtrip(const char *src, size_t size) {
+    size_t capacity = LZ_CompressBound(size);
+    char *compressed = malloc(capacity);
+    char *restored = malloc(size + 1);
+    size_t compressed_size = LZ_Compress(src, size, compressed, capacity);
+    bool ok = compressed_size > 0
+              && LZ_Decompress(compressed, compressed_size, restored, size)
+              && memcmp(src, restored, size) == 0;
+    free(compressed);
+    free(restored);
+    return ok ? compressed_size : 0;
+}
+
+void test_roundtrip_small(void) {
+    TEST_CHECK(roundtrip("", 0) > 0);
+    TEST_CHECK(roundtrip("a", 1) > 0);
+    TEST_CHECK(roundtrip("abcd", 4) > 0);
+    TEST_CHECK(roundtrip("abcdabcdabcdabcd", 16) > 0);
+}
+
+void test_repetitive_text(void) {
+    size_t capacity = 256 * 1024;
+    char *csv = malloc(capacity);
+    size_t size = 0;
+    for (int i = 0; size + 64 < capacity; i++) {
+        size += snprintf(csv + size, 64, "2025-03-%02d 12:%02d:00,sensor-%d,temperature,%d.5,ok\n",
+                         i % 28 + 1, i % 60, i % 8, 20 + i % 5);
+    }
+    size_t compressed = roundtrip(csv, size);
+    TEST_CHECK(compressed > 0);
+    TEST_CHECK(compressed * 3 < size);
+    TEST_MSG("%zu -> %zu bytes", size, compressed);
+    free(csv);
+
+    // long runs need extra length bytes
+    char *run = malloc(100000);
+    memset(run, 'x', 100000);
+    compressed = roundtrip(run, 100000);
+    TEST_CHECK(compressed > 0 && compressed < 1000);
+    free(run);
+}
+
+void test_incompressible(void) {
+    size_t size = 100000;
+    char *noise = malloc(size);
+    srand(42);
+    for (size_t i = 0; i < size; i++) {
+        noise[i] = (char)(rand() & 0xff);
+    }
+    size_t compressed = roundtrip(noise, size);
+    TEST_CHECK(compressed > 0);
+    TEST_CHECK(compressed <= LZ_CompressBound(size));
+
+    // too small output buffer
+    char small[64];
+    TEST_CHECK(LZ_Compress(noise, size, small, sizeof(small)) == 0);
+    free(noise);
+}
+
+void test_damaged_input(void) {
+    const char *text = "hello hello hello hello hello hello";
+    size_t size = strlen(text);
+    char compressed[128];
+    size_t compressed_size = LZ_Compress(text, size, compressed, sizeof(compressed));
+    TEST_ASSERT(compressed_size > 0);
+
+    char out[128];
+    // truncated
+    TEST_CHECK(!LZ_Decompress(compressed, compressed_size - 1, out, size));
+    // wrong size
+    TEST_CHECK(!LZ_Decompress(compressed, compressed_size, out, size - 1));
+    TEST_CHECK(!LZ_Decompress(compressed, compressed_size, out, size + 1));
+    // offset before the start
+    const char bad_offset[] = { 0x10, 'a', 0x05, 0x00, 0x00 };
+    TEST_CHECK(!LZ_Decompress(bad_offset, sizeof(bad_offset), out, 5));
+}
+
+TEST_LIST = {
+    { "LZ: Roundtrip small", test_roundtrip_small },
+    { "LZ: Repetitive text", test_repetitive_text },
+    { "LZ: Incompressible", test_incompressible },
+    { "LZ: Damaged input", test_damaged_input },
+    { NULL, NULL }
+};
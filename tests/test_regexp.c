@@ -0,0 +1,343 @@
+#include "acutest.h"
+#include <string.h>
+#include <stdlib.h>
+#include "common/regexp.h"
+
+// search text from start, returns "start-end" or "none"
+static const char *search(const char *pattern, const char *text, size_t start) {
+    static char result[64];
+    char error[128] = "";
+    Regexp *re = Regexp_Compile(pattern, error, sizeof(error));
+    TEST_ASSERT_(re != NULL, "compile %s: %s", pattern, error);
+    RegexpMatch match;
+    if (Regexp_Search(re, text, strlen(text), start, &match)) {
+        snprintf(result, sizeof(result), "%zu-%zu", match.start, match.end);
+    }
+    else {
+        snprintf(result, sizeof(result), "none");
+    }
+    Regexp_Destroy(re);
+    return result;
+}
+
+#define CHECK_SEARCH(pattern, text, start, expected) do { \
+    const char *_result = search(pattern, text, start); \
+    TEST_CHECK(strcmp(_result, expected) == 0); \
+    TEST_MSG("/%s/ on \"%s\" from %d: expected %s, got %s", pattern, text, start, expected, _result); \
+} while (0)
+
+void test_leftmost_longest(void) {
+    CHECK_SEARCH("abc", "xxabcxx", 0, "2-5");
+    CHECK_SEARCH("abc", "xxabxx", 0, "none");
+    CHECK_SEARCH("a|ab|abc", "xabcd", 0, "1-4");
+    CHECK_SEARCH("(a|ab)(c|bcd)", "abcd", 0, "0-4");
+    CHECK_SEARCH("a.*b|c", "a c b", 0, "0-5");
+    CHECK_SEARCH("x*", "abc", 0, "0-0");
+    CHECK_SEARCH("[0-9]+", "ab 123 45", 0, "3-6");
+    CHECK_SEARCH("[0-9]+", "ab 123 45", 5, "5-6");
+    CHECK_SEARCH("[0-9]+", "ab 123 45", 6, "7-9");
+    CHECK_SEARCH("a{2,3}", "aaaa", 0, "0-3");
+    CHECK_SEARCH("a{2,}", "a aaaaa", 0, "2-7");
+    CHECK_SEARCH("a{,2}b", "aaab", 0, "1-4");
+    CHECK_SEARCH("\"[^\"]*\"", "x = \"a b\" \"c\"", 0, "4-9");
+    CHECK_SEARCH("\\*\\*", "a **b**", 0, "2-4");
+    CHECK_SEARCH("[]a]+", "x]a]y", 0, "1-4");
+    CHECK_SEARCH("[a-]+", "x-a-y", 0, "1-4");
+    CHECK_SEARCH("[[:digit:][:space:]]+", "ab1 2c", 0, "2-5");
+    CHECK_SEARCH("a)", "(a)", 0, "1-3");
+}
+
+void test_anchors(void) {
+    CHECK_SEARCH("^a", "aa", 0, "0-1");
+    CHECK_SEARCH("^a", "aa", 1, "none");
+    CHECK_SEARCH("^a", "ba", 0, "none");
+    CHECK_SEARCH("a$", "aa", 0, "1-2");
+    CHECK_SEARCH("^$", "", 0, "0-0");
+    CHECK_SEARCH("$", "abc", 1, "3-3");
+    CHECK_SEARCH("x|^y", "yx", 1, "1-2");
+    CHECK_SEARCH("a^", "aaa", 0, "none");
+    CHECK_SEARCH("^# (.*)$", "# Title", 0, "0-7");
+    CHECK_SEARCH("\\bab", "cab ab", 0, "4-6");
+    CHECK_SEARCH("ab\\b", "abc ab", 0, "4-6");
+    CHECK_SEARCH("\\<if\\>", "elif if", 0, "5-7");
+    CHECK_SEARCH("\\Bf", "f if", 0, "3-4");
+    // the context in front of start is seen
+    CHECK_SEARCH("\\bb", "ab b", 1, "3-4");
+}
+
+void test_utf8(void) {
+    // . and bracket expressions match whole characters
+    CHECK_SEARCH("x.y", "x\xc3\xa9y", 0, "0-4");
+    CHECK_SEARCH("x[^a]y", "x\xc3\xa9y", 0, "0-4");
+    CHECK_SEARCH("^.$", "\xe2\x82\xac", 0, "0-3");
+    CHECK_SEARCH("[\xc3\xa4\xc3\xb6\xc3\xbc]+", "a\xc3\xb6\xc3\xbcx", 0, "1-5");
+    CHECK_SEARCH("\xc3\xa9+", "e\xc3\xa9\xc3\xa9", 0, "1-5");
+    CHECK_SEARCH("\\w+", "--gr\xc3\xbc\xc3\x9f--", 0, "2-8");
+    CHECK_SEARCH("[[:alpha:]]+", "1\xc3\xa4x2", 0, "1-4");
+}
+
+void test_errors(void) {
+    const char *invalid[] = { "(", "(a|b", "*a", "a|*", "{1}", "a{3,2}", "[", "[a", "[b-a]",
+                              "[[:foo:]]", "(a)\\1", "a\\", "a{1001}" };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        char error[128] = "";
+        Regexp *re = Regexp_Compile(invalid[i], error, sizeof(error));
+        TEST_CHECK(re == NULL);
+        TEST_MSG("/%s/ was accepted", invalid[i]);
+        TEST_CHECK(strlen(error) > 0);
+        Regexp_Destroy(re);
+    }
+    // nested intervals must not blow up the program
+    TEST_CHECK(Regexp_Compile("((a{1000}){1000}){1000}", NULL, 0) == NULL);
+}
+
+// search the union of patterns (NULL terminated, "-" is a NULL part), returns "start-end:pattern" or "none"
+static const char *search_union(const char **patterns, const char *text, size_t start) {
+    static char result[64];
+    Regexp *parts[16] = { NULL };
+    size_t count = 0;
+    for (; patterns[count]; count++) {
+        TEST_ASSERT(count < 16);
+        parts[count] = strcmp(patterns[count], "-") == 0 ? NULL : Regexp_Compile(patterns[count], NULL, 0);
+    }
+    Regexp *re = Regexp_Union(parts, count);
+    for (size_t i = 0; i < count; i++) {
+        Regexp_Destroy(parts[i]);
+    }
+    RegexpMatch match;
+    if (Regexp_Search(re, text, strlen(text), start, &match)) {
+        snprintf(result, sizeof(result), "%zu-%zu:%zu", match.start, match.end, match.pattern);
+    }
+    else {
+        snprintf(result, sizeof(result), "none");
+    }
+    Regexp_Destroy(re);
+    return result;
+}
+
+#define CHECK_UNION(text, start, expected, ...) do { \
+    const char *_patterns[] = { __VA_ARGS__, NULL }; \
+    const char *_result = search_union(_patterns, text, start); \
+    TEST_CHECK(strcmp(_result, expected) == 0); \
+    TEST_MSG("on \"%s\" from %d: expected %s, got %s", text, start, expected, _result); \
+} while (0)
+
+void test_union(void) {
+    // the leftmost match wins
+    CHECK_UNION("xx bar foo", 0, "3-6:1", "foo", "bar");
+    CHECK_UNION("xx bar foo", 4, "7-10:0", "foo", "bar");
+    // on the same position the first pattern wins, even if another one is longer
+    CHECK_UNION("abcd", 0, "0-2:1", "x", "ab", "abcd");
+    CHECK_UNION("abcd", 0, "0-4:0", "a|abcd", "ab");
+    // and the longest match of the winner is taken
+    CHECK_UNION("aaab", 0, "0-3:0", "a+", "a+b");
+    CHECK_UNION("'a' // b", 0, "0-1:0", "'", "//", "$");
+    CHECK_UNION("'a' // b", 1, "2-3:0", "'", "//", "$");
+    CHECK_UNION("'a' // b", 3, "4-6:1", "'", "//", "$");
+    CHECK_UNION("'a' // b", 7, "8-8:2", "'", "//", "$");
+    // anchors and word boundaries of the parts are kept
+    CHECK_UNION("if elif if", 1, "8-10:1", "^el", "\\<if\\>");
+    CHECK_UNION("el if", 0, "0-2:0", "^el", "\\<if\\>");
+    // NULL parts never match but keep the indices
+    CHECK_UNION("abc", 0, "1-2:2", "-", "x", "b");
+    TEST_CHECK(Regexp_Union(NULL, 0) == NULL);
+    Regexp *none[2] = { NULL, NULL };
+    TEST_CHECK(Regexp_Union(none, 2) == NULL);
+}
+
+void test_prefilter(void) {
+    Regexp *re = Regexp_Compile("\\*\\*|`[^`]*`", NULL, 0);
+    TEST_ASSERT(re != NULL);
+    TEST_CHECK(re->prefilter && re->prefilter_count == 2);
+    size_t length = 10000;
+    char *text = malloc(length + 1);
+    memset(text, 'x', length);
+    memcpy(text + length - 8, "`a` **", 6);
+    text[length] = '\0';
+    RegexpMatch match;
+    TEST_CHECK(Regexp_Search(re, text, length, 0, &match));
+    TEST_CHECK(match.start == length - 8 && match.end == length - 5);
+    TEST_CHECK(re->stats.skipped >= length - 10);
+    TEST_MSG("%zu bytes skipped", re->stats.skipped);
+    TEST_CHECK(Regexp_Search(re, text, length, match.end, &match));
+    TEST_CHECK(match.start == length - 4 && match.end == length - 2);
+    TEST_CHECK(!Regexp_Search(re, text, length, match.end, &match));
+    free(text);
+    Regexp_Destroy(re);
+
+    // a pattern behind ^ is not a candidate, ^ only matches at the begin anyway
+    re = Regexp_Compile("^#|`", NULL, 0);
+    TEST_CHECK(re->prefilter && re->prefilter_count == 1 && re->prefilter_byte == '`');
+    Regexp_Destroy(re);
+    // everything may be an empty match
+    re = Regexp_Compile("a*", NULL, 0);
+    TEST_CHECK(!re->prefilter);
+    Regexp_Destroy(re);
+    re = Regexp_Compile("[^\"]", NULL, 0);
+    TEST_CHECK(!re->prefilter);
+    Regexp_Destroy(re);
+
+    // the candidates do not change the results
+    CHECK_SEARCH("^#|`", "#a`", 0, "0-1");
+    CHECK_SEARCH("^#|`", "a#`", 0, "2-3");
+    CHECK_SEARCH("a|$", "xxx", 0, "3-3");
+    CHECK_SEARCH("b|\\bx", "a xb", 0, "2-3");
+    CHECK_SEARCH("ab|b", "aab", 0, "1-3");
+}
+
+void test_bounded_cache(void) {
+    // many different states: the last 10 bytes must be known to decide the match
+    Regexp *re = Regexp_Compile("[ab]*a[ab]{8}c", NULL, 0);
+    TEST_ASSERT(re != NULL);
+    size_t length = 20000;
+    char *text = malloc(length + 1);
+    srand(7);
+    for (size_t i = 0; i < length; i++) {
+        text[i] = rand() % 2 ? 'a' : 'b';
+    }
+    memcpy(text + length - 10, "aababababc", 10);
+    text[length] = '\0';
+
+    RegexpMatch unlimited;
+    TEST_CHECK(Regexp_Search(re, text, length, 0, &unlimited));
+    TEST_CHECK(re->stats.flushes == 0);
+
+    Regexp_SetCacheLimit(re, 16 * 1024);
+    size_t flushes = re->stats.flushes;
+    RegexpMatch limited;
+    TEST_CHECK(Regexp_Search(re, text, length, 0, &limited));
+    TEST_CHECK(limited.start == unlimited.start && limited.end == unlimited.end);
+    TEST_CHECK(limited.end == length);
+    TEST_CHECK(re->stats.flushes > flushes);
+    TEST_CHECK(re->stats.cache_bytes <= 16 * 1024);
+    TEST_MSG("%zu bytes in %zu states, %zu flushes", re->stats.cache_bytes, re->stats.states, re->stats.flushes);
+
+    free(text);
+    Regexp_Destroy(re);
+}
+
+void test_search_range(void) {
+    Regexp *re = Regexp_Compile("a+|b$|\\<c", NULL, 0);
+    TEST_ASSERT(re != NULL);
+    const char *text = "xaaab cc";
+    size_t length = strlen(text);
+    RegexpMatch match;
+    // the match ends at the limit
+    TEST_CHECK(Regexp_SearchRange(re, text, length, 0, 3, &match));
+    TEST_CHECK(match.start == 1 && match.end == 3);
+    TEST_CHECK(!Regexp_SearchRange(re, text, length, 0, 1, &match));
+    // $ only matches at the end of the text, not at the limit
+    TEST_CHECK(!Regexp_SearchRange(re, text, length, 4, 5, &match));
+    // the byte in front of start is seen
+    TEST_CHECK(Regexp_SearchRange(re, text, length, 6, 7, &match));
+    TEST_CHECK(match.start == 6 && match.end == 7);
+    TEST_CHECK(!Regexp_SearchRange(re, text, length, 7, length, &match));
+    Regexp_Destroy(re);
+}
+
+void test_find_starts(void) {
+    const char *patterns[] = { "^a", "\\bb+", "c$", "a[bc]*d", "x" };
+    Regexp *parts[5];
+    for (size_t i = 0; i < 5; i++) {
+        parts[i] = Regexp_Compile(patterns[i], NULL, 0);
+    }
+    Regexp *re = Regexp_Union(parts, 5);
+    for (size_t i = 0; i < 5; i++) {
+        Regexp_Destroy(parts[i]);
+    }
+    TEST_ASSERT(re != NULL);
+
+    // the same matches as Regexp_Search() from every offset
+    const char *texts[] = { "abbd", "xa bb abcd c", "bab bbx ac", "", "cc", "aaacd xbc" };
+    uint16_t starts[64];
+    for (size_t t = 0; t < sizeof(texts) / sizeof(texts[0]); t++) {
+        size_t length = strlen(texts[t]);
+        for (size_t from = 0; from <= length; from++) {
+            TEST_ASSERT(Regexp_FindStarts(re, texts[t], length, from, starts));
+            for (size_t start = from; start <= length; start++) {
+                RegexpMatch expected, found;
+                bool ok = Regexp_Search(re, texts[t], length, start, &expected);
+                TEST_CHECK(Regexp_SearchStarts(re, texts[t], length, start, starts, &found) == ok);
+                TEST_CHECK(!ok || (found.start == expected.start && found.end == expected.end &&
+                                   found.pattern == expected.pattern));
+                TEST_MSG("\"%s\" from %zu: expected %zu-%zu:%zu, got %zu-%zu:%zu", texts[t], start,
+                         expected.start, expected.end, expected.pattern, found.start, found.end, found.pattern);
+            }
+        }
+    }
+    Regexp_Destroy(re);
+
+    // one pass, then the searches read little more than the matches: [ .. ] never ends here
+    re = Regexp_Compile("\\[.*\\]x|`[^`]*`", NULL, 0);
+    size_t units = 10000;
+    size_t length = units * 6;
+    char *text = malloc(length + 1);
+    uint16_t *table = malloc(sizeof(uint16_t) * (length + 1));
+    for (size_t i = 0; i < units; i++) {
+        memcpy(text + i * 6, "[a `b`", 6);
+    }
+    text[length] = '\0';
+    TEST_ASSERT(Regexp_FindStarts(re, text, length, 0, table));
+    size_t scanned = re->stats.scanned;
+    RegexpMatch match = { 0, 0, 0 };
+    size_t count = 0;
+    while (Regexp_SearchStarts(re, text, length, match.end, table, &match)) {
+        TEST_CHECK(match.start == count * 6 + 3 && match.end == count * 6 + 6);
+        count++;
+    }
+    TEST_CHECK(count == units);
+    TEST_CHECK(re->stats.scanned - scanned <= 5 * units);
+    TEST_MSG("%zu bytes scanned for %zu matches", re->stats.scanned - scanned, count);
+    free(table);
+    free(text);
+    Regexp_Destroy(re);
+}
+
+void test_copy(void) {
+    Regexp *parts[2] = { Regexp_Compile("\\<ab+", NULL, 0), Regexp_Compile("c$", NULL, 0) };
+    Regexp *re = Regexp_Union(parts, 2);
+    TEST_ASSERT(re != NULL);
+    const char *text = "xab abbb c";
+    size_t length = strlen(text);
+    RegexpMatch match;
+    TEST_CHECK(Regexp_Search(re, text, length, 0, &match));
+
+    // the copy finds the same matches with its own cache and stats
+    Regexp *copy = Regexp_Copy(re);
+    TEST_ASSERT(copy != NULL);
+    TEST_CHECK(copy->stats.searches == 0 && copy->stats.states == 0);
+    RegexpMatch copy_match;
+    for (size_t start = 0; start <= length; start++) {
+        bool found = Regexp_Search(re, text, length, start, &match);
+        TEST_CHECK(Regexp_Search(copy, text, length, start, &copy_match) == found);
+        TEST_CHECK(!found || (match.start == copy_match.start && match.end == copy_match.end &&
+                              match.pattern == copy_match.pattern));
+        TEST_MSG("from %zu", start);
+    }
+    TEST_CHECK(copy->stats.searches == length + 1);
+    TEST_CHECK(copy->slots != re->slots && copy->insts != re->insts);
+
+    uint16_t starts[16];
+    TEST_CHECK(Regexp_FindStarts(copy, text, length, 0, starts));
+    TEST_CHECK(starts[4] == 0 && starts[9] == 1);
+    TEST_CHECK(copy->reverse != NULL && re->reverse == NULL);
+
+    Regexp_Destroy(copy);
+    Regexp_Destroy(re);
+    Regexp_Destroy(parts[0]);
+    Regexp_Destroy(parts[1]);
+}
+
+TEST_LIST = {
+    { "Regexp: Leftmost longest", test_leftmost_longest },
+    { "Regexp: Anchors", test_anchors },
+    { "Regexp: UTF-8", test_utf8 },
+    { "Regexp: Errors", test_errors },
+    { "Regexp: Union", test_union },
+    { "Regexp: Prefilter", test_prefilter },
+    { "Regexp: Bounded cache", test_bounded_cache },
+    { "Regexp: Search range", test_search_range },
+    { "Regexp: Find starts", test_find_starts },
+    { "Regexp: Copy", test_copy },
+    { NULL, NULL }
+};
@@ -254,6 +254,30 @@ void test_edgecases(void) {
 
 }
 
+void test_shrink_to_fit(void) {
+    String str = String_FromCStr("a€b", strlen("a€b"));
+    for (int i = 0; i < 40; i++) {
+        String_AddChar(&str, "x");
+    }
+    TEST_CHECK(str.bytes_capacity > str.bytes_size + 1);
+    String_ShrinkToFit(&str);
+    TEST_CHECK(str.bytes_capacity == str.bytes_size + 1);
+    TEST_CHECK(str.multibytes_capacity == str.multibytes_size);
+    TEST_CHECK(String_Length(&str) == 43);
+
+    // a tight string grows again
+    String_AddChar(&str, "€");
+    String_AddChar(&str, "€");
+    TEST_CHECK(String_Length(&str) == 45);
+    TEST_CHECK(strcmp(String_GetChar(&str, 43), "€€") == 0);
+    String_Deinit(&str);
+
+    String empty = String_FromCStr("", 0);
+    String_ShrinkToFit(&empty);
+    TEST_CHECK(empty.bytes_capacity == 1 && strcmp(empty.bytes, "") == 0);
+    String_Deinit(&empty);
+}
+
 
 TEST_LIST = {
     { "String: Initialization", test_string_init },
@@ -265,5 +289,6 @@ TEST_LIST = {
     { "String: Misc", test_misc },
     { "String: Split", test_split },
     { "String: Edge Cases", test_edgecases },
+    { "String: Shrink to fit", test_shrink_to_fit },
     { NULL, NULL }
 };
\ No newline at end of file
@@ -13,7 +13,7 @@ void test_block_simple(void) {
     TEST_CHECK(block != NULL);
     TEST_CHECK(block->name != NULL);
     TEST_CHECK(strcmp(block->name, "test") == 0);
-    TEST_CHECK(block->start.re_nsub == 0);
+    TEST_CHECK(block->start != NULL);
     TEST_CHECK(block->color == 10);
     SyntaxBlockDef_Destroy(block);
     Table_Destroy(block_table);
@@ -29,7 +29,7 @@ void test_block_with_end(void) {
     TEST_CHECK(block != NULL);
     TEST_CHECK(block->name != NULL);
     TEST_CHECK(strcmp(block->name, "test") == 0);
-    TEST_CHECK(block->start.re_nsub == 0);
+    TEST_CHECK(block->start != NULL);
     TEST_CHECK(block->color == 10);
     SyntaxBlockDef_Destroy(block);
     Table_Destroy(block_table);
@@ -77,25 +77,28 @@ static void assert_highlight_tags(
     get_blocks(testcase.open_blocks_at_begin, testcase.open_blocks_at_begin_count, open_blocks_at_begin, blocks_table);
 
     // create the open_blocks_at_begin_stack
-    Stack *open_blocks_at_begin_stack = Stack_Create();
+    const SyntaxStack *open_blocks_at_begin_stack = NULL;
     for (size_t i=0; i<testcase.open_blocks_at_begin_count; i++) {
-        Stack_Push(open_blocks_at_begin_stack, open_blocks_at_begin[i]);
+        open_blocks_at_begin_stack = SyntaxHighlighting_Push(&hl, open_blocks_at_begin_stack, open_blocks_at_begin[i]);
     }
 
     // highlight the string 
-    const Stack *open_blocks = SyntaxHighlighting_HighlightString(&hl, &str, open_blocks_at_begin_stack);
+    SyntaxHighlightingString *shs = NULL;
+    const SyntaxStack *open_blocks = SyntaxHighlighting_HighlightString(&hl, &str, open_blocks_at_begin_stack, &shs);
 
-    SyntaxHighlightingString *shs = Table_Get(hl.strings, &str);
-    TEST_ASSERT(open_blocks == &shs->open_blocks_at_end);
+    TEST_ASSERT(shs != NULL);
+    TEST_ASSERT(open_blocks == shs->open_blocks_at_end);
 
-    TEST_CHECK(!Stack_IsEmpty(open_blocks));
+    TEST_ASSERT(open_blocks != NULL);
     TEST_MSG("Expected open_blocks to not be not empty.");
 
-    TEST_CHECK(open_blocks_count_expected == Stack_Size(open_blocks));
-    TEST_MSG("Expected %zu open blocks but got %zu.", open_blocks_count_expected, Stack_Size(open_blocks));
+    TEST_ASSERT(open_blocks_count_expected == open_blocks->depth);
+    TEST_MSG("Expected %zu open blocks but got %zu.", open_blocks_count_expected, open_blocks->depth);
 
-    for (size_t i=0; i<open_blocks_count_expected; i++) {
-        const SyntaxBlockDef *block = open_blocks->items[open_blocks_count_expected-i-1];
+    // the innermost block first
+    const SyntaxStack *open = open_blocks;
+    for (size_t i=0; i<open_blocks_count_expected; i++, open = open->parent) {
+        const SyntaxBlockDef *block = open->block;
         TEST_CHECK(block != NULL);
         TEST_CHECK(strcmp(open_blocks_expected[i], block->name) == 0);
         TEST_MSG("Expected open block #%zu to be '%s' but got '%s'.", i, open_blocks_expected[i], block->name);
@@ -112,9 +115,9 @@ static void assert_highlight_tags(
         TEST_MSG("Expected block #%zu to be '%s' but got '%s'.", i, tag_blocks[i], shs->tags[i].block->name);
     }
 
-    Stack_Destroy(open_blocks_at_begin_stack);
     Table_Destroy(blocks_table);
 
+    SyntaxHighlightingString_Destroy(shs);
     String_Deinit(&str);
     SyntaxHighlighting_Deinit(&hl);
 }
@@ -138,20 +141,27 @@ void test_highlight_string_simple(void) {
     SyntaxHighlighting_Init(&hl, def);
 
     String test1 = String_Format("root 'string' root");
-    Stack *open_blocks_at_begin = Stack_Create();
-    Stack_Push(open_blocks_at_begin, def->root);
-    const Stack *open_blocks = SyntaxHighlighting_HighlightString(&hl, &test1, open_blocks_at_begin);
+    const SyntaxStack *open_blocks_at_begin = SyntaxHighlighting_Push(&hl, NULL, def->root);
+    TEST_CHECK(open_blocks_at_begin == hl.root);
+    SyntaxHighlightingString *shs = NULL;
+    const SyntaxStack *open_blocks = SyntaxHighlighting_HighlightString(&hl, &test1, open_blocks_at_begin, &shs);
 
     TEST_CHECK(open_blocks != NULL);
-    TEST_CHECK(Stack_Peek(open_blocks) == def->root);
-    SyntaxHighlightingString *shs = Table_Get(hl.strings, &test1);
+    TEST_CHECK(open_blocks == hl.root);
+    TEST_ASSERT(shs != NULL);
     TEST_CHECK(shs->tags_count == 2);
     TEST_CHECK(shs->tags[0].byte_offset == 5);  // start of 'string'
     TEST_CHECK(strcmp(shs->tags[0].block->name, "string") == 0);
     TEST_CHECK(shs->tags[1].byte_offset == 13);  // end of 'string'
     TEST_CHECK(shs->tags[1].block == def->root);
 
-    Stack_Destroy(open_blocks_at_begin);
+    // highlighting it again reuses the state
+    SyntaxHighlightingString *first = shs;
+    SyntaxHighlighting_HighlightString(&hl, &test1, open_blocks_at_begin, &shs);
+    TEST_CHECK(shs == first);
+    TEST_CHECK(shs->tags_count == 2);
+
+    SyntaxHighlightingString_Destroy(shs);
     String_Deinit(&test1);
     SyntaxHighlighting_Deinit(&hl);
 }
@@ -374,6 +384,69 @@ void test_moderate(void) {
 }
 
 
+const char *test_ini_tie =
+"[meta]\n"
+"name = TIE\n"
+"\n"
+"[block:root]\n"
+"child_blocks=string, value\n"
+"\n"
+"[block:string]\n"
+"start='\n"
+"end='\n"
+"child_blocks=escape\n"
+"\n"
+"[block:escape]\n"
+"start=''\n"
+"\n"
+"[block:value]\n"
+"start=:\n"
+"end=$\n"
+"ends_on=comment\n"
+"child_blocks=number\n"
+"\n"
+"[block:number]\n"
+"start=@1\n"
+"\n"
+"[block:comment]\n"
+"start=@\n"
+"end=$\n";
+
+// matches on the same position: the end beats an ends_on block, which beats a child
+void test_tie(void) {
+    TagTestCase cases[] = {
+        {
+            test_ini_tie,
+            "x 'a''b' y",  // end and child
+            1,
+            { "root" },
+            4,
+            {2, 5, 5, 8},
+            {"string", "root", "string", "root"},
+            1,
+            {"root"}
+        },
+        {
+            test_ini_tie,
+            "a:@1",  // ends_on and child
+            1,
+            { "root" },
+            3,
+            {1, 2, 4},
+            {"value", "comment", "root"},
+            1,
+            {"root"}
+        },
+    };
+    size_t count = sizeof(cases) / sizeof(cases[0]);
+
+    for (size_t i=0; i<count; i++) {
+        TEST_CASE(cases[i].str);
+        assert_highlight_tags(cases[i]);
+    }
+}
+
+
 void test_open_blocks(void) {
     TagTestCase cases[] = {
         {
@@ -474,22 +547,287 @@ void test_stress(void) {
         TEST_CASE(str);
 
         String test = String_FromCStr(str, strlen(str));
-        const Stack *open_blocks = SyntaxHighlighting_HighlightString(&hl, &test, NULL);
+        SyntaxHighlightingString *shs = NULL;
+        const SyntaxStack *open_blocks = SyntaxHighlighting_HighlightString(&hl, &test, NULL, &shs);
 
         TEST_CHECK(open_blocks != NULL);
-        TEST_CHECK(!Stack_IsEmpty(open_blocks));
+        TEST_CHECK(open_blocks->depth > 0);
 
+        SyntaxHighlightingString_Destroy(shs);
         String_Deinit(&test);
         SyntaxHighlighting_Deinit(&hl);
     }
 
 }
 
+// the tag in effect at offset, the slow way
+static const SyntaxHighlightingTag *linear_find_tag(const SyntaxHighlightingString *shs, size_t offset) {
+    const SyntaxHighlightingTag *found = NULL;
+    for (size_t i=0; i<shs->tags_count && shs->tags[i].byte_offset <= offset; i++) {
+        found = &shs->tags[i];
+    }
+    return found;
+}
+
+void test_tag_cursor(void) {
+    SyntaxDefinition *def = create_definition(test_ini1);
+    SyntaxHighlighting hl;
+    SyntaxHighlighting_Init(&hl, def);
+
+    const char *tokens[] = { "(", ")", "keyword", "'", "//", " ", "x" };
+    for (int round=0; round<100; round++) {
+        char str[4096];
+        generate_random_string(str, 512, tokens, sizeof(tokens) / sizeof(tokens[0]));
+        String test = String_FromCStr(str, strlen(str));
+        SyntaxHighlightingString *shs = NULL;
+        SyntaxHighlighting_HighlightString(&hl, &test, NULL, &shs);
+        TEST_ASSERT(shs != NULL);
+
+        // walking forward sees every tag in effect
+        SyntaxHighlightingTagCursor cursor;
+        SyntaxHighlightingTagCursor_Init(&cursor, shs);
+        const SyntaxHighlightingTag *current = NULL;
+        bool ok = true;
+        for (size_t offset=0; offset<=test.bytes_size; offset++) {
+            const SyntaxHighlightingTag *tag = SyntaxHighlightingTagCursor_Seek(&cursor, offset);
+            current = tag ? tag : current;
+            const SyntaxHighlightingTag *expected = linear_find_tag(shs, offset);
+            ok = ok && current == expected && SyntaxHighlightingString_FindTag(shs, offset) == expected;
+            // the last of several tags at the same offset
+            const SyntaxHighlightingTag *exact = expected && expected->byte_offset == offset ? expected : NULL;
+            ok = ok && SyntaxHighlightingString_GetTag(shs, offset) == exact;
+        }
+        TEST_CHECK(ok);
+        TEST_MSG("string: %s", str);
+
+        // seeking backwards returns the tag in effect
+        size_t middle = test.bytes_size / 2;
+        if (shs->tags_count > 0 && shs->tags[shs->tags_count - 1].byte_offset > middle) {
+            TEST_CHECK(SyntaxHighlightingTagCursor_Seek(&cursor, middle) == linear_find_tag(shs, middle));
+        }
+        SyntaxHighlightingString_Destroy(shs);
+        String_Deinit(&test);
+    }
+    SyntaxHighlighting_Deinit(&hl);
+}
+
+void test_interned_stacks(void) {
+    SyntaxDefinition *def = create_definition(test_ini1);
+    SyntaxHighlighting hl;
+    SyntaxHighlighting_Init(&hl, def);
+    Table *blocks_table = build_blocks_table(def);
+    SyntaxBlockDef *brackets = Table_Get(blocks_table, "brackets");
+    SyntaxBlockDef *string = Table_Get(blocks_table, "string");
+
+    // the same blocks give the same stack
+    const SyntaxStack *a = SyntaxHighlighting_Push(&hl, hl.root, brackets);
+    const SyntaxStack *b = SyntaxHighlighting_Push(&hl, SyntaxHighlighting_Push(&hl, NULL, def->root), brackets);
+    TEST_CHECK(a == b);
+    TEST_CHECK(a->depth == 2 && a->parent == hl.root && a->block == brackets);
+    TEST_CHECK(SyntaxHighlighting_Push(&hl, a, string) != SyntaxHighlighting_Push(&hl, hl.root, string));
+
+    // lines that end with the same open blocks share the stack
+    String line1 = String_Format("( 'a");
+    String line2 = String_Format("( 'b' ( 'c");
+    SyntaxHighlightingString *shs1 = NULL;
+    SyntaxHighlightingString *shs2 = NULL;
+    const SyntaxStack *end1 = SyntaxHighlighting_HighlightString(&hl, &line1, NULL, &shs1);
+    const SyntaxStack *end2 = SyntaxHighlighting_HighlightString(&hl, &line2, a, &shs2);
+    TEST_CHECK(end1 == SyntaxHighlighting_Push(&hl, a, string));
+    TEST_CHECK(end2->depth == 5 && end2->parent->parent->parent == a);
+    size_t stacks = Table_GetUsage(hl.stacks);
+    SyntaxHighlighting_HighlightString(&hl, &line2, a, &shs2);
+    TEST_CHECK(Table_GetUsage(hl.stacks) == stacks);
+
+    SyntaxHighlightingString_Destroy(shs1);
+    SyntaxHighlightingString_Destroy(shs2);
+    String_Deinit(&line1);
+    String_Deinit(&line2);
+    Table_Destroy(blocks_table);
+    SyntaxHighlighting_Deinit(&hl);
+}
+
+const char *test_ini_long_line =
+"[meta]\n"
+"name = TEST\n"
+"[block:root]\n"
+"child_blocks=image, code\n"
+"[block:image]\n"
+"start=\"!\\\\[.*\\\\]\\\\(x\\\\)\"\n"
+"[block:code]\n"
+"start=`\n"
+"end=`\n";
+
+void test_long_line(void) {
+    SyntaxDefinition *def = create_definition(test_ini_long_line);
+    SyntaxHighlighting hl;
+    SyntaxHighlighting_Init(&hl, def);
+
+    // every '!' is a candidate for image and makes the search read to the end of the line
+    const char *unit = "![a] `c` ";
+    size_t unit_length = strlen(unit);
+    size_t units = 20000;
+    char *bytes = malloc(units * unit_length + 1);
+    for (size_t i=0; i<units; i++) {
+        memcpy(bytes + i * unit_length, unit, unit_length);
+    }
+    String line = String_FromCStr(bytes, units * unit_length);
+    free(bytes);
+    TEST_ASSERT(line.bytes_size >= SH_LONG_LINE);
+
+    SyntaxHighlightingString *shs = NULL;
+    SyntaxHighlighting_HighlightString(&hl, &line, NULL, &shs);
+    TEST_ASSERT(shs != NULL);
+
+    // the code block opens and closes in every unit
+    TEST_CHECK(shs->tags_count == 2 * units);
+    TEST_MSG("%zu tags", shs->tags_count);
+    bool ok = true;
+    for (size_t i=0; i<shs->tags_count && ok; i++) {
+        ok = shs->tags[i].byte_offset == (i / 2) * unit_length + (i % 2 ? 8 : 5);
+    }
+    TEST_CHECK(ok);
+
+    // and the matcher of root read every byte only a few times
+    size_t scanned = hl.def->root->matcher->stats.scanned;
+    TEST_CHECK(scanned < 4 * line.bytes_size);
+    TEST_MSG("%zu bytes scanned for a line of %zu bytes", scanned, line.bytes_size);
+
+    SyntaxHighlightingString_Destroy(shs);
+    String_Deinit(&line);
+    SyntaxHighlighting_Deinit(&hl);
+}
+
+void test_long_line_root_only(void) {
+    // root has no children and so no matcher
+    SyntaxDefinition *def = create_definition("[meta]\nname = TEST\n[block:root]\n");
+    SyntaxHighlighting hl;
+    SyntaxHighlighting_Init(&hl, def);
+
+    char *bytes = malloc(5000);
+    memset(bytes, 'x', 5000);
+    String line = String_FromCStr(bytes, 5000);
+    free(bytes);
+    TEST_ASSERT(line.bytes_size >= SH_LONG_LINE);
+
+    SyntaxHighlightingString *shs = NULL;
+    SyntaxHighlighting_HighlightString(&hl, &line, NULL, &shs);
+    TEST_ASSERT(shs != NULL);
+    TEST_CHECK(shs->tags_count == 0);
+
+    SyntaxHighlightingString_Destroy(shs);
+    String_Deinit(&line);
+    SyntaxHighlighting_Deinit(&hl);
+}
+
+// highlight lines one after another and in parallel, the results must be the same
+static void check_parallel(SyntaxHighlighting *hl, ThreadPool *pool, String *lines, size_t count, size_t *main_searches) {
+    const String **texts = malloc(sizeof(String*) * count);
+    SyntaxHighlightingString **sequential = calloc(count, sizeof(SyntaxHighlightingString*));
+    SyntaxHighlightingString **parallel = calloc(count, sizeof(SyntaxHighlightingString*));
+    SyntaxHighlightingString ***highlights = malloc(sizeof(SyntaxHighlightingString**) * count);
+    TEST_ASSERT(texts && sequential && parallel && highlights);
+    for (size_t i=0; i<count; i++) {
+        texts[i] = &lines[i];
+        highlights[i] = &parallel[i];
+    }
+
+    const SyntaxStack *open_blocks = NULL;
+    for (size_t i=0; i<count; i++) {
+        open_blocks = SyntaxHighlighting_HighlightString(hl, &lines[i], open_blocks, &sequential[i]);
+    }
+    const Regexp *root_matcher = hl->context->matchers[hl->def->root->index];
+    size_t searches = root_matcher->stats.searches;
+    const SyntaxStack *parallel_open_blocks = SyntaxHighlighting_HighlightStrings(
+        hl, pool, texts, (SyntaxHighlightingString **const *)highlights, count, NULL);
+    *main_searches = root_matcher->stats.searches - searches;
+    TEST_CHECK(parallel_open_blocks == open_blocks);
+
+    bool same = true;
+    for (size_t i=0; i<count && same; i++) {
+        const SyntaxHighlightingString *a = sequential[i];
+        const SyntaxHighlightingString *b = parallel[i];
+        same = b && a->open_blocks_at_begin == b->open_blocks_at_begin && a->open_blocks_at_end == b->open_blocks_at_end &&
+               a->tags_count == b->tags_count;
+        for (size_t j=0; j<a->tags_count && same; j++) {
+            same = a->tags[j].byte_offset == b->tags[j].byte_offset && a->tags[j].block == b->tags[j].block;
+        }
+        TEST_CHECK(same);
+        TEST_MSG("line %zu: \"%s\"", i, lines[i].bytes);
+    }
+
+    for (size_t i=0; i<count; i++) {
+        SyntaxHighlightingString_Destroy(sequential[i]);
+        SyntaxHighlightingString_Destroy(parallel[i]);
+    }
+    free(highlights);
+    free(parallel);
+    free(sequential);
+    free(texts);
+}
+
+void test_parallel(void) {
+    SyntaxDefinition *def = create_definition(test_ini1);
+    SyntaxHighlighting hl;
+    SyntaxHighlighting_Init(&hl, def);
+    ThreadPool *pool = ThreadPool_Create(4);
+    size_t count = 20000;
+    String *lines = malloc(sizeof(String) * count);
+    TEST_ASSERT(lines);
+
+    // random brackets and strings, the guesses of the workers are wrong for long
+    const char *tokens[] = { "(", ")", "keyword", "'", "//" };
+    srand(1);
+    for (size_t i=0; i<count; i++) {
+        char str[64];
+        generate_random_string(str, 40, tokens, sizeof(tokens) / sizeof(tokens[0]));
+        lines[i] = String_FromCStr(str, strlen(str));
+    }
+    size_t main_searches;
+    check_parallel(&hl, pool, lines, count, &main_searches);
+    for (size_t i=0; i<count; i++) {
+        String_Deinit(&lines[i]);
+    }
+
+    // strings over two lines, the guesses are right after a line or two
+    for (size_t i=0; i<count; i++) {
+        const char *str = i % 3 == 0 ? "a 'string" : i % 3 == 1 ? "over two' lines" : "keyword // comment";
+        lines[i] = String_FromCStr(str, strlen(str));
+    }
+    check_parallel(&hl, pool, lines, count, &main_searches);
+    // the calling thread did the first chunk and a few lines of the others
+    TEST_CHECK(main_searches < count);
+    TEST_MSG("%zu searches of the calling thread", main_searches);
+    for (size_t i=0; i<count; i++) {
+        String_Deinit(&lines[i]);
+    }
+
+    // without a pool everything is done by the calling thread
+    for (size_t i=0; i<10; i++) {
+        lines[i] = String_FromCStr("a 'b", 4);
+    }
+    check_parallel(&hl, NULL, lines, 10, &main_searches);
+    for (size_t i=0; i<10; i++) {
+        String_Deinit(&lines[i]);
+    }
+
+    free(lines);
+    ThreadPool_Poll(pool);
+    ThreadPool_Destroy(pool);
+    SyntaxHighlighting_Deinit(&hl);
+}
+
 TEST_LIST = {
     { "SyntaxHighlighting: Simple", test_highlight_string_simple },
     { "SyntaxHighlighting: Basics", test_basics },
     { "SyntaxHighlighting: Moderate", test_moderate },
+    { "SyntaxHighlighting: Same position", test_tie },
     { "SyntaxHighlighting: Open blocks", test_open_blocks },
     { "SyntaxHighlighting: Random Tests", test_stress },
+    { "SyntaxHighlighting: Tag cursor", test_tag_cursor },
+    { "SyntaxHighlighting: Long line", test_long_line },
+    { "SyntaxHighlighting: Long line without children", test_long_line_root_only },
+    { "SyntaxHighlighting: Interned stacks", test_interned_stacks },
+    { "SyntaxHighlighting: Parallel", test_parallel },
     { NULL, NULL }
 };
\ No newline at end of file
@@ -108,7 +108,6 @@ void test_binding_basic(void) {
     TestFixture fixture;
     setup_fixture(&fixture, test_ini, lines, lines_count);
     TextBuffer *tb = &fixture.tb;
-    SyntaxHighlighting *sh = &fixture.sh;
     SyntaxHighlightingBinding *binding = &fixture.binding;
 
     
@@ -116,8 +115,8 @@ void test_binding_basic(void) {
     SyntaxHighlightingBinding_UpdateLine(binding, tb->current_line->next, tb->current_line->next);
 
     // 3. Check
-    TEST_CHECK(Table_Get(sh->strings, &fixture.lines[0]->text) != NULL);
-    TEST_CHECK(Table_Get(sh->strings, &fixture.lines[1]->text) != NULL);
+    TEST_CHECK(fixture.lines[0]->highlight != NULL);
+    TEST_CHECK(fixture.lines[1]->highlight != NULL);
 
     // 4. Cleanup
     cleanup_fixture(&fixture);
@@ -135,7 +134,6 @@ void test_binding_basic2(void) {
     TestFixture fixture;
     setup_fixture(&fixture, test_ini, lines, lines_count);
     //TextBuffer *tb = &fixture.tb;
-    SyntaxHighlighting *sh = &fixture.sh;
     SyntaxHighlightingBinding *binding = &fixture.binding;
 
     
@@ -143,23 +141,245 @@ void test_binding_basic2(void) {
     SyntaxHighlightingBinding_UpdateLine(binding, fixture.lines[1], fixture.lines[1]);
 
     // 3. Check
-    SyntaxHighlightingString *shs0 = Table_Get(sh->strings, &fixture.lines[0]->text);
-    SyntaxHighlightingString *shs1 = Table_Get(sh->strings, &fixture.lines[1]->text);
+    SyntaxHighlightingString *shs0 = fixture.lines[0]->highlight;
+    SyntaxHighlightingString *shs1 = fixture.lines[1]->highlight;
     TEST_CHECK(shs0 != NULL);
     TEST_CHECK(shs0->text == &fixture.lines[0]->text);
     TEST_CHECK(shs0->tags_count == 1);
     TEST_CHECK(shs0->tags[0].byte_offset == 6);
-    TEST_CHECK(shs0->open_blocks_at_end.size == 2);
-    TEST_MSG("%zu", shs0->open_blocks_at_end.size);
-    TEST_CHECK(shs0->open_blocks_at_end.size == shs1->open_blocks_at_begin.size);
-    TEST_CHECK(Table_Get(sh->strings, &fixture.lines[1]->text) != NULL);
+    TEST_CHECK(shs0->open_blocks_at_end->depth == 2);
+    TEST_MSG("%zu", shs0->open_blocks_at_end->depth);
+    TEST_CHECK(shs0->open_blocks_at_end == shs1->open_blocks_at_begin);
+    TEST_CHECK(shs1 != NULL);
 
     // 4. Cleanup
     cleanup_fixture(&fixture);
 }
 
+void test_binding_deleted_line(void) {
+    // data
+    const char *lines[] = {
+        "First 'line",
+        "Second' line",
+        "Third 'line",
+    };
+    size_t lines_count = sizeof(lines) / sizeof(char*);
+
+    // 1. Setup
+    TestFixture fixture;
+    setup_fixture(&fixture, test_ini, lines, lines_count);
+    SyntaxHighlightingBinding *binding = &fixture.binding;
+    SyntaxHighlightingBinding_UpdateAll(binding, true);
+    TEST_ASSERT(fixture.lines[2]->highlight != NULL);
+    TEST_CHECK(fixture.lines[2]->highlight->open_blocks_at_begin == fixture.sh.root);
+
+    // 2. Delete the line that closes the string (its highlighting goes with it)
+    TEST_CHECK(TextBuffer_DeleteLine(&fixture.tb, (Line*)fixture.lines[1]));
+    SyntaxHighlightingBinding_UpdateLine(binding, fixture.lines[2], fixture.lines[2]);
+
+    // 3. Check
+    const SyntaxHighlightingString *shs = fixture.lines[2]->highlight;
+    TEST_CHECK(shs->open_blocks_at_begin == fixture.lines[0]->highlight->open_blocks_at_end);
+    TEST_CHECK(shs->open_blocks_at_begin->depth == 2);
+    TEST_CHECK(shs->tags_count == 1);
+    TEST_CHECK(shs->open_blocks_at_end == fixture.sh.root);
+
+    // 4. Cleanup
+    cleanup_fixture(&fixture);
+}
+
+void test_binding_lazy(void) {
+    // a string is opened in the second line and never closed
+    size_t lines_count = 20000;
+    const char **lines = malloc(sizeof(char*) * lines_count);
+    TEST_ASSERT(lines);
+    lines[0] = "First line";
+    lines[1] = "Second 'line";
+    for (size_t i = 2; i < lines_count; i++) {
+        lines[i] = "text";
+    }
+
+    // 1. Setup
+    TestFixture fixture;
+    setup_fixture(&fixture, test_ini, lines, lines_count);
+    SyntaxHighlightingBinding *binding = &fixture.binding;
+    TEST_CHECK(fixture.tb.highlight_line == fixture.lines[0]);
+
+    // 2. Jump far into the file: only the screen and the lines right in front of it are highlighted
+    size_t first = 15000;
+    fixture.tl.first_line = (Line*)fixture.lines[first];
+    fixture.tl.first_visual_line_idx = 0;
+    fixture.tl.dirty = true;
+    SyntaxHighlightingBinding_UpdateVisible(binding);
+    size_t highlighted = 0;
+    for (size_t i = 0; i < lines_count; i++) {
+        highlighted += fixture.lines[i]->highlight != NULL;
+    }
+    TEST_CHECK(highlighted == SH_BINDING_CATCHUP_LINES + 4);
+    TEST_MSG("%zu", highlighted);
+    TEST_CHECK(fixture.lines[first + 3]->highlight != NULL);
+    TEST_CHECK(fixture.lines[first + 4]->highlight == NULL);
+    // the open string is not known yet
+    TEST_CHECK(fixture.lines[first]->highlight->open_blocks_at_begin == fixture.sh.root);
+
+    // 3. The background corrects the guess and highlights the rest
+    size_t steps = 0;
+    while (SyntaxHighlightingBinding_Step(binding, SH_BINDING_STEP_LINES)) {
+        steps++;
+    }
+    TEST_CHECK(steps >= lines_count / SH_BINDING_STEP_LINES - 1);
+    TEST_MSG("%zu steps", steps);
+    TEST_CHECK(fixture.tb.highlight_line == NULL);
+    const SyntaxStack *open_blocks = fixture.sh.root;
+    bool follow = true;
+    for (size_t i = 0; i < lines_count && follow; i++) {
+        follow = fixture.lines[i]->highlight && fixture.lines[i]->highlight->open_blocks_at_begin == open_blocks;
+        open_blocks = follow ? fixture.lines[i]->highlight->open_blocks_at_end : NULL;
+    }
+    TEST_CHECK(follow);
+    TEST_CHECK(fixture.lines[first]->highlight->open_blocks_at_begin->depth == 2);
+
+    // 4. Nothing left to do, a deleted line has the line after it checked again
+    TEST_CHECK(!SyntaxHighlightingBinding_Step(binding, SH_BINDING_STEP_LINES));
+    TEST_CHECK(TextBuffer_DeleteLine(&fixture.tb, (Line*)fixture.lines[1]));
+    TEST_CHECK(fixture.tb.highlight_line == fixture.lines[2]);
+    SyntaxHighlightingBinding_UpdateAll(binding, false);
+    TEST_CHECK(fixture.tb.highlight_line == NULL);
+    TEST_CHECK(fixture.lines[first]->highlight->open_blocks_at_begin == fixture.sh.root);
+
+    // 5. Cleanup
+    cleanup_fixture(&fixture);
+    free(lines);
+}
+
+// counts the jobs of the workers that are done
+static void count_job(void *caller, void *data) {
+    (void)caller;
+    (*(size_t*)data)++;
+}
+
+// append count lines that were never highlighted, returns the first one
+static Line *append_lines(TextBuffer *tb, const char *text, size_t count) {
+    Line *first = NULL;
+    for (size_t i = 0; i < count; i++) {
+        Line *new_line = Line_Create();
+        String s = String_FromCStr(text, strlen(text));
+        String_Take(&new_line->text, &s);
+        TextBuffer_InsertLineAtBottom(tb, new_line);
+        first = first ? first : new_line;
+    }
+    return first;
+}
+
+// step like the main loop until every line is checked
+static void run_steps(SyntaxHighlightingBinding *binding, ThreadPool *pool) {
+    while (SyntaxHighlightingBinding_Step(binding, SH_BINDING_STEP_LINES) || binding->job) {
+        if (binding->job) {
+            ThreadPool_WaitIdle(pool);
+            ThreadPool_Poll(pool);
+        }
+    }
+}
+
+void test_binding_parallel(void) {
+    // strings over two lines
+    size_t lines_count = 40000;
+    const char **lines = malloc(sizeof(char*) * lines_count);
+    TEST_ASSERT(lines);
+    for (size_t i = 0; i < lines_count; i++) {
+        lines[i] = i % 3 == 0 ? "a 'string" : i % 3 == 1 ? "over two' lines" : "keyword # comment";
+    }
+
+    // 1. Setup
+    TestFixture fixture;
+    setup_fixture(&fixture, test_ini, lines, lines_count);
+    SyntaxHighlightingBinding *binding = &fixture.binding;
+    ThreadPool *pool = ThreadPool_Create(4);
+    binding->pool = pool;
+    size_t jobs = 0;
+    binding->job_done = Callback_New(count_job, &jobs);
+
+    // 2. The lines were never highlighted, a step starts a job and the lines are left alone until it's done
+    TEST_CHECK(!SyntaxHighlightingBinding_Step(binding, SH_BINDING_STEP_LINES));
+    TEST_CHECK(binding->job != NULL);
+    ThreadPool_WaitIdle(pool);
+    TEST_CHECK(fixture.lines[0]->highlight == NULL);
+    TEST_CHECK(!SyntaxHighlightingBinding_Step(binding, SH_BINDING_STEP_LINES));  // still waiting
+    ThreadPool_Poll(pool);
+    TEST_CHECK(jobs == 1);
+    TEST_CHECK(binding->job == NULL);
+    TEST_CHECK(fixture.lines[SH_BINDING_PARALLEL_LINES - 1]->highlight != NULL);
+    TEST_CHECK(fixture.lines[SH_BINDING_PARALLEL_LINES]->highlight == NULL);
+    TEST_CHECK(fixture.lines[0]->highlight->text == &fixture.lines[0]->text);
+
+    // 3. The workers do the rest in large batches
+    run_steps(binding, pool);
+    TEST_CHECK(jobs == (lines_count + SH_BINDING_PARALLEL_LINES - 1) / SH_BINDING_PARALLEL_LINES);
+    TEST_MSG("%zu jobs", jobs);
+    TEST_CHECK(fixture.tb.highlight_line == NULL);
+
+    // 4. Check
+    const SyntaxStack *open_blocks = fixture.sh.root;
+    bool ok = true;
+    for (size_t i = 0; i < lines_count && ok; i++) {
+        const SyntaxHighlightingString *shs = fixture.lines[i]->highlight;
+        // the same text in the same state gives the same tags
+        ok = shs && shs->open_blocks_at_begin == open_blocks &&
+             shs->tags_count == fixture.lines[i % 3]->highlight->tags_count &&
+             shs->open_blocks_at_end->depth == (i % 3 == 0 ? 2 : 1);
+        TEST_CHECK(ok);
+        TEST_MSG("line %zu", i);
+        open_blocks = shs ? shs->open_blocks_at_end : NULL;
+    }
+
+    // 5. A job is dropped if the buffer changed meanwhile, then the main thread takes a step
+    Line *appended = append_lines(&fixture.tb, "keyword", 2 * SH_BINDING_PARALLEL_LINES);
+    TEST_CHECK(fixture.tb.highlight_line == appended);
+    TEST_CHECK(!SyntaxHighlightingBinding_Step(binding, SH_BINDING_STEP_LINES));
+    TEST_CHECK(binding->job != NULL);
+    TextBuffer_WillChangeLine(&fixture.tb, (Line*)fixture.lines[0]);
+    ThreadPool_WaitIdle(pool);
+    ThreadPool_Poll(pool);
+    TEST_CHECK(binding->job == NULL);
+    TEST_CHECK(appended->highlight == NULL);
+    TEST_CHECK(SyntaxHighlightingBinding_Step(binding, SH_BINDING_STEP_LINES));
+    TEST_CHECK(binding->job == NULL);
+    TEST_CHECK(appended->highlight != NULL);
+    TEST_CHECK(!SyntaxHighlightingBinding_Step(binding, SH_BINDING_STEP_LINES));
+    TEST_CHECK(binding->job != NULL);
+
+    // 6. Everything at once drops the job and waits for the workers
+    size_t jobs_before = jobs;
+    SyntaxHighlightingBinding_UpdateAll(binding, false);
+    TEST_CHECK(binding->job == NULL);
+    TEST_CHECK(fixture.tb.highlight_line == NULL);
+    TEST_CHECK(TextBuffer_GetLastLine(&fixture.tb)->highlight != NULL);
+    ThreadPool_WaitIdle(pool);
+    ThreadPool_Poll(pool);
+    TEST_CHECK(jobs == jobs_before);
+
+    // 7. With a single worker the main thread highlights the lines itself
+    ThreadPool *single = ThreadPool_Create(1);
+    binding->pool = single;
+    appended = append_lines(&fixture.tb, "keyword", SH_BINDING_STEP_LINES + 1);
+    TEST_CHECK(SyntaxHighlightingBinding_Step(binding, SH_BINDING_STEP_LINES));
+    TEST_CHECK(binding->job == NULL);
+    TEST_CHECK(appended->highlight != NULL);
+    TEST_CHECK(!SyntaxHighlightingBinding_Step(binding, SH_BINDING_STEP_LINES));
+    TEST_CHECK(fixture.tb.highlight_line == NULL);
+
+    // 8. Cleanup
+    ThreadPool_Destroy(single);
+    ThreadPool_Destroy(pool);
+    cleanup_fixture(&fixture);
+    free(lines);
+}
+
 TEST_LIST = {
     { "TextLayoutBindings: No Styling", test_binding_basic },
     { "TextLayoutBindings: String over two lines", test_binding_basic2 },
+    { "TextLayoutBindings: Deleted line", test_binding_deleted_line },
+    { "TextLayoutBindings: Lazy highlighting", test_binding_lazy },
+    { "TextLayoutBindings: Parallel highlighting", test_binding_parallel },
     { NULL, NULL }
 };
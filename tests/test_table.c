@@ -127,6 +127,24 @@ void test_ptr_table(void) {
     Table_Destroy(table);
 }
 
+void test_clear(void) {
+    Table *table = Table_Create();
+    char key[16];
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        Table_Set(table, key, strdup("value"), free);
+    }
+    size_t capacity = table->capacity;
+    Table_Clear(table);
+    TEST_CHECK(Table_GetUsage(table) == 0);
+    TEST_CHECK(table->capacity == capacity);
+    TEST_CHECK(Table_Get(table, "key1") == NULL);
+
+    Table_Set(table, "key1", strdup("again"), free);
+    TEST_CHECK(strcmp(Table_Get(table, "key1"), "again") == 0);
+    Table_Destroy(table);
+}
+
 TEST_LIST = {
     { "Table: Creation", test_creation },
     { "Table: Set and Get", test_set_get },
@@ -134,5 +152,6 @@ TEST_LIST = {
     { "Table: Rehashing", test_rehashing },
     { "Table: Edge Case", test_edge_case },
     { "Table: Pointer Keys", test_ptr_table },
+    { "Table: Clear", test_clear },
     { NULL, NULL }
 };
\ No newline at end of file
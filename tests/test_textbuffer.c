@@ -151,6 +151,10 @@ void test_textbuffer_line_management(void) {
     TEST_CHECK(line1->next == line3);
     TEST_CHECK(line3->prev == line1);
 
+    // deleting the last line keeps the last line lookup valid
+    TEST_CHECK(TextBuffer_DeleteLine(&tb, line3) == true);
+    TEST_CHECK(TextBuffer_GetLastLine(&tb) == line1);
+
     TextBuffer_Deinit(&tb);
 }
 
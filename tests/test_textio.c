@@ -0,0 +1,229 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sched.h>
+
+#include "acutest.h"
+#include "document/textbuffer.h"
+#include "document/textio.h"
+#include "document/backgroundsave.h"
+#include "common/string.h"
+
+typedef struct {
+    char dir[64];
+    char path[128];
+    TextBuffer tb;
+} TestFixture;
+
+static void write_file(const char *path, const char *content) {
+    FILE *fp = fopen(path, "wb");
+    TEST_ASSERT(fp != NULL);
+    fputs(content, fp);
+    fclose(fp);
+}
+
+static char *read_file(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+    char *buf = malloc(size + 1);
+    size_t n = fread(buf, 1, size, fp);
+    buf[n] = '\0';
+    fclose(fp);
+    return buf;
+}
+
+static void setup_fixture(TestFixture *f, const char *content) {
+    snprintf(f->dir, sizeof(f->dir), "/tmp/clieditor_test_XXXXXX");
+    TEST_ASSERT(mkdtemp(f->dir) != NULL);
+    snprintf(f->path, sizeof(f->path), "%s/doc.txt", f->dir);
+    write_file(f->path, content);
+
+    TextBuffer_Init(&f->tb);
+    File *file = File_Open(f->path, FILE_ACCESS_READ);
+    TEST_ASSERT(file != NULL);
+    TextBuffer_LoadFromFile(&f->tb, file);
+    File_Close(file);
+}
+
+static void teardown_fixture(TestFixture *f) {
+    TextBuffer_Deinit(&f->tb);
+    unlink(f->path);
+    rmdir(f->dir);
+}
+
+static void check_file(const char *path, const char *expected) {
+    char *content = read_file(path);
+    TEST_ASSERT(content != NULL);
+    TEST_CHECK(strcmp(content, expected) == 0);
+    TEST_MSG("Expected: '%s', Got: '%s'", expected, content);
+    free(content);
+}
+
+static Line *create_line(const char *text) {
+    Line *line = Line_Create();
+    String_Set(&line->text, String_FromCStr(text, strlen(text)));
+    return line;
+}
+
+void test_load_disk_offsets(void) {
+    TestFixture f;
+    setup_fixture(&f, "ab\ncde\n\nf\n");
+    TEST_CHECK(f.tb.disk_known);
+    TEST_CHECK(f.tb.disk_size == 10);
+    TEST_CHECK(f.tb.clean_bytes == 10);
+    TEST_CHECK(f.tb.dirty_line == NULL);
+    int64_t expected[] = { 0, 3, 7, 8 };
+    int i = 0;
+    for (Line *line = TextBuffer_GetFirstLine(&f.tb); line; line = line->next, i++) {
+        TEST_CHECK(line->disk_offset == expected[i]);
+    }
+    teardown_fixture(&f);
+}
+
+void test_tail_save_append(void) {
+    TestFixture f;
+    setup_fixture(&f, "one\ntwo\n");
+
+    TextBuffer_InsertLineAtBottom(&f.tb, create_line("three"));
+    TEST_CHECK(f.tb.clean_bytes == 8);
+
+    FileWriterStats stats;
+    TEST_CHECK(TextBuffer_SaveTail(&f.tb, f.path, false, &stats));
+    TEST_CHECK(stats.bytes_written == 6);  // only "three\n"
+    check_file(f.path, "one\ntwo\nthree\n");
+    TEST_CHECK(f.tb.clean_bytes == 14);
+
+    // nothing changed, nothing written
+    TEST_CHECK(TextBuffer_SaveTail(&f.tb, f.path, false, &stats));
+    TEST_CHECK(stats.bytes_written == 0);
+
+    teardown_fixture(&f);
+}
+
+void test_tail_save_change_and_delete(void) {
+    TestFixture f;
+    setup_fixture(&f, "one\ntwo\nthree\nfour\n");
+
+    // change "two", delete "four"
+    Line *two = TextBuffer_GetFirstLine(&f.tb)->next;
+    TextBuffer_WillChangeLine(&f.tb, two);
+    String_Set(&two->text, String_FromCStr("2", 1));
+    TextBuffer_DeleteLine(&f.tb, TextBuffer_GetLastLine(&f.tb));
+    TEST_CHECK(f.tb.clean_bytes == 4);
+
+    FileWriterStats stats;
+    TEST_CHECK(TextBuffer_SaveTail(&f.tb, f.path, false, &stats));
+    TEST_CHECK(stats.bytes_written == 8);  // "2\nthree\n"
+    check_file(f.path, "one\n2\nthree\n");
+
+    // delete the last line only: just truncate
+    TextBuffer_DeleteLine(&f.tb, TextBuffer_GetLastLine(&f.tb));
+    TEST_CHECK(TextBuffer_SaveTail(&f.tb, f.path, false, &stats));
+    TEST_CHECK(stats.bytes_written == 0);
+    check_file(f.path, "one\n2\n");
+
+    // insert at the top
+    TextBuffer_InsertLineAtTop(&f.tb, create_line("zero"));
+    TEST_CHECK(TextBuffer_SaveTail(&f.tb, f.path, false, NULL));
+    check_file(f.path, "zero\none\n2\n");
+
+    teardown_fixture(&f);
+}
+
+void test_tail_save_refused(void) {
+    // the file was changed by somebody else
+    TestFixture f;
+    setup_fixture(&f, "one\n");
+    write_file(f.path, "one\nother\n");
+    TextBuffer_InsertLineAtBottom(&f.tb, create_line("two"));
+    TEST_CHECK(!TextBuffer_SaveTail(&f.tb, f.path, false, NULL));
+    // the full save works and enables tail saving again
+    TEST_CHECK(TextBuffer_SaveToPath(&f.tb, f.path, false, NULL));
+    check_file(f.path, "one\ntwo\n");
+    TextBuffer_InsertLineAtBottom(&f.tb, create_line("three"));
+    TEST_CHECK(TextBuffer_SaveTail(&f.tb, f.path, false, NULL));
+    check_file(f.path, "one\ntwo\nthree\n");
+    teardown_fixture(&f);
+
+    // CRLF line breaks: the first line would change on disk
+    setup_fixture(&f, "one\r\ntwo\r\n");
+    TEST_CHECK(f.tb.clean_bytes == 0);
+    TEST_CHECK(f.tb.dirty_line == TextBuffer_GetFirstLine(&f.tb));
+    teardown_fixture(&f);
+
+    // missing newline at the end: the last line needs to be written again
+    setup_fixture(&f, "one\ntwo");
+    TEST_CHECK(f.tb.clean_bytes == 4);
+    TextBuffer_InsertLineAtBottom(&f.tb, create_line("three"));
+    TEST_CHECK(TextBuffer_SaveTail(&f.tb, f.path, false, NULL));
+    check_file(f.path, "one\ntwo\nthree\n");
+    teardown_fixture(&f);
+}
+
+void test_load_shares_identical_lines(void) {
+    TestFixture f;
+    setup_fixture(&f, "a\n----\nb\n----\n\n\n----\n");
+    Line *sep1 = TextBuffer_GetFirstLine(&f.tb)->next;
+    Line *sep2 = sep1->next->next;
+    Line *empty1 = sep2->next;
+    Line *empty2 = empty1->next;
+    Line *sep3 = empty2->next;
+    TEST_CHECK(sep1->shared && sep2->shared && sep3->shared);
+    TEST_CHECK(sep1->text.bytes == sep2->text.bytes && sep2->text.bytes == sep3->text.bytes);
+    TEST_CHECK(empty1->shared && empty1->text.bytes == empty2->text.bytes);
+    TEST_CHECK(!TextBuffer_GetFirstLine(&f.tb)->shared);
+
+    // copy on write
+    TextBuffer_WillChangeLine(&f.tb, sep2);
+    TEST_CHECK(!sep2->shared && sep2->text.bytes != sep1->text.bytes);
+    String_Set(&sep2->text, String_FromCStr("====", 4));
+    TEST_CHECK(strcmp(sep1->text.bytes, "----") == 0);
+    TEST_CHECK(strcmp(sep3->text.bytes, "----") == 0);
+
+    TextBuffer_DeleteLine(&f.tb, sep1);
+    TEST_CHECK(TextBuffer_SaveToPath(&f.tb, f.path, false, NULL));
+    check_file(f.path, "a\nb\n====\n\n\n----\n");
+    teardown_fixture(&f);
+}
+
+void test_background_save_shared_lines(void) {
+    TestFixture f;
+    setup_fixture(&f, "----\nx\n----\n----\n");
+    Line *first = TextBuffer_GetFirstLine(&f.tb);
+    Line *last = TextBuffer_GetLastLine(&f.tb);
+    TEST_ASSERT(first->shared && last->shared);
+
+    BackgroundSave *bs = BackgroundSave_Start(&f.tb, f.path, false);
+    TEST_ASSERT(bs != NULL);
+    // the snapshot keeps the shared bytes of changed and deleted lines
+    TextBuffer_WillChangeLine(&f.tb, first);
+    String_Set(&first->text, String_FromCStr("new", 3));
+    TextBuffer_DeleteLine(&f.tb, last);
+    TextBuffer_DeleteLine(&f.tb, TextBuffer_GetLastLine(&f.tb));
+    while (!BackgroundSave_Poll(bs, NULL)) {
+        sched_yield();
+    }
+    TEST_CHECK(BackgroundSave_Finish(bs, NULL));
+    check_file(f.path, "----\nx\n----\n----\n");
+
+    TEST_CHECK(TextBuffer_SaveToPath(&f.tb, f.path, false, NULL));
+    check_file(f.path, "new\nx\n");
+    teardown_fixture(&f);
+}
+
+TEST_LIST = {
+    { "TextIO: Disk offsets after loading", test_load_disk_offsets },
+    { "TextIO: Tail save of appended lines", test_tail_save_append },
+    { "TextIO: Tail save of changed and deleted lines", test_tail_save_change_and_delete },
+    { "TextIO: Tail save refused", test_tail_save_refused },
+    { "TextIO: Identical lines are shared", test_load_shares_identical_lines },
+    { "TextIO: Background save of shared lines", test_background_save_shared_lines },
+    { NULL, NULL }
+};
@@ -0,0 +1,206 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "acutest.h"
+#include "document/textbuffer.h"
+#include "document/textsnapshot.h"
+#include "document/backgroundsave.h"
+#include "common/string.h"
+
+static Line *create_line(const char *text) {
+    Line *line = Line_Create();
+    String_Set(&line->text, String_FromCStr(text, strlen(text)));
+    return line;
+}
+
+// fill tb with the lines "0", "1", ... 
+static void fill_buffer(TextBuffer *tb, int count) {
+    TextBuffer_Init(tb);
+    String_Set(&tb->current_line->text, String_FromCStr("0", 1));
+    for (int i = 1; i < count; i++) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%d", i);
+        TextBuffer_InsertLineAtBottom(tb, create_line(buf));
+    }
+}
+
+// join the lines of the snapshot with '|'
+static String snapshot_content(TextSnapshot *snap) {
+    String out = String_Empty();
+    TextSnapshot_Lock(snap);
+    Line *line = snap->first;
+    while (line) {
+        String_Append(&out, TextSnapshot_Text(snap, line));
+        line = TextSnapshot_Next(snap, line);
+        if (line) {
+            String_AddChar(&out, "|");
+        }
+    }
+    TextSnapshot_Unlock(snap);
+    return out;
+}
+
+static String buffer_content(TextBuffer *tb) {
+    String out = String_Empty();
+    Line *line = TextBuffer_GetFirstLine(tb);
+    while (line) {
+        String_Append(&out, &line->text);
+        line = line->next;
+        if (line) {
+            String_AddChar(&out, "|");
+        }
+    }
+    return out;
+}
+
+void test_snapshot_unchanged(void) {
+    TextBuffer tb;
+    fill_buffer(&tb, 4);
+    TextSnapshot *snap = TextBuffer_TakeSnapshot(&tb);
+    TEST_ASSERT(snap != NULL);
+    TEST_CHECK(snap->line_count == 4);
+    TEST_CHECK(TextBuffer_TakeSnapshot(&tb) == NULL);  // only one at a time
+
+    String content = snapshot_content(snap);
+    TEST_CHECK(strcmp(String_AsCStr(&content), "0|1|2|3") == 0);
+    String_Deinit(&content);
+
+    TextBuffer_ReleaseSnapshot(&tb);
+    TEST_CHECK(tb.snapshot == NULL);
+    TextBuffer_Deinit(&tb);
+}
+
+void test_snapshot_merges_gap(void) {
+    TextBuffer tb;
+    fill_buffer(&tb, 2);
+    String_Set(&tb.gap.text, String_FromCStr("x", 1));
+    tb.gap.position = 1;
+
+    TextSnapshot *snap = TextBuffer_TakeSnapshot(&tb);
+    String content = snapshot_content(snap);
+    TEST_CHECK(strcmp(String_AsCStr(&content), "0x|1") == 0);
+    TEST_MSG("Got: %s", String_AsCStr(&content));
+    String_Deinit(&content);
+
+    TextBuffer_ReleaseSnapshot(&tb);
+    TextBuffer_Deinit(&tb);
+}
+
+void test_snapshot_copy_on_write(void) {
+    TextBuffer tb;
+    fill_buffer(&tb, 5);
+    TextSnapshot *snap = TextBuffer_TakeSnapshot(&tb);
+
+    Line *first = TextBuffer_GetFirstLine(&tb);
+    Line *second = first->next;
+    const char *bytes_before = second->text.bytes;
+
+    // change text of line 1
+    TextBuffer_WillChangeLine(&tb, second);
+    String_Set(&second->text, String_FromCStr("changed", 7));
+    // change it again, the original must not be overwritten
+    TextBuffer_WillChangeLine(&tb, second);
+    String_Set(&second->text, String_FromCStr("changed again", 13));
+    // insert a new line after line 0
+    tb.current_line = first;
+    TextBuffer_InsertLineAfterCurrent(&tb, create_line("new"));
+    // delete line 3 and the new line
+    TextBuffer_DeleteLine(&tb, second->next->next);
+    TextBuffer_DeleteLine(&tb, first->next);
+    // and add one at the bottom and the top
+    TextBuffer_InsertLineAtBottom(&tb, create_line("bottom"));
+    TextBuffer_InsertLineAtTop(&tb, create_line("top"));
+
+    String live = buffer_content(&tb);
+    TEST_CHECK(strcmp(String_AsCStr(&live), "top|0|changed again|2|4|bottom") == 0);
+    TEST_MSG("Got: %s", String_AsCStr(&live));
+    String_Deinit(&live);
+
+    String content = snapshot_content(snap);
+    TEST_CHECK(strcmp(String_AsCStr(&content), "0|1|2|3|4") == 0);
+    TEST_MSG("Got: %s", String_AsCStr(&content));
+    String_Deinit(&content);
+
+    // the original bytes were preserved, not copied
+    TextSnapshot_Lock(snap);
+    TEST_CHECK(TextSnapshot_Text(snap, second)->bytes == bytes_before);
+    TextSnapshot_Unlock(snap);
+    TEST_CHECK(snap->saved_lines == 1);
+
+    TextBuffer_ReleaseSnapshot(&tb);
+    TEST_CHECK(second->snapshot == NULL);
+
+    live = buffer_content(&tb);
+    TEST_CHECK(strcmp(String_AsCStr(&live), "top|0|changed again|2|4|bottom") == 0);
+    String_Deinit(&live);
+    TEST_CHECK(tb.line_count == 6);
+
+    TextBuffer_Deinit(&tb);
+}
+
+void test_background_save(void) {
+    char dir[] = "/tmp/clieditor_test_XXXXXX";
+    TEST_ASSERT(mkdtemp(dir) != NULL);
+    char path[64];
+    snprintf(path, sizeof(path), "%s/doc.txt", dir);
+
+    const int line_count = 20000;
+    TextBuffer tb;
+    fill_buffer(&tb, line_count);
+
+    BackgroundSave *bs = BackgroundSave_Start(&tb, path, false);
+    TEST_ASSERT(bs != NULL);
+    TEST_CHECK(BackgroundSave_Start(&tb, path, false) == NULL);
+
+    // keep editing while the worker writes
+    Line *line = TextBuffer_GetFirstLine(&tb);
+    for (int i = 0; i < 100 && line->next; i++) {
+        TextBuffer_WillChangeLine(&tb, line);
+        String_Set(&line->text, String_FromCStr("edited", 6));
+        TextBuffer_DeleteLine(&tb, line->next);
+        line = line->next;
+    }
+
+    double progress;
+    while (!BackgroundSave_Poll(bs, &progress)) {
+        TEST_CHECK(progress >= 0.0 && progress <= 1.0);
+        sched_yield();
+    }
+    FileWriterStats stats;
+    TEST_CHECK(BackgroundSave_Finish(bs, &stats));
+    TEST_CHECK(tb.snapshot == NULL);
+
+    // the file holds the state at the time save was started
+    FILE *fp = fopen(path, "r");
+    TEST_ASSERT(fp != NULL);
+    char buf[32];
+    int i = 0;
+    bool all_equal = true;
+    while (fgets(buf, sizeof(buf), fp)) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "%d\n", i);
+        if (strcmp(buf, expected) != 0) {
+            all_equal = false;
+        }
+        i++;
+    }
+    fclose(fp);
+    TEST_CHECK(all_equal);
+    TEST_CHECK(i == line_count);
+    TEST_MSG("lines: %d", i);
+
+    TextBuffer_Deinit(&tb);
+    unlink(path);
+    rmdir(dir);
+}
+
+TEST_LIST = {
+    { "TextSnapshot: Unchanged buffer", test_snapshot_unchanged },
+    { "TextSnapshot: Gap is merged", test_snapshot_merges_gap },
+    { "TextSnapshot: Copy on write", test_snapshot_copy_on_write },
+    { "BackgroundSave: Save while editing", test_background_save },
+    { NULL, NULL }
+};
@@ -0,0 +1,177 @@
+#define _DEFAULT_SOURCE  // usleep()
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "acutest.h"
+#include "common/threadpool.h"
+
+static atomic_int sum;
+static int done_count;
+static int cancelled_count;
+
+static void add(void *data, const CancelToken *token) {
+    (void)token;
+    atomic_fetch_add(&sum, *(int*)data);
+}
+
+static void count_done(void *data, bool cancelled) {
+    (void)data;
+    done_count++;
+    cancelled_count += cancelled;
+}
+
+static void reset(void) {
+    atomic_store(&sum, 0);
+    done_count = 0;
+    cancelled_count = 0;
+}
+
+void test_run_tasks(void) {
+    reset();
+    ThreadPool *pool = ThreadPool_Create(4);
+    TEST_ASSERT(pool != NULL);
+    static int values[1000];
+    for (int i = 0; i < 1000; i++) {
+        values[i] = i;
+        ThreadPool_Submit(pool, i % 2 ? THREADPOOL_PRIORITY_HIGH : THREADPOOL_PRIORITY_LOW, add, count_done, &values[i], NULL);
+    }
+    ThreadPool_WaitIdle(pool);
+    TEST_CHECK(atomic_load(&sum) == 999 * 1000 / 2);
+    // the done callbacks run on this thread only
+    TEST_CHECK(done_count == 0);
+    TEST_CHECK(ThreadPool_Poll(pool) == 1000);
+    TEST_CHECK(done_count == 1000 && cancelled_count == 0);
+    TEST_CHECK(atomic_load(&pool->stats.completed) == 1000);
+    ThreadPool_Destroy(pool);
+}
+
+// blocks the only worker until it's opened
+static atomic_bool gate_open;
+static atomic_bool gate_entered;
+static char order[64];
+static atomic_int order_length;
+
+static void wait_for_gate(void *data, const CancelToken *token) {
+    (void)data;
+    (void)token;
+    atomic_store(&gate_entered, true);
+    while (!atomic_load(&gate_open)) {
+        usleep(100);
+    }
+}
+
+// occupy the only worker, so the next tasks are all queued when it continues
+static void close_gate(ThreadPool *pool) {
+    atomic_store(&gate_open, false);
+    atomic_store(&gate_entered, false);
+    ThreadPool_Submit(pool, THREADPOOL_PRIORITY_HIGH, wait_for_gate, NULL, NULL, NULL);
+    while (!atomic_load(&gate_entered)) {
+        usleep(100);
+    }
+}
+
+static void record(void *data, const CancelToken *token) {
+    (void)token;
+    order[atomic_fetch_add(&order_length, 1)] = *(char*)data;
+}
+
+void test_priorities(void) {
+    reset();
+    atomic_store(&order_length, 0);
+    ThreadPool *pool = ThreadPool_Create(1);
+    close_gate(pool);
+    static char low = 'l', high = 'h';
+    for (int i = 0; i < 4; i++) {
+        ThreadPool_Submit(pool, THREADPOOL_PRIORITY_LOW, record, NULL, &low, NULL);
+    }
+    for (int i = 0; i < 4; i++) {
+        ThreadPool_Submit(pool, THREADPOOL_PRIORITY_HIGH, record, NULL, &high, NULL);
+    }
+    atomic_store(&gate_open, true);
+    ThreadPool_WaitIdle(pool);
+    order[atomic_load(&order_length)] = '\0';
+    TEST_CHECK(strcmp(order, "hhhhllll") == 0);
+    TEST_MSG("order: %s", order);
+    ThreadPool_Destroy(pool);
+}
+
+static atomic_bool saw_cancel;
+
+static void run_until_cancelled(void *data, const CancelToken *token) {
+    (void)data;
+    while (!CancelToken_IsCancelled(token)) {
+        usleep(100);
+    }
+    atomic_store(&saw_cancel, true);
+}
+
+void test_cancel(void) {
+    reset();
+    atomic_store(&saw_cancel, false);
+    ThreadPool *pool = ThreadPool_Create(1);
+    CancelToken *token = CancelToken_Create();
+    close_gate(pool);
+    static int one = 1;
+    // cancelled before they are started
+    for (int i = 0; i < 10; i++) {
+        ThreadPool_Submit(pool, THREADPOOL_PRIORITY_LOW, add, count_done, &one, token);
+    }
+    CancelToken_Cancel(token);
+    CancelToken_Release(token);
+    atomic_store(&gate_open, true);
+    ThreadPool_WaitIdle(pool);
+    ThreadPool_Poll(pool);
+    TEST_CHECK(atomic_load(&sum) == 0);
+    TEST_CHECK(done_count == 10 && cancelled_count == 10);
+
+    // a running task returns early
+    token = CancelToken_Create();
+    ThreadPool_Submit(pool, THREADPOOL_PRIORITY_LOW, run_until_cancelled, NULL, NULL, token);
+    usleep(1000);
+    CancelToken_Cancel(token);
+    CancelToken_Release(token);
+    ThreadPool_WaitIdle(pool);
+    TEST_CHECK(atomic_load(&saw_cancel));
+    ThreadPool_Destroy(pool);
+}
+
+static ThreadPool *spawning_pool;
+
+static void slow_add(void *data, const CancelToken *token) {
+    (void)token;
+    usleep(200);
+    atomic_fetch_add(&sum, *(int*)data);
+}
+
+static void spawn(void *data, const CancelToken *token) {
+    (void)token;
+    // subtasks go to the deque of this worker, the others steal them
+    for (int i = 0; i < 200; i++) {
+        ThreadPool_Submit(spawning_pool, THREADPOOL_PRIORITY_LOW, slow_add, count_done, data, NULL);
+    }
+}
+
+void test_work_stealing(void) {
+    reset();
+    spawning_pool = ThreadPool_Create(4);
+    static int one = 1;
+    ThreadPool_Submit(spawning_pool, THREADPOOL_PRIORITY_LOW, spawn, NULL, &one, NULL);
+    ThreadPool_WaitIdle(spawning_pool);
+    TEST_CHECK(atomic_load(&sum) == 200);
+    TEST_CHECK(atomic_load(&spawning_pool->stats.stolen) > 0);
+    TEST_MSG("stolen: %zu", atomic_load(&spawning_pool->stats.stolen));
+    // destroying calls the remaining done callbacks
+    ThreadPool_Destroy(spawning_pool);
+    TEST_CHECK(done_count == 200);
+}
+
+TEST_LIST = {
+    { "ThreadPool: Run tasks", test_run_tasks },
+    { "ThreadPool: Priorities", test_priorities },
+    { "ThreadPool: Cancel", test_cancel },
+    { "ThreadPool: Work stealing", test_work_stealing },
+    { NULL, NULL }
+};
@@ -0,0 +1,119 @@
+// Time per frame of drawing a full screen of densely highlighted, wrapped lines.
+// Build with CMAKE_BUILD_TYPE=Release.
+//
+// usage: bench_draw [frames]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include "widgets/components/editor.h"
+#include "syntax/highlighting.h"
+#include "common/iniparser.h"
+
+#define WIDTH 200
+#define HEIGHT 60
+
+static const char *ini =
+    "[meta]\n"
+    "name = bench\n"
+    "[block:root]\n"
+    "child_blocks = string, number, keyword, comment\n"
+    "color = 15\n"
+    "[block:string]\n"
+    "start = \"\\\"\"\n"
+    "end = \"\\\"\"\n"
+    "color = 64\n"
+    "[block:number]\n"
+    "start = [0-9]+\n"
+    "color = 33\n"
+    "[block:keyword]\n"
+    "start = (if|else|return|while)\n"
+    "color = 45\n"
+    "[block:comment]\n"
+    "start = //\n"
+    "end = $\n"
+    "color = 92\n";
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static SyntaxHighlighting *create_highlighting(void) {
+    IniParser parser;
+    IniParser_Init(&parser);
+    IniParser_SetText(&parser, ini);
+    Table *table = IniParser_Parse(&parser);
+    IniParser_Deinit(&parser);
+    SyntaxDefinitionError error;
+    SyntaxDefinition *def = table ? SyntaxDefinition_FromTable(table, &error) : NULL;
+    if (table) {
+        Table_Destroy(table);
+    }
+    if (!def) {
+        fprintf(stderr, "Invalid syntax definition\n");
+        exit(1);
+    }
+    return SyntaxHighlighting_Create(def);
+}
+
+int main(int argc, char **argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 2000;
+
+    // long lines (wrapped three times) with a tag every few characters
+    TextBuffer tb;
+    TextBuffer_Init(&tb);
+    for (int i = 0; i < HEIGHT; i++) {
+        String text = String_Format("%d", i);
+        while (String_Length(&text) < WIDTH * 3) {
+            String part = String_Format(" if x%d == \"s%d\" return %d; else while 1\t", i, i, i * 7);
+            String_Append(&text, &part);
+            String_Deinit(&part);
+        }
+        Line *line = i == 0 ? tb.current_line : Line_Create();
+        String_Set(&line->text, text);
+        if (i > 0) {
+            TextBuffer_InsertLineAtBottom(&tb, line);
+        }
+    }
+    tb.current_line = TextBuffer_GetFirstLine(&tb);
+
+    Editor editor;
+    Editor_Init(&editor, NULL, &tb);
+    Editor_Resize(&editor, WIDTH, HEIGHT);
+    editor.sh_binding.sh = create_highlighting();
+    Widget_Update(AS_WIDGET(&editor));  // highlights everything
+    // a selection over a few lines
+    Line *second = TextBuffer_GetFirstLine(&tb)->next;
+    TextSelection_Begin(&editor.ts, second, 10);
+    TextSelection_End(&editor.ts, second->next->next, 50);
+
+    Canvas canvas;
+    Canvas_Init(&canvas, WIDTH, HEIGHT);
+    AS_WIDGET(&editor)->ops->draw(AS_WIDGET(&editor), &canvas);  // lay out
+
+    double started = now_seconds();
+    for (int i = 0; i < frames; i++) {
+        editor.cursor_visible = i % 2;  // something changes every frame
+        AS_WIDGET(&editor)->ops->draw(AS_WIDGET(&editor), &canvas);
+    }
+    double seconds = now_seconds() - started;
+    // the same checksum means the same picture
+    uint64_t checksum = 1469598103934665603ULL;
+    for (size_t i = 0; i < canvas.size; i++) {
+        const Cell *cell = &canvas.buffer[i];
+        uint64_t value = (uint64_t)cell->cp << 32 | (uint64_t)cell->style.fg << 24 | (uint64_t)cell->style.bg << 16 | cell->style.attributes;
+        checksum = (checksum ^ value) * 1099511628211ULL;
+    }
+    printf("%d frames of %dx%d cells: %.1f us per frame (checksum %016llx)\n", frames, WIDTH, HEIGHT,
+           seconds / frames * 1e6, (unsigned long long)checksum);
+
+    Canvas_Deinit(&canvas);
+    SyntaxHighlighting_Destroy(editor.sh_binding.sh);
+    editor.sh_binding.sh = NULL;
+    AS_WIDGET(&editor)->ops->destroy(AS_WIDGET(&editor));
+    TextBuffer_Deinit(&tb);
+    return 0;
+}
@@ -0,0 +1,232 @@
+// Highlighting throughput over a generated corpus of markdown and config lines.
+// Build with CMAKE_BUILD_TYPE=Release and run it from the build or the source
+// directory (it loads data/syntax/<syntax>.ini). If syntax is a number, a
+// definition with that many keyword blocks in root is generated instead (the
+// cost per line should not depend on it).
+//
+// With "single" all lines are joined to one long line (the time per byte
+// should not grow with the length of the line). With "parallel" the lines are
+// highlighted by a thread pool with the given number of workers (0 for one per
+// CPU), see SyntaxHighlighting_HighlightStrings().
+//
+// usage: bench_highlight [syntax|blocks] [lines] [rounds] [single|parallel [workers]]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include "syntax/highlighting.h"
+#include "common/iniparser.h"
+
+static const char *words[] = {
+    "the", "editor", "loads", "a", "file", "and", "highlights", "every", "line", "with",
+    "blocks", "from", "its", "syntax", "definition", "while", "scrolling", "through", "text", "fast"
+};
+
+static uint32_t seed = 12345;
+
+static uint32_t next_random(void) {
+    seed = seed * 1103515245u + 12345u;
+    return seed >> 16;
+}
+
+static void append_words(String *line, int count) {
+    for (int i = 0; i < count; i++) {
+        String_AddChar(line, " ");
+        const char *word = words[next_random() % (sizeof(words) / sizeof(words[0]))];
+        String part = String_FromCStr(word, strlen(word));
+        String_Append(line, &part);
+        String_Deinit(&part);
+    }
+}
+
+static String create_line(int i) {
+    String line = String_Empty();
+    String part;
+    switch (next_random() % 10) {
+        case 0:
+            part = String_Format("## Section %d", i);
+            break;
+        case 1:
+            part = String_Format("[section_%d]", i);
+            break;
+        case 2:
+            part = String_Format("key_%d = \"value %d with \\\"quotes\\\"\" ; comment", i, i);
+            break;
+        case 3:
+            part = String_Format("number.%d = %d", i, i * 31);
+            break;
+        case 4:
+            part = String_Format("Some **bold %d** and `code %d` in", i, i);
+            break;
+        case 5:
+            part = String_Format("![image %d](img/%d.png) caption", i, i);
+            break;
+        case 6:
+            part = String_Format("```");
+            break;
+        default:
+            part = String_Format("%d.", i);
+            break;
+    }
+    String_Append(&line, &part);
+    String_Deinit(&part);
+    append_words(&line, 4 + next_random() % 16);
+    return line;
+}
+
+// root with a string block and count keyword blocks (the first ones are words of the corpus)
+static void generate_ini(char *ini, size_t size, int count) {
+    size_t used = (size_t)snprintf(ini, size, "[meta]\nname = GENERATED\n[block:string]\nstart = \"\\\"\"\nend = \"\\\"\"\n");
+    String children = String_FromCStr("string", 6);
+    for (int i = 0; i < count && used < size; i++) {
+        const char *word = words[i % (sizeof(words) / sizeof(words[0]))];
+        int suffix = i / (int)(sizeof(words) / sizeof(words[0]));
+        used += (size_t)snprintf(ini + used, size - used, "[block:kw%d]\nstart = \"\\\\<%s%.0d\\\\>\"\n", i, word, suffix);
+        String name = String_Format(", kw%d", i);
+        String_Append(&children, &name);
+        String_Deinit(&name);
+    }
+    if (used < size) {
+        snprintf(ini + used, size - used, "[block:root]\nchild_blocks = %s\n", children.bytes);
+    }
+    String_Deinit(&children);
+}
+
+static SyntaxHighlighting *load_highlighting(const char *syntax) {
+    static char ini[65536];
+    int blocks = atoi(syntax);
+    if (blocks > 0) {
+        generate_ini(ini, sizeof(ini), blocks);
+    }
+    else {
+        char path[256];
+        snprintf(path, sizeof(path), "data/syntax/%s.ini", syntax);
+        FILE *fp = fopen(path, "rb");
+        if (!fp) {
+            return NULL;
+        }
+        size_t size = fread(ini, 1, sizeof(ini) - 1, fp);
+        ini[size] = '\0';
+        fclose(fp);
+    }
+
+    IniParser parser;
+    IniParser_Init(&parser);
+    IniParser_SetText(&parser, ini);
+    Table *table = IniParser_Parse(&parser);
+    IniParser_Deinit(&parser);
+    SyntaxDefinitionError error;
+    SyntaxDefinition *def = table ? SyntaxDefinition_FromTable(table, &error) : NULL;
+    if (table) {
+        Table_Destroy(table);
+    }
+    return def ? SyntaxHighlighting_Create(def) : NULL;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    const char *syntax = argc > 1 ? argv[1] : "md";
+    int line_count = argc > 2 ? atoi(argv[2]) : 20000;
+    int rounds = argc > 3 ? atoi(argv[3]) : 5;
+
+    SyntaxHighlighting *sh = load_highlighting(syntax);
+    if (!sh) {
+        fprintf(stderr, "Cannot load data/syntax/%s.ini\n", syntax);
+        return 1;
+    }
+
+    String *lines = malloc(sizeof(String) * line_count);
+    SyntaxHighlightingString **highlights = calloc(line_count, sizeof(SyntaxHighlightingString*));
+    const String **texts = malloc(sizeof(String*) * line_count);
+    SyntaxHighlightingString ***targets = malloc(sizeof(SyntaxHighlightingString**) * line_count);
+    size_t bytes = 0;
+    for (int i = 0; i < line_count; i++) {
+        lines[i] = create_line(i);
+        bytes += lines[i].bytes_size;
+    }
+    if (argc > 4 && strcmp(argv[4], "single") == 0) {
+        // no ^ pattern matches the whole line
+        String single = String_FromCStr("text", 4);
+        for (int i = 0; i < line_count; i++) {
+            String_AddChar(&single, " ");
+            String_Append(&single, &lines[i]);
+            String_Deinit(&lines[i]);
+        }
+        lines[0] = single;
+        bytes = single.bytes_size;
+        line_count = 1;
+    }
+    ThreadPool *pool = NULL;
+    if (argc > 4 && strcmp(argv[4], "parallel") == 0) {
+        pool = ThreadPool_Create(argc > 5 ? (size_t)atoi(argv[5]) : 0);
+    }
+    for (int i = 0; i < line_count; i++) {
+        texts[i] = &lines[i];
+        targets[i] = &highlights[i];
+    }
+
+    double started = now_seconds();
+    for (int round = 0; round < rounds; round++) {
+        if (pool) {
+            SyntaxHighlighting_HighlightStrings(sh, pool, texts, (SyntaxHighlightingString **const *)targets,
+                                                (size_t)line_count, NULL);
+            continue;
+        }
+        const SyntaxStack *open_blocks = NULL;
+        for (int i = 0; i < line_count; i++) {
+            open_blocks = SyntaxHighlighting_HighlightString(sh, &lines[i], open_blocks, &highlights[i]);
+        }
+    }
+    double seconds = now_seconds() - started;
+
+    // the same checksum means the same tags
+    uint64_t checksum = 1469598103934665603ULL;
+    size_t tags = 0;
+    for (int i = 0; i < line_count; i++) {
+        const SyntaxHighlightingString *shs = highlights[i];
+        for (size_t j = 0; j < shs->tags_count; j++) {
+            checksum = (checksum ^ ((uint64_t)shs->tags[j].byte_offset << 32 | (uint64_t)i)) * 1099511628211ULL;
+            for (const char *c = shs->tags[j].block->name; *c; c++) {
+                checksum = (checksum ^ (uint8_t)*c) * 1099511628211ULL;
+            }
+        }
+        tags += shs->tags_count;
+    }
+    printf("%s: %d lines (%.1f MB), %zu tags: %.1f MB/s (checksum %016llx)\n", syntax, line_count,
+           bytes / 1e6, tags, bytes * (double)rounds / 1e6 / seconds, (unsigned long long)checksum);
+    if (pool) {
+        // the searches below are those of the calling thread only
+        printf("%zu workers\n", pool->worker_count);
+        ThreadPool_Poll(pool);
+        ThreadPool_Destroy(pool);
+    }
+
+    size_t searches = 0;
+    size_t skipped = 0;
+    for (size_t i = 0; i < sh->def->blocks_count; i++) {
+        const Regexp *matcher = sh->def->blocks[i]->matcher;
+        if (matcher) {
+            searches += matcher->stats.searches;
+            skipped += matcher->stats.skipped;
+        }
+    }
+    printf("%zu searches, %.1f%% of the bytes skipped by prefilters\n", searches / rounds,
+           100.0 * skipped / ((double)bytes * rounds));
+
+    for (int i = 0; i < line_count; i++) {
+        SyntaxHighlightingString_Destroy(highlights[i]);
+        String_Deinit(&lines[i]);
+    }
+    free(targets);
+    free(texts);
+    free(highlights);
+    free(lines);
+    SyntaxHighlighting_Destroy(sh);
+    return 0;
+}
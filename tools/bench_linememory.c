@@ -0,0 +1,103 @@
+// Heap bytes per line after loading a file and after compacting the lines.
+// Build with CMAKE_BUILD_TYPE=Release, the sanitizers hide the heap usage.
+//
+// usage: bench_linememory [file]   (without a file a log with 1M lines is generated)
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <malloc.h>
+#include "document/textbuffer.h"
+#include "document/textio.h"
+#include "document/linepager.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static size_t heap_bytes(void) {
+    return mallinfo2().uordblks;
+}
+
+static void generate_log(const char *path, size_t line_count) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        perror(path);
+        exit(1);
+    }
+    srand(1);
+    for (size_t i = 0; i < line_count; i++) {
+        fprintf(fp, "2025-03-%02zu 12:%02zu:%02zu [worker-%d] request %zu took %d ms\n",
+                i % 28 + 1, i / 60 % 60, i % 60, rand() % 16, i, rand() % 5000);
+    }
+    fclose(fp);
+}
+
+int main(int argc, char **argv) {
+    char tmp_path[] = "/tmp/bench_linememory_XXXXXX";
+    const char *path = argc > 1 ? argv[1] : NULL;
+    if (!path) {
+        int fd = mkstemp(tmp_path);
+        if (fd < 0) {
+            perror("mkstemp");
+            return 1;
+        }
+        close(fd);
+        generate_log(tmp_path, 1000000);
+        path = tmp_path;
+    }
+
+    size_t heap_before = heap_bytes();
+    TextBuffer tb;
+    TextBuffer_Init(&tb);
+    File *file = File_Open(path, FILE_ACCESS_READ);
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    double started = now_seconds();
+    TextBuffer_LoadFromFile(&tb, file);
+    double load_seconds = now_seconds() - started;
+    File_Close(file);
+
+    size_t lines = 0, text_bytes = 0;
+    for (const Line *line = TextBuffer_GetFirstLine(&tb); line; line = line->next) {
+        lines++;
+        text_bytes += line->text.bytes_size;
+    }
+    size_t heap_loaded = heap_bytes() - heap_before;
+
+    // compact as the idle editor would, one step at a time
+    LinePager *pager = TextBuffer_EnablePaging(&tb, path, SIZE_MAX);
+    double slowest_step = 0.0;
+    started = now_seconds();
+    for (size_t visited = 0; visited < lines; visited += LINEPAGER_COMPACT_STEPS) {
+        double step_started = now_seconds();
+        LinePager_Compact(pager);
+        double step = now_seconds() - step_started;
+        slowest_step = step > slowest_step ? step : slowest_step;
+    }
+    double compact_seconds = now_seconds() - started;
+    malloc_trim(0);
+    size_t heap_compacted = heap_bytes() - heap_before;
+
+    printf("%zu lines, %.1f text bytes per line, loaded in %.3f s\n",
+           lines, (double)text_bytes / (double)lines, load_seconds);
+    printf("after load:       %.1f MB, %.1f heap bytes per line (%.1f overhead)\n",
+           (double)heap_loaded / (1024.0 * 1024.0), (double)heap_loaded / (double)lines,
+           (double)(heap_loaded - text_bytes) / (double)lines);
+    printf("after compaction: %.1f MB, %.1f heap bytes per line (%.1f overhead)\n",
+           (double)heap_compacted / (1024.0 * 1024.0), (double)heap_compacted / (double)lines,
+           (double)(heap_compacted - text_bytes) / (double)lines);
+    printf("compaction: %.3f s, %zu lines packed, slowest step %.2f ms\n",
+           compact_seconds, pager->stats.packed_lines, slowest_step * 1e3);
+
+    TextBuffer_Deinit(&tb);
+    if (path == tmp_path) {
+        unlink(tmp_path);
+    }
+    return 0;
+}